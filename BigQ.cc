@@ -36,15 +36,59 @@ void gen_random_string(char *s, const int len) {
   s[len] = 0;
 }
 
+/*------------------------------------------------------------------------------
+ * Sort the records of a run (given by their bits) with the sort instantiated for
+ * the shape of the comparator's key. A descending run is sorted and then reversed
+ *----------------------------------------------------------------------------*/
+void sortRun(vector<char*>& runRecs, KeyComparator& comparator, bool descending){
+  switch(comparator.GetShape()){
+    case KEY_INT: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_INT>(&comparator)); break;
+    case KEY_INT_INT: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_INT_INT>(&comparator)); break;
+    case KEY_DOUBLE: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_DOUBLE>(&comparator)); break;
+    case KEY_STRING: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_STRING>(&comparator)); break;
+    case KEY_INT_STRING: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_INT_STRING>(&comparator)); break;
+    default: std::sort(runRecs.begin(),runRecs.end(),QSortCompare<KEY_GENERIC>(&comparator));
+  }
+  if(descending) std::reverse(runRecs.begin(),runRecs.end());
+}
+
+/*------------------------------------------------------------------------------
+ * Sort the records of a run (given by where they start in the run buffer) and
+ * write them to runFile, packing them into pages the way Page.ToBinary does,
+ * starting at page firstPage. Returns the page after the last one written
+ *----------------------------------------------------------------------------*/
+int writeRun(File& runFile, int firstPage, vector<char*>& runRecs, KeyComparator& comparator, bool descending, char* pageBits){
+  sortRun(runRecs,comparator,descending);
+  int page = firstPage;
+  int numOnPage = 0;
+  int pageBytes = sizeof(int); // the page starts with the number of records on it
+  for(int i=0;i<runRecs.size();i++){
+    int len = ((int *) runRecs[i])[0];
+    if(pageBytes + len > PAGE_SIZE){ // page full. Write it out
+      ((int *) pageBits)[0] = numOnPage;
+      runFile.AddPageBits(pageBits,page++);
+      numOnPage = 0;
+      pageBytes = sizeof(int);
+    }
+    memcpy(pageBits+pageBytes,runRecs[i],len);
+    pageBytes += len;
+    numOnPage++;
+  }
+  if(numOnPage > 0){
+    ((int *) pageBits)[0] = numOnPage;
+    runFile.AddPageBits(pageBits,page++);
+  }
+  return page;
+}
+
 void* workerRoutine(void* ptr){
   workerThreadUtil* myT = (workerThreadUtil*) ptr;
+  threadCounters = myT->counters; // our pages and memory count towards the operation that created us
+  long startCPU = ThreadCPUNanos ();
 
-  Record* currentRun; // array to store current run of records
   Record currentRec;
   Record* headOfRuns; // array of heads of all runs
   Page* mergePages; // array of 1 page each of all runs
-  Record* currRec; // last record read
-  currRec = new Record;
 
   /*
   // Basic sanity check to see that threads are not screwy
@@ -72,120 +116,99 @@ void* workerRoutine(void* ptr){
   exit(0);
   */
 
-  DBFile* dbfile1;
-  char* phase1OutputFile = new char[11]; // make sure this length is 1 more than the second argument of gen_random_string
-  char* phase1OutputMetaFile = new char[16];
+  char phase1OutputFile[11]; // make sure this length is 1 more than the second argument of gen_random_string
   gen_random_string(phase1OutputFile,6); // name of temp file to store results of phase 1
   strcat(phase1OutputFile,".bin");
-  strcpy(phase1OutputMetaFile,phase1OutputFile);
-  strcat(phase1OutputMetaFile,".meta"); // this is created by DBFile.cc but we don't need it.
-                                        // delete it when we delete phase1OutputFile
-  dbfile1 = new DBFile();
-  dbfile1->Create (phase1OutputFile, heap, NULL);
-  dbfile1->Close();
-
-  int runlen = myT->runlen;
-  int numRecs = 0; // count number of records read
+  File runFile; // created when the first run is written out
+  KeyComparator comparator = myT->sortOrder->GetComparator(); // the sort order is complete by now
 
   /*******************************************************************************
    * Phase 1 of TPMMS starts
    ******************************************************************************/
-  Page tempPage; // this page is used to track a page worth of data
-  int numRuns = 0; // count number of runs
-  int numPages = 0; // track how many pages read. used to keep track of a run worth of data
-  int totalRecs = 0; // track total records read
-  int pagesInLastRun = 0;
-  vector<Record*>* qSortVec = new vector<Record*>(); // vector used for QuickSort
-  Record* newRec;
-  Record* tempRec; // tempRec is pushed onto qSortVec
+  // The records of a run are copied once, one after another, into runBuf, and
+  // runRecs notes where each one starts. A run ends when the next record would take
+  // it past runlen pages worth of bytes. Only the pointers are sorted; the records
+  // are then packed straight into pages. runBuf grows as needed, so small inputs
+  // don't get runlen pages
+  long runCapacity = (long) (myT->runlen > 0 ? myT->runlen : 1) * PAGE_SIZE; // most bytes in a run
+  long bufSize = PAGE_SIZE < runCapacity ? PAGE_SIZE : runCapacity;
+  char* runBuf = new (std::nothrow) char[bufSize];
+  char* pageBits = new (std::nothrow) char[PAGE_SIZE]; // the page being packed by writeRun
+  if (runBuf == NULL || pageBits == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  CountMemory(bufSize + PAGE_SIZE);
+  long runBytes = 0; // bytes of the records in runBuf
+  vector<char*> runRecs; // where each record of the run starts in runBuf
+  int numRuns = 0; // count number of runs written to runFile
+  vector<int> runStart; // first page of every run in the file, plus one past the last run. Runs
+                        // usually take runlen+1 pages, but records of varied sizes may be packed
+                        // into more pages in sorted order than they took on the way in
+  runStart.push_back(0);
 
   // 1. Read runlen pages worth of data from in pipe using inpipe.Remove
   while(myT->inputPipe->Remove(&currentRec)){ // keep reading from the input pipe as long it has elements in it
-    newRec = new Record();
-    tempRec = new Record();
-    newRec->Copy(&currentRec);
-    tempRec->Copy(&currentRec); // tempRec is pushed onto the vector used for qSort (qSortVec). we don't push newRec because
-                                // newRec will be consumed below in tempPage.Append. Hence, the pointer in qSortVec
-                                // will now point to emptied bits.
-    qSortVec->push_back(tempRec);
-    numRecs++;
-    totalRecs++;
-    if(tempPage.Append(newRec)==0){
-      tempPage.EmptyItOut(); // reset for next page
-      numPages++;
-    }
-    if(numPages == runlen){ // we have one run worth of records. Sort them!
-      // 2. Sort the runlen pages of data we have so far
-      numRecs--; // the last write filled up tempPage and hence numRecs that we incremented BEFORE it doesn't really count
-      std::sort(qSortVec->begin(),qSortVec->end(),QSortCompare(myT->sortOrder));
-      // 3. Write sorted run to file using single DBFile instance
-      dbfile1->Open(phase1OutputFile);
-      while(!qSortVec->empty()){
-        dbfile1->Add(*(qSortVec->front()));
-        qSortVec->erase(qSortVec->begin());
-      }
-      dbfile1->Close();
+    int len = ((int *) currentRec.bits)[0];
+    if(runBytes + len > runCapacity){ // we have one run worth of records
+      // 2. Sort the run and 3. write it to the file
+      if(numRuns == 0) runFile.Open(0,phase1OutputFile);
+      runStart.push_back(writeRun(runFile,runStart.back(),runRecs,comparator,myT->descending,pageBits));
       numRuns++;
-      numPages = 0; // reset count
-      currentRec.Copy(newRec); // since tempPage was full, this last record would
-                               // not fit in the page. It was in newRec
-                               // but we now copy it to currentRec so the new
-                               // page of the next run can start with it
-      numRecs = 1; // reset count to 1 instead of 0 so that going into the while loop the next time
-                   // doesn't overwrite currentRec that we just wrote above
+      runRecs.clear();
+      runBytes = 0;
     }
-  }
-  if(numRecs>0){ // we still have elements in currRun to empty (these elements
-                  // didn't add up to one run worth of records, however, which
-                  // is why we never went into the if condition above)
-    numRuns++;
-    pagesInLastRun = numPages+1;
-    /* Sort and write the remaining records as well */
-    // 2. Sort the remaining pages of data
-    std::sort(qSortVec->begin(),qSortVec->end(),QSortCompare(myT->sortOrder));
-    // 3. Write sorted run to file using single DBFile instance
-    dbfile1->Open(phase1OutputFile);
-    while(!qSortVec->empty()){
-      dbfile1->Add(*(qSortVec->front()));
-      qSortVec->erase(qSortVec->begin());
+    if(runBytes + len > bufSize){ // make room for the record
+      long newSize = bufSize;
+      while(runBytes + len > newSize) newSize *= 2;
+      if(newSize > runCapacity) newSize = runCapacity;
+      char* newBuf = new (std::nothrow) char[newSize];
+      if (newBuf == NULL)
+      {
+        cout << "ERROR : Not enough memory. EXIT !!!\n";
+        exit(1);
+      }
+      memcpy(newBuf,runBuf,runBytes);
+      for(int i=0;i<runRecs.size();i++) runRecs[i] = newBuf + (runRecs[i] - runBuf);
+      delete [] runBuf;
+      runBuf = newBuf;
+      CountMemory(newSize - bufSize);
+      bufSize = newSize;
     }
-    dbfile1->Close();
-  }
-  // cout << "bigq.workerroutine total records " << totalRecs << endl;
-  // cout << "file has pages " << (numRuns-1)*(runlen+1) + pagesInLastRun << endl;
-
-  // Sanity check to make sure that we wrote as many lines to the file as there were in
-  // the input (the latter value is reported by the producer in std out).
-  /*
-  if(dbfile1!=NULL) delete dbfile1;
-  dbfile1 = new DBFile();
-  dbfile1->Open(phase1OutputFile);
-  dbfile1->MoveFirst ();
-  int a2 = 0;
-  while(dbfile1->GetNext(*currRec)==1){
-    a2++;
-    // currRec->Print(new Schema("catalog","lineitem"));
+    memcpy(runBuf+runBytes,currentRec.bits,len);
+    runRecs.push_back(runBuf+runBytes);
+    runBytes += len;
   }
-  cout << " number of records in " << phase1OutputFile << ": " << a2 << endl;
-  dbfile1->Close();
-  */
 
   /*******************************************************************************
    * Phase 1 of TPMMS complete
    * Phase 2 of TPMMS starts
    ******************************************************************************/
 
-  if(numRuns==1){ // only one run - simply copy results of phase 1 to output
-    if(dbfile1!=NULL) delete dbfile1;
-    dbfile1 = new DBFile();
-    dbfile1->Open(phase1OutputFile);
-    dbfile1->MoveFirst ();
-    while(dbfile1->GetNext(*currRec)==1){
-      myT->outputPipe->Insert(currRec);
+  if(numRuns==0){ // only one run and it is still in memory - sort it and send it straight to the output
+    sortRun(runRecs,comparator,myT->descending);
+    RecordPool::Free(currentRec.bits); // the last input record, copied into runBuf already
+    for(int i=0;i<runRecs.size();i++){
+      int len = ((int *) runRecs[i])[0];
+      currentRec.bits = RecordPool::Alloc(len);
+      memcpy(currentRec.bits,runRecs[i],len);
+      if(!myT->outputPipe->Insert(&currentRec)) break; // the consumer has all it wants
     }
-    dbfile1->Close();
+    delete [] runBuf;
+    delete [] pageBits;
+    CountMemory(-(bufSize + PAGE_SIZE));
   }
   else{ // more than one run
+    if(!runRecs.empty()){ // the last, partial run
+      runStart.push_back(writeRun(runFile,runStart.back(),runRecs,comparator,myT->descending,pageBits));
+      numRuns++;
+    }
+    runFile.Close();
+    delete [] runBuf;
+    delete [] pageBits;
+    CountMemory(-(bufSize + PAGE_SIZE));
+
     // 4. Construct priority queue over sorted runs and dump sorted data into the
     //    out pipe (use STL lib for priority queue)
     mergePages = new (std::nothrow) Page[numRuns]; // hold 1 page worth of Records from EVERY run.
@@ -204,11 +227,12 @@ void* workerRoutine(void* ptr){
 
     File* currFile = new File();
     currFile->Open(1,phase1OutputFile);
+    CountMemory((long) numRuns*PAGE_SIZE); // one page of every run
 
     // cout << "file has pages " << currFile->GetLength()-1 << endl; // - 1 coz GetLength() adds 1 for metadata
 
     // priority_queue <MergeStruct, vector<MergeStruct>, PQCompare(orderMaker)>  pq; // priority queue for phase 2
-    myPQ pq(PQCompare(myT->sortOrder)); // priority queue for phase 2
+    myPQ pq((PQCompare(&comparator,myT->descending))); // priority queue for phase 2
 
     /*
     // Sanity check that the priority queue works as desired
@@ -231,7 +255,7 @@ void* workerRoutine(void* ptr){
         // 4a. read out first page each of every run using File.GetPage and correct offset
         pOffset[i] = 0;
         temp[i] = 1;
-        currFile->GetPage(&mergePages[i],((i*(runlen+1))+pOffset[i])); // pOffset[i] is 0 here
+        currFile->GetPage(&mergePages[i],runStart[i]+pOffset[i]); // pOffset[i] is 0 here
 
         // 4b. get the first record from each page using page.getfirst and put it in a min
         //    priority queue
@@ -242,7 +266,7 @@ void* workerRoutine(void* ptr){
     // Process till no more elements left
     while(!pq.empty()){
       // 4c. pop the first element of pq and write to output pipe, which, in turn, writes to disk using DBFile
-      myT->outputPipe->Insert(pq.top().currentRec);
+      if(!myT->outputPipe->Insert(pq.top().currentRec)) break; // the consumer has all it wants
       lastRun = pq.top().runNo;
       pq.pop();
       // 4d. read in the next record from the run that we just popped an element from
@@ -252,9 +276,8 @@ void* workerRoutine(void* ptr){
       }
       else{ // this page of this run ended. is there another page?
         pOffset[lastRun]++;
-        if((lastRun< numRuns-1 && pOffset[lastRun] < runlen+1) ||
-           (lastRun==numRuns-1 && pOffset[lastRun] < pagesInLastRun)){ // there are more pages
-          currFile->GetPage(&mergePages[lastRun],((lastRun*(runlen+1))+pOffset[lastRun]));
+        if(runStart[lastRun]+pOffset[lastRun] < runStart[lastRun+1]){ // there are more pages
+          currFile->GetPage(&mergePages[lastRun],runStart[lastRun]+pOffset[lastRun]);
           if(mergePages[lastRun].GetFirst(&headOfRuns[lastRun])){
             temp[lastRun]++;
             pq.push({lastRun, &headOfRuns[lastRun]});
@@ -262,23 +285,29 @@ void* workerRoutine(void* ptr){
         }
       }
     }
-
+    CountMemory(-(long) numRuns*PAGE_SIZE);
+    currFile->Close();
+    delete currFile;
+    delete [] mergePages;
+    delete [] headOfRuns;
+    delete [] pOffset;
+    delete [] temp;
   }
 
-  remove(phase1OutputFile);
-  remove(phase1OutputMetaFile);
+  if(numRuns>0) remove(phase1OutputFile);
 
   /*******************************************************************************
    * Phase 2 of TPMMS complete
    ******************************************************************************/
 
+  CountCPU(ThreadCPUNanos () - startCPU);
   return 0; // http:// stackoverflow.com/a/5761837: Pthreads departs from the standard unix return code of -1 on error convention. It returns 0 on success and a positive integer code on error.
 }
 
 /*******************************************************************************
  * Constructor
  ******************************************************************************/
-BigQ :: BigQ (Pipe &in, Pipe &out, OrderMaker &sortorder, int runlen) {
+BigQ :: BigQ (Pipe &in, Pipe &out, OrderMaker &sortorder, int runlen, bool descending) {
   // set up internal data structures
   workerThreadUtil* t = new workerThreadUtil();
   pthread_t workerThread;
@@ -286,6 +315,8 @@ BigQ :: BigQ (Pipe &in, Pipe &out, OrderMaker &sortorder, int runlen) {
   t->outputPipe = &out;
   t->sortOrder = &sortorder;
   t->runlen = runlen;
+  t->descending = descending;
+  t->counters = threadCounters; // set by the relational operation calling us, if any
 
   // spawns its only worker thread
   pthread_create(&workerThread, NULL, workerRoutine, (void*)t);
@@ -12,6 +12,8 @@ typedef struct{
   Pipe* outputPipe;
   OrderMaker* sortOrder;
   int runlen;
+  bool descending; // largest first
+  ExecCounters* counters; // counters of the operation that created us (File.h); NULL if none
 } workerThreadUtil; // struct used to store pipes, sortorder and runlen. Used by workerThread
 
 struct MergeStruct{
@@ -21,30 +23,35 @@ struct MergeStruct{
   Record* currentRec;
 };
 
-class QSortCompare{ // used by priority queue for comparison
-  OrderMaker* sortOrder;
+template <int keyShape>
+class QSortCompare{ // used by std::sort to sort the records of a run, given by their bits.
+                    // One class per key shape (see KeyComparator), so the sort inlines
+                    // the comparison for the shape of the sort order
+  KeyComparator* comparator;
   public:
-    QSortCompare(OrderMaker* oMaker) : sortOrder(oMaker) {}
-    bool operator()(Record* left, Record* right){ // used by qsort for sorting
-      ComparisonEngine* myCeng = new ComparisonEngine();
-      return(myCeng->Compare(left,right,sortOrder)<0);
+    QSortCompare(KeyComparator* keyComparator) : comparator(keyComparator) {}
+    bool operator()(char* left, char* right){
+      return(comparator->CompareShape<keyShape>(left,right)<0);
     }
 };
 
 class PQCompare{ // used by priority queue for comparison
-  OrderMaker* sortOrder;
+  KeyComparator* comparator;
+  bool descending;
   public:
-    PQCompare(OrderMaker* oMaker) : sortOrder(oMaker) {}
+    PQCompare(KeyComparator* keyComparator, bool descending) : comparator(keyComparator), descending(descending) {}
     int operator()(MergeStruct& left, MergeStruct& right){ // Returns 1 if t1 is earlier than t2
-      ComparisonEngine* myCeng = new ComparisonEngine();
-      return myCeng->Compare(left.currentRec,right.currentRec,sortOrder)>0;
+      int cmp = comparator->Compare(left.currentRec->bits,right.currentRec->bits);
+      return descending ? cmp<0 : cmp>0;
     }
 };
 
 class BigQ {
   public:
     workerThreadUtil* myT;
-    BigQ (Pipe &in, Pipe &out, OrderMaker &sortorder, int runlen);
+    // sorts in by sortorder into out, smallest first unless descending. Stops early
+    // if the consumer of out cancels it (see Pipe.Cancel)
+    BigQ (Pipe &in, Pipe &out, OrderMaker &sortorder, int runlen, bool descending = false);
     ~BigQ();
 };
 
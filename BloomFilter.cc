@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * File: BloomFilter.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "BloomFilter.h"
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+ * Constructor
+ *----------------------------------------------------------------------------*/
+BloomFilter :: BloomFilter () {
+  bits = NULL;
+  numBits = 0;
+  ready = false;
+  pthread_mutex_init (&readyMutex, NULL);
+  pthread_cond_init (&readyVar, NULL);
+}
+
+/*------------------------------------------------------------------------------
+ * Destructor
+ *----------------------------------------------------------------------------*/
+BloomFilter :: ~BloomFilter () {
+  delete [] bits;
+  pthread_mutex_destroy (&readyMutex);
+  pthread_cond_destroy (&readyVar);
+}
+
+/*------------------------------------------------------------------------------
+ * Hash the attributes of rec listed in order. FNV-1a over the bytes of each
+ * attribute followed by a final mix so that every bit of the result depends on
+ * every input byte (the two halves are used as two independent hashes).
+ *----------------------------------------------------------------------------*/
+unsigned long long BloomFilter :: Hash (Record *rec, OrderMaker *order) {
+  unsigned long long h = 14695981039346656037ULL;
+  int* whichAtts = order->getWhichAtts();
+  Type* whichTypes = order->getWhichTypes();
+  for (int i = 0; i < order->getNumAtts(); i++) {
+    char* val = rec->bits + ((int *) rec->bits)[whichAtts[i] + 1];
+    int len;
+    double zero = 0.0;
+    switch (whichTypes[i]) {
+      case Int:
+        len = sizeof (int);
+        break;
+      case Double:
+        len = sizeof (double);
+        if (*((double *) val) == 0.0) val = (char*) &zero; // -0.0 == 0.0 in ComparisonEngine, so hash them alike
+        break;
+      case String:
+        len = strlen (val);
+        break;
+    }
+    for (int j = 0; j < len; j++) {
+      h ^= (unsigned char) val[j];
+      h *= 1099511628211ULL;
+    }
+    h ^= 0xff; // separate attributes so ("ab","c") and ("a","bc") differ
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/*------------------------------------------------------------------------------
+ * Add the key of a build side record. The bits are only set in Finish, once we
+ * know how many keys there are
+ *----------------------------------------------------------------------------*/
+void BloomFilter :: Add (Record *rec, OrderMaker *order) {
+  keyHashes.push_back (Hash (rec, order));
+}
+
+/*------------------------------------------------------------------------------
+ * Size the filter at BLOOM_BITS_PER_KEY bits per key, set the bits of every key
+ * and wake up anyone waiting to probe. The i-th probe position is h1 + i*h2.
+ *----------------------------------------------------------------------------*/
+void BloomFilter :: Finish () {
+  numBits = keyHashes.size () * BLOOM_BITS_PER_KEY;
+  if (numBits < 64) numBits = 64;
+  bits = new (std::nothrow) unsigned char[numBits/8 + 1];
+  if (bits == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  memset (bits, 0, numBits/8 + 1);
+
+  for (size_t k = 0; k < keyHashes.size (); k++) {
+    unsigned long long h1 = keyHashes[k] & 0xffffffffULL;
+    unsigned long long h2 = (keyHashes[k] >> 32) | 1;
+    for (int i = 0; i < BLOOM_NUM_HASHES; i++) {
+      unsigned long long bit = (h1 + i*h2) % numBits;
+      bits[bit >> 3] |= (1 << (bit & 7));
+    }
+  }
+  vector<unsigned long long> ().swap (keyHashes); // free the memory
+
+  pthread_mutex_lock (&readyMutex);
+  ready = true;
+  pthread_cond_broadcast (&readyVar);
+  pthread_mutex_unlock (&readyMutex);
+}
+
+/*------------------------------------------------------------------------------
+ * Block till Finish has been called
+ *----------------------------------------------------------------------------*/
+void BloomFilter :: WaitUntilReady () {
+  pthread_mutex_lock (&readyMutex);
+  while (!ready) {
+    pthread_cond_wait (&readyVar, &readyMutex);
+  }
+  pthread_mutex_unlock (&readyMutex);
+}
+
+/*------------------------------------------------------------------------------
+ * False if no build side record had this key; true if one might have
+ *----------------------------------------------------------------------------*/
+bool BloomFilter :: MayContain (Record *rec, OrderMaker *order) {
+  unsigned long long h = Hash (rec, order);
+  unsigned long long h1 = h & 0xffffffffULL;
+  unsigned long long h2 = (h >> 32) | 1;
+  for (int i = 0; i < BLOOM_NUM_HASHES; i++) {
+    unsigned long long bit = (h1 + i*h2) % numBits;
+    if (!(bits[bit >> 3] & (1 << (bit & 7)))) return false;
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
@@ -0,0 +1,54 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include "Record.h"
+#include "Comparison.h"
+#include <pthread.h>
+#include <vector>
+
+using namespace std;
+
+#define BLOOM_BITS_PER_KEY 10 // ~1% false positives with BLOOM_NUM_HASHES hashes
+#define BLOOM_NUM_HASHES 7
+
+// Bloom filter over the join keys of one side of a join. Added so that Join can
+// throw away records of its right (probe) side that can't possibly find a match
+// before they are sorted.
+//
+// The filter is built once: Add is called for every record of the build side and
+// Finish sizes the bit array for the number of keys seen and sets the bits. The
+// probe side may run in another thread (the planner can push the filter down to a
+// SelectFile or SelectPipe below the join); it calls WaitUntilReady before its
+// first probe. The build and probe sides hash their own attributes, given by their
+// own OrderMaker, the same way GetSortOrders pairs them up.
+class BloomFilter {
+  private:
+    vector<unsigned long long> keyHashes; // hashes of the build side keys, till Finish
+    unsigned char* bits;
+    unsigned long long numBits;
+    bool ready;
+    pthread_mutex_t readyMutex;
+    pthread_cond_t readyVar;
+
+  public:
+    BloomFilter ();
+    ~BloomFilter ();
+
+    // hash the attributes of rec listed in order
+    static unsigned long long Hash (Record *rec, OrderMaker *order);
+
+    // add the key of a build side record
+    void Add (Record *rec, OrderMaker *order);
+
+    // size the filter for the keys added so far, set the bits and wake up any prober
+    void Finish ();
+
+    // block till Finish has been called
+    void WaitUntilReady ();
+
+    // false if no build side record had this key; true if one might have.
+    // Must only be called once the filter is ready
+    bool MayContain (Record *rec, OrderMaker *order);
+};
+
+#endif
@@ -0,0 +1,309 @@
+/*******************************************************************************
+ * File: Catalog.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "Catalog.h"
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+/*------------------------------------------------------------------------------
+ * Strings in the catalog file: their length followed by their bytes
+ *----------------------------------------------------------------------------*/
+static void writeString (FILE *f, const string &str) {
+  int len = str.size ();
+  fwrite (&len, sizeof (int), 1, f);
+  fwrite (str.data (), 1, len, f);
+}
+
+static string readString (FILE *f) {
+  int len = 0;
+  fread (&len, sizeof (int), 1, f);
+  string str (len, '\0');
+  if (len > 0)
+    fread (&str[0], 1, len, f);
+  return str;
+}
+
+/*------------------------------------------------------------------------------
+ * Constructor
+ *----------------------------------------------------------------------------*/
+Catalog :: Catalog () {
+  path = NULL;
+  numRecords = 0;
+  version = 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Destructor
+ *----------------------------------------------------------------------------*/
+Catalog :: ~Catalog () {
+  for (auto it = schemas.begin (); it != schemas.end (); ++it) {
+    delete it->second;
+  }
+  free (path);
+}
+
+/*------------------------------------------------------------------------------
+ * Load the catalog at catalogPath by replaying its records:
+ *   CATALOG_ADD_REL   name, number of attributes, (name, type) per attribute
+ *   CATALOG_DROP_REL  name
+ *   CATALOG_STATS     Statistics.WriteBinary
+ * If there is no catalog yet, import the text files it replaces and create it
+ *----------------------------------------------------------------------------*/
+void Catalog :: Open (char *catalogPath, char *textCatalogPath, char *savedStatePath, char *statsPath) {
+  path = strdup (catalogPath);
+  FILE *f = fopen (path, "rb");
+  if (f == NULL) {
+    cout << "INFO: No binary catalog at " << path << ". Importing " << savedStatePath << " and " << statsPath << endl;
+    unordered_map<string, Schema*> textSchemas;
+    ReadTextSchemas (textCatalogPath, textSchemas);
+    ifstream infile (savedStatePath);
+    string buffer;
+    while (getline (infile, buffer)) { // names of the relations created so far
+      if (textSchemas.count (buffer) && !schemas.count (buffer)) {
+        schemas[buffer] = textSchemas[buffer];
+        relNames.push_back (buffer);
+        textSchemas.erase (buffer);
+      }
+      else if (!schemas.count (buffer)) {
+        cerr << "ERROR: No schema for " << buffer << " in " << textCatalogPath << ". Skipping it." << endl;
+      }
+    }
+    for (auto it = textSchemas.begin (); it != textSchemas.end (); ++it) {
+      delete it->second;
+    }
+    stats.Read (statsPath);
+    compact ();
+    return;
+  }
+
+  int magic = 0;
+  fread (&magic, sizeof (int), 1, f);
+  if (magic != CATALOG_MAGIC) {
+    cerr << "ERROR: " << path << " is not a catalog file. EXIT !!!" << endl;
+    exit (1);
+  }
+  int kind;
+  while (fread (&kind, sizeof (int), 1, f) == 1) {
+    numRecords++;
+    if (kind == CATALOG_ADD_REL) {
+      string relName = readString (f);
+      int numAtts = 0;
+      fread (&numAtts, sizeof (int), 1, f);
+      Attribute* atts = new Attribute[numAtts];
+      vector<string> attNames (numAtts);
+      for (int i = 0; i < numAtts; i++) {
+        attNames[i] = readString (f);
+        atts[i].name = (char*) attNames[i].c_str (); // Schema makes its own copy
+        fread (&atts[i].myType, sizeof (Type), 1, f);
+      }
+      if (schemas.count (relName)) {
+        delete schemas[relName];
+      }
+      else {
+        relNames.push_back (relName);
+      }
+      schemas[relName] = new Schema ((char*) relName.c_str (), numAtts, atts);
+      delete [] atts;
+    }
+    else if (kind == CATALOG_DROP_REL) {
+      string relName = readString (f);
+      delete schemas[relName];
+      schemas.erase (relName);
+      relNames.erase (remove (relNames.begin (), relNames.end (), relName), relNames.end ());
+      stats.DeleteRel ((char*) relName.c_str ());
+    }
+    else if (kind == CATALOG_STATS) {
+      stats.ReadBinary (f);
+    }
+    else {
+      cerr << "ERROR: " << path << " is corrupt. EXIT !!!" << endl;
+      exit (1);
+    }
+  }
+  fclose (f);
+
+  // one record per relation and one for the statistics would do
+  if (numRecords > 2*(relNames.size () + 1) + 16) {
+    compact ();
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Read every schema in the text catalog at fName in one pass. The format is the
+ * one Schema (char *fName, char *relName) reads:
+ *   BEGIN relName fileName (attName attType)* END
+ *----------------------------------------------------------------------------*/
+void Catalog :: ReadTextSchemas (char *fName, unordered_map<string, Schema*> &into) {
+  FILE *foo = fopen (fName, "r");
+  if (foo == NULL) {
+    return;
+  }
+  char space[200]; // this is enough space to hold any tokens
+  while (fscanf (foo, "%s", space) != EOF) {
+    if (strcmp (space, "BEGIN")) {
+      continue;
+    }
+    char relName[200];
+    if (fscanf (foo, "%s", relName) == EOF || fscanf (foo, "%s", space) == EOF) { // name and file name
+      break;
+    }
+    vector<Attribute> atts;
+    vector<string> attNames;
+    while (fscanf (foo, "%s", space) != EOF && strcmp (space, "END")) {
+      Attribute att;
+      attNames.push_back (space);
+      fscanf (foo, "%s", space);
+      if (!strcmp (space, "Int")) {
+        att.myType = Int;
+      } else if (!strcmp (space, "Double")) {
+        att.myType = Double;
+      } else if (!strcmp (space, "String")) {
+        att.myType = String;
+      } else {
+        cout << "Bad attribute type for " << attNames.back () << "\n";
+        exit (1);
+      }
+      atts.push_back (att);
+    }
+    for (int i = 0; i < atts.size (); i++) {
+      atts[i].name = (char*) attNames[i].c_str (); // Schema makes its own copy
+    }
+    delete into[relName];
+    into[relName] = new Schema (relName, atts.size (), atts.empty () ? NULL : &atts[0]);
+  }
+  fclose (foo);
+}
+
+/*------------------------------------------------------------------------------
+ * Append one record of kind to the file. relName NULL in a CATALOG_STATS record
+ * means the statistics of all relations
+ *----------------------------------------------------------------------------*/
+void Catalog :: appendRecord (int kind, char *relName) {
+  FILE *f = fopen (path, "ab");
+  if (f == NULL) {
+    cerr << "ERROR: Cannot write " << path << ". EXIT !!!" << endl;
+    exit (1);
+  }
+  fwrite (&kind, sizeof (int), 1, f);
+  if (kind == CATALOG_ADD_REL) {
+    Schema* schema = schemas[relName];
+    writeString (f, relName);
+    int numAtts = schema->GetNumAtts ();
+    Attribute* atts = schema->GetAtts ();
+    fwrite (&numAtts, sizeof (int), 1, f);
+    for (int i = 0; i < numAtts; i++) {
+      writeString (f, atts[i].name);
+      fwrite (&atts[i].myType, sizeof (Type), 1, f);
+    }
+  }
+  else if (kind == CATALOG_DROP_REL) {
+    writeString (f, relName);
+  }
+  else {
+    stats.WriteBinary (f, relName);
+  }
+  fclose (f);
+  numRecords++;
+  version++;
+}
+
+/*------------------------------------------------------------------------------
+ * Rewrite the file with only the live records. The new file is written next to
+ * the old one and renamed over it, so a crash leaves one or the other
+ *----------------------------------------------------------------------------*/
+void Catalog :: compact () {
+  char* finalPath = path;
+  string tempPath = string (path) + ".tmp";
+  path = (char*) tempPath.c_str ();
+  FILE *f = fopen (path, "wb");
+  if (f == NULL) {
+    cerr << "ERROR: Cannot write " << path << ". EXIT !!!" << endl;
+    exit (1);
+  }
+  int magic = CATALOG_MAGIC;
+  fwrite (&magic, sizeof (int), 1, f);
+  fclose (f);
+  numRecords = 0;
+  for (int i = 0; i < relNames.size (); i++) {
+    appendRecord (CATALOG_ADD_REL, (char*) relNames[i].c_str ());
+  }
+  appendRecord (CATALOG_STATS, NULL);
+  path = finalPath;
+  rename (tempPath.c_str (), path);
+}
+
+/*------------------------------------------------------------------------------
+ * Add relName with the given schema, which the catalog takes over
+ *----------------------------------------------------------------------------*/
+void Catalog :: AddRelation (char *relName, Schema *schema) {
+  if (schemas.count (relName)) {
+    delete schemas[relName];
+  }
+  else {
+    relNames.push_back (relName);
+  }
+  schemas[relName] = schema;
+  appendRecord (CATALOG_ADD_REL, relName);
+}
+
+/*------------------------------------------------------------------------------
+ * Forget relName and its statistics
+ *----------------------------------------------------------------------------*/
+void Catalog :: DropRelation (char *relName) {
+  if (!schemas.count (relName)) {
+    return;
+  }
+  delete schemas[relName];
+  schemas.erase (relName);
+  relNames.erase (remove (relNames.begin (), relNames.end (), string (relName)), relNames.end ());
+  stats.DeleteRel (relName);
+  appendRecord (CATALOG_DROP_REL, relName);
+}
+
+/*------------------------------------------------------------------------------
+ * Take over the statistics in s and persist those of relName
+ *----------------------------------------------------------------------------*/
+void Catalog :: UpdateStatistics (char *relName, Statistics &s) {
+  stats = s;
+  appendRecord (CATALOG_STATS, relName);
+}
+
+/*------------------------------------------------------------------------------
+ * Schema of relName, or NULL if there is no such relation
+ *----------------------------------------------------------------------------*/
+Schema* Catalog :: GetSchema (char *relName) {
+  auto it = schemas.find (relName);
+  if (it == schemas.end ()) {
+    return NULL;
+  }
+  return it->second;
+}
+
+/*------------------------------------------------------------------------------
+ * Names of all the relations, in the order they were added
+ *----------------------------------------------------------------------------*/
+vector<string>& Catalog :: GetRelations () {
+  return relNames;
+}
+
+/*------------------------------------------------------------------------------
+ * The statistics of all the relations
+ *----------------------------------------------------------------------------*/
+Statistics& Catalog :: GetStatistics () {
+  return stats;
+}
+
+/*------------------------------------------------------------------------------
+ * Changes every time a relation is added or dropped or statistics are updated
+ *----------------------------------------------------------------------------*/
+int Catalog :: GetVersion () {
+  return version;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
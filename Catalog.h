@@ -0,0 +1,84 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "Schema.h"
+#include "Statistics.h"
+#include <stdio.h>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define CATALOG_MAGIC 0x43415431 // "CAT1"; first int of every catalog file
+
+// kinds of record in the catalog file
+#define CATALOG_ADD_REL 1   // relation name and schema
+#define CATALOG_DROP_REL 2  // relation name
+#define CATALOG_STATS 3     // Statistics.WriteBinary of one or all relations
+
+// Binary, memory resident catalog of the database: the schema of every relation
+// and the statistics of the relations. Added so that startup, CREATE/DROP TABLE and
+// query planning no longer re-read the text catalog (once per relation),
+// savedState.txt and Statistics.txt.
+//
+// The file is a log: Open replays it once at startup and every change appends one
+// record, so a CREATE, DROP or UPDATE STATISTICS costs the same however many
+// relations there are. When Open finds that most of the records are dead (dropped
+// relations, older statistics), it rewrites the file with only the live ones.
+//
+// The file type, sort order and delta runs of a relation stay in its .bin.meta
+// file: DBFile, Sorted and Tree open those on their own (so do BigQ and RelOp for
+// their temporary files), without a catalog.
+class Catalog {
+  private:
+    char* path;
+    unordered_map<string, Schema*> schemas;
+    vector<string> relNames;   // in the order the relations were added
+    Statistics stats;          // statistics as of the last UPDATE STATISTICS
+    int numRecords;            // records in the file, dead or alive
+    int version;               // bumped by every change, so others can tell their copies are stale
+
+    // append one record of kind to the file. If relName is NULL, a CATALOG_STATS
+    // record holds the statistics of all relations
+    void appendRecord(int kind, char *relName);
+
+    // rewrite the file with one record per relation and one for the statistics
+    void compact();
+
+  public:
+    Catalog ();
+    ~Catalog ();
+
+    // load the catalog at catalogPath. If there is none, import the relations listed
+    // in savedStatePath from the text catalog at textCatalogPath and the statistics
+    // from the text file at statsPath, and create it
+    void Open (char *catalogPath, char *textCatalogPath, char *savedStatePath, char *statsPath);
+
+    // read every schema in the text catalog at fName, in one pass
+    static void ReadTextSchemas (char *fName, unordered_map<string, Schema*> &into);
+
+    // add relName with the given schema (the catalog takes it over); persisted at once
+    void AddRelation (char *relName, Schema *schema);
+
+    // forget relName and its statistics; persisted at once
+    void DropRelation (char *relName);
+
+    // s holds new statistics for relName (and is otherwise a copy of GetStatistics).
+    // They replace the catalog's and are persisted at once
+    void UpdateStatistics (char *relName, Statistics &s);
+
+    // schema of relName, or NULL if there is no such relation
+    Schema* GetSchema (char *relName);
+
+    // names of all the relations, in the order they were added
+    vector<string>& GetRelations ();
+
+    // the statistics of all the relations. Callers that Apply predicates must copy them
+    Statistics& GetStatistics ();
+
+    // changes every time a relation is added or dropped or statistics are updated
+    int GetVersion ();
+};
+
+#endif
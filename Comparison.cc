@@ -8,6 +8,11 @@
 
 Comparison::Comparison()
 {
+  fixedOffset1 = -1;
+  fixedOffset2 = -1;
+  lastAtt1 = -1;
+  lastAtt2 = -1;
+  litLength = -1;
 }
 
 
@@ -21,6 +26,12 @@ Comparison::Comparison(const Comparison &copy_me)
   attType = copy_me.attType;
 
   op = copy_me.op;
+
+  fixedOffset1 = copy_me.fixedOffset1;
+  fixedOffset2 = copy_me.fixedOffset2;
+  lastAtt1 = copy_me.lastAtt1;
+  lastAtt2 = copy_me.lastAtt2;
+  litLength = copy_me.litLength;
 }
 
 
@@ -67,10 +78,14 @@ void Comparison :: Print () {
 
 OrderMaker :: OrderMaker() {
   numAtts = 0;
+  for (int i = 0; i < MAX_ANDS; i++)
+    fixedOffsets[i] = -1;
 }
 
 OrderMaker :: OrderMaker(Schema *schema) {
   numAtts = 0;
+  for (int i = 0; i < MAX_ANDS; i++)
+    fixedOffsets[i] = -1;
 
   int n = schema->GetNumAtts();
   Attribute *atts = schema->GetAtts();
@@ -100,6 +115,10 @@ OrderMaker :: OrderMaker(Schema *schema) {
       numAtts++;
     }
   }
+
+  // the attributes before the first string are in the same place in every record
+  for (int i = 0; i < numAtts && i < MAX_ANDS; i++)
+    fixedOffsets[i] = schema->GetFixedOffset (whichAtts[i]);
 }
 
 
@@ -140,6 +159,14 @@ void OrderMaker :: initOrderMaker(int numAtts, myAtt* myAtts){
   for(int i=0;i<numAtts;i++){
     whichAtts[i] = myAtts[i].attNo;
     whichTypes[i] = myAtts[i].attType;
+    fixedOffsets[i] = -1;
+  }
+}
+
+void OrderMaker :: initOrderMaker(int numAtts, myAtt* myAtts, Schema* schema){
+  initOrderMaker(numAtts, myAtts);
+  for(int i=0;i<numAtts;i++){
+    fixedOffsets[i] = schema->GetFixedOffset(myAtts[i].attNo);
   }
 }
 
@@ -153,6 +180,58 @@ int* OrderMaker :: getWhichAtts(){
   return whichAtts;
 }
 
+// get attribute types. used to build key OrderMakers in Tree.cc - added for the B+-tree file
+Type* OrderMaker :: getWhichTypes(){
+  return whichTypes;
+}
+
+KeyComparator OrderMaker :: GetComparator () {
+  return GetComparator (*this);
+}
+
+KeyComparator OrderMaker :: GetComparator (OrderMaker &other) {
+  KeyComparator comparator;
+  comparator.leftOrder = this;
+  comparator.rightOrder = &other;
+  if (numAtts != other.numAtts || numAtts < 1 || numAtts > 2)
+    return comparator;
+  for (int i = 0; i < numAtts; i++) {
+    if (whichTypes[i] != other.whichTypes[i])
+      return comparator;
+    comparator.leftAtts[i] = whichAtts[i];
+    comparator.leftOffsets[i] = fixedOffsets[i];
+    comparator.rightAtts[i] = other.whichAtts[i];
+    comparator.rightOffsets[i] = other.fixedOffsets[i];
+  }
+
+  if (numAtts == 1) {
+    if (whichTypes[0] == Int) comparator.shape = KEY_INT;
+    else if (whichTypes[0] == Double) comparator.shape = KEY_DOUBLE;
+    else comparator.shape = KEY_STRING;
+  }
+  else if (whichTypes[0] == Int && whichTypes[1] == Int)
+    comparator.shape = KEY_INT_INT;
+  else if (whichTypes[0] == Int && whichTypes[1] == String)
+    comparator.shape = KEY_INT_STRING;
+  return comparator;
+}
+
+KeyComparator :: KeyComparator () {
+  shape = KEY_GENERIC;
+  for (int i = 0; i < 2; i++) {
+    leftAtts[i] = rightAtts[i] = 0;
+    leftOffsets[i] = rightOffsets[i] = -1;
+  }
+  leftOrder = rightOrder = NULL;
+}
+
+int KeyComparator :: CompareGeneric (char *left, char *right) {
+  ComparisonEngine ceng;
+  if (leftOrder == rightOrder)
+    return ceng.Compare (left, right, leftOrder);
+  return ceng.Compare (left, leftOrder, right, rightOrder);
+}
+
 int CNF :: GetSortOrders (OrderMaker &left, OrderMaker &right) {
 
   // initialize the size of the OrderMakers
@@ -186,21 +265,25 @@ int CNF :: GetSortOrders (OrderMaker &left, OrderMaker &right) {
     if (orList[i][0].operand1 == Left) {
       left.whichAtts[left.numAtts] = orList[i][0].whichAtt1;
       left.whichTypes[left.numAtts] = orList[i][0].attType;
+      left.fixedOffsets[left.numAtts] = orList[i][0].fixedOffset1;
     }
 
     if (orList[i][0].operand1 == Right) {
       right.whichAtts[right.numAtts] = orList[i][0].whichAtt1;
       right.whichTypes[right.numAtts] = orList[i][0].attType;
+      right.fixedOffsets[right.numAtts] = orList[i][0].fixedOffset1;
     }
 
     if (orList[i][0].operand2 == Left) {
       left.whichAtts[left.numAtts] = orList[i][0].whichAtt2;
       left.whichTypes[left.numAtts] = orList[i][0].attType;
+      left.fixedOffsets[left.numAtts] = orList[i][0].fixedOffset2;
     }
 
     if (orList[i][0].operand2 == Right) {
       right.whichAtts[right.numAtts] = orList[i][0].whichAtt2;
       right.whichTypes[right.numAtts] = orList[i][0].attType;
+      right.fixedOffsets[right.numAtts] = orList[i][0].fixedOffset2;
     }
 
     // note that we have found two new attributes
@@ -250,6 +333,7 @@ int CNF :: createQueryOrder (OrderMaker &sortOrder, OrderMaker &queryOrder) {
           (orList[i][0].attType   == sortOrder.whichTypes[j])){
         queryOrder.whichAtts[queryOrder.numAtts] = i;
         queryOrder.whichTypes[queryOrder.numAtts] = orList[i][0].attType;
+        queryOrder.fixedOffsets[queryOrder.numAtts] = -1;
 
         queryOrder.numAtts++;
         stop = false;
@@ -265,6 +349,80 @@ int CNF :: createQueryOrder (OrderMaker &sortOrder, OrderMaker &queryOrder) {
   return queryOrder.numAtts;
 }
 
+// Find the bounds that the CNF places on the leading attribute of sortOrder - added for
+// the B+-tree file. Called from Tree.GetNext w/ CNF version.
+// Any bound we find is safe to use even if the CNF has a tighter one because every record
+// handed back is still checked against the whole CNF; the bounds only decide where the scan
+// starts and when it can stop.
+int CNF :: GetLeadingAttBounds (OrderMaker &sortOrder, int &lowLit, int &highLit, int &highInclusive) {
+  lowLit = -1;
+  highLit = -1;
+  highInclusive = 0;
+  if (sortOrder.numAtts == 0) {
+    return 0;
+  }
+
+  int leadingAtt = sortOrder.whichAtts[0];
+  Type leadingType = sortOrder.whichTypes[0];
+
+  for (int i = 0; i < numAnds; i++) {
+    // a disjunction can't bound the attribute on its own
+    if (orLens[i] != 1) {
+      continue;
+    }
+
+    Comparison &c = orList[i][0];
+    if (c.attType != leadingType) {
+      continue;
+    }
+
+    // rewrite the comparison so that it reads (att op lit)
+    CompOperator op = c.op;
+    int litAtt;
+    if (c.operand1 == Left && c.whichAtt1 == leadingAtt && c.operand2 == Literal) {
+      litAtt = c.whichAtt2;
+    }
+    else if (c.operand2 == Left && c.whichAtt2 == leadingAtt && c.operand1 == Literal) {
+      litAtt = c.whichAtt1;
+      if (op == LessThan) op = GreaterThan; // (lit < att) is (att > lit)
+      else if (op == GreaterThan) op = LessThan;
+    }
+    else {
+      continue;
+    }
+
+    if (op == Equals) {
+      lowLit = litAtt;
+      highLit = litAtt;
+      highInclusive = 1;
+      break; // an equality is as tight as it gets
+    }
+    else if (op == GreaterThan && lowLit == -1) {
+      lowLit = litAtt;
+    }
+    else if (op == LessThan && highLit == -1) {
+      highLit = litAtt;
+      highInclusive = 0;
+    }
+  }
+
+  return (lowLit != -1 || highLit != -1);
+}
+
+void CNF :: NoteLiteralLengths (Record &literal) {
+  char *litBits = literal.bits;
+  for (int i = 0; i < numAnds; i++) {
+    for (int j = 0; j < orLens[i]; j++) {
+      Comparison &c = orList[i][j];
+      c.litLength = -1;
+      if (c.attType != String || (c.operand1 == Literal) == (c.operand2 == Literal))
+        continue;
+      int litAtt = (c.operand1 == Literal) ? c.whichAtt1 : c.whichAtt2;
+      c.litLength = strlen (litBits + ((int *) litBits)[litAtt + 1]) + 1;
+    }
+  }
+}
+
 void CNF :: Print () {
 
   for (int i = 0; i < numAnds; i++) {
@@ -489,6 +647,21 @@ void CNF :: GrowFromParseTree (struct AndList *parseTree, Schema *leftSchema,
     }
   }
 
+  // note where the attributes compared start in every record of their schemas
+  for (int i = 0; i < cnf.numAnds; i++) {
+    for (int j = 0; j < cnf.orLens[i]; j++) {
+      Comparison &c = cnf.orList[i][j];
+      c.fixedOffset1 = (c.operand1 == Literal) ? -1 :
+        (c.operand1 == Left ? leftSchema : rightSchema)->GetFixedOffset (c.whichAtt1);
+      c.fixedOffset2 = (c.operand2 == Literal) ? -1 :
+        (c.operand2 == Left ? leftSchema : rightSchema)->GetFixedOffset (c.whichAtt2);
+      c.lastAtt1 = (c.operand1 == Literal) ? -1 :
+        (c.operand1 == Left ? leftSchema : rightSchema)->GetNumAtts () - 1;
+      c.lastAtt2 = (c.operand2 == Literal) ? -1 :
+        (c.operand2 == Left ? leftSchema : rightSchema)->GetNumAtts () - 1;
+    }
+  }
+
   // the very last thing is to set up the literal record; first close the
   // file where its information has been stored
   fclose (outRecFile);
@@ -503,6 +676,7 @@ void CNF :: GrowFromParseTree (struct AndList *parseTree, Schema *leftSchema,
 
   // and get the record
   literal.SuckNextRecord (&mySchema, outRecFile);
+  cnf.NoteLiteralLengths (literal);
 
   // close the record file
   fclose (outRecFile);
@@ -658,6 +832,17 @@ void CNF :: GrowFromParseTree (struct AndList *parseTree, Schema *mySchema,
     }
   }
 
+  // note where the attributes compared start in every record of the schema
+  for (int i = 0; i < cnf.numAnds; i++) {
+    for (int j = 0; j < cnf.orLens[i]; j++) {
+      Comparison &c = cnf.orList[i][j];
+      c.fixedOffset1 = (c.operand1 == Left) ? mySchema->GetFixedOffset (c.whichAtt1) : -1;
+      c.fixedOffset2 = (c.operand2 == Left) ? mySchema->GetFixedOffset (c.whichAtt2) : -1;
+      c.lastAtt1 = (c.operand1 == Left) ? mySchema->GetNumAtts () - 1 : -1;
+      c.lastAtt2 = (c.operand2 == Left) ? mySchema->GetNumAtts () - 1 : -1;
+    }
+  }
+
   // the very last thing is to set up the literal record; first close the
   // file where its information has been stored
   fclose (outRecFile);
@@ -672,6 +857,7 @@ void CNF :: GrowFromParseTree (struct AndList *parseTree, Schema *mySchema,
 
   // and get the record
   literal.SuckNextRecord (&outSchema, outRecFile);
+  cnf.NoteLiteralLengths (literal);
 
   // close the record file
   fclose (outRecFile);
@@ -6,6 +6,7 @@
 #include "File.h"
 #include "Comparison.h"
 #include "ComparisonEngine.h"
+#include "StringCompare.h"
 
 using namespace std;
 
@@ -29,6 +30,18 @@ class Comparison {
 
   CompOperator op;
 
+  // where the two operands start in every record they come from (see
+  // Schema::GetFixedOffset), or -1 if that has to be looked up in the record
+  int fixedOffset1;
+  int fixedOffset2;
+
+  // for String comparisons: the last attribute of the schemas of the two operands,
+  // so that a string is known to end where the next attribute starts (-1 if not
+  // known), and the bytes of the literal operand with its null (-1 if none)
+  int lastAtt1;
+  int lastAtt2;
+  int litLength;
+
 public:
 
   Comparison();
@@ -42,6 +55,7 @@ public:
 
 
 class Schema;
+class KeyComparator;
 
 // This structure encapsulates a sort order for records
 class OrderMaker {
@@ -54,6 +68,10 @@ class OrderMaker {
   int whichAtts[MAX_ANDS];
   Type whichTypes[MAX_ANDS];
 
+  // where each of whichAtts starts in every record, or -1 if that has to be looked
+  // up in the record. Known when the OrderMaker is made from a schema or a CNF
+  int fixedOffsets[MAX_ANDS];
+
 public:
 
 
@@ -75,13 +93,145 @@ public:
   // invoked in Sorted.Open
   void initOrderMaker(int numAtts, myAtt* myAtts);
 
+  // same, for records of schema, so that the attributes whose place the schema knows
+  // (see Schema::GetFixedOffset) aren't looked up in the records. Added for GroupBy
+  void initOrderMaker(int numAtts, myAtt* myAtts, Schema* schema);
+
   // get number of attributes. used in CNF.CreateQueryOrder. - added in assignment 2 part 2
   int getNumAtts();
 
   // get attribute numbers. used in RelOp.GroupBy. - added in assignment 3
   int* getWhichAtts();
+
+  // get attribute types. used to build key OrderMakers in Tree.cc - added for the B+-tree file
+  Type* getWhichTypes();
+
+  // a comparator for the records of this OrderMaker, specialized for the number and
+  // types of its attributes (see KeyComparator). Made once by whoever compares many
+  // records, after the OrderMaker is filled in
+  KeyComparator GetComparator ();
+
+  // the same, comparing records of this OrderMaker (on the left) with records of
+  // other (on the right), as in a sort-merge join
+  KeyComparator GetComparator (OrderMaker &other);
+};
+
+#define KEY_GENERIC 0    // any other key: ComparisonEngine::Compare
+#define KEY_INT 1        // (Int)
+#define KEY_INT_INT 2    // (Int, Int)
+#define KEY_DOUBLE 3     // (Double)
+#define KEY_STRING 4     // (String)
+#define KEY_INT_STRING 5 // (Int, String)
+
+// Compares records on one or two OrderMakers, with the same result as
+// ComparisonEngine::Compare. Added because almost every sort key is one or two
+// attributes, and going through the OrderMaker attribute by attribute, switching
+// on each type, costs more than the comparison itself.
+//
+// The shape of the key is worked out once, when the comparator is made. Compare
+// switches on it and goes straight to the code for that shape. Callers that make a
+// great many comparisons with one comparator, like the sort of a BigQ run, can
+// instantiate their loop for each shape with CompareShape and skip even that switch.
+// Keys with more attributes or other types go to ComparisonEngine.
+class KeyComparator {
+
+  friend class OrderMaker;
+
+  int shape;
+
+  // where the first two attributes of the key are in left and right records: the
+  // offset if the schema knows it (see Schema::GetFixedOffset), else -1 and the
+  // attribute number
+  int leftAtts[2];
+  int leftOffsets[2];
+  int rightAtts[2];
+  int rightOffsets[2];
+
+  // for KEY_GENERIC
+  OrderMaker *leftOrder;
+  OrderMaker *rightOrder;
+
+  int CompareGeneric (char *left, char *right);
+
+  static inline char *Locate (char *bits, int att, int offset) {
+    return bits + (offset >= 0 ? offset : ((int *) bits)[att + 1]);
+  }
+
+  static inline int CompareInts (char *left, char *right) {
+    int l = *((int *) left);
+    int r = *((int *) right);
+    return (l < r) ? -1 : (l > r);
+  }
+
+public:
+
+  KeyComparator ();
+
+  int GetShape () { return shape; }
+
+  // compare the bits of two records as the key of the given shape, which must be
+  // the comparator's own
+  template <int keyShape>
+  inline int CompareShape (char *left, char *right);
+
+  // returns a negative number, 0, or a positive number if left is less than, equal
+  // to, or greater than right
+  inline int Compare (char *left, char *right);
 };
 
+template <>
+inline int KeyComparator :: CompareShape<KEY_INT> (char *left, char *right) {
+  return CompareInts (Locate (left, leftAtts[0], leftOffsets[0]), Locate (right, rightAtts[0], rightOffsets[0]));
+}
+
+template <>
+inline int KeyComparator :: CompareShape<KEY_INT_INT> (char *left, char *right) {
+  int c = CompareInts (Locate (left, leftAtts[0], leftOffsets[0]), Locate (right, rightAtts[0], rightOffsets[0]));
+  if (c != 0)
+    return c;
+  return CompareInts (Locate (left, leftAtts[1], leftOffsets[1]), Locate (right, rightAtts[1], rightOffsets[1]));
+}
+
+template <>
+inline int KeyComparator :: CompareShape<KEY_DOUBLE> (char *left, char *right) {
+  double l = *((double *) Locate (left, leftAtts[0], leftOffsets[0]));
+  double r = *((double *) Locate (right, rightAtts[0], rightOffsets[0]));
+  return (l < r) ? -1 : (l > r);
+}
+
+template <>
+inline int KeyComparator :: CompareShape<KEY_STRING> (char *left, char *right) {
+  char *l = Locate (left, leftAtts[0], leftOffsets[0]);
+  char *r = Locate (right, rightAtts[0], rightOffsets[0]);
+  return StringCompare :: Compare (l, StringCompare :: Bound (left, l), r, StringCompare :: Bound (right, r));
+}
+
+template <>
+inline int KeyComparator :: CompareShape<KEY_INT_STRING> (char *left, char *right) {
+  int c = CompareInts (Locate (left, leftAtts[0], leftOffsets[0]), Locate (right, rightAtts[0], rightOffsets[0]));
+  if (c != 0)
+    return c;
+  char *l = Locate (left, leftAtts[1], leftOffsets[1]);
+  char *r = Locate (right, rightAtts[1], rightOffsets[1]);
+  return StringCompare :: Compare (l, StringCompare :: Bound (left, l), r, StringCompare :: Bound (right, r));
+}
+
+template <>
+inline int KeyComparator :: CompareShape<KEY_GENERIC> (char *left, char *right) {
+  return CompareGeneric (left, right);
+}
+
+inline int KeyComparator :: Compare (char *left, char *right) {
+  switch (shape) {
+    case KEY_INT: return CompareShape<KEY_INT> (left, right);
+    case KEY_INT_INT: return CompareShape<KEY_INT_INT> (left, right);
+    case KEY_DOUBLE: return CompareShape<KEY_DOUBLE> (left, right);
+    case KEY_STRING: return CompareShape<KEY_STRING> (left, right);
+    case KEY_INT_STRING: return CompareShape<KEY_INT_STRING> (left, right);
+    default: return CompareGeneric (left, right);
+  }
+}
+
 class Record;
 
 // This structure stores a CNF expression that is to be evaluated
@@ -96,6 +246,10 @@ class CNF {
   int orLens[MAX_ANDS];
   int numAnds;
 
+  // note how long the String literals of the comparisons are, once the literal
+  // record is built
+  void NoteLiteralLengths (Record &literal);
+
 public:
 
   // this returns two instances of the OrderMaker class that
@@ -128,6 +282,15 @@ public:
   // queryOrder is the OrderMaker that will be built
   int createQueryOrder (OrderMaker &sortOrder, OrderMaker &queryOrder);
 
+  // Find the bounds that the CNF places on the leading attribute of sortOrder - added for
+  // the B+-tree file. Only singleton disjunctions comparing the attribute with a literal
+  // are considered. Arguments:
+  // lowLit        literal attribute number of a lower bound (att = lit or att > lit); -1 if none
+  // highLit       literal attribute number of an upper bound (att = lit or att < lit); -1 if none
+  // highInclusive 1 if records equal to the upper bound can still qualify (equality), 0 if not
+  // Returns 1 if at least one bound was found and 0 otherwise
+  int GetLeadingAttBounds (OrderMaker &sortOrder, int &lowLit, int &highLit, int &highInclusive);
+
 };
 
 #endif
@@ -6,19 +6,46 @@
 #include <stdlib.h>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// where attribute att starts in bits: at fixedOffset when the schema says so (see
+// Schema::GetFixedOffset), which saves reading the offset from the record
+static inline char *attStart (char *bits, int att, int fixedOffset) {
+  return bits + (fixedOffset >= 0 ? fixedOffset : ((int *) bits)[att + 1]);
+}
+
+// compares the strings val1 and val2 of the records bits1 and bits2. Kept out of
+// the loops over the attributes so that they stay small for the other types
+static int __attribute__ ((noinline)) compareStrings (char *bits1, char *val1, char *bits2, char *val2) {
+  return StringCompare :: Compare (val1, StringCompare :: Bound (bits1, val1), val2, StringCompare :: Bound (bits2, val2));
+}
 
 // returns a -1, 0, or 1 depending upon whether left is less then, equal to, or greater
 // than right, depending upon the OrderMaker
 int ComparisonEngine :: Compare(Record *left, Record *right, OrderMaker *orderUs) {
+  return Compare (left->GetBits(), right->GetBits(), orderUs);
+}
 
-  char *val1, *val2;
 
-  char *left_bits = left->GetBits();
-  char *right_bits = right->GetBits();
+// same, on the bits of the two records
+int ComparisonEngine :: Compare(char *left_bits, char *right_bits, OrderMaker *orderUs) {
+
+  char *val1, *val2;
 
   for (int i = 0; i < orderUs->numAtts; i++) {
-    val1 = left_bits + ((int *) left_bits)[orderUs->whichAtts[i] + 1];
-    val2 = right_bits + ((int *) right_bits)[orderUs->whichAtts[i] + 1];
+    // both records come from the same relation, so the attribute is either in the
+    // same place in the two of them or has to be looked up in both
+    int fixedOffset = orderUs->fixedOffsets[i];
+    if (fixedOffset >= 0) {
+      val1 = left_bits + fixedOffset;
+      val2 = right_bits + fixedOffset;
+    } else {
+      val1 = left_bits + ((int *) left_bits)[orderUs->whichAtts[i] + 1];
+      val2 = right_bits + ((int *) right_bits)[orderUs->whichAtts[i] + 1];
+    }
 
     // these are used to store the two operands, depending on their type
     int val1Int, val2Int;
@@ -61,7 +88,7 @@ int ComparisonEngine :: Compare(Record *left, Record *right, OrderMaker *orderUs
 
       // last case: dealing with strings
       default:
-      int sc = strcmp (val1, val2);
+      int sc = compareStrings (left_bits, val1, right_bits, val2);
       if (sc != 0)
         return sc;
 
@@ -78,15 +105,18 @@ int ComparisonEngine :: Compare(Record *left, Record *right, OrderMaker *orderUs
 // than right, depending upon the OrderMakers that are passed in.  This one is used for
 // joins, where you have to compare records *across* two input tables
 int ComparisonEngine :: Compare (Record *left, OrderMaker *order_left, Record *right, OrderMaker *order_right) {
+  return Compare (left->GetBits(), order_left, right->GetBits(), order_right);
+}
 
-  char *val1, *val2;
 
-  char *left_bits = left->GetBits();
-  char *right_bits = right->GetBits();
+// same, on the bits of the two records
+int ComparisonEngine :: Compare (char *left_bits, OrderMaker *order_left, char *right_bits, OrderMaker *order_right) {
+
+  char *val1, *val2;
 
   for (int i = 0; i < order_left->numAtts; i++) {
-    val1 = left_bits + ((int *) left_bits)[order_left->whichAtts[i] + 1];
-    val2 = right_bits + ((int *) right_bits)[order_right->whichAtts[i] + 1];
+    val1 = attStart (left_bits, order_left->whichAtts[i], order_left->fixedOffsets[i]);
+    val2 = attStart (right_bits, order_right->whichAtts[i], order_right->fixedOffsets[i]);
 
     // these are used to store the two operands, depending on their type
     int val1Int, val2Int;
@@ -129,7 +159,7 @@ int ComparisonEngine :: Compare (Record *left, OrderMaker *order_left, Record *r
 
       // last case: dealing with strings
       default:
-      int sc = strcmp (val1, val2);
+      int sc = compareStrings (left_bits, val1, right_bits, val2);
       if (sc != 0)
         return sc;
 
@@ -146,12 +176,15 @@ int ComparisonEngine :: Compare (Record *left, OrderMaker *order_left, Record *r
 // dpending upon wheter or not the CNF expression accepts the record
 int ComparisonEngine :: Compare (Record *left, Record *literal, CNF *myComparison) {
 
+  char *left_bits = left->GetBits();
+  char *lit_bits = literal->GetBits();
+
   for (int i = 0; i < myComparison->numAnds; i++) {
 
     for (int j = 0; j < myComparison->orLens[i]; j++) {
 
       // this returns a 0 if the comparison did not eval to true
-      int result = Run(left, literal, &myComparison->orList[i][j]);
+      int result = Run(left_bits, lit_bits, &myComparison->orList[i][j]);
 
       if (result != 0) {
         break;
@@ -173,6 +206,176 @@ int ComparisonEngine :: Compare (Record *left, Record *literal, CNF *myCompariso
 }
 
 
+// hits[k] is 1 if vals[k] op lit and 0 if not, for the n values. With SSE2, 16
+// values are compared four at a time and their 16 results stored at once
+template <int op, class T>
+static inline int compareOne (T val, T lit) {
+  return op == LessThan ? val < lit : (op == GreaterThan ? val > lit : val == lit);
+}
+
+template <int op>
+static void compareInts (int *vals, int n, int lit, unsigned char *hits) {
+  int k = 0;
+#ifdef __SSE2__
+  __m128i l = _mm_set1_epi32 (lit);
+  __m128i one = _mm_set1_epi8 (1);
+  for (; k + 16 <= n; k += 16) {
+    __m128i r[4];
+    for (int j = 0; j < 4; j++) {
+      __m128i v = _mm_loadu_si128 ((__m128i *) (vals + k + 4 * j));
+      r[j] = op == LessThan ? _mm_cmplt_epi32 (v, l) :
+             (op == GreaterThan ? _mm_cmpgt_epi32 (v, l) : _mm_cmpeq_epi32 (v, l));
+    }
+    // all ones or all zeros in each int, narrowed to one byte each
+    __m128i b = _mm_packs_epi16 (_mm_packs_epi32 (r[0], r[1]), _mm_packs_epi32 (r[2], r[3]));
+    _mm_storeu_si128 ((__m128i *) (hits + k), _mm_and_si128 (b, one));
+  }
+#endif
+  for (; k < n; k++)
+    hits[k] = compareOne<op> (vals[k], lit);
+}
+
+template <int op>
+static void compareDoubles (double *vals, int n, double lit, unsigned char *hits) {
+  int k = 0;
+#ifdef __SSE2__
+  __m128d l = _mm_set1_pd (lit);
+  __m128i one = _mm_set1_epi8 (1);
+  for (; k + 16 <= n; k += 16) {
+    __m128i r[4];
+    for (int j = 0; j < 4; j++) {
+      __m128d v1 = _mm_loadu_pd (vals + k + 4 * j);
+      __m128d v2 = _mm_loadu_pd (vals + k + 4 * j + 2);
+      __m128d r1 = op == LessThan ? _mm_cmplt_pd (v1, l) : (op == GreaterThan ? _mm_cmpgt_pd (v1, l) : _mm_cmpeq_pd (v1, l));
+      __m128d r2 = op == LessThan ? _mm_cmplt_pd (v2, l) : (op == GreaterThan ? _mm_cmpgt_pd (v2, l) : _mm_cmpeq_pd (v2, l));
+      // one int of each of the four results
+      r[j] = _mm_castps_si128 (_mm_shuffle_ps (_mm_castpd_ps (r1), _mm_castpd_ps (r2), _MM_SHUFFLE (2, 0, 2, 0)));
+    }
+    __m128i b = _mm_packs_epi16 (_mm_packs_epi32 (r[0], r[1]), _mm_packs_epi32 (r[2], r[3]));
+    _mm_storeu_si128 ((__m128i *) (hits + k), _mm_and_si128 (b, one));
+  }
+#endif
+  for (; k < n; k++)
+    hits[k] = compareOne<op> (vals[k], lit);
+}
+
+// the value of type T that attribute att of each of the records recs[rows[k]] starts with
+template <class T>
+static void gather (char **recs, int *rows, int n, int att, int fixedOffset, T *vals) {
+  if (fixedOffset >= 0) {
+    for (int k = 0; k < n; k++)
+      vals[k] = *((T *) (recs[rows[k]] + fixedOffset));
+  } else {
+    for (int k = 0; k < n; k++) {
+      char *bits = recs[rows[k]];
+      vals[k] = *((T *) (bits + ((int *) bits)[att + 1]));
+    }
+  }
+}
+
+// keeps the rows whose hits are 1, in order, and returns how many there are
+static inline int keepHits (int *rows, int n, unsigned char *hits) {
+  int kept = 0;
+  for (int k = 0; k < n; k++) {
+    rows[kept] = rows[k];
+    kept += hits[k];
+  }
+  return kept;
+}
+
+// This is an internal function used by the batch Compare. It sets hits[k] to the
+// result of the comparison for the record recs[rows[k]], for the numRows rows
+void ComparisonEngine :: RunBatch (char **recs, int *rows, int numRows, char *lit_bits, Comparison *c, unsigned char *hits) {
+
+  Target operand1 = c->operand1, operand2 = c->operand2;
+  int whichAtt1 = c->whichAtt1, whichAtt2 = c->whichAtt2;
+  int fixedOffset1 = c->fixedOffset1;
+  int op = c->op;
+
+  // a literal compared with an attribute is turned around, so that the attribute comes first
+  if (operand1 == Literal && operand2 == Left) {
+    operand1 = Left; operand2 = Literal;
+    whichAtt1 = c->whichAtt2; whichAtt2 = c->whichAtt1;
+    fixedOffset1 = c->fixedOffset2;
+    op = (op == LessThan) ? GreaterThan : (op == GreaterThan ? LessThan : op);
+  }
+
+  // anything but an Int or Double attribute against a literal is done a record at a time
+  if (operand1 != Left || operand2 != Literal || c->attType == String) {
+    for (int k = 0; k < numRows; k++)
+      hits[k] = Run (recs[rows[k]], lit_bits, c);
+    return;
+  }
+
+  char *lit = lit_bits + ((int *) lit_bits)[whichAtt2 + 1];
+
+  if (c->attType == Int) {
+    int vals[COMPARE_BATCH];
+    gather (recs, rows, numRows, whichAtt1, fixedOffset1, vals);
+    switch (op) {
+      case LessThan: compareInts<LessThan> (vals, numRows, *((int *) lit), hits); break;
+      case GreaterThan: compareInts<GreaterThan> (vals, numRows, *((int *) lit), hits); break;
+      default: compareInts<Equals> (vals, numRows, *((int *) lit), hits); break;
+    }
+  } else {
+    double vals[COMPARE_BATCH];
+    gather (recs, rows, numRows, whichAtt1, fixedOffset1, vals);
+    switch (op) {
+      case LessThan: compareDoubles<LessThan> (vals, numRows, *((double *) lit), hits); break;
+      case GreaterThan: compareDoubles<GreaterThan> (vals, numRows, *((double *) lit), hits); break;
+      default: compareDoubles<Equals> (vals, numRows, *((double *) lit), hits); break;
+    }
+  }
+}
+
+
+// applies the CNF to a batch of records at a time. Every disjunction narrows the
+// rows (positions in recs) still in the running, so that later ones look only at
+// the records that passed the ones before
+int ComparisonEngine :: Compare (char **recs, int numRecs, Record *literal, CNF *myComparison, int *selected) {
+
+  char *lit_bits = literal->GetBits();
+  int rows[COMPARE_BATCH];
+  unsigned char hits[COMPARE_BATCH];
+  unsigned char anyHits[COMPARE_BATCH];
+  int numSelected = 0;
+
+  for (int start = 0; start < numRecs; start += COMPARE_BATCH) {
+
+    int numRows = numRecs - start < COMPARE_BATCH ? numRecs - start : COMPARE_BATCH;
+    for (int k = 0; k < numRows; k++)
+      rows[k] = start + k;
+
+    for (int i = 0; i < myComparison->numAnds && numRows > 0; i++) {
+
+      // an empty disjunction accepts everything, as it does for a single record
+      if (myComparison->orLens[i] == 0)
+        continue;
+
+      if (myComparison->orLens[i] == 1) {
+        RunBatch (recs, rows, numRows, lit_bits, &myComparison->orList[i][0], hits);
+        numRows = keepHits (rows, numRows, hits);
+        continue;
+      }
+
+      // a record passes a disjunction if any of its comparisons is true for it
+      memset (anyHits, 0, numRows);
+      for (int j = 0; j < myComparison->orLens[i]; j++) {
+        RunBatch (recs, rows, numRows, lit_bits, &myComparison->orList[i][j], hits);
+        for (int k = 0; k < numRows; k++)
+          anyHits[k] |= hits[k];
+      }
+      numRows = keepHits (rows, numRows, anyHits);
+    }
+
+    memcpy (selected + numSelected, rows, numRows * sizeof (int));
+    numSelected += numRows;
+  }
+
+  return numSelected;
+}
+
+
 // this is just like the last one, except that it deals with a pair of records
 int ComparisonEngine :: Compare (Record *left, Record *right, Record *literal, CNF *myComparison) {
 
@@ -202,30 +405,59 @@ int ComparisonEngine :: Compare (Record *left, Record *right, Record *literal, C
   return 1;
 }
 
+// This is an internal function used by the comparison engine. It compares the
+// strings val1 and val2, which are in the records bits1 and bits2. An equality with
+// a literal only has to check the literal's bytes, and fails at once if the other
+// string hasn't room for them
+int ComparisonEngine :: RunString (Comparison *c, char *bits1, char *val1, char *bits2, char *val2) {
+
+  if (c->op == Equals && c->litLength > 0) {
+    if (*val1 != *val2) // most strings are told apart by the first byte
+      return 0;
+    if (c->operand2 == Literal)
+      return StringCompare :: Equal (val1, StringCompare :: Bound (bits1, val1, c->whichAtt1, c->lastAtt1),
+                                     val2, c->litLength);
+    return StringCompare :: Equal (val2, StringCompare :: Bound (bits2, val2, c->whichAtt2, c->lastAtt2),
+                                   val1, c->litLength);
+  }
+
+  int len1 = StringCompare :: Bound (bits1, val1, c->whichAtt1, c->lastAtt1);
+  int len2 = StringCompare :: Bound (bits2, val2, c->whichAtt2, c->lastAtt2);
+  int result = StringCompare :: Compare (val1, len1, val2, len2);
+  switch (c->op) {
+
+    case LessThan:
+    return result < 0;
+
+    case GreaterThan:
+    return result > 0;
+
+    default:
+    return result == 0;
+  }
+}
+
 // This is an internal function used by the comparison engine
-int ComparisonEngine :: Run (Record *left, Record *literal, Comparison *c) {
+int ComparisonEngine :: Run (char *left_bits, char *lit_bits, Comparison *c) {
 
   char *val1, *val2;
 
-  char *left_bits = left->GetBits();
-  char *lit_bits = literal->GetBits();
-
   // first get a pointer to the first value to compare
   if (c->operand1 == Left) {
-    val1 = left_bits + ((int *) left_bits)[c->whichAtt1 + 1];
+    val1 = attStart (left_bits, c->whichAtt1, c->fixedOffset1);
   } else {
     val1 = lit_bits + ((int *) lit_bits)[c->whichAtt1 + 1];
   }
 
   // next get a pointer to the second value to compare
   if (c->operand2 == Left) {
-    val2 = left_bits + ((int *) left_bits)[c->whichAtt2 + 1];
+    val2 = attStart (left_bits, c->whichAtt2, c->fixedOffset2);
   } else {
     val2 = lit_bits + ((int *) lit_bits)[c->whichAtt2 + 1];
   }
 
 
-  int val1Int, val2Int, tempResult;
+  int val1Int, val2Int;
   double val1Double, val2Double;
 
   // now check the type and the comparison operation
@@ -278,24 +510,8 @@ int ComparisonEngine :: Run (Record *left, Record *literal, Comparison *c) {
 
     // final case: dealing with strings
     default:
-
-    // so check the operation type in order to actually do the comparison
-    tempResult = strcmp (val1, val2);
-    switch (c->op) {
-
-      case LessThan:
-      return tempResult < 0;
-      break;
-
-      case GreaterThan:
-      return tempResult > 0;
-      break;
-
-      default:
-      return tempResult == 0;
-      break;
-    }
-    break;
+    return RunString (c, c->operand1 == Left ? left_bits : lit_bits, val1,
+                      c->operand2 == Left ? left_bits : lit_bits, val2);
   }
 
 }
@@ -313,11 +529,11 @@ int ComparisonEngine :: Run (Record *left, Record *right, Record *literal, Compa
   switch (c->operand1) {
 
     case Left:
-    val1 = left_bits + ((int *) left_bits)[c->whichAtt1 + 1];
+    val1 = attStart (left_bits, c->whichAtt1, c->fixedOffset1);
     break;
 
     case Right:
-    val1 = right_bits + ((int *) right_bits)[c->whichAtt1 + 1];
+    val1 = attStart (right_bits, c->whichAtt1, c->fixedOffset1);
     break;
 
     default:
@@ -329,11 +545,11 @@ int ComparisonEngine :: Run (Record *left, Record *right, Record *literal, Compa
   switch (c->operand2) {
 
     case Left:
-    val2 = left_bits + ((int *) left_bits)[c->whichAtt2 + 1];
+    val2 = attStart (left_bits, c->whichAtt2, c->fixedOffset2);
     break;
 
     case Right:
-    val2 = right_bits + ((int *) right_bits)[c->whichAtt2 + 1];
+    val2 = attStart (right_bits, c->whichAtt2, c->fixedOffset2);
     break;
 
     default:
@@ -342,7 +558,7 @@ int ComparisonEngine :: Run (Record *left, Record *right, Record *literal, Compa
 
   }
 
-  int val1Int, val2Int, tempResult;
+  int val1Int, val2Int;
   double val1Double, val2Double;
 
   // now check the type and the comparison operation
@@ -395,24 +611,8 @@ int ComparisonEngine :: Run (Record *left, Record *right, Record *literal, Compa
 
     // final case: dealing with strings
     default:
-
-    // so check the operation type in order to actually do the comparison
-    tempResult = strcmp (val1, val2);
-    switch (c->op) {
-
-      case LessThan:
-      return tempResult < 0;
-      break;
-
-      case GreaterThan:
-      return tempResult > 0;
-      break;
-
-      default:
-      return tempResult == 0;
-      break;
-    }
-    break;
+    return RunString (c, c->operand1 == Left ? left_bits : (c->operand1 == Right ? right_bits : lit_bits), val1,
+                      c->operand2 == Left ? left_bits : (c->operand2 == Right ? right_bits : lit_bits), val2);
   }
 
 }
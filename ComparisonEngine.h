@@ -13,12 +13,16 @@ class Comparison;
 class OrderMaker;
 class CNF;
 
+#define COMPARE_BATCH 1024 // records the batch Compare evaluates a comparison over at a time
+
 class ComparisonEngine {
 
 private:
 
-  int Run(Record *left, Record *literal, Comparison *c);
+  int Run(char *left_bits, char *lit_bits, Comparison *c);
+  void RunBatch(char **recs, int *rows, int numRows, char *lit_bits, Comparison *c, unsigned char *hits);
   int Run(Record *left, Record *right, Record *literal, Comparison *c);
+  int RunString(Comparison *c, char *bits1, char *val1, char *bits2, char *val2);
 
 public:
 
@@ -32,11 +36,18 @@ public:
   // when both of the records come from the SAME RELATION
   int Compare(Record *left, Record *right, OrderMaker *orderUs);
 
+  // same, but on the bits of two records that need not be in Record objects.
+  // Added for BigQ, which sorts records packed into one buffer
+  int Compare(char *left, char *right, OrderMaker *orderUs);
+
   // similar to the last function, except that this one works in the
   // case where the two records come from different input relations
   // it is used to do sorts for a sort-merge join
   int Compare(Record *left, OrderMaker *order_left, Record *right, OrderMaker *order_right);
 
+  // same, on the bits of the two records. Added for KeyComparator
+  int Compare(char *left, OrderMaker *order_left, char *right, OrderMaker *order_right);
+
   // this applies the given CNF to the three records and either
   // accepts the records or rejects them.
   // It is is for binary operations such as join.  Returns
@@ -46,6 +57,14 @@ public:
   // like the last one, but for unary operations
   int Compare(Record *left, Record *literal, CNF *myComparison);
 
+  // the same CNF over numRecs records at once, given by their bits. The positions
+  // (in recs) of the records it accepts are written to selected, in order, and
+  // their number is returned. Each comparison is evaluated only over the records
+  // that passed the ones before, an Int or Double attribute against a literal by
+  // gathering the attribute into an array and comparing several values at a time.
+  // Added for SelectFile and SelectPipe
+  int Compare(char **recs, int numRecs, Record *literal, CNF *myComparison, int *selected);
+
 
 };
 
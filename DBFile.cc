@@ -17,6 +17,7 @@
 #include "Sorted.h" // important to keep this line here and not in DBFile.h otherwise
                   // you end up with circular dependencies because Sorted.h, in turn,
                   // includes DBFile.h
+#include "Tree.h"
 #include <fstream>
 #include <istream>
 
@@ -60,6 +61,11 @@ int DBFile :: Create (char *f_path, fType f_type, void *startup) {
    * This indicates we sorted
    * - first on attribute 0 of this relation, which was a String
    * - second on attribute 3 of this relation which was an Int
+   *
+   * format for tree: same as sorted (with "tree" on the first line), followed by
+   *   root page number (-1 for an empty tree)
+   *   height of the tree
+   * Tree.Close rewrites the last two lines every time the file is closed.
    */
   char metafilepath[100];
   sprintf(metafilepath, "%s.meta", f_path);
@@ -105,6 +111,25 @@ int DBFile :: Create (char *f_path, fType f_type, void *startup) {
       break;
     }
     case(tree):{
+      // write file type, runlen and ordermaker to meta file, as for sorted.
+      // the tree starts off empty
+      typedef struct {OrderMaker *o; int l;} temp;
+      temp* tempvar = (temp*) startup;
+      char printedOrder[1000]; // used to write order to meta file
+      tempvar->o->PrinttoString(printedOrder);
+      if (myfile.is_open())
+      {
+        myfile << "tree" << endl;
+        myfile << tempvar->l << endl;
+        myfile << printedOrder << endl;
+        myfile << -1 << endl; // root page
+        myfile << 0 << endl;  // height
+        myfile.close();
+      }
+      else cerr << "Unable to open file " << metafilepath << " for writing." << endl;
+
+      myInternalVar = new Tree();
+      retval = myInternalVar->Create(f_path,f_type,startup);
       break;
     }
   }
@@ -136,6 +161,7 @@ int DBFile :: Open (char *f_path) {
     myInternalVar = new Sorted();
   }
   else if(ftype.compare("tree")==0){
+    myInternalVar = new Tree();
   }
   return myInternalVar->Open(f_path);
 }
@@ -190,6 +216,14 @@ int DBFile :: GetNext (Record &fetchme, CNF &cnf, Record &literal) {
   return myInternalVar->GetNext(fetchme,cnf,literal);
 }
 
+/*------------------------------------------------------------------------------
+ * READ the rest of the records a page at a time, in their binary form. Returns
+ * -1 for files that don't do this (see GenericDBFile.GetNextPage).
+ *----------------------------------------------------------------------------*/
+int DBFile :: GetNextPage (char *bits) {
+  return myInternalVar->GetNextPage(bits);
+}
+
 /*------------------------------------------------------------------------------
  * Correct the length returned by File->GetLength which adds 1 to the actual
  * number of pages of records for the one page of metadata at the beginning.
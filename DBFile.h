@@ -27,6 +27,7 @@ public:
   void Add (Record &addme);
   int GetNext (Record &fetchme);
   int GetNext (Record &fetchme, CNF &cnf, Record &literal);
+  int GetNextPage (char *bits);
 
   int GetNumofRecordPages();
 
@@ -7,6 +7,39 @@
 #include <string.h>
 #include <iostream>
 #include <stdlib.h>
+#include <time.h>
+
+__thread ExecCounters* threadCounters = NULL;
+
+/*------------------------------------------------------------------------------
+ * Execution counters (see File.h)
+ *----------------------------------------------------------------------------*/
+void CountMemory (long delta) {
+  if (threadCounters == NULL) return;
+  long now = __sync_add_and_fetch (&threadCounters->memory, delta);
+  long peak = threadCounters->peakMemory;
+  while (now > peak) { // raise the peak unless another thread beat us to it
+    long seen = __sync_val_compare_and_swap (&threadCounters->peakMemory, peak, now);
+    if (seen == peak) break;
+    peak = seen;
+  }
+}
+
+void CountCPU (long nanos) {
+  if (threadCounters != NULL) __sync_fetch_and_add (&threadCounters->cpuNanos, nanos);
+}
+
+long ThreadCPUNanos () {
+  struct timespec ts;
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+long WallNanos () {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
 
 
 
@@ -185,12 +218,46 @@ void File :: GetPage (Page *putItHere, off_t whichPage) {
   read (myFilDes, bits, PAGE_SIZE);
   putItHere->FromBinary (bits);
   delete [] bits;
+  if (threadCounters != NULL) __sync_fetch_and_add (&threadCounters->pagesRead, 1);
+
+}
+
+
+void File :: GetPageBits (char *bits, off_t whichPage) {
+
+  // this is because the first page has no data
+  whichPage++;
+
+  if (whichPage >= curLength) {
+    cerr << "whichPage " << whichPage << " length " << curLength << endl;
+    cerr << "BAD: you tried to read past the end of the file\n";
+    exit (1);
+  }
+
+  lseek (myFilDes, PAGE_SIZE * whichPage, SEEK_SET);
+  read (myFilDes, bits, PAGE_SIZE);
+  if (threadCounters != NULL) __sync_fetch_and_add (&threadCounters->pagesRead, 1);
 
 }
 
 
 void File :: AddPage (Page *addMe, off_t whichPage) {
 
+  char *bits = new (std::nothrow) char[PAGE_SIZE];
+  if (bits == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+
+  addMe->ToBinary (bits);
+  AddPageBits (bits, whichPage);
+  delete [] bits;
+}
+
+
+void File :: AddPageBits (char *bits, off_t whichPage) {
+
   // cout << "bloh" << endl;
   // this is because the first page has no data
   whichPage++;
@@ -213,17 +280,9 @@ void File :: AddPage (Page *addMe, off_t whichPage) {
   }
 
   // now write the page
-  char *bits = new (std::nothrow) char[PAGE_SIZE];
-  if (bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
-
-  addMe->ToBinary (bits);
   lseek (myFilDes, PAGE_SIZE * whichPage, SEEK_SET);
   write (myFilDes, bits, PAGE_SIZE);
-  delete [] bits;
+  if (threadCounters != NULL) __sync_fetch_and_add (&threadCounters->pagesWritten, 1);
 #ifdef F_DEBUG
   cerr << " File: curLength " << curLength << " whichPage " << whichPage << endl;
 #endif
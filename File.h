@@ -12,6 +12,37 @@ class Record;
 
 using namespace std;
 
+// What the threads of one relational operation did, for EXPLAIN ANALYZE. An
+// operation points threadCounters at its counters in each of its threads (and
+// BigQ passes the pointer on to its worker); File then counts every page read or
+// written by that thread. Several threads of one operation may share the counters,
+// so they are only ever updated with the atomic helpers below
+struct ExecCounters {
+  long pagesRead;
+  long pagesWritten;
+  long memory;     // bytes of record buffers the operation holds right now
+  long peakMemory; // most it ever held
+  long cpuNanos;   // CPU time of all of the operation's threads
+  long wallNanos;  // from the start to the end of the operation's main thread
+
+  ExecCounters () : pagesRead (0), pagesWritten (0), memory (0), peakMemory (0), cpuNanos (0), wallNanos (0) {}
+};
+
+// counters of the operation the calling thread works for; NULL outside of operations
+extern __thread ExecCounters* threadCounters;
+
+// add delta (may be negative) to the memory held by the calling thread's operation
+void CountMemory (long delta);
+
+// add nanos to the CPU time of the calling thread's operation
+void CountCPU (long nanos);
+
+// CPU time used so far by the calling thread, in nanoseconds
+long ThreadCPUNanos ();
+
+// nanoseconds on a monotonic clock
+long WallNanos ();
+
 class Page {
 private:
   TwoWayList <Record> *myRecs;
@@ -69,11 +100,19 @@ public:
   // allows someone to explicitly get a specified page from the file
   void GetPage (Page *putItHere, off_t whichPage);
 
+  // same, but the page is left in its binary form in bits (PAGE_SIZE bytes laid out
+  // the way Page.ToBinary does it)
+  void GetPageBits (char *bits, off_t whichPage);
+
   // allows someone to explicitly write a specified page to the file
   // if the write is past the end of the file, all of the new pages that
   // are before the page to be written are zeroed out
   void AddPage (Page *addMe, off_t whichPage);
 
+  // same as AddPage, but for a page that is already in its binary form (PAGE_SIZE
+  // bytes laid out the way Page.ToBinary does it)
+  void AddPageBits (char *bits, off_t whichPage);
+
   // closes the file and returns the file length (in number of pages)
   int Close ();
 
@@ -64,6 +64,7 @@ Type Function :: RecursivelyBuild (struct FuncOperator *parseTree, Schema &mySch
 
         opList[numOps].myOp = PushInt;
         opList[numOps].recInput = myNum;
+        opList[numOps].recOffset = mySchema.GetFixedOffset (myNum);
         opList[numOps].litInput = 0;
         numOps++;
         return Int;
@@ -73,6 +74,7 @@ Type Function :: RecursivelyBuild (struct FuncOperator *parseTree, Schema &mySch
 
         opList[numOps].myOp = PushDouble;
         opList[numOps].recInput = myNum;
+        opList[numOps].recOffset = mySchema.GetFixedOffset (myNum);
         opList[numOps].litInput = 0;
         numOps++;
         return Double;
@@ -84,6 +86,7 @@ Type Function :: RecursivelyBuild (struct FuncOperator *parseTree, Schema &mySch
         // we were given a literal integer value!
         opList[numOps].myOp = PushInt;
         opList[numOps].recInput = -1;
+        opList[numOps].recOffset = -1;
         opList[numOps].litInput = (void *) (new int);
         *((int *) opList[numOps].litInput) = atoi (parseTree->leftOperand->value);
         numOps++;
@@ -93,6 +96,7 @@ Type Function :: RecursivelyBuild (struct FuncOperator *parseTree, Schema &mySch
 
         opList[numOps].myOp = PushDouble;
         opList[numOps].recInput = -1;
+        opList[numOps].recOffset = -1;
         opList[numOps].litInput = (void *) (new double);
         *((double *) opList[numOps].litInput) = atof (parseTree->leftOperand->value);
         numOps++;
@@ -275,7 +279,8 @@ Type Function :: Apply (Record &toMe, int &intResult, double &doubleResult) {
 
         // see if we need to get the int from the record
         if (opList[i].recInput >= 0) {
-          int pointer = ((int *) toMe.bits)[opList[i].recInput + 1];
+          int pointer = opList[i].recOffset;
+          if (pointer < 0) pointer = ((int *) toMe.bits)[opList[i].recInput + 1];
           *((int *) lastPos) = *((int *) &(bits[pointer]));
 
         // or from the literal value
@@ -291,7 +296,8 @@ Type Function :: Apply (Record &toMe, int &intResult, double &doubleResult) {
 
         // see if we need to get the int from the record
         if (opList[i].recInput >= 0) {
-          int pointer = ((int *) toMe.bits)[opList[i].recInput + 1];
+          int pointer = opList[i].recOffset;
+          if (pointer < 0) pointer = ((int *) toMe.bits)[opList[i].recInput + 1];
           *((double *) lastPos) = *((double *) &(bits[pointer]));
 
         // or from the literal value
@@ -14,6 +14,7 @@ struct Arithmatic {
 
   ArithOp myOp;
   int recInput;
+  int recOffset; // where recInput starts in every record (Schema::GetFixedOffset), or -1
   void *litInput;
 };
 
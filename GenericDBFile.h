@@ -32,6 +32,13 @@ class GenericDBFile {
     // return next record that satisfies CNF. literal is used to check cnf; return 0 if no record present.
     virtual int GetNext (Record &fetchme, CNF &cnf, Record &literal) = 0;
 
+    // put the records GetNext has yet to return, up to the end of the page they are on,
+    // into bits (laid out the way Page.ToBinary does it) and move on to the next page.
+    // Return 0 if no record present, or -1 if this kind of file doesn't hand out pages
+    // and GetNext has to be used. Added for SelectFile, which applies its CNF to a page
+    // of records at a time
+    virtual int GetNextPage (char *bits) { return -1; }
+
     // creates file using File class. fpath is path to file, file_type is {heap|sorted|tree}, startup used only in assignment 2; return 1 on success and 0 on failure
     virtual int Create (char *fpath, fType file_type, void *startup) = 0;
 
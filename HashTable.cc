@@ -0,0 +1,237 @@
+/*******************************************************************************
+ * File: HashTable.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "HashTable.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+// bytes an entry takes besides its record: the Record, and its place in every vector
+#define ENTRY_OVERHEAD (sizeof (Record) + sizeof (Record*) + sizeof (unsigned long long) + 2 * sizeof (int))
+
+static inline unsigned long long rotl (unsigned long long x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// fold the 8 bytes of w into h (the body of MurmurHash3's 64 bit lanes)
+static inline unsigned long long mixWord (unsigned long long h, unsigned long long w) {
+  w *= 0x87c37b91114253d5ULL;
+  w = rotl (w, 31);
+  w *= 0x4cf5ad432745937fULL;
+  h ^= w;
+  h = rotl (h, 27);
+  return h * 5 + 0x52dce729;
+}
+
+// make every bit of the result depend on every bit of h
+static inline unsigned long long finish (unsigned long long h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline unsigned int tagOf (unsigned long long hash) {
+  unsigned int tag = (unsigned int) (hash >> 32);
+  return (tag == 0) ? 1 : tag;
+}
+
+/*------------------------------------------------------------------------------
+ * Constructors and destructor
+ *----------------------------------------------------------------------------*/
+HashTable :: HashTable (OrderMaker &buildOrder) {
+  this->buildOrder = buildOrder;
+  this->probeOrder = buildOrder;
+  Init ();
+}
+
+HashTable :: HashTable (OrderMaker &buildOrder, OrderMaker &probeOrder) {
+  this->buildOrder = buildOrder;
+  this->probeOrder = probeOrder;
+  Init ();
+}
+
+// the comparators point at the table's own OrderMakers, so they are made once those are set
+void HashTable :: Init () {
+  sameKey = buildOrder.GetComparator ();
+  probeKey = buildOrder.GetComparator (probeOrder);
+  slots = (Slot *) calloc (HASH_MIN_SLOTS, sizeof (Slot));
+  if (slots == NULL) {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit (1);
+  }
+  mask = HASH_MIN_SLOTS - 1;
+  numKeys = 0;
+  bytes = HASH_MIN_SLOTS * sizeof (Slot);
+  CountMemory (bytes);
+}
+
+HashTable :: ~HashTable () {
+  Clear ();
+  free (slots);
+  CountMemory (-bytes);
+}
+
+/*------------------------------------------------------------------------------
+ * Hash the attributes of bits listed in order, a word at a time. Ints and
+ * doubles are one word each (-0.0 as 0.0, since they compare equal), and strings
+ * as many as their characters take, the last one padded with zeros, followed by
+ * their length. The padding after the null of a string is never looked at
+ *----------------------------------------------------------------------------*/
+unsigned long long HashTable :: Hash (char *bits, OrderMaker *order) {
+  unsigned long long h = HASH_SEED;
+  int* whichAtts = order->getWhichAtts ();
+  Type* whichTypes = order->getWhichTypes ();
+  int numAtts = order->getNumAtts ();
+  for (int i = 0; i < numAtts; i++) {
+    char* val = bits + ((int *) bits)[whichAtts[i] + 1];
+    unsigned long long w = 0;
+    switch (whichTypes[i]) {
+      case Int:
+        w = (unsigned int) *((int *) val);
+        h = mixWord (h, w);
+        break;
+      case Double: {
+        double d = *((double *) val);
+        if (d == 0.0) d = 0.0;
+        memcpy (&w, &d, sizeof (double));
+        h = mixWord (h, w);
+        break;
+      }
+      case String: {
+        int len = strlen (val);
+        int j = 0;
+        for (; j + 8 <= len; j += 8) {
+          memcpy (&w, val + j, 8);
+          h = mixWord (h, w);
+        }
+        w = 0;
+        memcpy (&w, val + j, len - j);
+        h = mixWord (h, w);
+        h = mixWord (h, len);
+        break;
+      }
+    }
+  }
+  return finish (h ^ numAtts);
+}
+
+/*------------------------------------------------------------------------------
+ * Walk the slots from where the hash points, past the ones of other keys. A key
+ * is only compared when the top bits of its hash are those of the slot
+ *----------------------------------------------------------------------------*/
+inline unsigned long long HashTable :: Probe (char *bits, unsigned long long hash, KeyComparator &cmp) {
+  unsigned int tag = tagOf (hash);
+  unsigned long long i = hash & mask;
+  while (slots[i].tag != 0) {
+    if (slots[i].tag == tag && cmp.Compare (entries[slots[i].entry]->bits, bits) == 0)
+      return i;
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+/*------------------------------------------------------------------------------
+ * Add rec as an entry, at the end of the chain of the key in slot, or as the first
+ * one of its key if the slot is empty
+ *----------------------------------------------------------------------------*/
+int HashTable :: Add (Record *rec, unsigned long long hash, unsigned long long slot) {
+  int entry = entries.size ();
+  Record* copy = new Record;
+  copy->Consume (rec);
+  long size = ((int *) copy->bits)[0] + ENTRY_OVERHEAD;
+  entries.push_back (copy);
+  hashes.push_back (hash);
+  nextSame.push_back (-1);
+  lastSame.push_back (entry);
+  bytes += size;
+  CountMemory (size);
+
+  if (slots[slot].tag != 0) { // another entry with the key
+    int first = slots[slot].entry;
+    nextSame[lastSame[first]] = entry;
+    lastSame[first] = entry;
+    return entry;
+  }
+  slots[slot].tag = tagOf (hash);
+  slots[slot].entry = entry;
+  numKeys++;
+  if (numKeys > (mask + 1) * HASH_MAX_LOAD)
+    Grow ();
+  return entry;
+}
+
+int HashTable :: Insert (Record *rec) {
+  unsigned long long hash = Hash (rec->bits, &buildOrder);
+  return Add (rec, hash, Probe (rec->bits, hash, sameKey));
+}
+
+int HashTable :: FindOrInsert (Record *rec, bool &inserted) {
+  unsigned long long hash = Hash (rec->bits, &buildOrder);
+  unsigned long long slot = Probe (rec->bits, hash, sameKey);
+  inserted = (slots[slot].tag == 0);
+  if (!inserted)
+    return slots[slot].entry;
+  return Add (rec, hash, slot);
+}
+
+int HashTable :: Find (Record *probe) {
+  unsigned long long hash = Hash (probe->bits, &probeOrder);
+  unsigned long long slot = Probe (probe->bits, hash, probeKey);
+  return (slots[slot].tag == 0) ? -1 : slots[slot].entry;
+}
+
+/*------------------------------------------------------------------------------
+ * Double the slots. The first entry of every key goes where its hash points in
+ * the new slots; the keys are known to be distinct, so none is compared
+ *----------------------------------------------------------------------------*/
+void HashTable :: Grow () {
+  unsigned long long numSlots = (mask + 1) * 2;
+  Slot* grown = (Slot *) calloc (numSlots, sizeof (Slot));
+  if (grown == NULL) {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit (1);
+  }
+  unsigned long long newMask = numSlots - 1;
+  for (unsigned long long s = 0; s <= mask; s++) {
+    if (slots[s].tag == 0)
+      continue;
+    unsigned long long i = hashes[slots[s].entry] & newMask;
+    while (grown[i].tag != 0)
+      i = (i + 1) & newMask;
+    grown[i] = slots[s];
+  }
+  free (slots);
+  slots = grown;
+  CountMemory ((numSlots / 2) * sizeof (Slot));
+  bytes += (numSlots / 2) * sizeof (Slot);
+  mask = newMask;
+}
+
+/*------------------------------------------------------------------------------
+ * Take out every entry. The slots stay as big as they have grown
+ *----------------------------------------------------------------------------*/
+void HashTable :: Clear () {
+  long entryBytes = 0;
+  for (int i = 0; i < entries.size (); i++) {
+    entryBytes += ((int *) entries[i]->bits)[0] + ENTRY_OVERHEAD;
+    delete entries[i];
+  }
+  entries.clear ();
+  hashes.clear ();
+  nextSame.clear ();
+  lastSame.clear ();
+  memset (slots, 0, (mask + 1) * sizeof (Slot));
+  numKeys = 0;
+  bytes -= entryBytes;
+  CountMemory (-entryBytes);
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
@@ -0,0 +1,106 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include "Record.h"
+#include "Comparison.h"
+#include <vector>
+
+using namespace std;
+
+#define HASH_MIN_SLOTS 1024 // slots of a new table; always a power of two
+#define HASH_MAX_LOAD 0.5   // the slots double when more than this share of them is taken
+
+// Hash table of records, keyed by the attributes an OrderMaker lists. Added so that
+// joins, GroupBy, DuplicateRemoval, distinct counts and semi-join filters can all
+// find records by key without sorting, through one table instead of one of their own.
+//
+// The table owns the records put into it (its entries), numbered in the order they
+// came. Entries with the same key form a chain, in that order: Insert adds to the
+// chain of its key, as the build side of a join wants, and FindOrInsert only adds a
+// record whose key isn't there yet, as a group by or a duplicate removal wants.
+// Records of another relation can be looked up with Find, on the attributes of their
+// own OrderMaker, paired up with those of the table's the way GetSortOrders does.
+//
+// The slots are open addressed and probed one after the other. Every slot holds the
+// top bits of the hash of its key next to its entry, so a probe only looks at a
+// record whose hash matches, and walks through memory that is one slot after the
+// other. The keys are hashed a word at a time over their bytes. The memory the table
+// takes, its slots and the records it owns, is counted with CountMemory towards
+// the operation that uses it, and Bytes tells how much it is.
+class HashTable {
+  private:
+    struct Slot {
+      unsigned int tag; // top 32 bits of the hash of the key; 0 if the slot is empty
+      int entry;        // first entry with the key
+    };
+
+    Slot* slots;
+    unsigned long long mask;  // number of slots - 1
+    long numKeys;             // slots taken
+    long bytes;               // memory counted with CountMemory
+
+    OrderMaker buildOrder;    // attributes of the key in the entries
+    OrderMaker probeOrder;    // and in the records given to Find
+    KeyComparator sameKey;    // entries against records of buildOrder
+    KeyComparator probeKey;   // entries against records of probeOrder
+
+    vector<Record*> entries;
+    vector<unsigned long long> hashes; // of the key of every entry, for growing
+    vector<int> nextSame;     // next entry with the same key, or -1
+    vector<int> lastSame;     // for the first entry of a chain, the last one
+
+    void Init ();
+
+    // the slot of the key of bits (hashed to hash) compared with cmp, or the empty
+    // slot where it would go
+    inline unsigned long long Probe (char *bits, unsigned long long hash, KeyComparator &cmp);
+
+    // add rec as an entry; slot is where Probe found its key or an empty slot
+    int Add (Record *rec, unsigned long long hash, unsigned long long slot);
+
+    // double the slots and put the keys back in
+    void Grow ();
+
+  public:
+    // a table keyed by the attributes of buildOrder, looked up by the same ones
+    HashTable (OrderMaker &buildOrder);
+
+    // a table keyed by the attributes of buildOrder, looked up with Find by those
+    // of probeOrder in records of another relation
+    HashTable (OrderMaker &buildOrder, OrderMaker &probeOrder);
+
+    ~HashTable ();
+
+    // hash the attributes of bits listed in order. Keys that ComparisonEngine finds
+    // equal hash alike, whichever relation and OrderMaker they come from
+    static unsigned long long Hash (char *bits, OrderMaker *order);
+
+    // add rec (consumed) as the last entry with its key. Returns its number
+    int Insert (Record *rec);
+
+    // the first entry with the key of rec. If there is none, rec (consumed) becomes
+    // it and inserted is set
+    int FindOrInsert (Record *rec, bool &inserted);
+
+    // the first entry with the key of probe, a record of probeOrder, or -1
+    int Find (Record *probe);
+
+    // the entry after entry with the same key, or -1
+    int Next (int entry) { return nextSame[entry]; }
+
+    // the record of entry, which stays the table's
+    Record* Entry (int entry) { return entries[entry]; }
+
+    long NumEntries () { return entries.size (); }
+
+    // distinct keys in the table
+    long NumKeys () { return numKeys; }
+
+    // memory the table takes, in bytes
+    long Bytes () { return bytes; }
+
+    // take out every entry
+    void Clear ();
+};
+
+#endif
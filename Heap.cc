@@ -13,6 +13,10 @@
 #include "Heap.h"
 #include <algorithm>
 #include <vector>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 // comparison function used by binary search
 bool binarySearchCompare (Record* left,Record* right);
@@ -136,6 +140,27 @@ int Heap :: GetNext (Record &fetchme) {
     return 1; // we fetched a record successfully
 }
 
+/*------------------------------------------------------------------------------
+ * READ the rest of the records a page at a time, in their binary form. First what
+ * is left in the buffer, then the following pages straight from the file, without
+ * making Records of them. The buffer is left empty, so a GetNext after this starts
+ * on the page after the one returned.
+ *----------------------------------------------------------------------------*/
+int Heap :: GetNextPage (char *bits) {
+  WritePageIfDirty();
+  currPage->ToBinary(bits);
+  if(((int *) bits)[0] > 0){   // records were left in the buffer
+    currPage->EmptyItOut();
+    return 1;
+  }
+  if(currPageNo < GetNumofRecordPages()-1){
+    currPageNo++;
+    currFile->GetPageBits(bits,currPageNo);
+    return 1;
+  }
+  return 0; // we've gone past the end of the file.
+}
+
 /*------------------------------------------------------------------------------
  * READ one page worth of data from file relative to pointer.
  * We assume that the File object has already been created (either from Load
@@ -314,6 +339,24 @@ bool Heap :: BinarySearch(Record& fetchme,OrderMaker& leftOrder,Record& literal,
   if(retval==2) return false;
 }
 
+/*------------------------------------------------------------------------------
+ * Position the pointer at the start of page pageNo. Any dirty page is written
+ * out first so that it is counted as a page of the file. If pageNo is past the
+ * end of the file, the pointer is left at the end (GetNext returns 0).
+ * Added for the fence index in Sorted.
+ *----------------------------------------------------------------------------*/
+void Heap :: MoveToPage(int pageNo){
+  WritePageIfDirty();
+  if(pageNo < GetNumofRecordPages()){
+    currPageNo = pageNo;
+    currFile->GetPage(currPage,currPageNo);
+  }
+  else{
+    currPageNo = GetNumofRecordPages();
+    currPage->EmptyItOut();
+  }
+}
+
 /*------------------------------------------------------------------------------
  * Add new record to end of file; consumes addme after it is added so it can't
  * be reused (done in Page.Append())
@@ -340,7 +383,8 @@ void Heap :: Add (Record &addme) {
     // the record is not consumed unless successfully added
     currPage->EmptyItOut();
     currPage->Append(&addme);
-    PAGEDIRTIED = false;                         // reset dirty flag // Added after a2. This was an omission in my a1 submission neeraj
+    PAGEDIRTIED = true;                          // the new page holds addme, which is not on disk yet
+                                                 // (Close would otherwise drop it if it is the last record)
   }
   else{ // 1 indicates that the record is saved to the end of the page AND we
         // still have space left on the page. However, the page is now dirty and
@@ -366,30 +410,170 @@ int Heap :: Create (char *f_path, fType f_type, void *startup) {
  *----------------------------------------------------------------------------*/
 void Heap :: MoveFirst () {
   currFile->GetPage(currPage,0);
+  currPageNo = 0;
 }
 
+typedef struct{
+  char* start;          // text of the chunk
+  char* end;
+  vector<char*> pages;  // binary pages parsed out of the chunk, in order
+  bool done;
+} loadChunk; // one piece of the text file handled by Heap.Load
+
+typedef struct{
+  Schema* schema;
+  vector<loadChunk>* chunks;
+  int nextChunk;        // next chunk a thread should parse
+  int chunksWritten;    // chunks whose pages are already in the file
+  int window;           // threads don't start on a chunk more than window chunks ahead of the writer
+  pthread_mutex_t mutex;
+  pthread_cond_t chunkDone;    // signalled when a thread finishes a chunk
+  pthread_cond_t chunkWritten; // signalled when the writer finishes a chunk
+} loadUtil; // struct shared by the threads of Heap.Load
+
 /*------------------------------------------------------------------------------
- * Bulk load data from file at loadpath
- * This operation canNOT be interrupted!!!
+ * Thread routine of Heap.Load. Takes chunks in order and parses each into full
+ * binary pages. A record is built in recSpace and copied onto the page; a new page
+ * is started when it doesn't fit.
  *----------------------------------------------------------------------------*/
-void Heap :: Load (Schema &f_schema, char *loadpath) {
-  Record tempRecord;
+void* loadRoutine(void* ptr){
+  loadUtil* myT = (loadUtil*) ptr;
+  char* recSpace = new (std::nothrow) char[PAGE_SIZE];
+  if (recSpace == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
 
-  FILE* tempFile = fopen(loadpath, "r");
-  if(tempFile==NULL){
+  while(true){
+    pthread_mutex_lock(&myT->mutex);
+    while(myT->nextChunk < (int) myT->chunks->size() && myT->nextChunk >= myT->chunksWritten + myT->window)
+      pthread_cond_wait(&myT->chunkWritten,&myT->mutex); // don't run too far ahead of the writer
+    if(myT->nextChunk >= (int) myT->chunks->size()){
+      pthread_mutex_unlock(&myT->mutex);
+      break;
+    }
+    loadChunk* chunk = &(myT->chunks->at(myT->nextChunk++));
+    pthread_mutex_unlock(&myT->mutex);
+
+    char* pos = chunk->start;
+    char* page = NULL;
+    int pageUsed = 0;  // bytes used on page, including the record count
+    int len;
+    while((len = Record::ParseNextRecord(myT->schema,pos,chunk->end,recSpace)) != 0){
+      if(page == NULL || pageUsed + len > PAGE_SIZE){ // same test as Page.Append
+        page = new (std::nothrow) char[PAGE_SIZE];
+        if (page == NULL)
+        {
+          cout << "ERROR : Not enough memory. EXIT !!!\n";
+          exit(1);
+        }
+        ((int *) page)[0] = 0;
+        pageUsed = sizeof (int);
+        chunk->pages.push_back(page);
+      }
+      memcpy(page + pageUsed, recSpace, len);
+      pageUsed += len;
+      ((int *) page)[0]++;
+    }
+
+    pthread_mutex_lock(&myT->mutex);
+    chunk->done = true;
+    pthread_cond_broadcast(&myT->chunkDone);
+    pthread_mutex_unlock(&myT->mutex);
+  }
+  delete [] recSpace;
+  return NULL;
+}
+
+/*------------------------------------------------------------------------------
+ * Bulk load from a text file. Cut the mapped file into chunks of about
+ * LOAD_CHUNK_SIZE bytes at line breaks, let up to LOAD_MAX_THREADS threads parse
+ * them into pages and append the pages to the file in chunk order from this thread.
+ *----------------------------------------------------------------------------*/
+void Heap :: Load (Schema &f_schema, char *loadpath) {
+  int fd = open(loadpath, O_RDONLY);
+  if(fd < 0){
     cerr << "ERROR: File " << loadpath << " not found. EXIT !!!\n" << endl;
     exit(1);
   }
-  else{
-    while(tempRecord.SuckNextRecord (&f_schema, tempFile) == 1){
-      Add(tempRecord); // if we exceed a page worth of data, Add() will
-                       // automatically write it to disk via
-                       // File.AddPage(), empty the page and continue
-                       // adding data to it.
+  WritePageIfDirty(); // records Add-ed before the load come first
+  struct stat st;
+  fstat(fd, &st);
+  if(st.st_size == 0){
+    close(fd);
+    return;
+  }
+  char* text = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(text == MAP_FAILED){
+    cerr << "ERROR: Could not map file " << loadpath << ". EXIT !!!\n" << endl;
+    exit(1);
+  }
+  madvise(text, st.st_size, MADV_SEQUENTIAL);
+  char* textEnd = text + st.st_size;
+
+  vector<loadChunk> chunks;
+  char* pos = text;
+  while(pos < textEnd){
+    loadChunk chunk;
+    chunk.start = pos;
+    chunk.done = false;
+    if(textEnd - pos <= LOAD_CHUNK_SIZE) pos = textEnd;
+    else{
+      char* lineEnd = (char*) memchr(pos + LOAD_CHUNK_SIZE, '\n', textEnd - pos - LOAD_CHUNK_SIZE);
+      pos = (lineEnd == NULL) ? textEnd : lineEnd + 1;
+    }
+    chunk.end = pos;
+    chunks.push_back(chunk);
+  }
+
+  int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(numThreads > LOAD_MAX_THREADS) numThreads = LOAD_MAX_THREADS;
+  if(numThreads > (int) chunks.size()) numThreads = chunks.size();
+  if(numThreads < 1) numThreads = 1;
+
+  loadUtil* t = new loadUtil;
+  t->schema = &f_schema;
+  t->chunks = &chunks;
+  t->nextChunk = 0;
+  t->chunksWritten = 0;
+  t->window = LOAD_WINDOW * numThreads;
+  pthread_mutex_init(&t->mutex, NULL);
+  pthread_cond_init(&t->chunkDone, NULL);
+  pthread_cond_init(&t->chunkWritten, NULL);
+  vector<pthread_t> threads(numThreads);
+  for(int i=0;i<numThreads;i++){
+    pthread_create(&threads[i],NULL,loadRoutine,(void*)t);
+  }
+
+  // write the pages in order as the chunks get done
+  for(size_t i=0;i<chunks.size();i++){
+    pthread_mutex_lock(&t->mutex);
+    while(!chunks[i].done)
+      pthread_cond_wait(&t->chunkDone,&t->mutex);
+    pthread_mutex_unlock(&t->mutex);
+
+    for(size_t j=0;j<chunks[i].pages.size();j++){
+      currFile->AddPageBits(chunks[i].pages[j],GetNumofRecordPages());
+      delete [] chunks[i].pages[j];
     }
-    WritePageIfDirty();
-    fclose(tempFile);
+
+    pthread_mutex_lock(&t->mutex);
+    t->chunksWritten++;
+    pthread_cond_broadcast(&t->chunkWritten);
+    pthread_mutex_unlock(&t->mutex);
+  }
+
+  for(int i=0;i<numThreads;i++){
+    pthread_join(threads[i],NULL);
   }
+  pthread_mutex_destroy(&t->mutex);
+  pthread_cond_destroy(&t->chunkDone);
+  pthread_cond_destroy(&t->chunkWritten);
+  delete t;
+  munmap(text, st.st_size);
+  close(fd);
+  currPageNo = GetNumofRecordPages(); // same state WritePageIfDirty leaves us in
 }
 
 /*------------------------------------------------------------------------------
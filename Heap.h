@@ -13,6 +13,10 @@
 
 using namespace std;
 
+#define LOAD_CHUNK_SIZE (8*1024*1024) // bytes of text parsed by one Load thread at a time
+#define LOAD_MAX_THREADS 8            // most threads Load will parse with
+#define LOAD_WINDOW 4                 // chunks per thread Load parses ahead of the page writer
+
 class Heap: virtual public GenericDBFile {
 
   private:
@@ -46,13 +50,20 @@ class Heap: virtual public GenericDBFile {
     // return next record that satisfies CNF. literal is used to check cnf; return 0 if no record present.
     virtual int GetNext (Record &fetchme, CNF &cnf, Record &literal);
 
+    // put the records GetNext has yet to return, up to the end of the page they are on,
+    // into bits and move on to the next page; return 0 if no record present
+    virtual int GetNextPage (char *bits);
+
     // creates file using File class. fpath is path to file, file_type is {heap|sorted|tree}, startup used only in assignment 2; return 1 on success and 0 on failure
     virtual int Create (char *fpath, fType file_type, void *startup);
 
     // close the file. return 1 on success and 0 on failure
     virtual int Close ();
 
-    // bulk loads Heap from loadpath, which is a TEXT FILE. Uses Record.SuckNextRecord.
+    // bulk loads Heap from loadpath, which is a TEXT FILE. The file is mapped into memory
+    // and cut into chunks at line breaks; the chunks are parsed into pages (with
+    // Record.ParseNextRecord) by several threads and the pages are appended in file order.
+    // Each chunk ends with its own, possibly partly filled, page
     virtual void Load (Schema &myschema, char *loadpath);
 
     // Correct the length returned by File->GetLength which adds 1 to the actual
@@ -74,6 +85,12 @@ class Heap: virtual public GenericDBFile {
     // 1: we successfully read a record but the pages hasn't ended
     // 2: we've gone past the end of the file; no more records left.
     virtual int readOnePage(Record &fetchme);
+
+    // Position the pointer at the start of page pageNo so the next GetNext returns
+    // the first record on that page. Added for the fence index in Sorted, which uses
+    // it to jump straight to the page a lookup lands on (one read instead of a scan
+    // from the start of the file).
+    virtual void MoveToPage(int pageNo);
   };
 
 #endif
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * File: HyperLogLog.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "HyperLogLog.h"
+#include <string.h>
+#include <math.h>
+
+/*------------------------------------------------------------------------------
+ * Constructor
+ *----------------------------------------------------------------------------*/
+HyperLogLog :: HyperLogLog () {
+  numRegisters = 1 << HLL_PRECISION;
+  registers = new (std::nothrow) unsigned char[numRegisters];
+  if (registers == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  memset (registers, 0, numRegisters);
+}
+
+/*------------------------------------------------------------------------------
+ * Destructor
+ *----------------------------------------------------------------------------*/
+HyperLogLog :: ~HyperLogLog () {
+  delete [] registers;
+}
+
+/*------------------------------------------------------------------------------
+ * Hash a value of the given type. FNV-1a over its bytes followed by a final mix
+ * so that the leading bits are as random as the trailing ones.
+ *----------------------------------------------------------------------------*/
+unsigned long long HyperLogLog :: Hash (char *val, Type type) {
+  int len;
+  double zero = 0.0;
+  switch (type) {
+    case Int:
+      len = sizeof (int);
+      break;
+    case Double:
+      len = sizeof (double);
+      if (*((double *) val) == 0.0) val = (char*) &zero; // -0.0 is the same value as 0.0
+      break;
+    case String:
+    default:
+      len = strlen (val);
+      break;
+  }
+  unsigned long long h = 14695981039346656037ULL;
+  for (int j = 0; j < len; j++) {
+    h ^= (unsigned char) val[j];
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/*------------------------------------------------------------------------------
+ * Add attribute att of rec
+ *----------------------------------------------------------------------------*/
+void HyperLogLog :: Add (Record *rec, int att, Type type) {
+  unsigned long long h = Hash (rec->bits + ((int *) rec->bits)[att + 1], type);
+  int reg = h >> (64 - HLL_PRECISION);
+  unsigned long long rest = h << HLL_PRECISION;
+  unsigned char rank = 1;
+  while (rank <= 64 - HLL_PRECISION && !(rest & (1ULL << 63))) { // count the leading zeros
+    rank++;
+    rest <<= 1;
+  }
+  if (rank > registers[reg])
+    registers[reg] = rank;
+}
+
+/*------------------------------------------------------------------------------
+ * Estimated number of distinct values added so far: the bias corrected harmonic
+ * mean of 2^register, or linear counting while the estimate is small and there
+ * are still empty registers
+ *----------------------------------------------------------------------------*/
+double HyperLogLog :: Estimate () {
+  double sum = 0;
+  int zeros = 0;
+  for (int i = 0; i < numRegisters; i++) {
+    sum += ldexp (1.0, -registers[i]);
+    if (registers[i] == 0)
+      zeros++;
+  }
+  double alpha = 0.7213/(1 + 1.079/numRegisters);
+  double estimate = alpha*numRegisters*(double)numRegisters/sum;
+  if (estimate <= 2.5*numRegisters && zeros != 0)
+    estimate = numRegisters*log (numRegisters/(double)zeros);
+  return estimate;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
@@ -0,0 +1,39 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include "Record.h"
+#include "Comparison.h"
+
+using namespace std;
+
+#define HLL_PRECISION 14 // 2^14 one byte registers; ~0.8% standard error
+
+// HyperLogLog estimate of the number of distinct values of one attribute. Added
+// so that UPDATE STATISTICS can count the distinct values of every attribute in
+// the same scan that counts the tuples, in a fixed amount of memory, instead of
+// sorting the relation once per attribute.
+//
+// Every value is hashed to 64 bits. The first HLL_PRECISION bits pick a register
+// and the register keeps the longest run of leading zeros (+1) seen in the rest
+// of the bits. Small counts, where many registers are still empty, are estimated
+// by linear counting instead.
+class HyperLogLog {
+  private:
+    unsigned char* registers;
+    int numRegisters;
+
+  public:
+    HyperLogLog ();
+    ~HyperLogLog ();
+
+    // hash a value of the given type
+    static unsigned long long Hash (char *val, Type type);
+
+    // add attribute att of rec, which has the given type
+    void Add (Record *rec, int att, Type type);
+
+    // estimated number of distinct values added so far
+    double Estimate ();
+};
+
+#endif
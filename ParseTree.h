@@ -64,8 +64,9 @@ struct SchemaList {
 struct CreateTableType{
   char* heapOrSorted; // "HEAP": create the database as a heap dbfile
                       // "SORTED": create the database as a sorted dbfile
-  struct AndList *sortingAtts; // the set of attributes in CREATE TABLE that we are sorting on (if sorted file;
-                               // if heap, this is NULL)
+                      // "TREE": create the database as a B+-tree dbfile
+  struct AndList *sortingAtts; // the set of attributes in CREATE TABLE that we are sorting on (if sorted or tree
+                               // file; if heap, this is NULL)
 };
 
 struct NameList {
@@ -19,6 +19,9 @@
   struct NameList *attsToSelect; // the set of attributes in the SELECT (NULL if no such atts)
   int distinctAtts; // 1 if there is a DISTINCT in a non-aggregate query 
   int distinctFunc;  // 1 if there is a DISTINCT in an aggregate query
+  struct NameList *orderingAtts; // the attributes in the ORDER BY (NULL if no ORDER BY)
+  int orderDescending; // 1 if the ORDER BY is DESC
+  int limitRows; // the number in the LIMIT (-1 if no LIMIT)
 
 
   struct SchemaList *schemas; // the list of tables and aliases in the query
@@ -33,6 +36,7 @@
                    // 6 if the command is 'quit'
                    // 7 if the command is 'setupdemo'
                    // 8 if the command is 'UPDATE STATISTICS'
+                   // 9 if the command is 'EXPLAIN ANALYZE' followed by a SQL command
   int NumAtt=0;
 %}
 
@@ -81,6 +85,12 @@
 %token UPDATE
 %token STATISTICS
 %token FOR
+%token EXPLAIN
+%token ANALYZE
+%token ORDER
+%token LIMIT
+%token ASC
+%token DESC
 
 %type <myOrList> OrList
 %type <myAndList> AndList
@@ -110,7 +120,13 @@ COMMANDLINE: SQL
 | CR_TABLE
 | QUIT_PROGRAM
 | SETUP_DEMO
-| UPDATE_STATISTICS;
+| UPDATE_STATISTICS
+| EXPLAIN_ANALYZE;
+
+EXPLAIN_ANALYZE: EXPLAIN ANALYZE SQL
+{
+  commandFlag=9;
+};
 
 UPDATE_STATISTICS: UPDATE STATISTICS FOR Tables
 {
@@ -142,7 +158,7 @@ TableType: Name // for heap
   $$->heapOrSorted = $1;
   $$->sortingAtts = NULL;
 }
-| Name ON AndList // for sorted
+| Name ON AndList // for sorted and tree
 {
   $$ = (struct CreateTableType *) malloc (sizeof (struct CreateTableType));
   $$->heapOrSorted = $1;
@@ -216,7 +232,7 @@ SET_OUTPUT: SET OUTPUT String
   commandFlag=4;
 };
 
-SQL: SELECT WhatIWant FROM Tables WHERE AndList
+SQL: SELECT WhatIWant FROM Tables WHERE AndList OrderLimit
 {
   tables = $4;
   whereClausePredicate = $6;  
@@ -224,7 +240,7 @@ SQL: SELECT WhatIWant FROM Tables WHERE AndList
   commandFlag=5;
 }
 
-| SELECT WhatIWant FROM Tables WHERE AndList GROUP BY Atts
+| SELECT WhatIWant FROM Tables WHERE AndList GROUP BY Atts OrderLimit
 {
   tables = $4;
   whereClausePredicate = $6;  
@@ -232,6 +248,54 @@ SQL: SELECT WhatIWant FROM Tables WHERE AndList
   commandFlag=5;
 };
 
+OrderLimit: // neither ORDER BY nor LIMIT
+{
+  orderingAtts = NULL;
+  orderDescending = 0;
+  limitRows = -1;
+}
+
+| ORDER BY Atts Direction
+{
+  orderingAtts = $3;
+  limitRows = -1;
+}
+
+| ORDER BY Atts Direction LimitRows
+{
+  orderingAtts = $3;
+}
+
+| LimitRows
+{
+  orderingAtts = NULL;
+  orderDescending = 0;
+};
+
+LimitRows: LIMIT Int
+{
+  limitRows = atoi($2);
+  if(limitRows < 0){ // would read as NO_LIMIT, or as nothing at all
+    yyerror("LIMIT must not be negative");
+    YYERROR;
+  }
+};
+
+Direction: // ascending by default
+{
+  orderDescending = 0;
+}
+
+| ASC
+{
+  orderDescending = 0;
+}
+
+| DESC
+{
+  orderDescending = 1;
+};
+
 WhatIWant: Function ',' Atts 
 {
   attsToSelect = $3;
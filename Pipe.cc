@@ -2,6 +2,15 @@
 
 #include <iostream>
 #include <stdlib.h>
+#include "File.h"
+#include <map>
+#include <stdio.h>
+
+using namespace std;
+
+// instrumented pipes by pipeID
+static map<int, Pipe*> instrumented;
+static pthread_mutex_t instrumentedMutex = PTHREAD_MUTEX_INITIALIZER;
 
 Pipe :: Pipe (int bufferSize) {
 
@@ -25,37 +34,78 @@ Pipe :: Pipe (int bufferSize) {
 
   // note that the pipe has not yet been turned off
   done = 0;
+  cancelled = 0;
+
+  numInserted = 0;
+  producerWaitNanos = consumerWaitNanos = 0;
+  producerStalls = consumerStalls = 0;
+  pipeID = -1;
 }
 
 Pipe :: ~Pipe () {
   // free everything up!
   delete [] buffered;
 
+  if (pipeID != -1) {
+    pthread_mutex_lock (&instrumentedMutex);
+    if (instrumented[pipeID] == this)
+      instrumented.erase (pipeID);
+    pthread_mutex_unlock (&instrumentedMutex);
+  }
+
   pthread_mutex_destroy (&pipeMutex);
   pthread_cond_destroy (&producerVar);
   pthread_cond_destroy (&consumerVar);
 }
 
 
-void Pipe :: Insert (Record *insertMe) {
+int Pipe :: Insert (Record *insertMe) {
 
   // first, get a mutex on the pipeline
   pthread_mutex_lock (&pipeMutex);
 
+  // the consumer doesn't want the record
+  if (cancelled) {
+    pthread_mutex_unlock (&pipeMutex);
+    Record dropped;
+    dropped.Consume (insertMe);
+    return 0;
+  }
+
   // next, see if there is space in the pipe for more data; if
   // there is, then do the insertion
+  if (pipeID != -1) {
+    if (numInserted == 0)
+      firstInsertNanos = WallNanos ();
+    if (numInserted % PIPE_SAMPLE_EVERY == 0)
+      occupancy [(lastSlot - firstSlot) * PIPE_OCCUPANCY_BUCKETS / totSpace]++;
+  }
+
   if (lastSlot - firstSlot < totSpace) {
     buffered [lastSlot % totSpace].Consume (insertMe);
 
   // if there is not, then we need to wait until the consumer
   // frees up some space in the pipeline
   } else {
+    long start = WallNanos ();
+    producerStalls++;
     pthread_cond_wait (&producerVar, &pipeMutex);
+    producerWaitNanos += WallNanos () - start;
+
+    // since the consumer may have cancelled the pipe rather than
+    // made room, we need to check if it still wants the record
+    if (cancelled) {
+      pthread_mutex_unlock (&pipeMutex);
+      Record dropped;
+      dropped.Consume (insertMe);
+      return 0;
+    }
     buffered [lastSlot % totSpace].Consume (insertMe);
   }
 
   // note that we have added a new record
   lastSlot++;
+  numInserted++;
 
   // signal the consumer who might now want to suck up the new
   // record that has been added to the pipeline
@@ -63,6 +113,7 @@ void Pipe :: Insert (Record *insertMe) {
 
   // done!
   pthread_mutex_unlock (&pipeMutex);
+  return 1;
 }
 
 
@@ -90,7 +141,10 @@ int Pipe :: Remove (Record *removeMe) {
     }
 
     // wait until there is something there
+    long start = WallNanos ();
+    consumerStalls++;
     pthread_cond_wait (&consumerVar, &pipeMutex);
+    consumerWaitNanos += WallNanos () - start;
 
     // since the producer may have decided to turn off
     // the pipe, we need to check if it is still open
@@ -122,6 +176,8 @@ void Pipe :: ShutDown () {
 
   // note that we are now done with the pipeline
   done = 1;
+  if (pipeID != -1)
+    shutDownNanos = WallNanos ();
 
   // signal the consumer who may be waiting
   pthread_cond_signal (&consumerVar);
@@ -130,3 +186,80 @@ void Pipe :: ShutDown () {
   pthread_mutex_unlock (&pipeMutex);
 
 }
+
+void Pipe :: Cancel () {
+
+  pthread_mutex_lock (&pipeMutex);
+  cancelled = 1;
+
+  // wake the producer if it is waiting for room
+  pthread_cond_signal (&producerVar);
+
+  pthread_mutex_unlock (&pipeMutex);
+}
+
+long Pipe :: NumInserted () {
+  pthread_mutex_lock (&pipeMutex);
+  long n = numInserted;
+  pthread_mutex_unlock (&pipeMutex);
+  return n;
+}
+
+double Pipe :: ProducerWait () {
+  pthread_mutex_lock (&pipeMutex);
+  double secs = producerWaitNanos / 1e9;
+  pthread_mutex_unlock (&pipeMutex);
+  return secs;
+}
+
+double Pipe :: ConsumerWait () {
+  pthread_mutex_lock (&pipeMutex);
+  double secs = consumerWaitNanos / 1e9;
+  pthread_mutex_unlock (&pipeMutex);
+  return secs;
+}
+
+void Pipe :: Instrument (int id) {
+  pthread_mutex_lock (&pipeMutex);
+  pipeID = id;
+  for (int i = 0; i <= PIPE_OCCUPANCY_BUCKETS; i++)
+    occupancy[i] = 0;
+  firstInsertNanos = shutDownNanos = 0;
+  pthread_mutex_unlock (&pipeMutex);
+
+  pthread_mutex_lock (&instrumentedMutex);
+  instrumented[id] = this;
+  pthread_mutex_unlock (&instrumentedMutex);
+}
+
+Pipe* Pipe :: Find (int id) {
+  pthread_mutex_lock (&instrumentedMutex);
+  map<int, Pipe*>::iterator it = instrumented.find (id);
+  Pipe *found = (it == instrumented.end ()) ? NULL : it->second;
+  pthread_mutex_unlock (&instrumentedMutex);
+  return found;
+}
+
+void Pipe :: PrintStats () {
+  pthread_mutex_lock (&pipeMutex);
+  double secs = 0;
+  if (numInserted > 0 && shutDownNanos > firstInsertNanos)
+    secs = (shutDownNanos - firstInsertNanos) / 1e9;
+  printf ("pipe %d: %ld records", pipeID, numInserted);
+  if (secs > 0)
+    printf (" in %.3fs, %.0f records/s", secs, numInserted / secs);
+  printf ("\n    producer stalled %ld times (%.3fs), consumer stalled %ld times (%.3fs)\n",
+          producerStalls, producerWaitNanos / 1e9, consumerStalls, consumerWaitNanos / 1e9);
+
+  long samples = 0;
+  for (int i = 0; i <= PIPE_OCCUPANCY_BUCKETS; i++)
+    samples += occupancy[i];
+  if (samples > 0) {
+    printf ("    occupancy of %d slots:", totSpace);
+    for (int i = 0; i < PIPE_OCCUPANCY_BUCKETS; i++)
+      printf (" %d-%d%%:%.0f%%", i * 100 / PIPE_OCCUPANCY_BUCKETS, (i + 1) * 100 / PIPE_OCCUPANCY_BUCKETS,
+              100.0 * occupancy[i] / samples);
+    printf (" full:%.0f%%\n", 100.0 * occupancy[PIPE_OCCUPANCY_BUCKETS] / samples);
+  }
+  pthread_mutex_unlock (&pipeMutex);
+}
@@ -5,6 +5,9 @@
 
 #include "Record.h"
 
+#define PIPE_OCCUPANCY_BUCKETS 10 // occupancy histogram: bucket i counts samples with the buffer i/10 to
+                                  // (i+1)/10 full; one more bucket counts the samples with it full
+#define PIPE_SAMPLE_EVERY 64      // sample the occupancy on every 64th Insert
 
 class Pipe {
 private:
@@ -17,6 +20,7 @@ private:
   int totSpace;
 
   int done;
+  int cancelled; // the consumer wants no more records
 
   // mutex for the pipe
   pthread_mutex_t pipeMutex;
@@ -25,6 +29,19 @@ private:
   pthread_cond_t producerVar;
   pthread_cond_t consumerVar;
 
+  // what went through the pipe, for EXPLAIN ANALYZE
+  long numInserted;
+  long producerWaitNanos; // time Insert spent waiting for a free slot
+  long consumerWaitNanos; // time Remove spent waiting for a record
+  long producerStalls;    // number of times Insert found the pipe full
+  long consumerStalls;    // number of times Remove found the pipe empty
+
+  // kept only once Instrument has been called
+  int pipeID;             // -1 if not instrumented
+  long occupancy[PIPE_OCCUPANCY_BUCKETS + 1];
+  long firstInsertNanos;  // when the first record came in
+  long shutDownNanos;     // when the producer shut the pipe down
+
 public:
 
   // this sets up the pipeline; the parameter is the number of
@@ -35,8 +52,10 @@ public:
   // This inserts a record into the pipeline; note that if the
   // buffer size is exceeded, then the insertion may block
   // Note that the parameter is consumed; after insertion, it can
-  // no longer be used and will be zero'ed out
-  void Insert (Record *insertMe);
+  // no longer be used and will be zero'ed out. Returns 0 if the
+  // consumer has cancelled the pipe; the record is then dropped, and
+  // the producer may as well stop
+  int Insert (Record *insertMe);
 
   // This removes a record from the pipeline and puts it into the
   // argument.  Note that whatever was in the parameter before the
@@ -49,6 +68,34 @@ public:
   // there is no more data that is going to be added into the pipe
   void ShutDown ();
 
+  // used by the consumer to signal that it wants no more records
+  // (a LIMIT has all it needs). From then on Insert drops what it is
+  // given and returns 0, even to a producer that was blocked on a
+  // full pipe, so producers that check it stop early and the others
+  // run to the end without blocking. The producer still shuts the
+  // pipe down as usual
+  void Cancel ();
+
+  // number of records inserted so far
+  long NumInserted ();
+
+  // seconds the producer spent blocked on a full pipe
+  double ProducerWait ();
+
+  // seconds the consumer spent blocked on an empty pipe
+  double ConsumerWait ();
+
+  // start sampling the occupancy of the buffer and timing the records going
+  // through, and make the pipe findable by pipeID (that of the query tree node
+  // whose output it is)
+  void Instrument (int pipeID);
+
+  // the pipe last instrumented with pipeID; NULL if none
+  static Pipe* Find (int pipeID);
+
+  // print the throughput, the stalls and the occupancy histogram
+  void PrintStats ();
+
 };
 
 #endif
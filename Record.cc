@@ -11,9 +11,7 @@ Record :: Record () {
 }
 
 Record :: ~Record () {
-  if (bits != NULL) {
-    delete [] bits;
-  }
+  RecordPool::Free (bits);
   bits = NULL;
 
 }
@@ -21,24 +19,13 @@ Record :: ~Record () {
 
 int Record :: ComposeRecord (Schema *mySchema, const char *src) {
 
-  // this is temporary storage
-  char *space = new (std::nothrow) char[PAGE_SIZE];
-  if (space == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  // this is temporary storage. It comes from the pool, which keeps it for the next call
+  char *space = RecordPool::Alloc (PAGE_SIZE);
 
-  char *recSpace = new (std::nothrow) char[PAGE_SIZE];
-  if (recSpace == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  char *recSpace = RecordPool::Alloc (PAGE_SIZE);
 
   // clear out the present record
-  if (bits != NULL)
-    delete [] bits;
+  RecordPool::Free (bits);
   bits = NULL;
 
   int n = mySchema->GetNumAtts();
@@ -59,8 +46,8 @@ int Record :: ComposeRecord (Schema *mySchema, const char *src) {
       if (nextChar == '|')
         break;
       else if (nextChar == '\0') {
-        delete [] space;
-        delete [] recSpace;
+        RecordPool::Free (space);
+        RecordPool::Free (recSpace);
         return 0;
       }
 
@@ -110,41 +97,25 @@ int Record :: ComposeRecord (Schema *mySchema, const char *src) {
   ((int *) recSpace)[0] = currentPosInRec;
 
   // and copy over the bits
-  bits = new (std::nothrow) char[currentPosInRec];
-  if (bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  bits = RecordPool::Alloc (currentPosInRec);
 
   memcpy (bits, recSpace, currentPosInRec);
 
-  delete [] space;
-  delete [] recSpace;
+  RecordPool::Free (space);
+  RecordPool::Free (recSpace);
 
   return 1;
 }
 
 int Record :: SuckNextRecord (Schema *mySchema, FILE *textFile) {
 
-  // this is temporary storage
-  char *space = new (std::nothrow) char[PAGE_SIZE];
-  if (space == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  // this is temporary storage. It comes from the pool, which keeps it for the next call
+  char *space = RecordPool::Alloc (PAGE_SIZE);
 
-  char *recSpace = new (std::nothrow) char[PAGE_SIZE];
-  if (recSpace == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  char *recSpace = RecordPool::Alloc (PAGE_SIZE);
 
   // clear out the present record
-  if (bits != NULL)
-    delete [] bits;
+  RecordPool::Free (bits);
   bits = NULL;
 
   int n = mySchema->GetNumAtts();
@@ -164,8 +135,8 @@ int Record :: SuckNextRecord (Schema *mySchema, FILE *textFile) {
       if (nextChar == '|')
         break;
       else if (nextChar == EOF) {
-        delete [] space;
-        delete [] recSpace;
+        RecordPool::Free (space);
+        RecordPool::Free (recSpace);
         return 0;
       }
 
@@ -215,24 +186,142 @@ int Record :: SuckNextRecord (Schema *mySchema, FILE *textFile) {
   ((int *) recSpace)[0] = currentPosInRec;
 
   // and copy over the bits
-  bits = new (std::nothrow) char[currentPosInRec];
-  if (bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  bits = RecordPool::Alloc (currentPosInRec);
 
   memcpy (bits, recSpace, currentPosInRec);
 
-  delete [] space;
-  delete [] recSpace;
+  RecordPool::Free (space);
+  RecordPool::Free (recSpace);
 
   return 1;
 }
 
 
+// parse a decimal int the way atoi does (leading white space, optional sign,
+// digits up to the first non-digit)
+static int parseInt (char *pos, char *end) {
+  while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+    pos++;
+  bool neg = false;
+  if (pos < end && (*pos == '-' || *pos == '+')) {
+    neg = (*pos == '-');
+    pos++;
+  }
+  unsigned int val = 0;
+  while (pos < end && *pos >= '0' && *pos <= '9') {
+    val = val * 10 + (*pos - '0');
+    pos++;
+  }
+  return neg ? -(int) val : (int) val;
+}
+
+// parse a double. Plain decimals with at most 15 significant digits (all that
+// the TPC-H tables have) are parsed by hand: both the digits and the power of ten
+// are exact doubles, so the one division rounds the same way atof does. Anything
+// else (exponents, inf, long mantissas) goes to atof.
+static double parseDouble (char *pos, char *end) {
+  static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                       1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+                                       1e20, 1e21, 1e22};
+  char *start = pos;
+  while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+    pos++;
+  bool neg = false;
+  if (pos < end && (*pos == '-' || *pos == '+')) {
+    neg = (*pos == '-');
+    pos++;
+  }
+  long long digits = 0;
+  int numDigits = 0, fracDigits = 0;
+  bool seenDot = false, fast = true;
+  for (; pos < end; pos++) {
+    if (*pos >= '0' && *pos <= '9') {
+      if (numDigits > 0 || *pos != '0') numDigits++;
+      digits = digits * 10 + (*pos - '0');
+      if (seenDot) fracDigits++;
+      if (numDigits > 15 || fracDigits > 22) { fast = false; break; }
+    }
+    else if (*pos == '.' && !seenDot) seenDot = true;
+    else { fast = false; break; }
+  }
+  if (fast) {
+    double val = (double) digits / powersOfTen[fracDigits];
+    return neg ? -val : val;
+  }
+
+  // slow path: atof wants a null terminated string
+  char buf[64];
+  char *str = buf;
+  if (end - start >= (int) sizeof (buf)) str = new char[end - start + 1];
+  memcpy (str, start, end - start);
+  str[end - start] = 0;
+  double val = atof (str);
+  if (str != buf) delete [] str;
+  return val;
+}
+
+/*------------------------------------------------------------------------------
+ * Build the next record of the text in [textPos, textEnd) in recSpace. The text
+ * has the same layout SuckNextRecord reads. The one difference is that the line
+ * break in front of a record is skipped rather than becoming part of its first
+ * attribute (it was only harmless there when that attribute is a number).
+ *----------------------------------------------------------------------------*/
+int Record :: ParseNextRecord (Schema *mySchema, char *&textPos, char *textEnd, char *recSpace) {
+  char *pos = textPos;
+  while (pos < textEnd && (*pos == '\n' || *pos == '\r'))
+    pos++;
+
+  int n = mySchema->GetNumAtts();
+  Attribute *atts = mySchema->GetAtts();
+  int currentPosInRec = sizeof (int) * (n + 1);
+
+  for (int i = 0; i < n; i++) {
+    // find the end of the attribute value
+    char *valEnd = (char *) memchr (pos, '|', textEnd - pos);
+    if (valEnd == NULL) return 0; // ran out of text in the middle of a record
+    int len = valEnd - pos;
+
+    ((int *) recSpace)[i + 1] = currentPosInRec;
+
+    if (atts[i].myType == Int) {
+      *((int *) &(recSpace[currentPosInRec])) = parseInt (pos, valEnd);
+      currentPosInRec += sizeof (int);
+
+    } else if (atts[i].myType == Double) {
+      // make sure that we are starting at a double-aligned position
+      while (currentPosInRec % sizeof(double) != 0) {
+        currentPosInRec += sizeof (int);
+        ((int *) recSpace)[i + 1] = currentPosInRec;
+      }
+      *((double *) &(recSpace[currentPosInRec])) = parseDouble (pos, valEnd);
+      currentPosInRec += sizeof (double);
+
+    } else if (atts[i].myType == String) {
+      // null terminate and align to the size of an int, zeroing the padding
+      int paddedLen = len + 1;
+      if (paddedLen % sizeof (int) != 0) {
+        paddedLen += sizeof (int) - (paddedLen % sizeof (int));
+      }
+      if (currentPosInRec + paddedLen + sizeof (double) * (n - i) > PAGE_SIZE) {
+        cerr << "ERROR: Record too large to fit on a page. EXIT !!!\n";
+        exit(1);
+      }
+      memcpy (&(recSpace[currentPosInRec]), pos, len);
+      memset (&(recSpace[currentPosInRec + len]), 0, paddedLen - len);
+      currentPosInRec += paddedLen;
+    }
+
+    pos = valEnd + 1;
+  }
+
+  // the last thing is to set up the pointer to just past the end of the reocrd
+  ((int *) recSpace)[0] = currentPosInRec;
+  textPos = pos;
+  return currentPosInRec;
+}
+
 void Record :: SetBits (char *bits) {
-  delete [] this->bits;
+  RecordPool::Free (this->bits);
   this->bits = bits;
 }
 
@@ -243,13 +332,10 @@ char* Record :: GetBits (void) {
 
 void Record :: CopyBits(char *bits, int b_len) {
 
-  delete [] this->bits;
-
-  this->bits = new (std::nothrow) char[b_len];
-  if (this->bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
+  // reuse the bits we have if they are big enough
+  if (this->bits == NULL || RecordPool::Capacity (this->bits) < b_len) {
+    RecordPool::Free (this->bits);
+    this->bits = RecordPool::Alloc (b_len);
   }
 
   memcpy (this->bits, bits, b_len);
@@ -258,7 +344,7 @@ void Record :: CopyBits(char *bits, int b_len) {
 
 
 void Record :: Consume (Record *fromMe) {
-  delete [] bits;
+  RecordPool::Free (bits);
   bits = fromMe->bits;
   fromMe->bits = NULL;
 
@@ -266,16 +352,8 @@ void Record :: Consume (Record *fromMe) {
 
 
 void Record :: Copy (Record *copyMe) {
-  // this is a deep copy, so allocate the bits and move them over!
-  delete [] bits;
-  bits = new (std::nothrow) char[((int *) copyMe->bits)[0]];
-  if (bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
-
-  memcpy (bits, copyMe->bits, ((int *) copyMe->bits)[0]);
+  // this is a deep copy, so allocate the bits (unless ours are big enough) and move them over!
+  CopyBits (copyMe->bits, ((int *) copyMe->bits)[0]);
 
 }
 
@@ -295,12 +373,7 @@ void Record :: Project (int *attsToKeep, int numAttsToKeep, int numAttsNow) {
   }
 
   // now, allocate the new bits
-  char *newBits = new (std::nothrow) char[totSpace];
-  if (newBits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  char *newBits = RecordPool::Alloc (totSpace);
 
   // record the total length of the record
   *((int *) newBits) = totSpace;
@@ -332,7 +405,7 @@ void Record :: Project (int *attsToKeep, int numAttsToKeep, int numAttsNow) {
   }
 
   // kill the old bits
-  delete [] bits;
+  RecordPool::Free (bits);
 
   // and attach the new ones
   bits = newBits;
@@ -342,7 +415,7 @@ void Record :: Project (int *attsToKeep, int numAttsToKeep, int numAttsNow) {
 
 // consumes right record and leaves the left record as it is
 void Record :: MergeRecords (Record *left, Record *right, int numAttsLeft, int numAttsRight, int *attsToKeep, int numAttsToKeep, int startOfRight) {
-  delete [] bits;
+  RecordPool::Free (bits);
   bits = NULL;
 
   // if one of the records is empty, new record is non-empty record
@@ -377,12 +450,7 @@ void Record :: MergeRecords (Record *left, Record *right, int numAttsLeft, int n
   }
 
   // now, allocate the new bits
-  bits = new (std::nothrow) char[totSpace+1];
-  if (bits == NULL)
-  {
-    cout << "ERROR : Not enough memory. EXIT !!!\n";
-    exit(1);
-  }
+  bits = RecordPool::Alloc (totSpace+1);
 
   // record the total length of the record
   *((int *) bits) = totSpace;
@@ -422,6 +490,97 @@ void Record :: MergeRecords (Record *left, Record *right, int numAttsLeft, int n
   }
 }
 
+// where attribute att of bits starts, and in len the bytes ComposeRecord gives it:
+// a string takes its nulls up to a multiple of sizeof (int), but not the padding
+// there may be before a double after it. isDouble tells if it needs aligning
+static inline char *keptAtt (char *bits, Schema *schema, int att, int &len, bool &isDouble) {
+  int start = schema->GetFixedOffset (att);
+  if (start < 0) {
+    start = ((int *) bits)[att + 1];
+  }
+
+  Type type = schema->GetAtts ()[att].myType;
+  isDouble = (type == Double);
+  if (type == Int) {
+    len = sizeof (int);
+  } else if (type == Double) {
+    len = sizeof (double);
+  } else {
+    len = strlen (bits + start) + 1;
+    if (len % sizeof (int) != 0) {
+      len += sizeof (int) - (len % sizeof (int));
+    }
+  }
+  return bits + start;
+}
+
+// makes the bits of a record out of the attributes attsToKeep of left (up to
+// startOfRight) and of right (after it), laid out the way ComposeRecord does
+static char *layOutKept (char *left, Schema *leftSchema, char *right, Schema *rightSchema,
+                         int *attsToKeep, int numAttsToKeep, int startOfRight) {
+  int len;
+  bool isDouble;
+
+  // first, figure out the size of the new record
+  int totSpace = sizeof (int) * (numAttsToKeep + 1);
+  for (int i = 0; i < numAttsToKeep; i++) {
+    if (i < startOfRight) {
+      keptAtt (left, leftSchema, attsToKeep[i], len, isDouble);
+    } else {
+      keptAtt (right, rightSchema, attsToKeep[i], len, isDouble);
+    }
+
+    // doubles start on a multiple of sizeof (double)
+    if (isDouble && totSpace % sizeof (double) != 0) {
+      totSpace += sizeof (int);
+    }
+    totSpace += len;
+  }
+
+  char *newBits = RecordPool::Alloc (totSpace);
+  *((int *) newBits) = totSpace;
+
+  // and copy all of the fields over
+  int curPos = sizeof (int) * (numAttsToKeep + 1);
+  for (int i = 0; i < numAttsToKeep; i++) {
+    char *from;
+    if (i < startOfRight) {
+      from = keptAtt (left, leftSchema, attsToKeep[i], len, isDouble);
+    } else {
+      from = keptAtt (right, rightSchema, attsToKeep[i], len, isDouble);
+    }
+
+    if (isDouble && curPos % sizeof (double) != 0) {
+      curPos += sizeof (int);
+    }
+    ((int *) newBits)[i + 1] = curPos;
+    memcpy (&(newBits[curPos]), from, len);
+    curPos += len;
+  }
+
+  return newBits;
+}
+
+void Record :: Project (int *attsToKeep, int numAttsToKeep, Schema *mySchema) {
+  char *newBits = layOutKept (bits, mySchema, NULL, NULL, attsToKeep, numAttsToKeep, numAttsToKeep);
+  RecordPool::Free (bits);
+  bits = newBits;
+}
+
+void Record :: ProjectFrom (char *fromBits, int *attsToKeep, int numAttsToKeep, Schema *mySchema) {
+  char *newBits = layOutKept (fromBits, mySchema, NULL, NULL, attsToKeep, numAttsToKeep, numAttsToKeep);
+  RecordPool::Free (bits);
+  bits = newBits;
+}
+
+void Record :: MergeRecords (Record *left, Record *right, Schema *leftSchema, Schema *rightSchema,
+                             int *attsToKeep, int numAttsToKeep, int startOfRight) {
+  char *newBits = layOutKept (left->bits, leftSchema, right->bits, rightSchema,
+                              attsToKeep, numAttsToKeep, startOfRight);
+  RecordPool::Free (bits);
+  bits = newBits;
+}
+
 /**************************************************************
  * Prints the contents of the record to an output file.
  * Added in the final demo. Called from setOutput() in main.cc
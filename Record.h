@@ -12,6 +12,7 @@
 #include "File.h"
 #include "Comparison.h"
 #include "ComparisonEngine.h"
+#include "RecordPool.h"
 
 
 
@@ -24,6 +25,7 @@
 //  n) Byte offset to the start of the att in position numAtts
 //  n+1) Bits encoding the record's data. This is the location pointed to
 //       by 2) above
+// The bits come from RecordPool::Alloc; anyone setting them directly must use it too
 class Record {
 
 friend class ComparisonEngine;
@@ -53,6 +55,13 @@ public:
   // if there is an error and returns a 1 otherwise
   int SuckNextRecord (Schema *mySchema, FILE *textFile);
 
+  // same as SuckNextRecord, but reads the text from memory, starting at textPos and
+  // stopping at textEnd, and builds the binary record in recSpace (which must hold
+  // PAGE_SIZE bytes) instead of allocating it. textPos is moved past the record.
+  // Returns the length of the record in bytes, or 0 if there is no complete record
+  // left. Added for the parallel Heap.Load, which parses straight into its pages
+  static int ParseNextRecord (Schema *mySchema, char *&textPos, char *textEnd, char *recSpace);
+
   int ComposeRecord (Schema *mySchema, const char *src);
 
   // this projects away various attributes...
@@ -68,6 +77,21 @@ public:
   void MergeRecords (Record *left, Record *right, int numAttsLeft,
     int numAttsRight, int *attsToKeep, int numAttsToKeep, int startOfRight);
 
+  // the same two, but they are given the schemas of the records they take attributes
+  // from, and lay the new record out the way ComposeRecord does for the attributes
+  // kept instead of copying the padding of the old ones along. So the new record
+  // keeps to Schema::GetFixedOffset like records read from files do, and the
+  // attributes whose place the schemas know are copied without reading the offsets
+  // at the start of the old records
+  void Project (int *attsToKeep, int numAttsToKeep, Schema *mySchema);
+  void MergeRecords (Record *left, Record *right, Schema *leftSchema,
+    Schema *rightSchema, int *attsToKeep, int numAttsToKeep, int startOfRight);
+
+  // the same as Project, but the attributes are taken from the record whose bits
+  // are fromBits, which is left as it is. Added for SelectFile, which projects the
+  // records where they lie on the page
+  void ProjectFrom (char *fromBits, int *attsToKeep, int numAttsToKeep, Schema *mySchema);
+
   // prints the contents of the record; this requires
   // that the schema also be given so that the record can be interpreted
   void Print (Schema *mySchema);
@@ -0,0 +1,285 @@
+/*******************************************************************************
+ * File: RecordPool.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "RecordPool.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <iostream>
+
+using namespace std;
+
+// the header at the start of every slab. Blocks bigger than the largest class get
+// a slab of their own with sizeClass -1
+struct Slab {
+  int sizeClass;
+  int blockSize;
+  int numBlocks; // blocks that fit in the slab
+  int carved;    // blocks carved so far; only the thread carving the slab changes it
+  int numFree;   // blocks in the shared list, counted by Trim
+  bool retired;  // no thread carves from it any more
+  Slab* next;    // in the list of slabs of the class
+};
+
+// free blocks of one size class. The list is linked through the blocks themselves
+struct FreeList {
+  char* head;
+  int count;
+};
+
+// the free lists of a thread, and the slabs it carves from
+struct ThreadCache {
+  FreeList lists[POOL_NUM_CLASSES];
+  Slab* carving[POOL_NUM_CLASSES];
+};
+
+// the free lists shared by all threads, and every slab of the class
+struct SharedList {
+  pthread_mutex_t lock;
+  FreeList list;
+  Slab* slabs;
+};
+
+static SharedList shared[POOL_NUM_CLASSES];
+static pthread_key_t cacheKey;
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static __thread ThreadCache* myCache = NULL;
+
+#define NEXT(block) (*((char **) (block))) // link to the next free block
+#define SLAB_OF(block) ((Slab *) ((uintptr_t) (block) & ~((uintptr_t) POOL_SLAB_SIZE - 1)))
+
+/*------------------------------------------------------------------------------
+ * Bytes of the blocks of size class c
+ *----------------------------------------------------------------------------*/
+static inline int classSize (int c) {
+  if (c == 0) return POOL_MIN_SIZE;
+  int shift = (c - 1) / 2;
+  return ((c - 1) % 2 == 0) ? (POOL_MIN_SIZE << shift) * 3 / 2 : (POOL_MIN_SIZE << (shift + 1));
+}
+
+/*------------------------------------------------------------------------------
+ * Smallest size class with blocks of at least n bytes
+ *----------------------------------------------------------------------------*/
+static inline int sizeClass (int n) {
+  if (n <= POOL_MIN_SIZE) return 0;
+  unsigned int m = n - 1;
+  int top = 31 - __builtin_clz (m); // highest bit of n-1; at least log2(POOL_MIN_SIZE)
+  int upperHalf = (m >> (top - 1)) & 1;
+  return (top - __builtin_ctz (POOL_MIN_SIZE)) * 2 + 1 + upperHalf;
+}
+
+/*------------------------------------------------------------------------------
+ * Free blocks of class c a thread keeps before it hands half of them on
+ *----------------------------------------------------------------------------*/
+static inline int cacheLimit (int c) {
+  int limit = POOL_CACHE_BYTES / classSize (c);
+  return limit < 2 ? 2 : limit;
+}
+
+/*------------------------------------------------------------------------------
+ * Move up to num blocks from one list to another
+ *----------------------------------------------------------------------------*/
+static void moveBlocks (FreeList &from, FreeList &to, int num) {
+  while (num-- > 0 && from.head != NULL) {
+    char* block = from.head;
+    from.head = NEXT (block);
+    from.count--;
+    NEXT (block) = to.head;
+    to.head = block;
+    to.count++;
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * A slab aligned to POOL_SLAB_SIZE, big enough for at least one block of bytes
+ *----------------------------------------------------------------------------*/
+static Slab* newSlab (int sizeClass, int bytes) {
+  size_t size = POOL_SLAB_HEADER + bytes;
+  if (size < POOL_SLAB_SIZE) size = POOL_SLAB_SIZE;
+  void* mem;
+  if (posix_memalign (&mem, POOL_SLAB_SIZE, size) != 0)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  Slab* slab = (Slab *) mem;
+  slab->sizeClass = sizeClass;
+  slab->blockSize = bytes;
+  slab->numBlocks = (POOL_SLAB_SIZE - POOL_SLAB_HEADER) / bytes;
+  if (slab->numBlocks < 1) slab->numBlocks = 1; // a block that goes past the first POOL_SLAB_SIZE
+  slab->carved = 0;
+  slab->numFree = 0;
+  slab->retired = false;
+  slab->next = NULL;
+  return slab;
+}
+
+/*------------------------------------------------------------------------------
+ * Called when a thread that used the pool ends
+ *----------------------------------------------------------------------------*/
+static void threadExit (void *cache) {
+  myCache = (ThreadCache *) cache;
+  RecordPool :: FlushThread ();
+  myCache = NULL;
+  free (cache);
+}
+
+static void initPool () {
+  for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+    pthread_mutex_init (&shared[c].lock, NULL);
+    shared[c].list.head = NULL;
+    shared[c].list.count = 0;
+    shared[c].slabs = NULL;
+  }
+  pthread_key_create (&cacheKey, threadExit);
+}
+
+/*------------------------------------------------------------------------------
+ * The free lists of the calling thread, made on first use
+ *----------------------------------------------------------------------------*/
+static inline ThreadCache* threadCache () {
+  if (myCache == NULL) {
+    pthread_once (&poolOnce, initPool);
+    myCache = (ThreadCache *) calloc (1, sizeof (ThreadCache));
+    if (myCache == NULL)
+    {
+      cout << "ERROR : Not enough memory. EXIT !!!\n";
+      exit(1);
+    }
+    pthread_setspecific (cacheKey, myCache); // so threadExit gets it
+  }
+  return myCache;
+}
+
+/*------------------------------------------------------------------------------
+ * A block of at least len bytes: from the thread's list, else a batch from the
+ * shared list, else carved from the thread's slab of the class
+ *----------------------------------------------------------------------------*/
+char* RecordPool :: Alloc (int len) {
+  if (len > classSize (POOL_NUM_CLASSES - 1)) { // a slab of its own
+    Slab* slab = newSlab (-1, len);
+    return ((char *) slab) + POOL_SLAB_HEADER;
+  }
+
+  int c = sizeClass (len);
+  ThreadCache* cache = threadCache ();
+  FreeList &list = cache->lists[c];
+  if (list.head == NULL) {
+    pthread_mutex_lock (&shared[c].lock);
+    moveBlocks (shared[c].list, list, cacheLimit (c) / 2);
+    pthread_mutex_unlock (&shared[c].lock);
+  }
+  if (list.head != NULL) {
+    char* block = list.head;
+    list.head = NEXT (block);
+    list.count--;
+    return block;
+  }
+
+  Slab* slab = cache->carving[c];
+  if (slab == NULL || slab->carved == slab->numBlocks) {
+    Slab* full = slab;
+    slab = newSlab (c, classSize (c));
+    pthread_mutex_lock (&shared[c].lock);
+    if (full != NULL) full->retired = true;
+    slab->next = shared[c].slabs;
+    shared[c].slabs = slab;
+    pthread_mutex_unlock (&shared[c].lock);
+    cache->carving[c] = slab;
+  }
+  return ((char *) slab) + POOL_SLAB_HEADER + (slab->carved++) * slab->blockSize;
+}
+
+/*------------------------------------------------------------------------------
+ * Give back a block from Alloc
+ *----------------------------------------------------------------------------*/
+void RecordPool :: Free (char *bits) {
+  if (bits == NULL) return;
+  Slab* slab = SLAB_OF (bits);
+  int c = slab->sizeClass;
+  if (c < 0) {
+    free (slab);
+    return;
+  }
+
+  FreeList &list = threadCache ()->lists[c];
+  NEXT (bits) = list.head;
+  list.head = bits;
+  list.count++;
+  if (list.count > cacheLimit (c)) { // hand half on to the shared list
+    pthread_mutex_lock (&shared[c].lock);
+    moveBlocks (list, shared[c].list, list.count / 2);
+    pthread_mutex_unlock (&shared[c].lock);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Bytes that fit in a block from Alloc
+ *----------------------------------------------------------------------------*/
+int RecordPool :: Capacity (char *bits) {
+  return SLAB_OF (bits)->blockSize;
+}
+
+/*------------------------------------------------------------------------------
+ * Move the free blocks of the calling thread to the shared lists, and stop
+ * carving from its slabs so that Trim may free them
+ *----------------------------------------------------------------------------*/
+void RecordPool :: FlushThread () {
+  if (myCache == NULL) return;
+  for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+    FreeList &list = myCache->lists[c];
+    if (list.head == NULL && myCache->carving[c] == NULL) continue;
+    pthread_mutex_lock (&shared[c].lock);
+    moveBlocks (list, shared[c].list, list.count);
+    if (myCache->carving[c] != NULL) myCache->carving[c]->retired = true;
+    pthread_mutex_unlock (&shared[c].lock);
+    myCache->carving[c] = NULL;
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Free the retired slabs whose carved blocks are all in the shared list. The
+ * blocks of each slab in the list are counted, then the list is rebuilt without
+ * the blocks of the slabs that go
+ *----------------------------------------------------------------------------*/
+void RecordPool :: Trim () {
+  FlushThread ();
+  pthread_once (&poolOnce, initPool);
+  for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+    pthread_mutex_lock (&shared[c].lock);
+    for (Slab* slab = shared[c].slabs; slab != NULL; slab = slab->next)
+      slab->numFree = 0;
+    for (char* block = shared[c].list.head; block != NULL; block = NEXT (block))
+      SLAB_OF (block)->numFree++;
+
+    FreeList kept = {NULL, 0};
+    char* block = shared[c].list.head;
+    while (block != NULL) {
+      char* next = NEXT (block);
+      Slab* slab = SLAB_OF (block);
+      if (!slab->retired || slab->numFree < slab->carved) {
+        NEXT (block) = kept.head;
+        kept.head = block;
+        kept.count++;
+      }
+      block = next;
+    }
+    shared[c].list = kept;
+
+    Slab** link = &shared[c].slabs;
+    while (*link != NULL) {
+      Slab* slab = *link;
+      if (slab->retired && slab->numFree == slab->carved) {
+        *link = slab->next;
+        free (slab);
+      }
+      else
+        link = &slab->next;
+    }
+    pthread_mutex_unlock (&shared[c].lock);
+  }
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
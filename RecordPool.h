@@ -0,0 +1,47 @@
+#ifndef RECORDPOOL_H
+#define RECORDPOOL_H
+
+#include <pthread.h>
+
+#define POOL_SLAB_SIZE (1 << 16)   // slabs are this big and aligned to it, so a block finds its slab
+#define POOL_SLAB_HEADER 64        // bytes at the start of a slab describing it
+#define POOL_MIN_SIZE 32           // bytes of the smallest block
+#define POOL_NUM_CLASSES 26        // size classes 32, 48, 64, 96, ... 196608 (fits a PAGE_SIZE record)
+#define POOL_CACHE_BYTES (1 << 18) // bytes of free blocks of one class a thread keeps to itself
+
+// Size classed slab allocator for Record.bits. Added because every record that
+// moves through an operation used to be a new [] and a delete [], and with an
+// operation per thread the threads spent a lot of their time contending in malloc.
+//
+// The sizes are rounded up to classes half a power of two apart. A block is carved
+// from a slab of its class, so records made one after another sit one after another
+// in memory. Every thread keeps free lists of its own, so Alloc and Free are a few
+// pointer operations and take no lock. A thread whose list of a class grows past
+// POOL_CACHE_BYTES moves half of it to the shared list of the class, and a thread
+// with an empty list takes a batch from there before carving, so records made by
+// one operation and freed by the next one downstream come back round. When a
+// thread ends its lists go to the shared ones. Trim, which main calls after every
+// command, gives the slabs whose blocks are all free back to the system in bulk.
+//
+// Ownership doesn't change: Record still owns its bits, Consume passes them on and
+// Copy makes new ones. Bits from Alloc must only be freed with Free, never delete [].
+class RecordPool {
+  public:
+    // a block of at least len bytes, 16 byte aligned
+    static char* Alloc (int len);
+
+    // give back a block from Alloc. NULL is fine
+    static void Free (char *bits);
+
+    // bytes that fit in a block from Alloc, so that a record can reuse its bits
+    static int Capacity (char *bits);
+
+    // move the free blocks of the calling thread to the shared lists
+    static void FlushThread ();
+
+    // give the slabs that have no block in use back to the system. Blocks still in
+    // the lists of other running threads keep their slabs
+    static void Trim ();
+};
+
+#endif
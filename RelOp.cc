@@ -9,8 +9,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <vector>
+#include <deque>
+#include <unordered_map>
 #include <cmath>
 #include <sstream>
+#include <algorithm>
 
 using namespace std;
 
@@ -37,6 +40,18 @@ void RelationalOp :: WaitUntilDone(){
   pthread_join(operationThread, NULL);
 }
 
+// the filters pushed down to us are the planner's; their probe orders are ours
+RelationalOp :: ~RelationalOp(){
+  for(size_t i=0;i<bloomOrders.size();i++){
+    delete bloomOrders[i];
+  }
+}
+
+// what the operation did. added for EXPLAIN ANALYZE
+ExecCounters& RelationalOp :: GetCounters(){
+  return counters;
+}
+
 // tell us how much internal memory the operation can use in pages
 void RelationalOp :: Use_n_Pages (int n){
   bnlPages = n; // only used for BNL Joins
@@ -45,6 +60,61 @@ void RelationalOp :: Use_n_Pages (int n){
   numPages = temp;
 }
 
+// drop output records that can't be in filter. added for the Bloom filters in Join
+void RelationalOp :: AddBloomFilter (BloomFilter *filter, OrderMaker &probeAtts){
+  bloomFilters.push_back(filter);
+  bloomOrders.push_back(new OrderMaker(probeAtts));
+}
+
+typedef struct{
+  void* (*routine)(void*);
+  void* arg;
+  ExecCounters* counters;
+  bool mainThread; // the operation's own thread, rather than one it started
+} StartThreadUtil; // struct used by startThread
+
+void* countedRoutine(void* ptr){
+  StartThreadUtil* myT = (StartThreadUtil*) ptr;
+  threadCounters = myT->counters; // File and BigQ count what we do towards the operation
+  long startWall = WallNanos();
+  long startCPU = ThreadCPUNanos();
+  void* ret = myT->routine(myT->arg);
+  CountCPU(ThreadCPUNanos() - startCPU);
+  if(myT->mainThread && myT->counters != NULL)
+    myT->counters->wallNanos = WallNanos() - startWall;
+  delete myT;
+  return ret;
+}
+
+// start a thread running routine(arg) whose pages, memory and CPU time count towards
+// counters. Every thread of an operation is started this way: the operation's own
+// thread with its counters and mainThread set, the threads it starts with threadCounters
+void startThread(pthread_t* thread, void* (*routine)(void*), void* arg, ExecCounters* counters, bool mainThread){
+  StartThreadUtil* t = new StartThreadUtil;
+  t->routine = routine;
+  t->arg = arg;
+  t->counters = counters;
+  t->mainThread = mainThread;
+  pthread_create(thread,NULL,countedRoutine,(void*)t);
+}
+
+// wait for every filter pushed down to an operation to be built
+void waitForBloomFilters(vector<BloomFilter*>* filters){
+  for(size_t i=0;i<filters->size();i++){
+    filters->at(i)->WaitUntilReady();
+  }
+}
+
+// true if rec might pass all the filters pushed down to an operation
+bool passesBloomFilters(Record* rec, vector<BloomFilter*>* filters, vector<OrderMaker*>* orders){
+  for(size_t i=0;i<filters->size();i++){
+    if(!filters->at(i)->MayContain(rec,orders->at(i))){
+      return false;
+    }
+  }
+  return true;
+}
+
 /*******************************************************************************
  * Class SelectPipe
  * SelectPipe takes two pipes as input: an input pipe and an output pipe. It also takes a
@@ -56,19 +126,45 @@ typedef struct{
   Pipe* outputPipe;
   CNF* cnf;
   Record* literal;
+  vector<BloomFilter*>* bloomFilters;
+  vector<OrderMaker*>* bloomOrders;
 } SelectPipeUtil; // struct used by operationThread in SelectPipe
 
 void* selectPipeRoutine(void* ptr){
   SelectPipeUtil* myT = (SelectPipeUtil*) ptr;
-  Record currRec;
+  Record* batch = new (std::nothrow) Record[SELECT_BATCH];
+  if(batch == NULL){
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  char* recs[SELECT_BATCH];
+  int selected[SELECT_BATCH];
   ComparisonEngine ceng;
+  waitForBloomFilters(myT->bloomFilters); // no-op unless the planner pushed a join's filter down to us
   // cout << "here" << endl;
-  while(myT->inputPipe->Remove(&currRec)!=0){ // keep reading from the input pipe as long it has elements in it
-    // cout << "here" << endl;
-    if(ceng.Compare(&currRec,myT->literal,myT->cnf)==1){ // push to output pipe if we have equality
-      myT->outputPipe->Insert(&currRec);
+  int numRecs = 0;
+  bool more = true;
+  while(more){
+    more = myT->inputPipe->Remove(&batch[numRecs])!=0; // keep reading from the input pipe as long it has elements in it
+    if(more){
+      recs[numRecs] = batch[numRecs].bits;
+      numRecs++;
+    }
+    if(numRecs == SELECT_BATCH || (!more && numRecs > 0)){
+      int numSelected = ceng.Compare(recs,numRecs,myT->literal,myT->cnf,selected);
+      for(int i=0;i<numSelected;i++){
+        Record* rec = &batch[selected[i]];
+        if(passesBloomFilters(rec,myT->bloomFilters,myT->bloomOrders) && // push to output pipe if we have equality
+           !myT->outputPipe->Insert(rec)){ // the consumer has all it wants, and so do we
+          myT->inputPipe->Cancel();
+          more = false;
+          break;
+        }
+      }
+      numRecs = 0; // the records left behind are freed as the next batch is removed into them
     }
   }
+  delete [] batch;
   // cout << "select pipe calling shutdown" << endl;
   myT->outputPipe->ShutDown();
   return 0;
@@ -80,7 +176,9 @@ void SelectPipe :: Run (Pipe &inPipe, Pipe &outPipe, CNF &selOp, Record &literal
   t->outputPipe = &outPipe;
   t->cnf = &selOp;
   t->literal = &literal;
-  pthread_create(&operationThread,NULL,selectPipeRoutine,(void*)t);
+  t->bloomFilters = &bloomFilters;
+  t->bloomOrders = &bloomOrders;
+  startThread(&operationThread,selectPipeRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -96,28 +194,96 @@ typedef struct{
   Pipe* outputPipe;
   CNF* cnf;
   Record* literal;
+  vector<BloomFilter*>* bloomFilters;
+  vector<OrderMaker*>* bloomOrders;
+  int* keepAtts;            // attributes to output (see SelectFile.KeepAtts); NULL: all of them
+  int numKeepAtts;
+  Schema* fileSchema;
 } SelectFileUtil; // struct used by operationThread in SelectFile
 
 void* selectFileRoutine(void* ptr){
   SelectFileUtil* myT = (SelectFileUtil*) ptr;
   Record currRec;
   ComparisonEngine ceng;
+  waitForBloomFilters(myT->bloomFilters); // no-op unless the planner pushed a join's filter down to us
   myT->dbfile->MoveFirst();
-  while(myT->dbfile->GetNext(currRec,*(myT->cnf),*(myT->literal))){ // keep reading from the input file as long it has elements in it
-    myT->outputPipe->Insert(&currRec);
+  char* pageBits = new (std::nothrow) char[PAGE_SIZE];
+  if(pageBits == NULL){
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+  vector<char*> recs;
+  vector<int> selected;
+  int got;
+  bool wanted = true; // until the consumer has all it wants
+  while(wanted && (got = myT->dbfile->GetNextPage(pageBits)) == 1){ // a page at a time, as long as the file has pages left
+    int numRecs = ((int *) pageBits)[0];
+    if(numRecs == 0)
+      continue;
+    if(recs.size() < numRecs){
+      recs.resize(numRecs);
+      selected.resize(numRecs);
+    }
+    char* pos = pageBits + sizeof(int); // the records lie one after the other, each starting with its length
+    for(int i=0;i<numRecs;i++){
+      recs[i] = pos;
+      pos += ((int *) pos)[0];
+    }
+    int numSelected = ceng.Compare(&recs[0],numRecs,myT->literal,myT->cnf,&selected[0]);
+    for(int i=0;i<numSelected;i++){ // only now are the accepted records copied off the page
+      if(myT->keepAtts != NULL) // with only the attributes kept
+        currRec.ProjectFrom(recs[selected[i]],myT->keepAtts,myT->numKeepAtts,myT->fileSchema);
+      else{
+        int len = ((int *) recs[selected[i]])[0];
+        RecordPool::Free(currRec.bits); // still there if a Bloom filter turned the last one away
+        currRec.bits = RecordPool::Alloc(len);
+        memcpy(currRec.bits,recs[selected[i]],len);
+      }
+      if(passesBloomFilters(&currRec,myT->bloomFilters,myT->bloomOrders) && !myT->outputPipe->Insert(&currRec)){
+        wanted = false;
+        break;
+      }
+    }
+  }
+  delete [] pageBits;
+  if(got < 0){ // sorted and B+-tree files find the records with their own order or index
+    while(myT->dbfile->GetNext(currRec,*(myT->cnf),*(myT->literal))){ // keep reading from the input file as long it has elements in it
+      if(myT->keepAtts != NULL)
+        currRec.Project(myT->keepAtts,myT->numKeepAtts,myT->fileSchema);
+      if(passesBloomFilters(&currRec,myT->bloomFilters,myT->bloomOrders) && !myT->outputPipe->Insert(&currRec))
+        break;
+    }
   }
   // cout << "select file calling shutdown" << endl; // debug
   myT->outputPipe->ShutDown();
   return 0;
 }
 
+SelectFile :: SelectFile (){
+  keepAtts = NULL;
+  numKeepAtts = 0;
+  fileSchema = NULL;
+}
+
+// output only attsToKeep of the records of the file, whose schema is fileSchema
+void SelectFile :: KeepAtts (int *attsToKeep, int numAttsToKeep, Schema *fileSchema){
+  keepAtts = attsToKeep;
+  numKeepAtts = numAttsToKeep;
+  this->fileSchema = fileSchema;
+}
+
 void SelectFile :: Run (DBFile &inFile, Pipe &outPipe, CNF &selOp, Record &literal){
   SelectFileUtil* t = new SelectFileUtil;
   t->dbfile = &inFile;
   t->outputPipe = &outPipe;
   t->cnf = &selOp;
   t->literal = &literal;
-  pthread_create(&operationThread,NULL,selectFileRoutine,(void*)t);
+  t->bloomFilters = &bloomFilters;
+  t->bloomOrders = &bloomOrders;
+  t->keepAtts = keepAtts;
+  t->numKeepAtts = numKeepAtts;
+  t->fileSchema = fileSchema;
+  startThread(&operationThread,selectFileRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -139,6 +305,7 @@ typedef struct{
   int* keepMe;
   int numAttsInput;
   int numAttsOutput;
+  Schema* schema; // of the input, if the planner gave it (see Project.UseSchema)
 } ProjectUtil; // struct used by operationThread in Project
 
 void* projectRoutine(void* ptr){
@@ -146,13 +313,28 @@ void* projectRoutine(void* ptr){
   Record currRec;
   ComparisonEngine ceng;
   while(myT->inputPipe->Remove(&currRec)!=0){ // keep reading from the input pipe as long it has elements in it
-    currRec.Project(myT->keepMe,myT->numAttsOutput,myT->numAttsInput);
-    myT->outputPipe->Insert(&currRec);
+    if(myT->schema != NULL)
+      currRec.Project(myT->keepMe,myT->numAttsOutput,myT->schema);
+    else
+      currRec.Project(myT->keepMe,myT->numAttsOutput,myT->numAttsInput);
+    if(!myT->outputPipe->Insert(&currRec)){ // the consumer has all it wants, and so do we
+      myT->inputPipe->Cancel();
+      break;
+    }
   }
   myT->outputPipe->ShutDown();
   return 0;
 }
 
+Project :: Project (){
+  schema = NULL;
+}
+
+// lay the output records out by the schema of the input
+void Project :: UseSchema (Schema *inSchema){
+  schema = inSchema;
+}
+
 void Project :: Run (Pipe &inPipe, Pipe &outPipe, int *keepMe, int numAttsInput, int numAttsOutput){
   ProjectUtil* t = new ProjectUtil;
   t->inputPipe = &inPipe;
@@ -160,7 +342,8 @@ void Project :: Run (Pipe &inPipe, Pipe &outPipe, int *keepMe, int numAttsInput,
   t->keepMe = keepMe;
   t->numAttsInput = numAttsInput;
   t->numAttsOutput = numAttsOutput;
-  pthread_create(&operationThread,NULL,projectRoutine,(void*)t);
+  t->schema = schema;
+  startThread(&operationThread,projectRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -174,18 +357,20 @@ void Project :: Run (Pipe &inPipe, Pipe &outPipe, int *keepMe, int numAttsInput,
  * CNF can’t be implemented using a sort-merge join (due to the fact it does not have an
  * equality check) then your Join operation should default to a block-nested loops join.
  *
- * Note that we assume the left relation is SMALLER than the right.
+ * A block nested loop join holds the right input in memory, unless the planner asks
+ * for the left one with UseBlockNestedLoop(true).
  ******************************************************************************/
 typedef struct{
   Pipe* inputPipe;
   Pipe* outputPipe;
   OrderMaker* orderMaker;
   int runlen;
+  bool descending;
 } CreateBigQUtil; // struct used by createBigQThread in DuplicateRemoval
 
 void* createBigQRoutine(void* ptr){
   CreateBigQUtil* myT = (CreateBigQUtil*) ptr;
-  new BigQ(*(myT->inputPipe),*(myT->outputPipe),*(myT->orderMaker),myT->runlen);
+  new BigQ(*(myT->inputPipe),*(myT->outputPipe),*(myT->orderMaker),myT->runlen,myT->descending);
   return 0;
 }
 
@@ -197,8 +382,271 @@ typedef struct{
   Record* literal;
   int runlen;
   int bnlpages; // used for BNL join
+  BloomFilter* bloomFilter; // NULL: join builds and applies its own filter
+  bool bloomPushedDown;     // true: the filter is applied below the right input
+  int algorithm;            // JOIN_SORT_MERGE or JOIN_BLOCK_NESTED_LOOP
+  bool blockLeft;           // BNL: the left input is held in memory, not the right
+  Schema* leftSchema;       // schemas of the inputs, if the planner gave them (see Join.UseSchemas)
+  Schema* rightSchema;
+  int* keepAtts;            // attributes of the output (see Join.KeepAtts); NULL: all of them
+  int numKeepAtts;
+  int keepFromLeft;
+  bool lateLeft;            // sort-merge: materialize the left input late (see Join.UseLateMaterialization)
+  bool lateRight;
 } JoinUtil; // struct used by operationThread in Project
 
+/*------------------------------------------------------------------------------
+ * The attributes of the output records: those Join was told to keep, or all of
+ * the left ones followed by all of the right ones. Sets totalAtts and startOfRight
+ * (where the right ones start) for MergeRecords
+ *----------------------------------------------------------------------------*/
+int* joinedAtts(int numAttsLeft, int numAttsRight, int &totalAtts, int &startOfRight, JoinUtil* myT){
+  if(myT->keepAtts != NULL){
+    totalAtts = myT->numKeepAtts;
+    startOfRight = myT->keepFromLeft;
+    int* attsToKeep = new int[totalAtts];
+    memcpy(attsToKeep, myT->keepAtts, totalAtts * sizeof(int));
+    return attsToKeep;
+  }
+  totalAtts = numAttsLeft + numAttsRight; // we preserve all input attributes. This
+                                          // fixes bugs with q1, q3 in the final demo queries.execute.
+  startOfRight = numAttsLeft;
+  int* attsToKeep = new int[totalAtts];
+  for(int i=0;i<numAttsLeft;i++){
+    attsToKeep[i] = i;
+  }
+  for(int i=numAttsLeft;i<totalAtts;i++){
+    attsToKeep[i] = i-numAttsLeft;
+  }
+  return attsToKeep;
+}
+
+/*------------------------------------------------------------------------------
+ * Put the concatenation of (the kept attributes of) left and right in newRec. It
+ * is laid out by the schemas of the inputs when Join has them, so that it keeps
+ * to Schema.GetFixedOffset
+ *----------------------------------------------------------------------------*/
+void mergeJoined(Record &newRec, Record* left, Record* right, int numAttsLeft, int numAttsRight,
+                 int* attsToKeep, int totalAtts, int startOfRight, JoinUtil* myT){
+  if(myT->leftSchema != NULL && myT->rightSchema != NULL)
+    newRec.MergeRecords (left, right, myT->leftSchema, myT->rightSchema, attsToKeep, totalAtts, startOfRight);
+  else
+    newRec.MergeRecords (left, right, numAttsLeft, numAttsRight, attsToKeep, totalAtts, startOfRight);
+}
+
+/*------------------------------------------------------------------------------
+ * The stash of an input of a sort-merge join that is materialized late (see
+ * Join in RelOp.h). Records are appended a page at a time; a record is known by
+ * the page it went to and its slot (place) on that page
+ *----------------------------------------------------------------------------*/
+typedef struct{
+  char* bits;               // the page as it is in the file
+  vector<char*> recs;       // where each slot's record starts in bits
+} stashPage;
+
+typedef struct{
+  File file;
+  char name[16];
+  Page page;                // the page being filled
+  int pageNo;               // its number in the file
+  int slot;                 // records on it so far
+  int numAtts;              // attributes of the stashed records
+  int cachePages;           // pages of the file the cache may hold
+  unordered_map<int, stashPage*> cache;
+  deque<int> cacheOrder;    // pages in the cache, oldest first
+} RecordStash;
+
+void stashOpen(RecordStash* stash, int cachePages){
+  gen_random_string(stash->name,6);
+  strcat(stash->name,".bin");
+  stash->file.Open(0,stash->name);
+  stash->pageNo = 0;
+  stash->slot = 0;
+  stash->numAtts = 0;
+  stash->cachePages = (cachePages < 1) ? 1 : cachePages;
+}
+
+/*------------------------------------------------------------------------------
+ * Append rec to the stash (consuming it) and put its key record in key: the
+ * attributes of order, in the order's order, followed by two Ints, the page and
+ * the slot of rec
+ *----------------------------------------------------------------------------*/
+void stashAdd(RecordStash* stash, Record &rec, OrderMaker &order, Record &key){
+  char* bits = rec.bits;
+  int numAtts = rec.GetNumAtts();
+  int numKeyAtts = order.getNumAtts();
+  int* whichAtts = order.getWhichAtts();
+  if(stash->numAtts == 0) stash->numAtts = numAtts;
+
+  // an attribute takes the bytes up to where the next one starts, its padding included
+  int totSpace = sizeof(int) * (numKeyAtts + 3) + 2 * sizeof(int);
+  for(int i=0;i<numKeyAtts;i++){
+    int att = whichAtts[i];
+    int end = (att == numAtts - 1) ? ((int *) bits)[0] : ((int *) bits)[att + 2];
+    totSpace += end - ((int *) bits)[att + 1];
+  }
+  char* keyBits = RecordPool::Alloc(totSpace);
+  ((int *) keyBits)[0] = totSpace;
+  int curPos = sizeof(int) * (numKeyAtts + 3);
+  for(int i=0;i<numKeyAtts;i++){
+    int att = whichAtts[i];
+    int start = ((int *) bits)[att + 1];
+    int end = (att == numAtts - 1) ? ((int *) bits)[0] : ((int *) bits)[att + 2];
+    ((int *) keyBits)[i + 1] = curPos;
+    memcpy(keyBits + curPos, bits + start, end - start);
+    curPos += end - start;
+  }
+
+  if(stash->page.Append(&rec) == 0){ // the page is full; on to the next one
+    stash->file.AddPage(&stash->page,stash->pageNo);
+    stash->page.EmptyItOut();
+    stash->pageNo++;
+    stash->slot = 0;
+    stash->page.Append(&rec);
+  }
+
+  ((int *) keyBits)[numKeyAtts + 1] = curPos;
+  *((int *) (keyBits + curPos)) = stash->pageNo;
+  ((int *) keyBits)[numKeyAtts + 2] = curPos + sizeof(int);
+  *((int *) (keyBits + curPos + sizeof(int))) = stash->slot;
+  stash->slot++;
+
+  RecordPool::Free(key.bits);
+  key.bits = keyBits;
+}
+
+// write out the last page, once everything is in the stash
+void stashFinish(RecordStash* stash){
+  if(stash->slot > 0)
+    stash->file.AddPage(&stash->page,stash->pageNo);
+  stash->page.EmptyItOut();
+}
+
+/*------------------------------------------------------------------------------
+ * A copy of the record whose key record is key (with numKeyAtts join attributes).
+ * Its page is read unless the cache has it; the page that has been in the cache
+ * longest makes room for it
+ *----------------------------------------------------------------------------*/
+Record* stashFetch(RecordStash* stash, Record* key, int numKeyAtts){
+  char* keyBits = key->bits;
+  int pageNo = *((int *) (keyBits + ((int *) keyBits)[numKeyAtts + 1]));
+  int slot = *((int *) (keyBits + ((int *) keyBits)[numKeyAtts + 2]));
+
+  auto cached = stash->cache.find(pageNo);
+  stashPage* page;
+  if(cached != stash->cache.end()){
+    page = cached->second;
+  }
+  else{
+    if(stash->cache.size() >= stash->cachePages){
+      stashPage* oldest = stash->cache[stash->cacheOrder.front()];
+      stash->cache.erase(stash->cacheOrder.front());
+      stash->cacheOrder.pop_front();
+      delete [] oldest->bits;
+      delete oldest;
+      CountMemory(-PAGE_SIZE);
+    }
+    page = new stashPage;
+    page->bits = new (std::nothrow) char[PAGE_SIZE];
+    if(page->bits == NULL){
+      cout << "ERROR : Not enough memory. EXIT !!!\n";
+      exit(1);
+    }
+    CountMemory(PAGE_SIZE);
+    stash->file.GetPageBits(page->bits,pageNo);
+    int numRecs = ((int *) page->bits)[0];
+    char* pos = page->bits + sizeof(int);
+    for(int i=0;i<numRecs;i++){
+      page->recs.push_back(pos);
+      pos += ((int *) pos)[0];
+    }
+    stash->cache[pageNo] = page;
+    stash->cacheOrder.push_back(pageNo);
+  }
+
+  char* bits = page->recs[slot];
+  Record* rec = new Record;
+  rec->bits = RecordPool::Alloc(((int *) bits)[0]);
+  memcpy(rec->bits,bits,((int *) bits)[0]);
+  return rec;
+}
+
+// the records of the key records in keys, fetched from the stash
+vector<Record*>* stashFetchAll(RecordStash* stash, vector<Record*>* keys, int numKeyAtts){
+  vector<Record*>* recs = new vector<Record*>();
+  for(int i=0;i<keys->size();i++){
+    recs->push_back(stashFetch(stash,keys->at(i),numKeyAtts));
+  }
+  return recs;
+}
+
+void stashClose(RecordStash* stash){
+  for(auto it = stash->cache.begin();it != stash->cache.end();it++){
+    delete [] it->second->bits;
+    delete it->second;
+    CountMemory(-PAGE_SIZE);
+  }
+  stash->file.Close();
+  remove(stash->name);
+}
+
+/*------------------------------------------------------------------------------
+ * The OrderMakers of the key records stashAdd makes for order: keyOrder on the
+ * join attributes, and sortOrder on them and then the page and the slot, so that
+ * the records with the same join attributes are fetched in the order they were
+ * stashed, a page after the other
+ *----------------------------------------------------------------------------*/
+void stashKeyOrder(OrderMaker &order, OrderMaker &keyOrder, OrderMaker &sortOrder){
+  myAtt atts[MAX_ANDS + 2];
+  int numAtts = order.getNumAtts();
+  for(int i=0;i<numAtts;i++){
+    atts[i].attNo = i;
+    atts[i].attType = order.getWhichTypes()[i];
+  }
+  keyOrder.initOrderMaker(numAtts,atts);
+  atts[numAtts].attNo = numAtts;
+  atts[numAtts].attType = Int;
+  atts[numAtts + 1].attNo = numAtts + 1;
+  atts[numAtts + 1].attType = Int;
+  sortOrder.initOrderMaker(numAtts + 2,atts);
+}
+
+/*------------------------------------------------------------------------------
+ * One round of the block nested loop join: read every record stored in dbfile
+ * (the non-block side) and join it with every record in block. Returns false
+ * if the consumer cancelled the output pipe, so that no more rounds are needed
+ *----------------------------------------------------------------------------*/
+bool joinBlock(vector<Record*> &block, DBFile* dbfile, char* fileName, int numAttsDisk, JoinUtil* myT){
+  ComparisonEngine ceng;
+  int numAttsBlock = block[0]->GetNumAtts();
+  int numAttsLeft = myT->blockLeft ? numAttsBlock : numAttsDisk;
+  int numAttsRight = myT->blockLeft ? numAttsDisk : numAttsBlock;
+  int totalAtts, startOfRight;
+  int* attsToKeep = joinedAtts(numAttsLeft, numAttsRight, totalAtts, startOfRight, myT);
+
+  Record diskRec;
+  bool wanted = true;
+  dbfile->Open(fileName);
+  dbfile->MoveFirst();
+  while(wanted && dbfile->GetNext(diskRec)){ // pipe through the disk side tuples
+    for(int i=0;i<block.size();i++){
+      Record* leftRec = myT->blockLeft ? block[i] : &diskRec;
+      Record* rightRec = myT->blockLeft ? &diskRec : block[i];
+      if(ceng.Compare(leftRec,rightRec,myT->literal,myT->cnf)){ // perform the joins if the join criteria are met
+        Record newRec;
+        mergeJoined (newRec, leftRec, rightRec, numAttsLeft, numAttsRight, attsToKeep, totalAtts, startOfRight, myT);
+        if(!myT->outputPipe->Insert(&newRec)){ // the consumer has all it wants
+          wanted = false;
+          break;
+        }
+      }
+    }
+  }
+  dbfile->Close();
+  delete [] attsToKeep;
+  return wanted;
+}
+
 void* joinRoutine(void* ptr){
   JoinUtil* myT = (JoinUtil*) ptr;
   // create two ordermakers, one each for the two BigQ's that we'll generate
@@ -207,29 +655,28 @@ void* joinRoutine(void* ptr){
   OrderMaker leftOrderMaker, rightOrderMaker;
   int retval = myT->cnf->GetSortOrders(leftOrderMaker, rightOrderMaker);
 
-  if(retval==0){ // an acceptable ordering could not be determined for the given comparison
-                 // i.e., you don't have an equality sign (you might have a <, >, or <= e.g.)
-                 // perform a block nested loop join
+  if(retval==0 || myT->algorithm==JOIN_BLOCK_NESTED_LOOP){ // an acceptable ordering could not be determined for the
+                 // given comparison i.e., you don't have an equality sign (you might have a <, >, or <= e.g.), or the
+                 // planner found a block nested loop join cheaper. Perform a block nested loop join
     // ----------------------------------------------------------
-    // WE ASSUME THE LEFT RELATION IS SMALLER AND RIGHT IS LARGER
-    // LEFT  --> DBFile
-    // RIGHT --> In-Memory
+    // BLOCK SIDE --> In-Memory (the right input unless blockLeft)
+    // OTHER SIDE --> DBFile
     // ----------------------------------------------------------
-    // we read in n pages (this is a 'block') of the larger relation. Then,
-    // records of the smaller relation are piped through on the fly and
-    // for each such record, we check whether the join condition is met. If
-    // yes, the concatenation of both is pushed to the output.
-    // Then, we load in the next block of the larger relation and repeat
-    // the process.
-    // The smaller relation is chosen to be piped through so as to minimize the
-    // number of disk reads
-
-    // Note that we need to pipe in records of the smaller relation multiple times.
-    // However, inputPipeR can be read completely only once. Hence, we need some kind
-    // of storage to store this data for the length of our session. We don't want to
-    // do this on the heap because it will, presumably, be full with as much of the
-    // larger relation as we can fit in it. Hence, we choose a DBFile for the job.
-    DBFile* dbfile;
+    // we read in n pages (this is a 'block') of the block side. Then, records
+    // of the other side are read back from the DBFile and for each such record,
+    // we check whether the join condition is met with every record in the block.
+    // If yes, the concatenation of both (left first) is pushed to the output.
+    // Then, we load in the next block and repeat the process.
+    // The planner holds the smaller input in memory so that the other one has
+    // to be read as few times as possible
+
+    // Note that we need to read the other side multiple times. However, its
+    // pipe can be read completely only once. Hence, we need some kind of storage
+    // to store this data for the length of our session. We don't want to do this
+    // on the heap because it will, presumably, be full with as much of the block
+    // side as we can fit in it. Hence, we choose a DBFile for the job.
+    Pipe* diskPipe = myT->blockLeft ? myT->inputPipeR : myT->inputPipeL;
+    Pipe* blockPipe = myT->blockLeft ? myT->inputPipeL : myT->inputPipeR;
     char* phase1OutputFile = new char[11]; // make sure this length is 1 more than the second argument of gen_random_string
     char* phase1OutputMetaFile = new char[16];
     gen_random_string(phase1OutputFile,6); // name of temp file to store results of phase 1
@@ -237,171 +684,152 @@ void* joinRoutine(void* ptr){
     strcpy(phase1OutputMetaFile,phase1OutputFile);
     strcat(phase1OutputMetaFile,".meta"); // this is created by DBFile.cc but we don't need it.
                                           // delete it when we delete phase1OutputFile
-    dbfile = new DBFile();
+    DBFile* dbfile = new DBFile();
     dbfile->Create (phase1OutputFile, heap, NULL);
 
-    Record smallerRelRec,smallerRelRecBackup;
-
-    while(myT->inputPipeL->Remove(&smallerRelRec)){ // add all smaller relation tuples to the dbfile
-      // smallerRelRec.Print(new Schema("catalog","supplier"));
-      smallerRelRecBackup.Copy(&smallerRelRec);
-      dbfile->Add(smallerRelRec);
+    Record diskRec;
+    int numAttsDisk = 0; // stays 0 if the disk side is empty
+    while(diskPipe->Remove(&diskRec)){ // add all the disk side tuples to the dbfile
+      if(numAttsDisk == 0) numAttsDisk = diskRec.GetNumAtts();
+      dbfile->Add(diskRec);
     }
+    dbfile->Close();
 
     Page tempPage; // this page is used to track a page worth of data
-    int numPages = 0; // track how many pages read. used to keep track of a run worth of data
-    vector<Record*>* largerRelVec = new vector<Record*>(); // vector used to store larger relation tuples in memory
-    Record* newRec;
-    Record* tempRec; // tempRec is pushed onto largerRelVec
-    Record largerRelRec;
-    ComparisonEngine ceng;
-
-    int numRecs = 0; // count number of records read
-    int numAttsLeft = 0;
-    int numAttsRight = 0;
-    int numAttsJoinRight = 0;
-    int totalAtts = 0;
-    int* attsToKeep;
-
-    bool mergeVarsInited = false; // true = merge variables inited
-
-    int blah = 0;
-    while(myT->inputPipeR->Remove(&largerRelRec)){ // load all larger relation tuples into main memory
-      if(!mergeVarsInited){ // one-time block to init merge variables
-        // init merge variables
-        numAttsLeft = smallerRelRecBackup.GetNumAtts();
-        numAttsRight = largerRelRec.GetNumAtts();
-        numAttsJoinRight = rightOrderMaker.getNumAtts();
-        totalAtts = numAttsLeft + numAttsRight; // we preserve all input attributes. This
-                                                // fixes bugs with q1, q3 in the final demo queries.execute.
-        attsToKeep = new int[totalAtts];
-        int* rightJoinAtts = new int[numAttsJoinRight];
-        rightJoinAtts = rightOrderMaker.getWhichAtts();
-        // copy over all of the left records attributes
-        for(int i=0;i<numAttsLeft;i++){
-          attsToKeep[i] = i;
-        }
-        /*
-         * This code is intended to combine input attribute sets that don't have the join columns
-         * duplicated. This is what we believe correct Join behavior should be. However, since the
-         * test code doesn't give a crap whether join columns appear more than once, we've commented
-         * this out.
-         * */
-        /*
-        // exclude those attributes on the right that were already used for the join
-        // and hence already in the left attributes we just copied over above
-        int j = 0;
-        int correctIndex = 0;
-        for(int i=numAttsLeft;i<totalAtts+numAttsJoinRight;i++){ // add numAttsJoinRight so we go to the end of the right join (we'll
-                                                                 // be ignoring numAttsJoinRight elements)
-          if((i-numAttsLeft)==rightJoinAtts[j]){
-            j++;
-            correctIndex++;
-          }
-          else{
-            attsToKeep[i-correctIndex] = i-numAttsLeft;
-          }
-        }
-        */
-        for(int i=numAttsLeft;i<totalAtts;i++){
-          attsToKeep[i] = i-numAttsLeft;
-        }
-        mergeVarsInited = true;
-      }
-      newRec = new Record();
-      tempRec = new Record();
-      newRec->Copy(&largerRelRec);
-      tempRec->Copy(&largerRelRec); // tempRec is pushed onto the vector used for qSort (largerRelVec). we don't push newRec because
-                                    // newRec will be consumed below in tempPage.Append. Hence, the pointer in largerRelVec
-                                    // will now point to emptied bits.
-      numRecs++;
-      largerRelVec->push_back(tempRec);
-      if(tempPage.Append(newRec)==0){
+    int numPages = 0; // track how many pages read. used to keep track of a block worth of data
+    vector<Record*> block; // the block side tuples in memory
+    long blockBytes = 0; // bytes of the records in block
+    Record blockRec;
+    bool moreRecs = blockPipe->Remove(&blockRec);
+    while(moreRecs){
+      Record* copy = new Record();
+      copy->Copy(&blockRec); // tempPage.Append consumes blockRec; the block keeps a copy
+      if(tempPage.Append(&blockRec)==0){
         tempPage.EmptyItOut(); // reset for next page
+        tempPage.Append(&blockRec);
         numPages++;
       }
-      if(numPages == myT->bnlpages){ // we have one block of records. Pipe in the larger relation and join on the fly
-        numRecs--; // the last write filled up tempPage and hence numRecs that we incremented BEFORE it doesn't really count
-        dbfile->Close();
-        dbfile->Open(phase1OutputFile);
-        dbfile->MoveFirst();
-        while(dbfile->GetNext(smallerRelRec)){ // pipe through the smaller relation tuples
-          for(int i=0;i<largerRelVec->size();i++){
-            if(ceng.Compare(&smallerRelRec,largerRelVec->at(i),myT->literal,myT->cnf)){ // perform the joins if the join criteria are met
-              Record newRec;
-              newRec.MergeRecords (&smallerRelRec, largerRelVec->at(i), numAttsLeft, numAttsRight, attsToKeep, totalAtts, numAttsLeft);
-              myT->outputPipe->Insert(&newRec);
-            }
-          }
-        }
-        numPages = 0; // reset page count for next block
-        largerRelRec.Copy(newRec); // since tempPage was full, this last record would
-                                 // not fit in the page. It was in newRec
-                                 // but we now copy it to largerRelRec so the new
-                                 // block can start with it
-        numRecs = 1; // reset count to 1 instead of 0 so that going into the while loop the next time
-                     // doesn't overwrite largerRelRec that we just wrote above
-        for(int i=0;i<largerRelVec->size();i++){
-          delete largerRelVec->at(i);
+      block.push_back(copy);
+      blockBytes += ((int *) copy->bits)[0];
+      moreRecs = blockPipe->Remove(&blockRec);
+      if(numPages == myT->bnlpages || !moreRecs){ // we have one block of records (or the last, smaller, one).
+                                                  // Read the disk side through and join on the fly
+        CountMemory(blockBytes);
+        if(numAttsDisk > 0 && !joinBlock(block, dbfile, phase1OutputFile, numAttsDisk, myT)){
+          myT->inputPipeL->Cancel(); // the consumer has all it wants, and so do we
+          myT->inputPipeR->Cancel();
+          moreRecs = false;
         }
-        largerRelVec = new vector<Record*>();
-      }
-    }
-    if(numRecs>0){ // we still have elements in the block to empty (these elements
-                   // didn't add up to one block worth of records, however, which
-                   // is why we never went into the if condition above)
-      dbfile->Close();
-      dbfile->Open(phase1OutputFile);
-      dbfile->MoveFirst();
-      while(dbfile->GetNext(smallerRelRec)){ // pipe through the smaller relation tuples
-        for(int i=0;i<largerRelVec->size();i++){
-          if(ceng.Compare(&smallerRelRec,largerRelVec->at(i),myT->literal,myT->cnf)){ // perform the joins if the join criteria are met
-            Record newRec;
-            newRec.MergeRecords (&smallerRelRec, largerRelVec->at(i), numAttsLeft, numAttsRight, attsToKeep, totalAtts, numAttsLeft);
-            myT->outputPipe->Insert(&newRec);
-          }
+        for(int i=0;i<block.size();i++){
+          delete block[i];
         }
-      }
-      for(int i=0;i<largerRelVec->size();i++){
-        delete largerRelVec->at(i);
+        block.clear();
+        CountMemory(-blockBytes);
+        blockBytes = 0;
+        tempPage.EmptyItOut();
+        numPages = 0; // reset page count for next block
       }
     }
-    dbfile->Close();
+    delete dbfile;
     remove(phase1OutputFile);
     remove(phase1OutputMetaFile);
     myT->outputPipe->ShutDown();
   }
   else{ // plain vanilla sort-merge join
+    // The BigQs don't read the input pipes directly. We read all of the left input
+    // first, building a Bloom filter on its join keys as we pass it on to the left
+    // BigQ. Then we pass on only those right records that pass the filter. Right
+    // records that can't possibly join are thus never sorted.
+    BloomFilter* bloomFilter = myT->bloomFilter;
+    bool ownFilter = (bloomFilter == NULL);
+    if(ownFilter) bloomFilter = new BloomFilter();
+    Pipe* inputPipeL = new Pipe(100);
+    Pipe* inputPipeR = new Pipe(100);
+
+    // An input materialized late goes to its stash, and its BigQ sorts the key
+    // records stashAdd makes instead, which are then compared on keyOrderL/R
+    RecordStash* stashL = myT->lateLeft ? new RecordStash : NULL;
+    RecordStash* stashR = myT->lateRight ? new RecordStash : NULL;
+    OrderMaker keyOrderL, keyOrderR, stashOrderL, stashOrderR;
+    OrderMaker* sortOrderL = &leftOrderMaker;
+    OrderMaker* sortOrderR = &rightOrderMaker;
+    OrderMaker* joinOrderL = &leftOrderMaker;
+    OrderMaker* joinOrderR = &rightOrderMaker;
+    if(stashL != NULL){
+      stashOpen(stashL,myT->runlen);
+      stashKeyOrder(leftOrderMaker,keyOrderL,stashOrderL);
+      sortOrderL = &stashOrderL;
+      joinOrderL = &keyOrderL;
+    }
+    if(stashR != NULL){
+      stashOpen(stashR,myT->runlen);
+      stashKeyOrder(rightOrderMaker,keyOrderR,stashOrderR);
+      sortOrderR = &stashOrderR;
+      joinOrderR = &keyOrderR;
+    }
+
     // now create two BigQ IN NEW THREADS so we don't block this one
     // one BigQ works on the left record and one on the right
     // Left BigQ
     Pipe* outputPipeL = new Pipe(100);
     CreateBigQUtil* tL = new CreateBigQUtil;
-    tL->inputPipe = myT->inputPipeL;
+    tL->inputPipe = inputPipeL;
     tL->outputPipe = outputPipeL;
-    tL->orderMaker = &leftOrderMaker;
+    tL->orderMaker = sortOrderL;
     tL->runlen = myT->runlen;
+    tL->descending = false;
     pthread_t createBigQThreadL;
-    pthread_create(&createBigQThreadL,NULL,createBigQRoutine,(void*)tL);
+    startThread(&createBigQThreadL,createBigQRoutine,(void*)tL,threadCounters,false);
     // Right BigQ
     Pipe* outputPipeR = new Pipe(100);
     CreateBigQUtil* tR = new CreateBigQUtil;
-    tR->inputPipe = myT->inputPipeR;
+    tR->inputPipe = inputPipeR;
     tR->outputPipe = outputPipeR;
-    tR->orderMaker = &rightOrderMaker;
+    tR->orderMaker = sortOrderR;
     tR->runlen = myT->runlen;
+    tR->descending = false;
     pthread_t createBigQThreadR;
-    pthread_create(&createBigQThreadR,NULL,createBigQRoutine,(void*)tR);
+    startThread(&createBigQThreadR,createBigQRoutine,(void*)tR,threadCounters,false);
+
+    Record inRec, keyRec;
+    while(myT->inputPipeL->Remove(&inRec)){ // build the filter from the left input
+      bloomFilter->Add(&inRec,&leftOrderMaker);
+      if(stashL != NULL){
+        stashAdd(stashL,inRec,leftOrderMaker,keyRec);
+        inputPipeL->Insert(&keyRec);
+      }
+      else
+        inputPipeL->Insert(&inRec);
+    }
+    if(stashL != NULL) stashFinish(stashL);
+    inputPipeL->ShutDown();
+    bloomFilter->Finish(); // wakes up any SelectFile/SelectPipe the planner pushed the filter down to
+
+    while(myT->inputPipeR->Remove(&inRec)){ // probe it with the right input
+      if(!myT->bloomPushedDown && !bloomFilter->MayContain(&inRec,&rightOrderMaker))
+        continue;
+      if(stashR != NULL){
+        stashAdd(stashR,inRec,rightOrderMaker,keyRec);
+        inputPipeR->Insert(&keyRec);
+      }
+      else
+        inputPipeR->Insert(&inRec);
+    }
+    if(stashR != NULL) stashFinish(stashR);
+    inputPipeR->ShutDown();
+    if(ownFilter) delete bloomFilter;
 
     int numAttsLeft = 0;
     int numAttsRight = 0;
-    int numAttsJoinRight = 0;
     int totalAtts = 0;
+    int startOfRight = 0;
     int* attsToKeep;
 
     Record recL;
     Record recR;
-    ComparisonEngine ceng;
+    KeyComparator joinKey = joinOrderL->GetComparator(*joinOrderR); // left records against right ones
+    KeyComparator leftKey = joinOrderL->GetComparator(); // left records against each other
+    KeyComparator rightKey = joinOrderR->GetComparator(); // right records against each other
     bool readLeft = true; // true = go ahead and read left BigQ
     bool readRight = true; // true = go ahead and read right BigQ
     bool leftDone = false; // true = left BigQ emptied
@@ -412,6 +840,7 @@ void* joinRoutine(void* ptr){
 
     // keep reading from the BigQs as long as they have elements in it
     bool dupsEnded = false;
+    bool wanted = true; // false once the consumer cancelled the output pipe
     do{
       // read in the first record from the appropriate bigQ
       // unless we exhausted the BigQ in the previous iteration
@@ -440,50 +869,19 @@ void* joinRoutine(void* ptr){
 
       if(!mergeVarsInited){ // one-time block to init merge variables
         // init merge variables
-        numAttsLeft = recL.GetNumAtts();
-        numAttsRight = recR.GetNumAtts();
-        numAttsJoinRight = rightOrderMaker.getNumAtts();
-        totalAtts = numAttsLeft + numAttsRight; // we preserve all input attributes. This
-                                                // fixes bugs with q1, q3 in the final demo queries.execute.
-        attsToKeep = new int[totalAtts];
-        int* rightJoinAtts = new int[numAttsJoinRight];
-        rightJoinAtts = rightOrderMaker.getWhichAtts();
-        // copy over all of the left records attributes
-        for(int i=0;i<numAttsLeft;i++){
-          attsToKeep[i] = i;
-        }
-        /*
-         * This code is intended to combine input attribute sets that don't have the join columns
-         * duplicated. This is what we believe correct Join behavior should be. However, since the
-           * test code doesn't give a crap whether join columns appear more than once, we've commented
-           * this out.
-           * */
-          /*
-          // exclude those attributes on the right that were already used for the join
-        // and hence already in the left attributes we just copied over above
-        int j = 0;
-        int correctIndex = 0;
-        for(int i=numAttsLeft;i<totalAtts+numAttsJoinRight;i++){ // add numAttsJoinRight so we go to the end of the right join (we'll
-                                                                 // be ignoring numAttsJoinRight elements)
-          if((i-numAttsLeft)==rightJoinAtts[j]){
-            j++;
-            correctIndex++;
-          }
-          else{
-            attsToKeep[i-correctIndex] = i-numAttsLeft;
-          }
-        }
-        */
-        for(int i=numAttsLeft;i<totalAtts;i++){
-          attsToKeep[i] = i-numAttsLeft;
-        }
+        numAttsLeft = (stashL != NULL) ? stashL->numAtts : recL.GetNumAtts();
+        numAttsRight = (stashR != NULL) ? stashR->numAtts : recR.GetNumAtts();
+        // all of the left records attributes, then all of the right ones, unless Join was
+        // told to keep only some of them
+        attsToKeep = joinedAtts(numAttsLeft, numAttsRight, totalAtts, startOfRight, myT);
         mergeVarsInited = true;
       }
 
       //recL.Print(new Schema("catalog","nation")); // debug
       //recR.Print(new Schema("catalog","region")); // debug
 
-      if(ceng.Compare(&recL,&leftOrderMaker,&recR,&rightOrderMaker)<0){ // left record < right record
+      int order = joinKey.Compare(recL.bits,recR.bits);
+      if(order<0){ // left record < right record
                                                                         // left BigQ must advance. right can stay put
         if(!leftDone){
           readLeft = true;
@@ -496,8 +894,8 @@ void* joinRoutine(void* ptr){
                             // right is already bigger than the left
         }
       }
-      else if(ceng.Compare(&recL,&leftOrderMaker,&recR,&rightOrderMaker)>0){ // right record < left record
-                                                                             // right BigQ must advance. left can stay put
+      else if(order>0){ // right record < left record
+                        // right BigQ must advance. left can stay put
         if(!rightDone){
           readLeft = false;
           readRight = true;
@@ -522,7 +920,7 @@ void* joinRoutine(void* ptr){
           Record* tempRec; // used to copy the right relation tuple before pushing on to the vector
           dupsEnded = false;
           do{
-            if(ceng.Compare(oldRecL,&leftOrderMaker,&recL,&leftOrderMaker)==0){ // use the same OrderMaker because these are tuples from the same table
+            if(leftKey.Compare(oldRecL->bits,recL.bits)==0){ // use the same OrderMaker because these are tuples from the same table
                                                                                 // the first comparison will always be true coz it's the same tuple
                                                                                 // thus, dupRecsVectorL will always have at least one element.
               tempRec = new Record(); // these will be destroyed below by calling delete on each individual vector element.
@@ -574,7 +972,7 @@ void* joinRoutine(void* ptr){
           Record* tempRec; // used to copy the right relation tuple before pushing on to the vector
           dupsEnded = false;
           do{
-            if(ceng.Compare(oldRecR,&rightOrderMaker,&recR,&rightOrderMaker)==0){ // use the same OrderMaker because these are tuples from the same table
+            if(rightKey.Compare(oldRecR->bits,recR.bits)==0){ // use the same OrderMaker because these are tuples from the same table
                                                                                   // the first comparison will always be true coz it's the same tuple
                                                                                   // thus, dupRecsVectorR will always have at least one element.
               tempRec = new Record(); // these will be destroyed below by calling delete on each individual vector element.
@@ -625,14 +1023,32 @@ void* joinRoutine(void* ptr){
         //   dupRecsVectorR->at(i)->Print(new Schema("catalog","region")); // debug
         // } // debug
 
-        // We have all duplicate records in two vectors. Perform a cross-join between them
-        for(int i=0;i<dupRecsVectorL->size();i++){
-          for(int j=0;j<dupRecsVectorR->size();j++){
+        // We have all duplicate records in two vectors. Perform a cross-join between them.
+        // The sides materialized late only have key records there; fetch their records first
+        vector<Record*>* joinedL = (stashL != NULL) ? stashFetchAll(stashL,dupRecsVectorL,leftOrderMaker.getNumAtts()) : dupRecsVectorL;
+        vector<Record*>* joinedR = (stashR != NULL) ? stashFetchAll(stashR,dupRecsVectorR,rightOrderMaker.getNumAtts()) : dupRecsVectorR;
+        for(int i=0;wanted && i<joinedL->size();i++){
+          for(int j=0;j<joinedR->size();j++){
             Record newRec;
-            newRec.MergeRecords (dupRecsVectorL->at(i), dupRecsVectorR->at(j), numAttsLeft, numAttsRight, attsToKeep, totalAtts, numAttsLeft);
-            myT->outputPipe->Insert(&newRec);
+            mergeJoined (newRec, joinedL->at(i), joinedR->at(j), numAttsLeft, numAttsRight, attsToKeep, totalAtts, startOfRight, myT);
+            if(!myT->outputPipe->Insert(&newRec)){
+              wanted = false;
+              break;
+            }
           }
         }
+        if(joinedL != dupRecsVectorL){
+          for(int i=0;i<joinedL->size();i++){
+            delete joinedL->at(i);
+          }
+          delete joinedL;
+        }
+        if(joinedR != dupRecsVectorR){
+          for(int i=0;i<joinedR->size();i++){
+            delete joinedR->at(i);
+          }
+          delete joinedR;
+        }
 
         // Delete the duplicate-holding vectors and recreate them for the next iteration
         for(int i=0;i<dupRecsVectorR->size();i++){
@@ -645,15 +1061,83 @@ void* joinRoutine(void* ptr){
         }
         dupRecsVectorL = new vector<Record*>();
 
+        if(!wanted) // the consumer has all it wants
+          break;
       }
       // cout << "leftDone " << leftDone << " rightDone " << rightDone << endl;
     }while(!leftDone || !rightDone); // make sure to exhaust Both BigQs
+    if(!wanted){ // the consumer has all it wants. The inputs have been read through
+                 // already; cancel them anyway, as the other operators do
+      myT->inputPipeL->Cancel();
+      myT->inputPipeR->Cancel();
+    }
+    // one BigQ may still have records for us if the other ran out first, or if we stopped.
+    // Stop them, and wait for them to finish before their counters go away with the Join
+    outputPipeL->Cancel();
+    outputPipeR->Cancel();
+    while(outputPipeL->Remove(&recL)!=0);
+    while(outputPipeR->Remove(&recR)!=0);
+    pthread_join(createBigQThreadL,NULL);
+    pthread_join(createBigQThreadR,NULL);
+    if(stashL != NULL){
+      stashClose(stashL);
+      delete stashL;
+    }
+    if(stashR != NULL){
+      stashClose(stashR);
+      delete stashR;
+    }
     myT->outputPipe->ShutDown();
   }
 
   return 0;
 }
 
+Join :: Join (){
+  bloomFilter = NULL;
+  bloomPushedDown = false;
+  algorithm = JOIN_SORT_MERGE;
+  blockLeft = false;
+  leftSchema = NULL;
+  rightSchema = NULL;
+  keepAtts = NULL;
+  numKeepAtts = 0;
+  keepFromLeft = 0;
+  lateLeft = false;
+  lateRight = false;
+}
+
+// lay the output records out by the schemas of the inputs
+void Join :: UseSchemas (Schema *leftSchema, Schema *rightSchema){
+  this->leftSchema = leftSchema;
+  this->rightSchema = rightSchema;
+}
+
+// do a block nested loop join even if the CNF has an equality
+void Join :: UseBlockNestedLoop (bool blockLeft){
+  algorithm = JOIN_BLOCK_NESTED_LOOP;
+  this->blockLeft = blockLeft;
+}
+
+// output only attsToKeep of the joined records, the first fromLeft of them from the left one
+void Join :: KeepAtts (int *attsToKeep, int numAttsToKeep, int fromLeft){
+  keepAtts = attsToKeep;
+  numKeepAtts = numAttsToKeep;
+  keepFromLeft = fromLeft;
+}
+
+// sort only the join keys of the left and/or right input, fetching the records after the merge
+void Join :: UseLateMaterialization (bool left, bool right){
+  lateLeft = left;
+  lateRight = right;
+}
+
+// build the Bloom filter into filter so the planner can push it down the right input
+void Join :: SetBloomFilter (BloomFilter *filter, bool pushedDown){
+  bloomFilter = filter;
+  bloomPushedDown = pushedDown;
+}
+
 void Join :: Run (Pipe &inPipeL, Pipe &inPipeR, Pipe &outPipe, CNF &selOp, Record &literal){
   JoinUtil* t = new JoinUtil;
   t->inputPipeL = &inPipeL;
@@ -663,7 +1147,18 @@ void Join :: Run (Pipe &inPipeL, Pipe &inPipeR, Pipe &outPipe, CNF &selOp, Recor
   t->literal = &literal;
   t->runlen = numPages;
   t->bnlpages = bnlPages;
-  pthread_create(&operationThread,NULL,joinRoutine,(void*)t);
+  t->bloomFilter = bloomFilter;
+  t->bloomPushedDown = bloomPushedDown;
+  t->algorithm = algorithm;
+  t->blockLeft = blockLeft;
+  t->leftSchema = leftSchema;
+  t->rightSchema = rightSchema;
+  t->keepAtts = keepAtts;
+  t->numKeepAtts = numKeepAtts;
+  t->keepFromLeft = keepFromLeft;
+  t->lateLeft = lateLeft;
+  t->lateRight = lateRight;
+  startThread(&operationThread,joinRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -699,28 +1194,37 @@ void* duplicateRemovalRoutine(void* ptr){
   t->outputPipe = &coupling;
   t->orderMaker = allAttrsOrderMaker;
   t->runlen = myT->runlen;
+  t->descending = false;
   pthread_t createBigQThread;
-  pthread_create(&createBigQThread,NULL,createBigQRoutine,(void*)t);
+  startThread(&createBigQThread,createBigQRoutine,(void*)t,threadCounters,false);
 
   Record firstRec, secondRec;
-  ComparisonEngine ceng;
+  KeyComparator recKey = allAttrsOrderMaker->GetComparator();
   bool firstRecRead = false;
   // compare output from bigQ pairwise. since bigQ's output is sorted, for every pair, if lhs == rhs, remove it coz
   // the rhs is a duplicate. else rhs becomes the lhs for the next round.
   while(coupling.Remove(&secondRec)!=0){ // keep reading from bigQ's output pipe as long it has elements in it
+    bool wanted = true;
     if(!firstRecRead){
       firstRec.Copy(&secondRec);
-      myT->outputPipe->Insert(&secondRec);
+      wanted = myT->outputPipe->Insert(&secondRec);
       firstRecRead = true;
     }
     else{
-      if(ceng.Compare(&firstRec,&secondRec,allAttrsOrderMaker)!=0){ // NOT a duplicate
+      if(recKey.Compare(firstRec.bits,secondRec.bits)!=0){ // NOT a duplicate
         firstRec.Copy(&secondRec);
-        myT->outputPipe->Insert(&secondRec);
+        wanted = myT->outputPipe->Insert(&secondRec);
       }
     }
+    if(!wanted){ // the consumer has all it wants. Stop the BigQ; we wait for it to finish below
+      coupling.Cancel();
+      while(coupling.Remove(&secondRec)!=0);
+      break;
+    }
   }
+  pthread_join(createBigQThread,NULL); // the BigQ counts towards us, and writes into coupling: it must not outlive either
   myT->outputPipe->ShutDown();
+  return 0;
 }
 
 void DuplicateRemoval :: Run (Pipe &inPipe, Pipe &outPipe, Schema &mySchema){
@@ -729,7 +1233,7 @@ void DuplicateRemoval :: Run (Pipe &inPipe, Pipe &outPipe, Schema &mySchema){
   t->outputPipe = &outPipe;
   t->schema = &mySchema;
   t->runlen = numPages;
-  pthread_create(&operationThread,NULL,duplicateRemovalRoutine,(void*)t);
+  startThread(&operationThread,duplicateRemovalRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -800,7 +1304,7 @@ void Sum :: Run (Pipe &inPipe, Pipe &outPipe, Function &computeMe){
   t->inputPipe = &inPipe;
   t->outputPipe = &outPipe;
   t->func = &computeMe;
-  pthread_create(&operationThread,NULL,sumRoutine,(void*)t);
+  startThread(&operationThread,sumRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -817,6 +1321,7 @@ typedef struct{
   OrderMaker* orderMaker;
   Function* func;
   int runlen;
+  Schema* schema; // of the input, if the planner gave it (see GroupBy.UseSchema)
 } GroupByUtil; // struct used by operationThread in GroupBy
 
 typedef struct{
@@ -838,6 +1343,19 @@ void* clearOutputVecRoutine(void* ptr){
   return 0;
 }
 
+/*------------------------------------------------------------------------------
+ * Put the sum of a group followed by the grouping attributes of firstRec in newRec.
+ * It is laid out by the schemas of the two when GroupBy has the input schema, so
+ * that it keeps to Schema.GetFixedOffset
+ *----------------------------------------------------------------------------*/
+void mergeGroup(Record* newRec, Record* sumRec, Schema* sumSchema, Record* firstRec, int* attsToKeep,
+                int totalAtts, GroupByUtil* myT){
+  if(myT->schema != NULL)
+    newRec->MergeRecords (sumRec, firstRec, sumSchema, myT->schema, attsToKeep, totalAtts, 1);
+  else
+    newRec->MergeRecords (sumRec, firstRec, 1, firstRec->GetNumAtts(), attsToKeep, totalAtts, 1);
+}
+
 void* groupByRoutine(void* ptr){
   // This is the flow of data for GroupBy:
   // GroupBy.inPipe ---> bigQ ---> bigQtoSumCoupling ---> (if part of same group) ---> sumInputPipe ---> mySum ---> sumToOutputCoupling ---> (collect in outRecsVector) ---> give from vector to GroupBy.outPipe IN A DIFFERENT THREAD
@@ -898,11 +1416,12 @@ void* groupByRoutine(void* ptr){
   t->outputPipe = &bigQtoSumCoupling;
   t->orderMaker = myT->orderMaker; // make bigQ sort ONLY by the fields we're grouping on
   t->runlen = myT->runlen;
+  t->descending = false;
   pthread_t createBigQThread, clearOutputVecThread;
-  pthread_create(&createBigQThread,NULL,createBigQRoutine,(void*)t);
+  startThread(&createBigQThread,createBigQRoutine,(void*)t,threadCounters,false);
 
   Record firstRec, secondRec;
-  ComparisonEngine ceng;
+  KeyComparator groupKey = myT->orderMaker->GetComparator();
   bool firstRecRead = false;
 
   // create a Sum object to keep track of totals for each group
@@ -923,6 +1442,8 @@ void* groupByRoutine(void* ptr){
   // the remaining columns are all the grouping attributes.
   // We create the output record using Record.MergeRecord
   int numAttsLeft = 1; // keep the sum
+  Attribute DA = {"Sum", Double}; // Sum always puts out a double
+  Schema sumSchema ("sum_sch", 1, &DA);
   int* leftAttsToKeep = new int[1]; // keep the sum
   leftAttsToKeep[0] = 0; // keep the sum
   int numAttsRight = myT->orderMaker->getNumAtts(); // keep all grouping attributes
@@ -943,7 +1464,7 @@ void* groupByRoutine(void* ptr){
       firstRecRead = true;
     }
     else{
-      if(ceng.Compare(&firstRec,&secondRec,myT->orderMaker)==0){ // this record is part of the same group as the last
+      if(groupKey.Compare(firstRec.bits,secondRec.bits)==0){ // this record is part of the same group as the last
         sumInputPipe->Insert(&secondRec); // put the record into Sum so it can add it to its running total
       }
       else{
@@ -953,10 +1474,11 @@ void* groupByRoutine(void* ptr){
         // summed result from sumToOutputCoupling and push it to GroupBy.outPipe
         sumInputPipe->ShutDown();
         mySum->WaitUntilDone ();
+        CountCPU(mySum->GetCounters().cpuNanos); // the Sum of every group is part of our work
         sumOfLastGroup = new Record; // record to hold the summed result of a group
         sumToOutputCoupling->Remove(sumOfLastGroup);
         newRec = new Record; // create a new record whose first column is the sum and the remaining columns are the grouping attributes
-        newRec->MergeRecords (sumOfLastGroup, &firstRec, numAttsLeft, numAttsRight, attsToKeep, totalAtts, numAttsLeft);
+        mergeGroup (newRec, sumOfLastGroup, &sumSchema, &firstRec, attsToKeep, totalAtts, myT);
         outRecsVector->push_back(newRec); // add the summed result to the end of our vector
 
         delete sumInputPipe; // re-create the sumInputPipe because we shut it down above
@@ -977,20 +1499,34 @@ void* groupByRoutine(void* ptr){
   // finish processing for LAST group
   sumInputPipe->ShutDown();
   mySum->WaitUntilDone ();
+  CountCPU(mySum->GetCounters().cpuNanos);
   sumOfLastGroup = new Record; // record to hold the summed result of a group
   sumToOutputCoupling->Remove(sumOfLastGroup);
   newRec = new Record; // create a new record whose first column is the sum and the remaining columns are the grouping attributes
-  newRec->MergeRecords (sumOfLastGroup, &firstRec, numAttsLeft, numAttsRight, attsToKeep, totalAtts, numAttsLeft);
+  mergeGroup (newRec, sumOfLastGroup, &sumSchema, &firstRec, attsToKeep, totalAtts, myT);
   outRecsVector->push_back(newRec); // add the summed result to the end of our vector
+  pthread_join(createBigQThread,NULL); // the BigQ counts towards us; it must not outlive our counters
 
+  // The clearing thread outlives us (see above), and so may outlive our counters: it counts
+  // towards no operation
   clearOutputVecUtil* tu = new clearOutputVecUtil;
   tu->outputRecsVector = outRecsVector;
   tu->outputPipe = myT->outputPipe;
-  pthread_create(&clearOutputVecThread,NULL,clearOutputVecRoutine,(void*)tu);
+  startThread(&clearOutputVecThread,clearOutputVecRoutine,(void*)tu,NULL,false);
+  pthread_detach(clearOutputVecThread);
 
   return 0;
 }
 
+GroupBy :: GroupBy (){
+  schema = NULL;
+}
+
+// lay the output records out by the schema of the input
+void GroupBy :: UseSchema (Schema *inSchema){
+  schema = inSchema;
+}
+
 void GroupBy :: Run (Pipe &inPipe, Pipe &outPipe, OrderMaker &groupAtts, Function &computeMe){
   GroupByUtil* t = new GroupByUtil;
   t->inputPipe = &inPipe;
@@ -998,7 +1534,179 @@ void GroupBy :: Run (Pipe &inPipe, Pipe &outPipe, OrderMaker &groupAtts, Functio
   t->orderMaker = &groupAtts;
   t->func = &computeMe;
   t->runlen = numPages;
-  pthread_create(&operationThread,NULL,groupByRoutine,(void*)t);
+  t->schema = schema;
+  startThread(&operationThread,groupByRoutine,(void*)t,&counters,true);
+}
+
+/*******************************************************************************
+ * Class OrderBy
+ * OrderBy puts the records of its input into the output sorted by the attributes of an
+ * OrderMaker, as ORDER BY does. With a limit, it keeps the best limit records it has seen
+ * in a heap whose front is the worst of them: a record better than that one takes its
+ * place, and the others are dropped as they come. Only if the heap outgrows its memory
+ * (or there is no limit) does OrderBy sort its input with a BigQ.
+ ******************************************************************************/
+#define HEAP_ENTRY_OVERHEAD (sizeof (Record) + sizeof (Record*)) // bytes a heap entry takes besides its record
+
+class TopNCompare{ // orders the heap of OrderBy: true if left goes out before right
+  KeyComparator* comparator;
+  bool descending;
+  public:
+    TopNCompare(KeyComparator* keyComparator, bool descending) : comparator(keyComparator), descending(descending) {}
+    bool operator()(Record* left, Record* right){
+      int cmp = comparator->Compare(left->bits,right->bits);
+      return descending ? cmp>0 : cmp<0;
+    }
+};
+
+typedef struct{
+  Pipe* inputPipe;
+  Pipe* outputPipe;
+  OrderMaker* sortOrder;
+  int limit;       // NO_LIMIT, or how many records to put out
+  bool descending;
+  int runlen;      // pages of a BigQ run
+  long heapBytes;  // most memory the heap may take
+} OrderByUtil; // struct used by operationThread in OrderBy
+
+// the heap outgrew its memory: sort the records in it and the rest of the input with a
+// BigQ, and put out the first limit of them
+void orderBySort(OrderByUtil* myT, vector<Record*> &heap){
+  Pipe toSort(100), sorted(100);
+  CreateBigQUtil* t = new CreateBigQUtil;
+  t->inputPipe = &toSort;
+  t->outputPipe = &sorted;
+  t->orderMaker = myT->sortOrder;
+  t->runlen = myT->runlen;
+  t->descending = myT->descending;
+  pthread_t createBigQThread;
+  startThread(&createBigQThread,createBigQRoutine,(void*)t,threadCounters,false);
+
+  long bytes = 0;
+  for(int i=0;i<heap.size();i++){
+    bytes += ((int *) heap[i]->bits)[0] + HEAP_ENTRY_OVERHEAD;
+    toSort.Insert(heap[i]);
+    delete heap[i];
+  }
+  CountMemory(-bytes);
+  Record currRec;
+  while(myT->inputPipe->Remove(&currRec)!=0)
+    toSort.Insert(&currRec);
+  toSort.ShutDown();
+
+  for(int n=0;n<myT->limit && sorted.Remove(&currRec)!=0;n++){
+    if(!myT->outputPipe->Insert(&currRec))
+      break;
+  }
+  sorted.Cancel(); // stop the BigQ, and wait for it to finish
+  while(sorted.Remove(&currRec)!=0);
+  pthread_join(createBigQThread,NULL);
+}
+
+void* orderByRoutine(void* ptr){
+  OrderByUtil* myT = (OrderByUtil*) ptr;
+  if(myT->limit == NO_LIMIT){ // a plain sort. The BigQ shuts the output pipe down
+    BigQ sorter(*(myT->inputPipe),*(myT->outputPipe),*(myT->sortOrder),myT->runlen,myT->descending);
+    return 0;
+  }
+  if(myT->limit == 0){ // nothing to put out; nothing to read
+    myT->inputPipe->Cancel();
+    myT->outputPipe->ShutDown();
+    return 0;
+  }
+
+  KeyComparator comparator = myT->sortOrder->GetComparator();
+  TopNCompare before(&comparator,myT->descending);
+  vector<Record*> heap; // the best records so far. heap.front() is the worst of them
+  long bytes = 0;       // memory the heap takes
+  Record currRec;
+  while(bytes <= myT->heapBytes && myT->inputPipe->Remove(&currRec)!=0){
+    long len = ((int *) currRec.bits)[0];
+    if((int) heap.size() < myT->limit){
+      Record* kept = new Record;
+      kept->Consume(&currRec);
+      heap.push_back(kept);
+      push_heap(heap.begin(),heap.end(),before);
+      bytes += len + HEAP_ENTRY_OVERHEAD;
+      CountMemory(len + HEAP_ENTRY_OVERHEAD);
+    }
+    else if(before(&currRec,heap.front())){ // better than the worst one kept; it takes its place
+      pop_heap(heap.begin(),heap.end(),before);
+      long change = len - ((int *) heap.back()->bits)[0];
+      heap.back()->Consume(&currRec);
+      push_heap(heap.begin(),heap.end(),before);
+      bytes += change;
+      CountMemory(change);
+    }
+  }
+
+  if(bytes > myT->heapBytes){ // the limit records don't fit in memory
+    orderBySort(myT,heap);
+  }
+  else{
+    sort_heap(heap.begin(),heap.end(),before); // first to go out first
+    bool wanted = true;
+    for(int i=0;i<heap.size();i++){
+      if(wanted)
+        wanted = myT->outputPipe->Insert(heap[i]);
+      delete heap[i];
+    }
+    CountMemory(-bytes);
+  }
+  myT->outputPipe->ShutDown();
+  return 0;
+}
+
+OrderBy :: OrderBy (){
+  descending = false;
+}
+
+// sort largest first
+void OrderBy :: SortDescending (bool descending){
+  this->descending = descending;
+}
+
+void OrderBy :: Run (Pipe &inPipe, Pipe &outPipe, OrderMaker &sortOrder, int limit){
+  OrderByUtil* t = new OrderByUtil;
+  t->inputPipe = &inPipe;
+  t->outputPipe = &outPipe;
+  t->sortOrder = &sortOrder;
+  t->limit = limit;
+  t->descending = descending;
+  t->runlen = numPages;
+  t->heapBytes = (long) bnlPages * PAGE_SIZE;
+  startThread(&operationThread,orderByRoutine,(void*)t,&counters,true);
+}
+
+/*******************************************************************************
+ * Class Limit
+ * Limit puts the first limit records of its input into the output, and then cancels
+ * its input pipe so that the operations below it can stop early.
+ ******************************************************************************/
+typedef struct{
+  Pipe* inputPipe;
+  Pipe* outputPipe;
+  int limit;
+} LimitUtil; // struct used by operationThread in Limit
+
+void* limitRoutine(void* ptr){
+  LimitUtil* myT = (LimitUtil*) ptr;
+  Record currRec;
+  for(int n=0;n<myT->limit && myT->inputPipe->Remove(&currRec)!=0;n++){
+    if(!myT->outputPipe->Insert(&currRec))
+      break;
+  }
+  myT->inputPipe->Cancel(); // we have all we want
+  myT->outputPipe->ShutDown();
+  return 0;
+}
+
+void Limit :: Run (Pipe &inPipe, Pipe &outPipe, int limit){
+  LimitUtil* t = new LimitUtil;
+  t->inputPipe = &inPipe;
+  t->outputPipe = &outPipe;
+  t->limit = limit;
+  startThread(&operationThread,limitRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
@@ -1028,7 +1736,7 @@ void WriteOut :: Run (Pipe &inPipe, FILE *outFile, Schema &mySchema){
   t->inputPipe = &inPipe;
   t->outFile = outFile;
   t->schema = &mySchema;
-  pthread_create(&operationThread,NULL,writeOutRoutine,(void*)t);
+  startThread(&operationThread,writeOutRoutine,(void*)t,&counters,true);
 }
 
 /*******************************************************************************
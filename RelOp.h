@@ -5,6 +5,8 @@
 #include "DBFile.h"
 #include "Record.h"
 #include "Function.h"
+#include "BloomFilter.h"
+#include <vector>
 
 using namespace std;
 
@@ -32,9 +34,15 @@ class RelationalOp {
     pthread_t operationThread;
     Record currRec; // used as temporary storage for comparisons etc.
     int numPages;
-    int bnlPages; // only used for BNL joins
+    int bnlPages; // only used for BNL joins and the heap of OrderBy
+    vector<BloomFilter*> bloomFilters; // filters pushed down to this operation by the planner. only used by
+    vector<OrderMaker*> bloomOrders;   // SelectFile and SelectPipe. bloomOrders[i] gives the attributes of our
+                                       // output records that bloomFilters[i] is probed with
+    ExecCounters counters; // pages, memory and time used by the operation's threads (see File.h)
 
   public:
+    virtual ~RelationalOp ();
+
     // blocks the caller until the particular relational operator
     // has run to completion
     // This MUST be called for Join, DuplicateRemoval and GroupBy
@@ -43,11 +51,22 @@ class RelationalOp {
 
     // tell us how much internal memory the operation can use
     void Use_n_Pages (int n);
+
+    // drop output records whose attributes in probeAtts can't be in filter. The operation
+    // waits for the filter to be finished before it produces anything. Only SelectFile and
+    // SelectPipe do anything with it
+    void AddBloomFilter (BloomFilter *filter, OrderMaker &probeAtts);
+
+    // what the operation did. Only complete once WaitUntilDone has returned
+    ExecCounters &GetCounters ();
 };
 
 // SelectPipe takes two pipes as input: an input pipe and an output pipe. It also takes a
 // CNF. It simply applies that CNF to every tuple that comes through the pipe, and every
-// tuple that is accepted is stuffed into the output pipe.
+// tuple that is accepted is stuffed into the output pipe. The tuples are taken off the pipe
+// SELECT_BATCH at a time and the CNF is applied to the batch at once (see the batch
+// ComparisonEngine.Compare).
+#define SELECT_BATCH 1024
 class SelectPipe : public RelationalOp {
   public:
     void Run (Pipe &inPipe, Pipe &outPipe, CNF &selOp, Record &literal);
@@ -57,9 +76,26 @@ class SelectPipe : public RelationalOp {
 // set up; it has been opened and is ready to go. It also takes a CNF. It then performs a scan
 // of the underlying file, and for every tuple accepted by the CNF, it stuffs the tuple into the
 // pipe as output. The DBFile should not be closed by the SelectFile class; that is the
-// job of the caller.
+// job of the caller. A heap file is scanned a page at a time: the CNF is applied to the
+// records of the page where they lie, and only those it accepts are made into Records.
+// SelectFile can be told to keep only some of the attributes; the records it accepts are
+// then projected as they are taken off the page, and only the attributes kept leave the
+// scan. The CNF is applied to the records as they are in the file, and the Bloom filters
+// to the records as they leave.
 class SelectFile : public RelationalOp {
+  private:
+    int* keepAtts;
+    int numKeepAtts;
+    Schema* fileSchema;
+
   public:
+    SelectFile ();
+
+    // put only the attributes attsToKeep of the records into the output pipe, laid out
+    // as Project does (see Project::UseSchema). fileSchema is the schema of the file.
+    // By default all of them are kept
+    void KeepAtts (int *attsToKeep, int numAttsToKeep, Schema *fileSchema);
+
     void Run (DBFile &inFile, Pipe &outPipe, CNF &selOp, Record &literal);
 
 };
@@ -75,7 +111,17 @@ class SelectFile : public RelationalOp {
 // of every record that it puts into the output pipe. The seventh input attribute becomes the
 // third.
 class Project : public RelationalOp {
+  private:
+    Schema* schema;
+
   public:
+    Project ();
+
+    // inSchema is the schema of the input records; the output records are then laid out
+    // the way ComposeRecord does, so that CNFs and OrderMakers made from the output
+    // schema can skip the offsets at the start of the records (see Schema::GetFixedOffset)
+    void UseSchema (Schema *inSchema);
+
     void Run (Pipe &inPipe, Pipe &outPipe, int *keepMe, int numAttsInput, int numAttsOutput);
 };
 
@@ -87,8 +133,58 @@ class Project : public RelationalOp {
 // the OrderMakers). If you can’t get an appropriate pair of OrderMakers because the
 // CNF can’t be implemented using a sort-merge join (due to the fact it does not have an
 // equality check) then your Join operation should default to a block-nested loops join.
+//
+#define JOIN_SORT_MERGE 0         // the default whenever the CNF has an equality
+#define JOIN_BLOCK_NESTED_LOOP 1  // always possible; the only choice without an equality
+//
+// For a sort-merge join, Join reads all of the left input first and builds a Bloom filter on
+// its join keys. The right input is checked against the filter before it goes into its BigQ,
+// so right records that can't find a match are never sorted.
+//
+// An input of a sort-merge join can be materialized late: its records are written once to a
+// temporary file (the stash), a page at a time, and only key records - the join attributes
+// and the page and slot of the record in the stash - go through the BigQ. The records that
+// join are fetched back by page and slot when the output is made, through a cache of
+// Use_n_Pages stash pages. Wide inputs whose sort would spill then spill only their keys.
 class Join : public RelationalOp {
+  private:
+    BloomFilter* bloomFilter;
+    bool bloomPushedDown;
+    int algorithm;
+    bool blockLeft;
+    Schema* leftSchema;
+    Schema* rightSchema;
+    int* keepAtts;
+    int numKeepAtts;
+    int keepFromLeft;
+    bool lateLeft;
+    bool lateRight;
+
   public:
+    Join ();
+
+    // do a block nested loop join even if the CNF has an equality. blockLeft: the left input
+    // (rather than the right) is the one held in memory, Use_n_Pages pages at a time; the
+    // other one is written to a temporary file and read once per block
+    void UseBlockNestedLoop (bool blockLeft);
+
+    // build the Bloom filter into filter (instead of a private one) so the planner can hand
+    // it to operations further down the right input. pushedDown: such an operation applies
+    // it, so Join need not check the right input against it again
+    void SetBloomFilter (BloomFilter *filter, bool pushedDown);
+
+    // the schemas of the two inputs, so that the output records are laid out by the
+    // merged schema (see Project::UseSchema)
+    void UseSchemas (Schema *leftSchema, Schema *rightSchema);
+
+    // put only some of the attributes of the joined records in the output: attsToKeep as
+    // for Record.MergeRecords, the first fromLeft of them attributes of the left record and
+    // the others of the right one. By default all of them are kept
+    void KeepAtts (int *attsToKeep, int numAttsToKeep, int fromLeft);
+
+    // materialize the left and/or right input of a sort-merge join late (see above)
+    void UseLateMaterialization (bool left, bool right);
+
     void Run (Pipe &inPipeL, Pipe &inPipeR, Pipe &outPipe, CNF &selOp, Record &literal);
 };
 
@@ -118,10 +214,49 @@ class Sum : public RelationalOp {
 // the attributes. The grouping is specified using an instance of the OrderMaker class that
 // is passed in. The sum to compute is given in an instance of the Function class.
 class GroupBy : public RelationalOp {
+  private:
+    Schema* schema;
+
   public:
+    GroupBy ();
+
+    // the schema of the input, so that the output records are laid out by the output
+    // schema (see Project::UseSchema)
+    void UseSchema (Schema *inSchema);
+
     void Run (Pipe &inPipe, Pipe &outPipe, OrderMaker &groupAtts, Function &computeMe);
 };
 
+// OrderBy takes an input pipe and an output pipe, and puts the records of the input into the
+// output sorted by the attributes of an OrderMaker, smallest first unless it is told to sort
+// descending, as ORDER BY does. Given a limit, only the first limit records are put out (ORDER
+// BY ... LIMIT). The operation then keeps the best limit records it has seen in a bounded heap,
+// replacing the worst of them whenever a better one comes, so the input is never sorted and
+// nothing goes to disk as long as they fit in the Use_n_Pages pages of memory. If they don't,
+// or there is no limit, the records are sorted with a BigQ.
+#define NO_LIMIT -1
+class OrderBy : public RelationalOp {
+  private:
+    bool descending;
+
+  public:
+    OrderBy ();
+
+    // sort largest first
+    void SortDescending (bool descending);
+
+    void Run (Pipe &inPipe, Pipe &outPipe, OrderMaker &sortOrder, int limit);
+};
+
+// Limit puts the first limit records of its input pipe into its output pipe, as LIMIT without
+// ORDER BY does. It then cancels its input pipe (see Pipe.Cancel), so that the operations below
+// it that can stop early - the scans, selections and projections, and the output of a BigQ -
+// do, rather than produce records nobody will look at.
+class Limit : public RelationalOp {
+  public:
+    void Run (Pipe &inPipe, Pipe &outPipe, int limit);
+};
+
 // WriteOut accepts an input pipe, a schema, and a FILE*, and uses the schema to write
 // text version of the output records to the file.
 class WriteOut : public RelationalOp {
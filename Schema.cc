@@ -36,6 +36,40 @@ Attribute *Schema :: GetAtts () {
   return myAtts;
 }
 
+int Schema :: GetFixedOffset (int att) {
+  return fixedOffsets[att];
+}
+
+int Schema :: GetFixedLength () {
+  return fixedLength;
+}
+
+// lays the attributes out the way Record::ComposeRecord does: after the offsets,
+// ints take 4 bytes, doubles 8 starting on a multiple of 8, and strings as many as
+// the string needs, which is only known record by record
+void Schema :: ComputeFixedLayout () {
+  fixedOffsets = new int[numAtts + 1];
+  int pos = sizeof (int) * (numAtts + 1);
+  for (int i = 0; i < numAtts; i++) {
+    if (pos < 0) {
+      fixedOffsets[i] = -1;
+      continue;
+    }
+    if (myAtts[i].myType == Double && pos % sizeof (double) != 0) {
+      pos += sizeof (int);
+    }
+    fixedOffsets[i] = pos;
+    if (myAtts[i].myType == Int) {
+      pos += sizeof (int);
+    } else if (myAtts[i].myType == Double) {
+      pos += sizeof (double);
+    } else {
+      pos = -1; // everything after a string moves with its length
+    }
+  }
+  fixedLength = pos;
+}
+
 
 Schema :: Schema (char *fpath, int num_atts, Attribute *atts) {
   fileName = strdup (fpath);
@@ -58,6 +92,7 @@ Schema :: Schema (char *fpath, int num_atts, Attribute *atts) {
     }
     myAtts[i].name = strdup (atts[i].name);
   }
+  ComputeFixedLayout ();
 }
 
 Schema* Schema ::mergeSchema(Schema* s){
@@ -202,10 +237,13 @@ Schema :: Schema (char *fName, char *relName) {
   }
 
   fclose (foo);
+  ComputeFixedLayout ();
 }
 
 Schema :: ~Schema () {
   delete [] myAtts;
   myAtts = 0;
+  delete [] fixedOffsets;
+  fixedOffsets = 0;
 }
 
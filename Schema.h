@@ -29,6 +29,15 @@ class Schema {
   // gives the physical location of the binary file storing the relation
   char *fileName;
 
+  // where each attribute starts in a record laid out by ComposeRecord, or -1 for the
+  // attributes after the first string, which start in a different place in every
+  // record. fixedLength is the length of every record, or -1 if there is a string
+  int *fixedOffsets;
+  int fixedLength;
+
+  // work out fixedOffsets and fixedLength from the types of the attributes
+  void ComputeFixedLayout ();
+
   friend class Record;
 
 public:
@@ -47,6 +56,16 @@ public:
   // this finds the type of the given attribute
   Type FindType (char *attName);
 
+  // the byte offset of attribute att in every record of this schema, or -1 if it
+  // comes after a string. Added so that comparisons and functions can skip the
+  // offsets at the start of the record. Records made by ComposeRecord (and so read
+  // from files) are laid out this way, and so are the records Join, Project and
+  // GroupBy make when they are given their input schemas
+  int GetFixedOffset (int att);
+
+  // the length of every record of this schema, or -1 if it has a string
+  int GetFixedLength ();
+
   // this reads the specification for the schema in from a file
   Schema (char *fName, char *relName);
 
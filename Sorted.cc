@@ -8,6 +8,7 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <stdio.h>
 
 typedef struct{
   Pipe* inputPipe;
@@ -30,6 +31,64 @@ void* myWorkerRoutine(void* ptr){
   return 0; // http:// stackoverflow.com/a/5761837: Pthreads departs from the standard unix return code of -1 on error convention. It returns 0 on success and a positive integer code on error.
 }
 
+typedef struct{
+  vector<string> inputs; // base file first, then the delta runs oldest first
+  string output;
+  OrderMaker* sortOrder;
+  int numDeltas;         // number of delta runs being compacted
+  bool done;
+  pthread_mutex_t doneMutex;
+} compactUtil; // struct shared with the compaction thread
+
+
+/*------------------------------------------------------------------------------
+ * Compaction thread. Merges the base file and the delta runs it was handed
+ * into one sorted file. It opens its own Heaps on the inputs so the main thread
+ * can keep reading them while this runs; nothing writes to them in the
+ * meantime because new inserts always go to a new delta run.
+ *----------------------------------------------------------------------------*/
+void* compactRoutine(void* ptr){
+  compactUtil* myT = (compactUtil*) ptr;
+  int numInputs = myT->inputs.size();
+  vector<Heap*> inputs(numInputs);
+  vector<Record*> heads(numInputs);
+  vector<bool> hasHeads(numInputs);
+  for(int i=0;i<numInputs;i++){
+    inputs[i] = new Heap();
+    inputs[i]->Open((char*)myT->inputs[i].c_str());
+    inputs[i]->MoveToPage(0);
+    heads[i] = new Record();
+    hasHeads[i] = inputs[i]->GetNext(*heads[i]);
+  }
+
+  Heap output;
+  output.Create((char*)myT->output.c_str(), heap, NULL);
+  ComparisonEngine ceng;
+  while(1){
+    int min = -1;
+    for(int i=0;i<numInputs;i++){ // ties go to the older source
+      if(hasHeads[i] && (min == -1 || ceng.Compare(heads[i], heads[min], myT->sortOrder) < 0)){
+        min = i;
+      }
+    }
+    if(min == -1) break; // every input is empty
+    output.Add(*heads[min]);
+    hasHeads[min] = inputs[min]->GetNext(*heads[min]);
+  }
+  output.Close();
+
+  for(int i=0;i<numInputs;i++){
+    inputs[i]->Close();
+    delete inputs[i];
+    delete heads[i];
+  }
+
+  pthread_mutex_lock(&myT->doneMutex);
+  myT->done = true;
+  pthread_mutex_unlock(&myT->doneMutex);
+  return 0;
+}
+
 /*------------------------------------------------------------------------------
  * Constructor
  *----------------------------------------------------------------------------*/
@@ -41,6 +100,12 @@ Sorted :: Sorted () {
   }
   currMode = reading; // init file in reading mode
   CALLEDBEFORE = false;
+  METADIRTY = false;
+  keyOrder = NULL;
+  keySchema = NULL;
+  MERGESTARTED = false;
+  COMPACTING = false;
+  compactState = NULL;
 }
 
 /*------------------------------------------------------------------------------
@@ -49,6 +114,17 @@ Sorted :: Sorted () {
 Sorted :: ~Sorted () {
   // housekeeping
   delete baseFile;
+  for(size_t i=0;i<fences.size();i++){
+    delete fences[i];
+  }
+  delete keySchema;
+  for(size_t i=0;i<deltas.size();i++){
+    delete deltas[i];
+  }
+  for(size_t i=0;i<heads.size();i++){
+    delete heads[i];
+  }
+  delete keyOrder;
 }
 
 /*------------------------------------------------------------------------------
@@ -65,6 +141,8 @@ int Sorted :: Create (char *f_path, fType f_type, void *startup) {
   myRunlen = tempvar->l;
   baseFileName = f_path;
   CALLEDBEFORE = false;
+  initFenceSchema();
+  METADIRTY = true; // the meta file written by DBFile.Create has no fences yet
 
   return baseFile->Create (baseFileName, heap, NULL); // remember: baseFile is heap, NOT sorted
 }
@@ -130,12 +208,51 @@ int Sorted :: Open (char *f_path) {
     }
     sortOrder = new OrderMaker();
     sortOrder->initOrderMaker(numAtts,myAtts);
+    initFenceSchema();
+
+    // next (after the blank line PrinttoString leaves behind) is the number of
+    // fences followed by one fence per line e.g.
+    // 3
+    // Customer#000000001|
+    // Customer#000000417|
+    // Customer#000000833|
+    // older meta files stop before this; the fences are rebuilt below.
+    int numFences;
+    if(myfile >> numFences){
+      myfile.getline(line,1000); // rest of the count line
+      for(int i=0;i<numFences;i++){
+        string fenceLine;
+        if(!getline(myfile,fenceLine)) break;
+        Record* fence = new Record();
+        fence->ComposeRecord(keySchema, fenceLine.c_str());
+        fences.push_back(fence);
+      }
+    }
+
+    // last line is the number of delta runs. they are called <base>.delta0,
+    // <base>.delta1, ... oldest first
+    int numDeltas;
+    if(myfile >> numDeltas){
+      char name[200];
+      for(int i=0;i<numDeltas;i++){
+        deltaName(i, name);
+        Heap* delta = new Heap();
+        delta->Open(name);
+        deltas.push_back(delta);
+      }
+    }
+    delete [] line;
   }
   else cerr << "Unable to open file " << metafilepath << " for reading." << endl;
   CALLEDBEFORE = false; // this includes resetting for Sorted.Load because Open
                         // is always called before Load
+  MERGESTARTED = false;
 
-  return baseFile->Open(f_path);
+  int retval = baseFile->Open(f_path);
+  if((int) fences.size() != baseFile->GetNumofRecordPages()){ // fences missing or stale
+    buildFences();
+  }
+  return retval;
 }
 
 /*------------------------------------------------------------------------------
@@ -167,10 +284,13 @@ void Sorted :: Load (Schema &f_schema, char *loadpath) {
  *----------------------------------------------------------------------------*/
 void Sorted :: MoveFirst () {
   // switch to reading mode
-  // merge BigQ and baseFile
+  // write BigQ out as a delta run
   switchToReading();
+  finishCompaction(false); // start of a scan is a safe point to swap in a finished compaction
   CALLEDBEFORE = false;
-  baseFile->MoveFirst();
+  MERGESTARTED = false;
+  baseFile->MoveToPage(0); // not Heap.MoveFirst, which leaves the page number wherever the
+                           // last lookup put it
 }
 
 /*------------------------------------------------------------------------------
@@ -194,7 +314,14 @@ void Sorted :: Add (Record &addme) {
 int Sorted :: GetNext (Record &fetchme) {
   // switch to reading mode
   switchToReading();
-  baseFile->GetNext(fetchme);
+  if(deltas.empty()){
+    return baseFile->GetNext(fetchme);
+  }
+  // merge baseFile and the delta runs on the fly
+  if(!MERGESTARTED){
+    startMergedRead();
+  }
+  return mergedNext(fetchme);
 }
 
 /*------------------------------------------------------------------------------
@@ -208,6 +335,32 @@ int Sorted :: GetNext (Record &fetchme, CNF &cnf, Record &literal) {
   // merge BigQ and baseFile
   switchToReading();
 
+  if(!deltas.empty()){ // merged read over baseFile and the delta runs
+    ComparisonEngine compEngine;
+    if(!CALLEDBEFORE){
+      queryOrder = new OrderMaker();
+      cnf.createQueryOrder(*sortOrder,*queryOrder);
+      if(queryOrder->getNumAtts()>0){ // position every source at the first record that can match
+        startMergedRead(literal);
+      }
+      else if(!MERGESTARTED){
+        startMergedRead();
+      }
+      CALLEDBEFORE = true;
+    }
+    while(mergedNext(fetchme)){
+      if(queryOrder->getNumAtts()>0 &&
+         compEngine.Compare(&literal, queryOrder, &fetchme, sortOrder) < 0){ // went past the records equal to literal
+                                                                            // on queryOrder. nothing further can match
+        return 0;
+      }
+      if(compEngine.Compare (&fetchme, &literal, &cnf)){
+        return 1;
+      }
+    }
+    return 0;
+  }
+
   // create the query ordermaker. This ordermaker has only those attributes that
   // are COMMON to both the sortOrder ordermaker and the query CNF that the user
   // just entered.
@@ -251,7 +404,7 @@ int Sorted :: GetNext (Record &fetchme, CNF &cnf, Record &literal) {
     else { // sortOrder and the CNF the user entered had something in common.
            // Conduct a binary search to get into the ballpark
       // cout << "sorted.getnext common attrs found. start binary search" << endl;
-      if(baseFile->BinarySearch(fetchme,*sortOrder,literal,*queryOrder)){ // binary search found something in the ballpark
+      if(fenceLookup(fetchme,literal)){ // binary search found something in the ballpark
         // We must now check that the record that was found also satisfies the CNF entered
         // by the user. Essentially, we're checking that the attributes NOT in the queryOrder
         // order maker that we constructed (but IN the CNF entered by the user) are satisfied
@@ -320,77 +473,384 @@ void Sorted :: switchToReading(){
                          // constructor we called in myWorkerRoutine will exit.
 
     Record *bigQRec = new Record();
-    Record *sortedFileRec = new Record();
 
     if(baseFile->GetNumofRecordPages()==0){ // sorted file is empty
                                             // just dump myBigQ into it
       while (myOutput->Remove (bigQRec)) {
         baseFile->Add(*bigQRec);
       }
+      buildFences();
     }
-    else if(myOutput->Remove (bigQRec)){ // we actually need a merge only if myBigQ is NOT empty because if
-                                         // myBigQ IS empty (could happen if the file is being closed just after, baseFile is already the way it should be.
-                                         // Note that if myBigQ is NOT empty, this line also initializes
-                                         // bigQRec.
-      // temporary file used to store results of merge temporarily
-      // bigQRec->Print(new Schema("catalog","customer"));
-      Heap* tempMergeFile = new Heap();
-      char* tempMergeFileName = "tempmerge.bin";
-      tempMergeFile->Create (tempMergeFileName, heap, NULL);
-      ComparisonEngine ceng;
-
-      // cout << "sorted.switchtoreading " << baseFile->GetNumofRecordPages() << endl;
-      baseFile->MoveFirst();
-      baseFile->GetNext(*sortedFileRec); // initialize sortedFileRec. bigQRec was already inited
-                                         // in the else if statement
-      // sortedFileRec->Print(new Schema("catalog","customer"));
-      int stop = 0; // stop = 1: myBigQ was emptied, 2: baseFile was emptied
-      while (!stop) { // repeat until EITHER BigQ or baseFile is empty
-        if (ceng.Compare (bigQRec, sortedFileRec, sortOrder) < 0) { // bigQRec < sortedFileRec
-          tempMergeFile->Add (*bigQRec);
-          if(myOutput->Remove (bigQRec)==0){
-            stop = 1;
-          }
-        }
-        else{ // sortedFileRec < bigQRec
-          tempMergeFile->Add (*sortedFileRec);
-          if(baseFile->GetNext(*sortedFileRec)==0){
-            stop = 2;
-          }
-        }
-      }
-
-      // empty whichever of myBigQ or baseFile still has recs
-      if(stop==1){ // it was myBigQ that was emptied
-        // cout << "sorted.switchtoreading bigq was just emptied" << endl;
-        tempMergeFile->Add(*sortedFileRec);
-        while(baseFile->GetNext(*sortedFileRec)){ // empty baseFile
-          tempMergeFile->Add(*sortedFileRec);
-        }
-      }
-      else{ // it was sorted file that was emptied
-        // cout << "sorted.switchtoreading sortedfile was just emptied" << endl;
-        tempMergeFile->Add(*bigQRec);
-        while (myOutput->Remove (bigQRec)) { // empty myBigQ
-          tempMergeFile->Add(*bigQRec);
-        }
-      }
-
-      // close both files. move over the temporary merge file to the final file
-      // reopen the final file. if Sorted.Close() wants, it can close it but we
-      // must remember that switchToReading() can be called from GetNext etc as
-      // well.
-      baseFile->Close();
-      tempMergeFile->Close();
-      rename(tempMergeFileName,baseFileName);
-      baseFile->Open(baseFileName);
+    else if(myOutput->Remove (bigQRec)){ // we need a new delta run only if myBigQ is NOT empty. Note that this
+                                         // line also initializes bigQRec.
+      // Write the BigQ output to a new delta run rather than merging it into
+      // the base file. A few inserts into a big table therefore cost only as
+      // much as the inserts themselves; the merge is put off till the deltas
+      // are worth compacting (see maybeStartCompaction).
+      addDeltaRun(bigQRec);
+      maybeStartCompaction();
     }
+    delete bigQRec;
 
     // switch to reading
     currMode = reading;
   }
 }
 
+/*------------------------------------------------------------------------------
+ * Build keyOrder and keySchema from sortOrder. A fence record holds the sort
+ * attributes of a record in sortOrder order, so attribute i of a fence is
+ * sortOrder's i-th attribute.
+ *----------------------------------------------------------------------------*/
+void Sorted :: initFenceSchema(){
+  int numKeys = sortOrder->getNumAtts();
+  myAtt* myAtts = new myAtt[numKeys];
+  Attribute* keyAtts = new Attribute[numKeys];
+  for(int i=0;i<numKeys;i++){
+    myAtts[i].attNo = i;
+    myAtts[i].attType = sortOrder->getWhichTypes()[i];
+    keyAtts[i].name = new char[20];
+    sprintf(keyAtts[i].name, "key%d", i);
+    keyAtts[i].myType = myAtts[i].attType;
+  }
+  keyOrder = new OrderMaker();
+  keyOrder->initOrderMaker(numKeys, myAtts);
+  keySchema = new Schema("fence", numKeys, keyAtts);
+  for(int i=0;i<numKeys;i++){
+    delete [] keyAtts[i].name;
+  }
+  delete [] keyAtts;
+  delete [] myAtts;
+}
+
+/*------------------------------------------------------------------------------
+ * Write atts of rec listed in order into out as "val|val|...|", the same text
+ * format SuckNextRecord and ComposeRecord read
+ *----------------------------------------------------------------------------*/
+void Sorted :: keyToString(Record* rec, OrderMaker* order, char* out){
+  out[0] = '\0';
+  char* pos = out;
+  for(int i=0;i<order->getNumAtts();i++){
+    char* val = rec->bits + ((int*)rec->bits)[order->getWhichAtts()[i]+1];
+    switch(order->getWhichTypes()[i]){
+      case Int:
+        pos += sprintf(pos, "%d|", *((int*)val));
+        break;
+      case Double:
+        pos += sprintf(pos, "%.17g|", *((double*)val)); // enough digits to read back the same double
+        break;
+      case String:
+        pos += sprintf(pos, "%s|", val);
+        break;
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Build a fence record from the sort attributes of rec. buf is scratch space
+ * of PAGE_SIZE bytes.
+ *----------------------------------------------------------------------------*/
+Record* Sorted :: makeFence(Record* rec, char* buf){
+  keyToString(rec, sortOrder, buf);
+  Record* fence = new Record();
+  fence->ComposeRecord(keySchema, buf);
+  return fence;
+}
+
+/*------------------------------------------------------------------------------
+ * Read the first record of every page of baseFile and rebuild fences. Called
+ * whenever the base file is rewritten and from Open if the saved fences are
+ * missing or don't match the file. Leaves the pointer at the start of the file.
+ *----------------------------------------------------------------------------*/
+void Sorted :: buildFences(){
+  for(size_t i=0;i<fences.size();i++){
+    delete fences[i];
+  }
+  fences.clear();
+
+  char* buf = new char[PAGE_SIZE];
+  Record first;
+  baseFile->MoveToPage(0); // also writes out a dirty page so it gets counted below
+  int numPages = baseFile->GetNumofRecordPages();
+  for(int i=0;i<numPages;i++){
+    baseFile->MoveToPage(i);
+    if(baseFile->GetNext(first)){
+      fences.push_back(makeFence(&first, buf));
+    }
+  }
+  delete [] buf;
+  baseFile->MoveToPage(0);
+  METADIRTY = true;
+}
+
+/*------------------------------------------------------------------------------
+ * Binary search the fences for the last page whose first key is strictly less
+ * than the literal on queryOrder. Equal keys may spill over from the page
+ * before the first page that starts with them, so that is where they begin.
+ *----------------------------------------------------------------------------*/
+int Sorted :: fencePage(Record& literal){
+  // queryOrder is a prefix of sortOrder, so the fence attributes to compare
+  // against are 0..n-1 of the fence record
+  int numQueryAtts = queryOrder->getNumAtts();
+  myAtt* myAtts = new myAtt[numQueryAtts];
+  for(int i=0;i<numQueryAtts;i++){
+    myAtts[i].attNo = i;
+    myAtts[i].attType = queryOrder->getWhichTypes()[i];
+  }
+  OrderMaker fenceOrder;
+  fenceOrder.initOrderMaker(numQueryAtts, myAtts);
+  delete [] myAtts;
+
+  ComparisonEngine compEngine;
+  int low = 0;
+  int high = fences.size()-1;
+  int page = 0;
+  while(low <= high){
+    int mid = (low+high)/2;
+    if(compEngine.Compare(&literal, queryOrder, fences[mid], &fenceOrder) > 0){ // first key of page mid < literal
+      page = mid;
+      low = mid+1;
+    }
+    else{
+      high = mid-1;
+    }
+  }
+  return page;
+}
+
+/*------------------------------------------------------------------------------
+ * Replaces Heap.BinarySearch for Sorted.GetNext WITH CNF.
+ * Read just the page fencePage points to and scan forward from it.
+ * Returns:
+ * true: a record equal to literal on queryOrder was found, put into fetchme,
+ *       and the pointer positioned just after it.
+ * false: there is no such record in the file
+ *----------------------------------------------------------------------------*/
+bool Sorted :: fenceLookup(Record& fetchme, Record& literal){
+  if(fences.empty()){
+    return false;
+  }
+
+  ComparisonEngine compEngine;
+  baseFile->MoveToPage(fencePage(literal));
+  while(baseFile->GetNext(fetchme)){
+    int c = compEngine.Compare(&literal, queryOrder, &fetchme, sortOrder); // IMPORTANT! queryOrder must be the second (and NOT
+                                                                            // the fourth argument) because it very well may have
+                                                                            // fewer attributes than the sortOrder
+    if(c == 0) return true; // found it. pointer is just after fetchme
+    if(c < 0) return false; // went past where it would have been
+  }
+  return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Name of delta run i: <base>.delta<i>
+ *----------------------------------------------------------------------------*/
+void Sorted :: deltaName(int i, char* name){
+  sprintf(name, "%s.delta%d", baseFileName, i);
+}
+
+/*------------------------------------------------------------------------------
+ * Write first and the rest of the BigQ output to a new delta run. The run is
+ * closed and reopened so its length is on disk for a compaction thread that
+ * opens it separately.
+ *----------------------------------------------------------------------------*/
+void Sorted :: addDeltaRun(Record* first){
+  char name[200];
+  deltaName(deltas.size(), name);
+  Heap* delta = new Heap();
+  delta->Create(name, heap, NULL);
+  delta->Add(*first);
+  while (myOutput->Remove (first)) {
+    delta->Add(*first);
+  }
+  delta->Close();
+  delta->Open(name);
+  deltas.push_back(delta);
+  MERGESTARTED = false;
+  METADIRTY = true;
+}
+
+/*------------------------------------------------------------------------------
+ * Start a compaction thread if the delta runs add up to more than
+ * 1/DELTA_SIZE_RATIO of the base file or there are more than MAX_DELTA_RUNS of
+ * them, and no compaction is running already.
+ *----------------------------------------------------------------------------*/
+void Sorted :: maybeStartCompaction(){
+  if(COMPACTING || deltas.empty()){
+    return;
+  }
+  int basePages = baseFile->GetNumofRecordPages();
+  int deltaPages = 0;
+  for(size_t i=0;i<deltas.size();i++){
+    deltaPages += deltas[i]->GetNumofRecordPages();
+  }
+  if(deltaPages*DELTA_SIZE_RATIO <= basePages && deltas.size() <= MAX_DELTA_RUNS){
+    return;
+  }
+
+  // the compaction thread reads the file length from disk, so flush it
+  baseFile->Close();
+  baseFile->Open(baseFileName);
+  MERGESTARTED = false;
+
+  compactUtil* t = new compactUtil();
+  t->inputs.push_back(baseFileName);
+  char name[200];
+  for(size_t i=0;i<deltas.size();i++){
+    deltaName(i, name);
+    t->inputs.push_back(name);
+  }
+  t->output = string(baseFileName) + ".compact";
+  t->sortOrder = sortOrder;
+  t->numDeltas = deltas.size();
+  t->done = false;
+  pthread_mutex_init(&t->doneMutex, NULL);
+  compactState = (void*)t;
+  COMPACTING = true;
+  pthread_create(&compactThread, NULL, compactRoutine, (void*)t);
+}
+
+/*------------------------------------------------------------------------------
+ * Swap in the result of a compaction: the compacted file replaces the base
+ * file, the delta runs it covered are deleted and the newer ones renumbered.
+ * wait: block till the thread finishes. Otherwise return straight away if it
+ * hasn't finished yet.
+ *----------------------------------------------------------------------------*/
+void Sorted :: finishCompaction(bool wait){
+  if(!COMPACTING){
+    return;
+  }
+  compactUtil* t = (compactUtil*)compactState;
+  if(!wait){
+    pthread_mutex_lock(&t->doneMutex);
+    bool done = t->done;
+    pthread_mutex_unlock(&t->doneMutex);
+    if(!done) return;
+  }
+  pthread_join(compactThread, NULL);
+
+  baseFile->Close();
+  rename(t->output.c_str(), baseFileName);
+  baseFile->Open(baseFileName);
+
+  char name[200];
+  char newName[200];
+  for(int i=0;i<t->numDeltas;i++){ // compacted runs
+    deltas[i]->Close();
+    delete deltas[i];
+    deltaName(i, name);
+    remove(name);
+  }
+  deltas.erase(deltas.begin(), deltas.begin()+t->numDeltas);
+  for(size_t i=0;i<deltas.size();i++){ // runs added while the compaction ran
+    deltaName(i+t->numDeltas, name);
+    deltaName(i, newName);
+    deltas[i]->Close();
+    rename(name, newName);
+    deltas[i]->Open(newName);
+  }
+
+  pthread_mutex_destroy(&t->doneMutex);
+  delete t;
+  compactState = NULL;
+  COMPACTING = false;
+  MERGESTARTED = false;
+  buildFences();
+}
+
+/*------------------------------------------------------------------------------
+ * Load the first record of every source of a merged read
+ *----------------------------------------------------------------------------*/
+void Sorted :: startMergedRead(){
+  int numSources = deltas.size()+1;
+  while((int) heads.size() < numSources){
+    heads.push_back(new Record());
+  }
+  hasHeads.assign(numSources, false);
+  for(int i=0;i<numSources;i++){
+    Heap* source = (i==0) ? baseFile : deltas[i-1];
+    source->MoveToPage(0);
+    hasHeads[i] = source->GetNext(*heads[i]);
+  }
+  MERGESTARTED = true;
+}
+
+/*------------------------------------------------------------------------------
+ * Load the first record >= literal on queryOrder of every source of a merged
+ * read. The base file jumps straight to the right page using the fences; the
+ * delta runs are small and are scanned from the start.
+ *----------------------------------------------------------------------------*/
+void Sorted :: startMergedRead(Record& literal){
+  ComparisonEngine compEngine;
+  int numSources = deltas.size()+1;
+  while((int) heads.size() < numSources){
+    heads.push_back(new Record());
+  }
+  hasHeads.assign(numSources, false);
+  for(int i=0;i<numSources;i++){
+    Heap* source = (i==0) ? baseFile : deltas[i-1];
+    source->MoveToPage((i==0 && !fences.empty()) ? fencePage(literal) : 0);
+    while((hasHeads[i] = source->GetNext(*heads[i])) &&
+          compEngine.Compare(&literal, queryOrder, heads[i], sortOrder) > 0); // skip records < literal
+  }
+  MERGESTARTED = true;
+}
+
+/*------------------------------------------------------------------------------
+ * Hand back the smallest of the heads and refill it from its source. Ties go
+ * to the older source (base file, then delta runs oldest first), so records
+ * with equal keys come back in insertion order. Returns 0 once every source is
+ * empty.
+ *----------------------------------------------------------------------------*/
+int Sorted :: mergedNext(Record& fetchme){
+  ComparisonEngine compEngine;
+  int min = -1;
+  for(size_t i=0;i<hasHeads.size();i++){
+    if(hasHeads[i] && (min == -1 || compEngine.Compare(heads[i], heads[min], sortOrder) < 0)){
+      min = i;
+    }
+  }
+  if(min == -1){
+    return 0;
+  }
+  fetchme.Consume(heads[min]);
+  Heap* source = (min==0) ? baseFile : deltas[min-1];
+  hasHeads[min] = source->GetNext(*heads[min]);
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Write the meta file. Same format as in DBFile.Create, followed by the fences:
+ *   number of fences
+ *   one fence per line, in the same "val|val|" format as the tpch text files
+ *   number of delta runs
+ *----------------------------------------------------------------------------*/
+void Sorted :: writeMeta(){
+  char metafilepath[100];
+  sprintf(metafilepath, "%s.meta", baseFileName);
+  ofstream myfile (metafilepath);
+  char printedOrder[1000];
+  sortOrder->PrinttoString(printedOrder);
+  if (myfile.is_open())
+  {
+    myfile << "sorted" << endl;
+    myfile << myRunlen << endl;
+    myfile << printedOrder << endl;
+    myfile << fences.size() << endl;
+    char* buf = new char[PAGE_SIZE];
+    for(size_t i=0;i<fences.size();i++){
+      keyToString(fences[i], keyOrder, buf);
+      myfile << buf << endl;
+    }
+    delete [] buf;
+    myfile << deltas.size() << endl;
+    myfile.close();
+    METADIRTY = false;
+  }
+  else cerr << "Unable to open file " << metafilepath << " for writing." << endl;
+}
+
 /*------------------------------------------------------------------------------
  * Correct the length returned by File->GetLength which adds 1 to the actual
  * number of pages of records for the one page of metadata at the beginning.
@@ -399,7 +859,11 @@ int Sorted :: GetNumofRecordPages(){
   // switch to reading mode
   // merge BigQ and baseFile
   switchToReading();
-  return baseFile->GetNumofRecordPages();
+  int numPages = baseFile->GetNumofRecordPages();
+  for(size_t i=0;i<deltas.size();i++){
+    numPages += deltas[i]->GetNumofRecordPages();
+  }
+  return numPages;
 }
 
 /*------------------------------------------------------------------------------
@@ -409,6 +873,13 @@ int Sorted :: Close () {
   // switch to reading mode
   // merge BigQ and baseFile
   switchToReading();
+  finishCompaction(true);
+  if(METADIRTY){
+    writeMeta();
+  }
+  for(size_t i=0;i<deltas.size();i++){
+    deltas[i]->Close();
+  }
   int numPages = baseFile->Close();
   if(numPages < 1) return 0;
   else return 1;
@@ -5,9 +5,14 @@
 #include "BigQ.h"
 #include <stdlib.h>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
+#define DELTA_SIZE_RATIO 10 // start a compaction once the delta runs add up to more than
+                            // 1/DELTA_SIZE_RATIO of the pages in the base file
+#define MAX_DELTA_RUNS 8    // ... or once there are more than this many delta runs
+
 typedef enum {reading, writing} fMode; // reading: moveFirst, Close, GetNext (both version)
                                        // writing: add, load
 
@@ -34,6 +39,58 @@ class Sorted: virtual public GenericDBFile {
                        //        reset it.
     bool PAGEDIRTIED; // TRUE: page was written to since our last read and must
                       // be written to disk before we make the next read.
+
+    // sparse fence index. fences[i] holds the sort key of the first record on page i
+    // of baseFile. The key records have just the sort attributes, numbered 0..n-1 in
+    // sortOrder order (see keyOrder). Saved in the meta file on Close and rebuilt in
+    // Open if it is missing or doesn't match the file.
+    vector<Record*> fences;
+    OrderMaker* keyOrder;  // sortOrder renumbered 0..n-1 for use on fence records
+    Schema* keySchema;     // schema of a fence record
+    bool METADIRTY;        // TRUE: fences or delta runs changed since the meta file was written
+    // build keyOrder and keySchema from sortOrder
+    void initFenceSchema();
+    // read the first record of every page of baseFile and rebuild fences
+    void buildFences();
+    // build a fence record from the sort attributes of rec
+    Record* makeFence(Record* rec, char* buf);
+    // write atts of rec listed in order as "val|val|...|" into out
+    void keyToString(Record* rec, OrderMaker* order, char* out);
+    // page of baseFile that the first record equal to literal on queryOrder would be on
+    int fencePage(Record& literal);
+    // use the fences to jump to the page holding the first record equal to literal
+    // on queryOrder. Same contract as Heap.BinarySearch.
+    bool fenceLookup(Record& fetchme, Record& literal);
+
+    // delta runs. Each switch from writing to reading writes the BigQ output to a new
+    // sorted run <base>.delta<i> instead of rewriting the base file. Reads merge the
+    // base file and the delta runs on the fly. Once the deltas get big enough (see
+    // DELTA_SIZE_RATIO) a compaction thread merges the base and the deltas it started
+    // with into <base>.compact, which replaces the base at the next MoveFirst or Close.
+    vector<Heap*> deltas;
+    vector<Record*> heads;   // next record of each source in a merged read. 0 is baseFile, i+1 is deltas[i]
+    vector<bool> hasHeads;   // false once a source has run out
+    bool MERGESTARTED;       // TRUE: heads are loaded for the current merged read
+    pthread_t compactThread;
+    void* compactState;      // shared with the compaction thread (compactUtil in Sorted.cc)
+    bool COMPACTING;         // TRUE: a compaction thread is running (or done but not yet swapped in)
+    // name of delta run i
+    void deltaName(int i, char* name);
+    // write first and the rest of the BigQ output to a new delta run
+    void addDeltaRun(Record* first);
+    // start a compaction if the deltas are big enough and none is running
+    void maybeStartCompaction();
+    // swap in the result of a compaction. wait: block till it finishes. otherwise
+    // only swap if it has already finished
+    void finishCompaction(bool wait);
+    // load the first record of every source
+    void startMergedRead();
+    // load the first record >= literal on queryOrder of every source
+    void startMergedRead(Record& literal);
+    // smallest of the heads; 0 if every source is empty
+    int mergedNext(Record& fetchme);
+    // write the meta file, fences included
+    void writeMeta();
     // If we're in reading mode, switch to writing.
     void switchToWriting();
     // If we're in writing mode, switch to reading.
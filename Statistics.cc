@@ -9,6 +9,8 @@
 #include <cstring>
 #include <boost/tokenizer.hpp>
 #include <utility>
+#include <algorithm>
+#include <cstdlib>
 using namespace boost;
 using namespace std;
 
@@ -17,6 +19,7 @@ using namespace std;
  ******************************************************************************/
 Statistics :: Statistics() {
   lastHandledRel = 0; // stores index of last updated relation
+  attDists = make_shared< unordered_map<string, attDistribution> >();
 }
 
 /*******************************************************************************
@@ -58,6 +61,200 @@ void Statistics :: AddAtt(char *relName, char *attName, int numDistincts) {
     (Relation_Size_Atts[RelationName].second)[AttrName] = Relation_Size_Atts[RelationName].first;
 }
 
+/*******************************************************************************
+ * Returns the number of tuples currently stored for relName, or -1 if there is
+ * no such relation
+ ******************************************************************************/
+int Statistics :: GetRelSize(char *relName) {
+  auto it = Relation_Size_Atts.find(string(relName));
+  if (it == Relation_Size_Atts.end())
+    return -1;
+  return it->second.first;
+}
+
+/*******************************************************************************
+ * Removes relName and its attributes
+ ******************************************************************************/
+void Statistics :: DeleteRel(char *relName) {
+  Relation_Size_Atts.erase(string(relName));
+}
+
+/*******************************************************************************
+ * Order two attribute values, as numbers if numeric. Returns <0, 0 or >0
+ ******************************************************************************/
+static int compareValues(const string &a, const string &b, bool numeric) {
+  if (!numeric)
+    return a.compare(b);
+  double x = atof(a.c_str());
+  double y = atof(b.c_str());
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/*******************************************************************************
+ * Builds the most common values and the equi-depth histogram of attName out of
+ * the values it takes in a uniform sample of the tuples of its relation.
+ * A value is a most common value if it shows up more than once in the sample and
+ * clearly more often (25%) than the average sampled value; we keep the
+ * STATS_NUM_MCV most frequent of those. If the sample has no more than
+ * STATS_NUM_MCV distinct values they all become most common values and there is
+ * no histogram. The rest of the sample is split into STATS_NUM_BUCKETS buckets
+ * holding the same number of values each.
+ ******************************************************************************/
+void Statistics :: AddDistribution(char *attName, vector<string> &sample, bool numeric) {
+  string AttrName(attName);
+  if (!attDists.unique()) // don't change the distributions of copies sharing them
+    attDists = make_shared< unordered_map<string, attDistribution> >(*attDists);
+  if (sample.empty()) {
+    attDists->erase(AttrName);
+    return;
+  }
+  sort(sample.begin(), sample.end(),
+       [numeric](const string &a, const string &b) { return compareValues(a, b, numeric) < 0; });
+
+  // run lengths of the sorted sample: (count, index of the first occurrence)
+  vector< pair<int, int> > runs;
+  for (int i = 0; i < sample.size(); i++) {
+    if (i > 0 && compareValues(sample[i], sample[i-1], numeric) == 0)
+      runs.back().first++;
+    else
+      runs.push_back(make_pair(1, i));
+  }
+
+  attDistribution dist;
+  dist.numeric = numeric;
+  dist.sampleSize = sample.size();
+  double average = sample.size()/(double)runs.size();
+  vector< pair<int, int> > common; // candidate most common values
+  for (int i = 0; i < runs.size(); i++) {
+    if (runs.size() <= STATS_NUM_MCV || (runs[i].first > 1 && runs[i].first > 1.25*average))
+      common.push_back(runs[i]);
+  }
+  sort(common.begin(), common.end(),
+       [](const pair<int, int> &a, const pair<int, int> &b) { return a.first > b.first; });
+  if (common.size() > STATS_NUM_MCV)
+    common.resize(STATS_NUM_MCV);
+
+  vector<bool> isCommon(sample.size(), false); // marks the first occurrence of every most common value
+  for (int i = 0; i < common.size(); i++) {
+    dist.mcvValues.push_back(sample[common[i].second]);
+    dist.mcvFreqs.push_back(common[i].first/(double)sample.size());
+    isCommon[common[i].second] = true;
+  }
+
+  // equi-depth histogram over the values left over
+  vector<string*> rest;
+  for (int i = 0; i < runs.size(); i++) {
+    if (isCommon[runs[i].second])
+      continue;
+    for (int j = 0; j < runs[i].first; j++)
+      rest.push_back(&sample[runs[i].second + j]);
+  }
+  if (!rest.empty()) {
+    int numBuckets = (rest.size() < STATS_NUM_BUCKETS) ? rest.size() : STATS_NUM_BUCKETS;
+    dist.bounds.push_back(*rest[0]);
+    for (int i = 1; i <= numBuckets; i++)
+      dist.bounds.push_back(*rest[(i*rest.size() + numBuckets - 1)/numBuckets - 1]); // last value of bucket i-1
+  }
+  (*attDists)[AttrName] = dist;
+}
+
+/*******************************************************************************
+ * Stretches the histogram of attName to the smallest and largest values the
+ * attribute takes in the whole relation
+ ******************************************************************************/
+void Statistics :: AddRange(char *attName, string minValue, string maxValue) {
+  auto found = attDists->find(string(attName));
+  if (found == attDists->end() || found->second.bounds.empty())
+    return;
+  if (!attDists.unique()) {
+    attDists = make_shared< unordered_map<string, attDistribution> >(*attDists);
+    found = attDists->find(string(attName));
+  }
+  attDistribution &dist = found->second;
+  if (compareValues(minValue, dist.bounds.front(), dist.numeric) < 0)
+    dist.bounds.front() = minValue;
+  if (compareValues(maxValue, dist.bounds.back(), dist.numeric) > 0)
+    dist.bounds.back() = maxValue;
+}
+
+/*******************************************************************************
+ * Fraction of the tuples whose value of att satisfies (att code value), where
+ * code is EQUALS, LESS_THAN or GREATER_THAN. Returns -1 if there is no
+ * distribution for att.
+ * EQUALS: the frequency of value if it is a most common value. If not, the tuples
+ *   that don't hold a most common value are spread evenly over the remaining
+ *   distinct values.
+ * LESS_THAN/GREATER_THAN: the most common values on the right side of value, plus
+ *   the part of the histogram on the right side of value. Inside the bucket that
+ *   value falls into we interpolate linearly between the bounds for numbers and
+ *   take half the bucket for strings.
+ * The result is never less than half a sampled tuple so that a value that didn't
+ * make it into the sample doesn't turn an estimate into zero.
+ ******************************************************************************/
+double Statistics :: distSelectivity(string &att, int code, string &value, double distinct) {
+  auto found = attDists->find(att);
+  if (found == attDists->end())
+    return -1;
+  attDistribution &dist = found->second;
+
+  double restFreq = 1.0; // fraction of the tuples covered by the histogram
+  for (int i = 0; i < dist.mcvFreqs.size(); i++)
+    restFreq -= dist.mcvFreqs[i];
+  if (restFreq < 0)
+    restFreq = 0;
+
+  double sel = 0;
+  if (code == EQUALS) {
+    int i;
+    for (i = 0; i < dist.mcvValues.size(); i++) {
+      if (compareValues(dist.mcvValues[i], value, dist.numeric) == 0)
+        break;
+    }
+    if (i < dist.mcvValues.size())
+      sel = dist.mcvFreqs[i];
+    else {
+      double restDistinct = distinct - dist.mcvValues.size();
+      sel = restFreq/((restDistinct > 1) ? restDistinct : 1);
+    }
+  }
+  else {
+    for (int i = 0; i < dist.mcvValues.size(); i++) {
+      int cmp = compareValues(dist.mcvValues[i], value, dist.numeric);
+      if ((code == LESS_THAN && cmp < 0) || (code == GREATER_THAN && cmp > 0))
+        sel += dist.mcvFreqs[i];
+    }
+    if (!dist.bounds.empty()) {
+      int numBuckets = dist.bounds.size() - 1;
+      double below; // fraction of the histogram below value
+      if (compareValues(value, dist.bounds[0], dist.numeric) <= 0)
+        below = 0;
+      else if (compareValues(value, dist.bounds[numBuckets], dist.numeric) > 0)
+        below = 1;
+      else {
+        int i = 0;
+        while (compareValues(value, dist.bounds[i+1], dist.numeric) > 0) // find the bucket holding value
+          i++;
+        double within = 0.5;
+        if (dist.numeric) {
+          double lo = atof(dist.bounds[i].c_str());
+          double hi = atof(dist.bounds[i+1].c_str());
+          if (hi > lo)
+            within = (atof(value.c_str()) - lo)/(hi - lo);
+        }
+        below = (i + within)/numBuckets;
+      }
+      sel += restFreq*((code == LESS_THAN) ? below : 1 - below);
+    }
+  }
+
+  double minSel = 0.5/dist.sampleSize;
+  if (sel < minSel)
+    sel = minSel;
+  if (sel > 1)
+    sel = 1;
+  return sel;
+}
+
 /*******************************************************************************
  * This operation produces a copy of the relation (including all of its attributes and all of its
  * statistics) and stores it under new name.
@@ -81,6 +278,8 @@ void Statistics :: Read(char *fromWhere) {
   infile.open(fromWhere);
   string buffer;
 
+  attDists = make_shared< unordered_map<string, attDistribution> >(); // don't touch the copies sharing the old one
+
   while (getline(infile, buffer)) { // while the file has more lines.
     if (buffer[0] != '(') { // if the string doesn't contain '(', then it's for the relation description
       char_separator<char> sep("(): ");
@@ -115,7 +314,35 @@ void Statistics :: Read(char *fromWhere) {
     }
     buffer.clear();
   }
-
+  infile.close();
+
+  // read back the distributions. For every attribute:
+  //   att numeric sampleSize numMCVs numBounds
+  //   freq length value          (one line per most common value)
+  //   length value               (one line per histogram bound)
+  // values are prefixed with their length since strings may hold any character
+  ifstream distfile((string(fromWhere) + ".dist").c_str());
+  string attName;
+  attDistribution dist;
+  int numMCVs, numBounds, len;
+  while (distfile >> attName >> dist.numeric >> dist.sampleSize >> numMCVs >> numBounds) {
+    dist.mcvValues.assign(numMCVs, "");
+    dist.mcvFreqs.assign(numMCVs, 0);
+    dist.bounds.assign(numBounds, "");
+    for (int i = 0; i < numMCVs; i++) {
+      distfile >> dist.mcvFreqs[i] >> len;
+      distfile.get(); // the space in front of the value
+      dist.mcvValues[i].resize(len);
+      distfile.read(&dist.mcvValues[i][0], len);
+    }
+    for (int i = 0; i < numBounds; i++) {
+      distfile >> len;
+      distfile.get();
+      dist.bounds[i].resize(len);
+      distfile.read(&dist.bounds[i][0], len);
+    }
+    (*attDists)[attName] = dist;
+  }
 }
 
 /*******************************************************************************
@@ -130,6 +357,124 @@ void Statistics :: Write(char *fromWhere) {
       myfile << "( " << (it->first) << " : " << itInside->first << " : " << itInside->second << ") " << endl;
     }
   }
+
+  // the distributions go to <fromWhere>.dist. See Read for the format
+  ofstream distfile((string(fromWhere) + ".dist").c_str());
+  distfile.precision(17);
+  for (auto it = attDists->begin(); it != attDists->end(); ++it) {
+    attDistribution &dist = it->second;
+    distfile << it->first << " " << dist.numeric << " " << dist.sampleSize << " "
+             << dist.mcvValues.size() << " " << dist.bounds.size() << endl;
+    for (int i = 0; i < dist.mcvValues.size(); i++)
+      distfile << dist.mcvFreqs[i] << " " << dist.mcvValues[i].size() << " " << dist.mcvValues[i] << endl;
+    for (int i = 0; i < dist.bounds.size(); i++)
+      distfile << dist.bounds[i].size() << " " << dist.bounds[i] << endl;
+  }
+}
+
+/*******************************************************************************
+ * Strings in the binary form: their length followed by their bytes
+ ******************************************************************************/
+static void writeString(FILE *f, const string &str) {
+  int len = str.size();
+  fwrite(&len, sizeof(int), 1, f);
+  fwrite(str.data(), 1, len, f);
+}
+
+static string readString(FILE *f) {
+  int len = 0;
+  fread(&len, sizeof(int), 1, f);
+  string str(len, '\0');
+  if (len > 0)
+    fread(&str[0], 1, len, f);
+  return str;
+}
+
+/*******************************************************************************
+ * Write relName (all relations if NULL) in the binary form used by the Catalog:
+ *   number of relations
+ *   per relation: name, size, number of attributes,
+ *     per attribute: name, distinct values, 1 if it has a distribution else 0,
+ *       [numeric, sampleSize, number of MCVs, (value, freq) per MCV,
+ *        number of bounds, bound per bound]
+ ******************************************************************************/
+void Statistics :: WriteBinary(FILE *f, char *relName) {
+  int numRels = (relName == NULL) ? Relation_Size_Atts.size() : Relation_Size_Atts.count(string(relName));
+  fwrite(&numRels, sizeof(int), 1, f);
+  for (auto it = Relation_Size_Atts.begin(); it != Relation_Size_Atts.end(); ++it) {
+    if (relName != NULL && it->first.compare(relName) != 0)
+      continue;
+    writeString(f, it->first);
+    fwrite(&it->second.first, sizeof(int), 1, f);
+    int numAtts = it->second.second.size();
+    fwrite(&numAtts, sizeof(int), 1, f);
+    for (auto att = it->second.second.begin(); att != it->second.second.end(); ++att) {
+      writeString(f, att->first);
+      fwrite(&att->second, sizeof(int), 1, f);
+      auto found = attDists->find(att->first);
+      int hasDist = (found != attDists->end());
+      fwrite(&hasDist, sizeof(int), 1, f);
+      if (!hasDist)
+        continue;
+      attDistribution &dist = found->second;
+      int numeric = dist.numeric;
+      fwrite(&numeric, sizeof(int), 1, f);
+      fwrite(&dist.sampleSize, sizeof(int), 1, f);
+      int numMCVs = dist.mcvValues.size();
+      fwrite(&numMCVs, sizeof(int), 1, f);
+      for (int i = 0; i < numMCVs; i++) {
+        writeString(f, dist.mcvValues[i]);
+        fwrite(&dist.mcvFreqs[i], sizeof(double), 1, f);
+      }
+      int numBounds = dist.bounds.size();
+      fwrite(&numBounds, sizeof(int), 1, f);
+      for (int i = 0; i < numBounds; i++)
+        writeString(f, dist.bounds[i]);
+    }
+  }
+}
+
+/*******************************************************************************
+ * Read back what one WriteBinary wrote, replacing those relations
+ ******************************************************************************/
+void Statistics :: ReadBinary(FILE *f) {
+  if (!attDists.unique())
+    attDists = make_shared< unordered_map<string, attDistribution> >(*attDists);
+  int numRels = 0;
+  fread(&numRels, sizeof(int), 1, f);
+  for (int r = 0; r < numRels; r++) {
+    string relName = readString(f);
+    pair< int, unordered_map<string, int> > &rel = Relation_Size_Atts[relName];
+    rel.second.clear();
+    int numAtts = 0;
+    fread(&rel.first, sizeof(int), 1, f);
+    fread(&numAtts, sizeof(int), 1, f);
+    for (int a = 0; a < numAtts; a++) {
+      string attName = readString(f);
+      int hasDist = 0;
+      fread(&rel.second[attName], sizeof(int), 1, f);
+      fread(&hasDist, sizeof(int), 1, f);
+      if (!hasDist) {
+        attDists->erase(attName);
+        continue;
+      }
+      attDistribution dist;
+      int numeric = 0, numMCVs = 0, numBounds = 0;
+      fread(&numeric, sizeof(int), 1, f);
+      dist.numeric = numeric;
+      fread(&dist.sampleSize, sizeof(int), 1, f);
+      fread(&numMCVs, sizeof(int), 1, f);
+      for (int i = 0; i < numMCVs; i++) {
+        dist.mcvValues.push_back(readString(f));
+        dist.mcvFreqs.push_back(0);
+        fread(&dist.mcvFreqs.back(), sizeof(double), 1, f);
+      }
+      fread(&numBounds, sizeof(int), 1, f);
+      for (int i = 0; i < numBounds; i++)
+        dist.bounds.push_back(readString(f));
+      (*attDists)[attName] = dist;
+    }
+  }
 }
 
 /*******************************************************************************
@@ -230,7 +575,12 @@ int Statistics :: evalComparisonOp(struct ComparisonOp *pCom, char **relNames, i
         // cout<< "== selection"<< endl; // diagnostic
         // the values left after this equal selection will be:
         // the original number of tuples/the number of distinct attribute values.
-        Dresult = Relation_Size_Atts[string(relNames[lastHandledRel])].first/(double)Relation_Size_Atts[string(relNames[lastHandledRel])].second[att];
+        // If we have the distribution of the attribute, it tells us how common this particular value is.
+        double sel = distSelectivity(att, EQUALS, value, Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]);
+        if (sel >= 0)
+          Dresult = Relation_Size_Atts[string(relNames[lastHandledRel])].first*sel;
+        else
+          Dresult = Relation_Size_Atts[string(relNames[lastHandledRel])].first/(double)Relation_Size_Atts[string(relNames[lastHandledRel])].second[att];
         // cout << Dresult << endl;
         Relation_Size_Atts[string(relNames[lastHandledRel])].first = (int)Dresult;
         // the number of distinct values left is now only one (the one that we selected).
@@ -260,10 +610,18 @@ int Statistics :: evalComparisonOp(struct ComparisonOp *pCom, char **relNames, i
       }
       else if(pCom->code == LESS_THAN || pCom->code == GREATER_THAN){ // unequal selection
         // cout<< "> or < selection"<< endl; // diagnostic
+        // use the histogram of the attribute if we have one, else
         // reduce the number of tuple and distinct attribute number to a third.
-        Dresult = Relation_Size_Atts[string(relNames[lastHandledRel])].first/3.0;
+        int code = pCom->code;
+        if (pCom->left->code != NAME) // (value < att) is (att > value)
+          code = (code == LESS_THAN) ? GREATER_THAN : LESS_THAN;
+        double sel = distSelectivity(att, code, value, Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]);
+        if (sel < 0)
+          sel = 1/3.0;
+        Dresult = Relation_Size_Atts[string(relNames[lastHandledRel])].first*sel;
         if(writeFlag){
-          Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]= (int)(Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]/3.0);
+          int distinct = (int)(Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]*sel);
+          Relation_Size_Atts[string(relNames[lastHandledRel])].second[att]= (distinct > 1) ? distinct : 1;
           Relation_Size_Atts[string(relNames[lastHandledRel])].first = (int)Dresult;
         }
       }
@@ -3,6 +3,13 @@
 #include "ParseTree.h"
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+
+#define STATS_NUM_MCV 10        // most common values kept per attribute
+#define STATS_NUM_BUCKETS 20    // buckets of the equi-depth histogram of an attribute
+#define STATS_SAMPLE_SIZE 30000 // tuples sampled by UPDATE STATISTICS to build the MCVs and histograms
 
 using namespace std;
 
@@ -63,6 +70,35 @@ class Statistics{
 
   int lastHandledRel; // stores index of last updated relation
 
+  // Distribution of the values of one attribute, built by AddDistribution out of a sample of the
+  // relation. Used to estimate selections on the attribute instead of assuming that every value is
+  // equally common (equality) and that a range keeps a third of the tuples (LESS_THAN, GREATER_THAN).
+  //   mcvValues/mcvFreqs  the most common values and the fraction of all tuples holding each of them
+  //   bounds              equi-depth histogram over the tuples NOT holding a most common value. Bucket i
+  //                       holds the values in (bounds[i], bounds[i+1]] and every bucket holds the same
+  //                       number of tuples. bounds[0] is the smallest value. Empty if every sampled
+  //                       value made it into the most common values
+  //   numeric             values are Int or Double and are compared as numbers, else as strings
+  //   sampleSize          number of tuples the distribution was built from
+  struct attDistribution {
+    vector<string> mcvValues;
+    vector<double> mcvFreqs;
+    vector<string> bounds;
+    bool numeric;
+    int sampleSize;
+  };
+
+  // The distributions, keyed on attribute name (like attAlias, we rely on attribute names being
+  // unique; a relation and its aliases share the distributions of the base relation). They are only
+  // read while estimating, so the copies made by Estimate share one map instead of copying it.
+  // They are persisted next to the text file written by Write, in <file>.dist
+  shared_ptr< unordered_map<string, attDistribution> > attDists;
+
+  // Fraction of the tuples whose value of att satisfies (att code value), where code is EQUALS,
+  // LESS_THAN or GREATER_THAN. distinct is the current number of distinct values of att. Returns -1 if
+  // there is no distribution for att
+  double distSelectivity(string &att, int code, string &value, double distinct);
+
   public:
     // This function performs the actual estimation of resulting tuples for Selection
     // and Equi Joins.
@@ -113,6 +149,22 @@ class Statistics{
     // relation.
     void AddAtt(char *relName, char *attName, int numDistincts);
 
+    // Returns the number of tuples currently stored for relName, or -1 if there is no such
+    // relation. Added for the physical cost model in operation_node.h
+    int GetRelSize(char *relName);
+
+    // Removes relName and its attributes (but not their distributions, which are shared by name)
+    void DeleteRel(char *relName);
+
+    // Builds the most common values and the equi-depth histogram of attName out of the values it
+    // takes in a uniform sample of the tuples of its relation (the sample can be the whole
+    // relation). numeric is true for Int and Double attributes. Replaces any earlier distribution
+    void AddDistribution(char *attName, vector<string> &sample, bool numeric);
+
+    // Stretches the histogram of attName to the smallest and largest values the attribute takes in
+    // the whole relation, which a sample will usually have missed
+    void AddRange(char *attName, string minValue, string maxValue);
+
     // This operation produces a copy of the relation (including all of its attributes and all of its
     // statistics) and stores it under new name.
     void CopyRel(char *oldName, char *newName);
@@ -124,6 +176,12 @@ class Statistics{
     // The Statistics object can write itself to a text file.
     void Write(char *fromWhere);
 
+    // Binary form used by the Catalog. WriteBinary writes the relations (and the distributions of their
+    // attributes) to f: relName alone, or all of them if relName is NULL. ReadBinary reads back what
+    // one WriteBinary wrote and adds it to the object, replacing whatever was there for those relations
+    void WriteBinary(FILE *f, char *relName);
+    void ReadBinary(FILE *f);
+
     // This operation takes a bit of explanation. Internally within the Statistics object, the
     // various relations are partitioned into a set of subsets or partitions, where each and
     // every relation is contained within exactly one subset (initially, each relation is in
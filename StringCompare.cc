@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * File: StringCompare.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "StringCompare.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRING_SIMD
+#endif
+
+static int resolveCompare (char *left, int leftLen, char *right, int rightLen);
+static int resolveEqual (char *val, int valLen, char *lit, int litLen);
+
+StringCompare::Kernel StringCompare :: compareKernel = resolveCompare;
+StringCompare::Kernel StringCompare :: equalKernel = resolveEqual;
+static const char* kernelName = NULL;
+
+/*------------------------------------------------------------------------------
+ * Portable kernels. The strings end within their bounds, so the library's own
+ * functions never read past them
+ *----------------------------------------------------------------------------*/
+static int compareScalar (char *left, int leftLen, char *right, int rightLen) {
+  return strcmp (left, right);
+}
+
+static int equalScalar (char *val, int valLen, char *lit, int litLen) {
+  return valLen >= litLen && memcmp (val, lit, litLen) == 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Byte by byte from i up to n, for what is left after the vector loops
+ *----------------------------------------------------------------------------*/
+static inline int compareTail (char *left, char *right, int i, int n) {
+  for (; i < n; i++) {
+    unsigned char l = left[i];
+    unsigned char r = right[i];
+    if (l != r || l == 0)
+      return l - r;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * 1 if the n bytes at val and lit are the same. Short lengths are done with two
+ * overlapping loads, so there is no loop
+ *----------------------------------------------------------------------------*/
+static inline int sameShortBytes (char *val, char *lit, int n) {
+  if (n >= 8) {
+    uint64_t v1, v2, l1, l2;
+    memcpy (&v1, val, 8); memcpy (&v2, val + n - 8, 8);
+    memcpy (&l1, lit, 8); memcpy (&l2, lit + n - 8, 8);
+    return ((v1 ^ l1) | (v2 ^ l2)) == 0;
+  }
+  if (n >= 4) {
+    uint32_t v1, v2, l1, l2;
+    memcpy (&v1, val, 4); memcpy (&v2, val + n - 4, 4);
+    memcpy (&l1, lit, 4); memcpy (&l2, lit + n - 4, 4);
+    return ((v1 ^ l1) | (v2 ^ l2)) == 0;
+  }
+  for (int i = 0; i < n; i++)
+    if (val[i] != lit[i])
+      return 0;
+  return 1;
+}
+
+#ifdef STRING_SIMD
+
+#define CMPISTR_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT)
+
+/*------------------------------------------------------------------------------
+ * SSE4.2: PCMPISTRI finds the first byte where the strings differ or one of
+ * them ends, 16 bytes at a time
+ *----------------------------------------------------------------------------*/
+__attribute__ ((target ("sse4.2")))
+static int compareSSE42 (char *left, int leftLen, char *right, int rightLen) {
+  int n = leftLen < rightLen ? leftLen : rightLen;
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i l = _mm_loadu_si128 ((__m128i *) (left + i));
+    __m128i r = _mm_loadu_si128 ((__m128i *) (right + i));
+    int k = _mm_cmpistri (l, r, CMPISTR_MODE);
+    if (k < 16)
+      return (unsigned char) left[i + k] - (unsigned char) right[i + k];
+    if (_mm_cmpistrs (l, r, CMPISTR_MODE)) // both ended at the same byte
+      return 0;
+  }
+  return compareTail (left, right, i, n);
+}
+
+/*------------------------------------------------------------------------------
+ * 1 if the n bytes at val and lit are the same, 16 at a time. The last 16 bytes
+ * overlap the ones before rather than going byte by byte
+ *----------------------------------------------------------------------------*/
+__attribute__ ((target ("sse4.2")))
+static int equalSSE42 (char *val, int valLen, char *lit, int litLen) {
+  if (valLen < litLen)
+    return 0;
+  if (litLen < 16)
+    return sameShortBytes (val, lit, litLen);
+  for (int i = 0; i + 16 < litLen; i += 16) {
+    __m128i v = _mm_loadu_si128 ((__m128i *) (val + i));
+    __m128i l = _mm_loadu_si128 ((__m128i *) (lit + i));
+    if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (v, l)) != 0xffff)
+      return 0;
+  }
+  __m128i v = _mm_loadu_si128 ((__m128i *) (val + litLen - 16));
+  __m128i l = _mm_loadu_si128 ((__m128i *) (lit + litLen - 16));
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, l)) == 0xffff;
+}
+
+/*------------------------------------------------------------------------------
+ * AVX2: 32 bytes at a time, marking the bytes that differ or are the null of
+ * left (where they don't differ, right ends there too). Then the SSE4.2 kernel
+ * does what is left
+ *----------------------------------------------------------------------------*/
+__attribute__ ((target ("avx2,sse4.2")))
+static int compareAVX2 (char *left, int leftLen, char *right, int rightLen) {
+  int n = leftLen < rightLen ? leftLen : rightLen;
+  int i = 0;
+  __m256i zero = _mm256_setzero_si256 ();
+  for (; i + 32 <= n; i += 32) {
+    __m256i l = _mm256_loadu_si256 ((__m256i *) (left + i));
+    __m256i r = _mm256_loadu_si256 ((__m256i *) (right + i));
+    unsigned int differ = ~(unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (l, r));
+    unsigned int ends = (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (l, zero));
+    if (differ | ends) {
+      int k = __builtin_ctz (differ | ends);
+      return (unsigned char) left[i + k] - (unsigned char) right[i + k];
+    }
+  }
+  return compareSSE42 (left + i, leftLen - i, right + i, rightLen - i);
+}
+
+__attribute__ ((target ("avx2,sse4.2")))
+static int equalAVX2 (char *val, int valLen, char *lit, int litLen) {
+  if (valLen < litLen)
+    return 0;
+  if (litLen <= 32)
+    return equalSSE42 (val, valLen, lit, litLen);
+  for (int i = 0; i + 32 < litLen; i += 32) {
+    __m256i v = _mm256_loadu_si256 ((__m256i *) (val + i));
+    __m256i l = _mm256_loadu_si256 ((__m256i *) (lit + i));
+    if ((unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, l)) != 0xffffffffu)
+      return 0;
+  }
+  __m256i v = _mm256_loadu_si256 ((__m256i *) (val + litLen - 32));
+  __m256i l = _mm256_loadu_si256 ((__m256i *) (lit + litLen - 32));
+  return (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, l)) == 0xffffffffu;
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+ * Pick the kernels for this CPU. Every thread that gets here picks the same ones,
+ * so there is no need for a lock
+ *----------------------------------------------------------------------------*/
+void StringCompare :: PickKernels () {
+#ifdef STRING_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("sse4.2")) {
+    compareKernel = compareAVX2;
+    equalKernel = equalAVX2;
+    kernelName = "avx2";
+    return;
+  }
+  if (__builtin_cpu_supports ("sse4.2")) {
+    compareKernel = compareSSE42;
+    equalKernel = equalSSE42;
+    kernelName = "sse4.2";
+    return;
+  }
+#endif
+  compareKernel = compareScalar;
+  equalKernel = equalScalar;
+  kernelName = "scalar";
+}
+
+static int resolveCompare (char *left, int leftLen, char *right, int rightLen) {
+  StringCompare :: PickKernels ();
+  return StringCompare :: Compare (left, leftLen, right, rightLen);
+}
+
+static int resolveEqual (char *val, int valLen, char *lit, int litLen) {
+  StringCompare :: PickKernels ();
+  return StringCompare :: Equal (val, valLen, lit, litLen);
+}
+
+const char* StringCompare :: Kernels () {
+  if (kernelName == NULL)
+    PickKernels ();
+  return kernelName;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
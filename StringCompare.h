@@ -0,0 +1,65 @@
+#ifndef STRINGCOMPARE_H
+#define STRINGCOMPARE_H
+
+// Comparison of String attributes, in place of strcmp. Added because selections
+// like (c_name = 'Customer#000070919') and joins on names compare strings for
+// every record, and strcmp neither knows how long they can be nor that an
+// equality can stop at the first difference.
+//
+// A string lies in the record with its null, padded to a multiple of an int, so
+// where the next attribute starts (or the record ends) bounds it. The kernels
+// take that bound and compare 16 (SSE4.2) or 32 (AVX2) bytes at a time, never
+// reading past it; the padding after the null may be anything and is never looked
+// at. Which kernels are used is decided once, from what the CPU supports, with
+// strcmp and memcmp where it supports neither.
+class StringCompare {
+  public:
+    typedef int (*Kernel) (char *, int, char *, int);
+
+  private:
+    // the kernels for this CPU, picked on the first call
+    static Kernel compareKernel;
+    static Kernel equalKernel;
+
+  public:
+    // returns a negative number, 0, or a positive number if the string at left is
+    // less than, equal to, or greater than the one at right, as strcmp does. Both
+    // must end within their len bytes. Most strings differ in the first byte, which
+    // is checked here before going to the kernel
+    static inline int Compare (char *left, int leftLen, char *right, int rightLen) {
+      unsigned char l = *left;
+      unsigned char r = *right;
+      if (l != r || l == 0)
+        return l - r;
+      return compareKernel (left, leftLen, right, rightLen);
+    }
+
+    // 1 if the string at val, ending within its valLen bytes, is the string lit,
+    // whose litLen bytes are exactly its characters and its null. A val with fewer
+    // than litLen bytes is rejected without looking at it
+    static inline int Equal (char *val, int valLen, char *lit, int litLen) {
+      if (valLen < litLen || *val != *lit)
+        return 0;
+      return equalKernel (val, valLen, lit, litLen);
+    }
+
+    // bytes from val to where the attribute att of bits ends: where the next one
+    // starts, or the end of the record if att is lastAtt (or lastAtt isn't known, -1)
+    static inline int Bound (char *bits, char *val, int att, int lastAtt) {
+      int end = (att < lastAtt) ? ((int *) bits)[att + 2] : ((int *) bits)[0];
+      return end - (int) (val - bits);
+    }
+
+    // bytes from val to the end of the record bits
+    static inline int Bound (char *bits, char *val) {
+      return ((int *) bits)[0] - (int) (val - bits);
+    }
+
+    // the kernels in use: "avx2", "sse4.2" or "scalar"
+    static const char* Kernels ();
+
+    // pick the kernels for this CPU. Done by the first comparison
+    static void PickKernels ();
+};
+
+#endif
@@ -0,0 +1,523 @@
+/*******************************************************************************
+ * File: TPCHGen.cc
+ * Author: Neeraj Rao
+ ******************************************************************************/
+#include "TPCHGen.h"
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+
+enum { REGION, NATION, PART, SUPPLIER, PARTSUPP, CUSTOMER, ORDERS, LINEITEM, NUM_TPCH_RELS };
+
+static const char* relNames[NUM_TPCH_RELS] = {"region", "nation", "part", "supplier",
+                                              "partsupp", "customer", "orders", "lineitem"};
+
+static const char* regions[] = {"AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST"};
+
+static const struct { const char* name; int region; } nations[] = {
+  {"ALGERIA", 0}, {"ARGENTINA", 1}, {"BRAZIL", 1}, {"CANADA", 1}, {"EGYPT", 4},
+  {"ETHIOPIA", 0}, {"FRANCE", 3}, {"GERMANY", 3}, {"INDIA", 2}, {"INDONESIA", 2},
+  {"IRAN", 4}, {"IRAQ", 4}, {"JAPAN", 2}, {"JORDAN", 4}, {"KENYA", 0},
+  {"MOROCCO", 0}, {"MOZAMBIQUE", 0}, {"PERU", 1}, {"CHINA", 2}, {"ROMANIA", 3},
+  {"SAUDI ARABIA", 4}, {"VIETNAM", 2}, {"RUSSIA", 3}, {"UNITED KINGDOM", 3},
+  {"UNITED STATES", 1}};
+
+static const char* colors[] = {"almond", "antique", "aquamarine", "azure", "beige", "bisque",
+  "black", "blanched", "blue", "blush", "brown", "burlywood", "burnished", "chartreuse",
+  "chiffon", "chocolate", "coral", "cornflower", "cornsilk", "cream", "cyan", "dark", "deep",
+  "dim", "dodger", "drab", "firebrick", "floral", "forest", "frosted", "gainsboro", "ghost",
+  "goldenrod", "green", "grey", "honeydew", "hot", "indian", "ivory", "khaki", "lace",
+  "lavender", "lawn", "lemon", "light", "lime", "linen", "magenta", "maroon", "medium",
+  "metallic", "midnight", "mint", "misty", "moccasin", "navajo", "navy", "olive", "orange",
+  "orchid", "pale", "papaya", "peach", "peru", "pink", "plum", "powder", "puff", "purple",
+  "red", "rose", "rosy", "royal", "saddle", "salmon", "sandy", "seashell", "sienna", "sky",
+  "slate", "smoke", "snow", "spring", "steel", "tan", "thistle", "tomato", "turquoise",
+  "violet", "wheat", "white", "yellow"};
+
+static const char* typeSize[] = {"STANDARD", "SMALL", "MEDIUM", "LARGE", "ECONOMY", "PROMO"};
+static const char* typeFinish[] = {"ANODIZED", "BURNISHED", "PLATED", "POLISHED", "BRUSHED"};
+static const char* typeMaterial[] = {"TIN", "NICKEL", "BRASS", "STEEL", "COPPER"};
+static const char* containerSize[] = {"SM", "LG", "MED", "JUMBO", "WRAP"};
+static const char* containerKind[] = {"CASE", "BOX", "BAG", "JAR", "PKG", "PACK", "CAN", "DRUM"};
+static const char* segments[] = {"AUTOMOBILE", "BUILDING", "FURNITURE", "MACHINERY", "HOUSEHOLD"};
+static const char* priorities[] = {"1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW"};
+static const char* instructions[] = {"DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"};
+static const char* shipModes[] = {"REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"};
+
+static const char* vocabulary[] = {"furiously", "quickly", "carefully", "blithely", "slyly",
+  "fluffily", "ironic", "regular", "final", "express", "special", "pending", "bold", "even",
+  "silent", "unusual", "close", "deposits", "requests", "packages", "accounts", "instructions",
+  "foxes", "theodolites", "pinto", "beans", "dependencies", "platelets", "asymptotes",
+  "excuses", "ideas", "courts", "sleep", "wake", "haggle", "nag", "use", "boost", "cajole",
+  "detect", "integrate", "among", "across", "above", "after", "along", "the", "of"};
+
+#define NUM(a) ((int) (sizeof (a) / sizeof (a[0])))
+
+#define TPCH_NUM_DAYS 2557 // 1992-01-01 .. 1998-12-31
+
+/*------------------------------------------------------------------------------
+ * Constructor. Every relation but region and nation scales linearly; each gets
+ * at least a few rows so that tiny scale factors still give a joinable database
+ *----------------------------------------------------------------------------*/
+TPCHGen :: TPCHGen (double scale, unsigned long long seed) {
+  this->scale = scale;
+  this->seed = seed;
+  state = 0;
+  outText = NULL;
+  outHeap = NULL;
+  numRows = 0;
+  curAtt = 0;
+  curPos = 0;
+
+  numParts = (long) (200000 * scale);
+  numSuppliers = (long) (10000 * scale);
+  numCustomers = (long) (150000 * scale);
+  numOrders = (long) (1500000 * scale);
+  if (numParts < 1) numParts = 1;
+  if (numSuppliers < 4) numSuppliers = 4; // so that a part's 4 suppliers are different
+  if (numCustomers < 1) numCustomers = 1;
+  if (numOrders < 1) numOrders = 1;
+
+  recBits = new (std::nothrow) char[TPCH_MAX_ROW];
+  if (recBits == NULL)
+  {
+    cout << "ERROR : Not enough memory. EXIT !!!\n";
+    exit(1);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Destructor
+ *----------------------------------------------------------------------------*/
+TPCHGen :: ~TPCHGen () {
+  delete [] recBits;
+}
+
+/*------------------------------------------------------------------------------
+ * Seed the generator from the seed, the relation and the row only, so that a row
+ * doesn't depend on which rows were generated before it
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: seedRow (int rel, long row) {
+  state = seed * 0x9e3779b97f4a7c15ULL + ((unsigned long long) rel << 56) + row;
+  next (); // mix the seed in
+}
+
+/*------------------------------------------------------------------------------
+ * splitmix64: fast, and good enough for generating data
+ *----------------------------------------------------------------------------*/
+unsigned long long TPCHGen :: next () {
+  unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/*------------------------------------------------------------------------------
+ * Uniform in [lo, hi]
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: uniform (long lo, long hi) {
+  return lo + (long) (next () % (unsigned long long) (hi - lo + 1));
+}
+
+/*------------------------------------------------------------------------------
+ * Random words from the vocabulary, cut to lo..hi characters
+ *----------------------------------------------------------------------------*/
+string TPCHGen :: words (int lo, int hi) {
+  int len = uniform (lo, hi);
+  string s;
+  while ((int) s.size () < len) {
+    if (!s.empty ()) s += ' ';
+    s += vocabulary[uniform (0, NUM (vocabulary) - 1)];
+  }
+  s.resize (len);
+  while (!s.empty () && s[s.size () - 1] == ' ') // no trailing blank where we cut
+    s.resize (s.size () - 1);
+  return s;
+}
+
+/*------------------------------------------------------------------------------
+ * Random alphanumeric string of lo..hi characters, like dbgen's addresses
+ *----------------------------------------------------------------------------*/
+string TPCHGen :: alphanumeric (int lo, int hi) {
+  static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ,";
+  int len = uniform (lo, hi);
+  string s (len, ' ');
+  for (int i = 0; i < len; i++)
+    s[i] = chars[uniform (0, sizeof (chars) - 2)];
+  return s;
+}
+
+/*------------------------------------------------------------------------------
+ * Day (after 1992-01-01) as yyyy-mm-dd
+ *----------------------------------------------------------------------------*/
+string TPCHGen :: date (int day) {
+  static const int monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  int year = 1992;
+  while (true) {
+    int yearDays = (year % 4 == 0) ? 366 : 365; // no century in range
+    if (day < yearDays) break;
+    day -= yearDays;
+    year++;
+  }
+  int month = 0;
+  while (true) {
+    int days = monthDays[month] + ((month == 1 && year % 4 == 0) ? 1 : 0);
+    if (day < days) break;
+    day -= days;
+    month++;
+  }
+  char buf[48]; // room for any int, so the compiler can see nothing is cut
+  snprintf (buf, sizeof (buf), "%04d-%02d-%02d", year, month + 1, day + 1);
+  return string (buf);
+}
+
+/*------------------------------------------------------------------------------
+ * Phone number; the country code is given by the nation
+ *----------------------------------------------------------------------------*/
+string TPCHGen :: phone (int nation) {
+  char buf[32];
+  sprintf (buf, "%02d-%03ld-%03ld-%04ld", nation + 10, uniform (100, 999),
+           uniform (100, 999), uniform (1000, 9999));
+  return string (buf);
+}
+
+/*------------------------------------------------------------------------------
+ * Retail price of a part, in cents. The formula of the TPC-H specification; it
+ * doesn't use the generator so that line items can work it out
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: retailPrice (long partKey) {
+  return 90000 + ((partKey / 10) % 20001) + 100 * (partKey % 1000);
+}
+
+/*------------------------------------------------------------------------------
+ * The i-th (0..3) supplier of a part, as in the TPC-H specification
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: partSupplier (long partKey, int i) {
+  return (partKey + i * (numSuppliers / 4 + (partKey - 1) / numSuppliers)) % numSuppliers + 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Start a row of numAtts attributes. The binary record is laid out the way
+ * Record::ComposeRecord does it
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: startRow (int numAtts) {
+  text.clear ();
+  curAtt = 0;
+  curPos = sizeof (int) * (numAtts + 1);
+  memset (recBits, 0, TPCH_MAX_ROW); // the padding is zeroed, as SuckNextRecord does
+}
+
+void TPCHGen :: addInt (int val) {
+  char buf[16];
+  sprintf (buf, "%d|", val);
+  text += buf;
+  ((int *) recBits)[++curAtt] = curPos;
+  *((int *) &(recBits[curPos])) = val;
+  curPos += sizeof (int);
+}
+
+void TPCHGen :: addDouble (long cents) {
+  char buf[32];
+  sprintf (buf, "%s%ld.%02ld|", cents < 0 ? "-" : "", labs (cents) / 100, labs (cents) % 100);
+  text += buf;
+  while (curPos % sizeof (double) != 0) // double aligned
+    curPos += sizeof (int);
+  ((int *) recBits)[++curAtt] = curPos;
+  *((double *) &(recBits[curPos])) = cents / 100.0; // what parsing the text gives
+  curPos += sizeof (double);
+}
+
+void TPCHGen :: addString (const string &val) {
+  text += val;
+  text += '|';
+  ((int *) recBits)[++curAtt] = curPos;
+  memcpy (&(recBits[curPos]), val.c_str (), val.size ());
+  int len = val.size () + 1; // null terminated and int aligned
+  if (len % sizeof (int) != 0)
+    len += sizeof (int) - (len % sizeof (int));
+  curPos += len;
+}
+
+/*------------------------------------------------------------------------------
+ * Write the row out to the text file and/or the heap file
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: emitRow () {
+  numRows++;
+  if (outText != NULL) {
+    text += '\n';
+    fwrite (text.data (), 1, text.size (), outText);
+  }
+  if (outHeap != NULL) {
+    ((int *) recBits)[0] = curPos;
+    Record rec;
+    rec.bits = RecordPool::Alloc (curPos);
+    memcpy (rec.bits, recBits, curPos);
+    outHeap->Add (rec);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * The fixed relations
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: regionRow (long row) {
+  seedRow (REGION, row);
+  startRow (3);
+  addInt (row);
+  addString (regions[row]);
+  addString (words (31, 115));
+  emitRow ();
+}
+
+void TPCHGen :: nationRow (long row) {
+  seedRow (NATION, row);
+  startRow (4);
+  addInt (row);
+  addString (nations[row].name);
+  addInt (nations[row].region);
+  addString (words (31, 114));
+  emitRow ();
+}
+
+/*------------------------------------------------------------------------------
+ * The relations that scale
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: partRow (long row) {
+  seedRow (PART, row);
+  long key = row + 1;
+  int mfgr = uniform (1, 5);
+  char buf[32];
+
+  startRow (9);
+  addInt (key);
+  string name;
+  for (int i = 0; i < 5; i++) {
+    if (i) name += ' ';
+    name += colors[uniform (0, NUM (colors) - 1)];
+  }
+  addString (name);
+  sprintf (buf, "Manufacturer#%d", mfgr);
+  addString (buf);
+  sprintf (buf, "Brand#%d%ld", mfgr, uniform (1, 5));
+  addString (buf);
+  string type = typeSize[uniform (0, NUM (typeSize) - 1)];
+  type = type + " " + typeFinish[uniform (0, NUM (typeFinish) - 1)];
+  type = type + " " + typeMaterial[uniform (0, NUM (typeMaterial) - 1)];
+  addString (type);
+  addInt (uniform (1, 50));
+  string container = containerSize[uniform (0, NUM (containerSize) - 1)];
+  container = container + " " + containerKind[uniform (0, NUM (containerKind) - 1)];
+  addString (container);
+  addDouble (retailPrice (key));
+  addString (words (5, 22));
+  emitRow ();
+}
+
+void TPCHGen :: supplierRow (long row) {
+  seedRow (SUPPLIER, row);
+  char buf[32];
+  int nation = uniform (0, NUM (nations) - 1);
+
+  startRow (7);
+  addInt (row + 1);
+  sprintf (buf, "Supplier#%09ld", row + 1);
+  addString (buf);
+  addString (alphanumeric (10, 40));
+  addInt (nation);
+  addString (phone (nation));
+  addDouble (uniform (-99999, 999999));
+  addString (words (25, 100));
+  emitRow ();
+}
+
+void TPCHGen :: partsuppRow (long row) {
+  seedRow (PARTSUPP, row);
+  long partKey = row / 4 + 1;
+
+  startRow (5);
+  addInt (partKey);
+  addInt (partSupplier (partKey, row % 4));
+  addInt (uniform (1, 9999));
+  addDouble (uniform (100, 100000));
+  addString (words (49, 198));
+  emitRow ();
+}
+
+void TPCHGen :: customerRow (long row) {
+  seedRow (CUSTOMER, row);
+  char buf[32];
+  int nation = uniform (0, NUM (nations) - 1);
+
+  startRow (8);
+  addInt (row + 1);
+  sprintf (buf, "Customer#%09ld", row + 1);
+  addString (buf);
+  addString (alphanumeric (10, 40));
+  addInt (nation);
+  addString (phone (nation));
+  addDouble (uniform (-99999, 999999));
+  addString (segments[uniform (0, NUM (segments) - 1)]);
+  addString (words (29, 116));
+  emitRow ();
+}
+
+/*------------------------------------------------------------------------------
+ * The order date is the first thing drawn for an order, so the line items can
+ * work it out on their own. Orders are placed up to 151 days before the end of
+ * 1998, so that all their line items are received in range
+ *----------------------------------------------------------------------------*/
+int TPCHGen :: orderDate (long row) {
+  seedRow (ORDERS, row);
+  return uniform (0, TPCH_NUM_DAYS - 152);
+}
+
+void TPCHGen :: ordersRow (long row) {
+  char status;
+  long totalCents;
+  lineitems (row, false, status, totalCents);
+
+  int day = orderDate (row); // and carry on drawing from the order's generator
+  long custKey = uniform (1, numCustomers);
+  if (custKey % 3 == 0) // a third of the customers have no orders
+    custKey = (custKey == numCustomers) ? custKey - 1 : custKey + 1;
+  long numClerks = (long) (1000 * scale);
+  if (numClerks < 1) numClerks = 1;
+  char buf[32];
+
+  startRow (9);
+  addInt (row + 1);
+  addInt (custKey);
+  addString (string (1, status));
+  addDouble (totalCents);
+  addString (date (day));
+  addString (priorities[uniform (0, NUM (priorities) - 1)]);
+  sprintf (buf, "Clerk#%09ld", uniform (1, numClerks));
+  addString (buf);
+  addInt (0);
+  addString (words (19, 78));
+  emitRow ();
+}
+
+/*------------------------------------------------------------------------------
+ * The line items of an order. The order's status is F if all of them have been
+ * shipped by the current date, O if none have, and P otherwise; its total price
+ * is the sum of their prices with tax and discount
+ *----------------------------------------------------------------------------*/
+void TPCHGen :: lineitems (long row, bool emit, char &status, long &totalCents) {
+  int day = orderDate (row);
+  seedRow (LINEITEM, row);
+  int numLines = uniform (1, TPCH_MAX_LINES);
+  int numShipped = 0;
+  totalCents = 0;
+
+  for (int line = 1; line <= numLines; line++) {
+    long partKey = uniform (1, numParts);
+    long suppKey = partSupplier (partKey, uniform (0, 3));
+    int quantity = uniform (1, 50);
+    long extendedCents = quantity * retailPrice (partKey);
+    int discount = uniform (0, 10);
+    int tax = uniform (0, 8);
+    int shipDay = day + uniform (1, 121);
+    int commitDay = day + uniform (30, 90);
+    int receiptDay = shipDay + uniform (1, 30);
+    const char* instruction = instructions[uniform (0, NUM (instructions) - 1)];
+    const char* mode = shipModes[uniform (0, NUM (shipModes) - 1)];
+    string comment = words (10, 43);
+    const char* returnFlag = (receiptDay <= TPCH_CURRENT_DATE) ? (uniform (0, 1) ? "R" : "A") : "N";
+    const char* lineStatus = (shipDay > TPCH_CURRENT_DATE) ? "O" : "F";
+
+    if (shipDay <= TPCH_CURRENT_DATE) numShipped++;
+    totalCents += (long) (extendedCents * (100 + tax) * (100 - discount) / 10000.0 + 0.5);
+
+    if (!emit) continue;
+    startRow (16);
+    addInt (row + 1);
+    addInt (partKey);
+    addInt (suppKey);
+    addInt (line);
+    addDouble (quantity * 100);
+    addDouble (extendedCents);
+    addDouble (discount);
+    addDouble (tax);
+    addString (returnFlag);
+    addString (lineStatus);
+    addString (date (shipDay));
+    addString (date (commitDay));
+    addString (date (receiptDay));
+    addString (instruction);
+    addString (mode);
+    addString (comment);
+    emitRow ();
+  }
+  status = (numShipped == numLines) ? 'F' : (numShipped == 0 ? 'O' : 'P');
+}
+
+/*------------------------------------------------------------------------------
+ * Write out every row of relName
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: generate (const char *relName) {
+  numRows = 0;
+  char status;
+  long totalCents;
+  if (!strcmp (relName, relNames[REGION]))
+    for (long i = 0; i < NUM (regions); i++) regionRow (i);
+  else if (!strcmp (relName, relNames[NATION]))
+    for (long i = 0; i < NUM (nations); i++) nationRow (i);
+  else if (!strcmp (relName, relNames[PART]))
+    for (long i = 0; i < numParts; i++) partRow (i);
+  else if (!strcmp (relName, relNames[SUPPLIER]))
+    for (long i = 0; i < numSuppliers; i++) supplierRow (i);
+  else if (!strcmp (relName, relNames[PARTSUPP]))
+    for (long i = 0; i < 4 * numParts; i++) partsuppRow (i);
+  else if (!strcmp (relName, relNames[CUSTOMER]))
+    for (long i = 0; i < numCustomers; i++) customerRow (i);
+  else if (!strcmp (relName, relNames[ORDERS]))
+    for (long i = 0; i < numOrders; i++) ordersRow (i);
+  else if (!strcmp (relName, relNames[LINEITEM]))
+    for (long i = 0; i < numOrders; i++) lineitems (i, true, status, totalCents);
+  else
+    return -1;
+  return numRows;
+}
+
+/*------------------------------------------------------------------------------
+ * True if relName is one of the eight TPC-H relations
+ *----------------------------------------------------------------------------*/
+bool TPCHGen :: Knows (const char *relName) {
+  for (int i = 0; i < NUM_TPCH_RELS; i++)
+    if (!strcmp (relName, relNames[i])) return true;
+  return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Write relName as a .tbl file
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: WriteText (const char *relName, char *tblPath) {
+  if (!Knows (relName)) return -1;
+  outText = fopen (tblPath, "w");
+  if (outText == NULL) {
+    cerr << "ERROR: Can't open " << tblPath << " for writing. EXIT !!!\n";
+    exit(1);
+  }
+  long rows = generate (relName);
+  fclose (outText);
+  outText = NULL;
+  return rows;
+}
+
+/*------------------------------------------------------------------------------
+ * Write relName straight into a heap file, skipping the text
+ *----------------------------------------------------------------------------*/
+long TPCHGen :: WriteHeap (const char *relName, char *binPath) {
+  if (!Knows (relName)) return -1;
+  DBFile dbfile;
+  dbfile.Create (binPath, heap, NULL);
+  outHeap = &dbfile;
+  long rows = generate (relName);
+  dbfile.Close ();
+  outHeap = NULL;
+  return rows;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
@@ -0,0 +1,124 @@
+#ifndef TPCHGEN_H
+#define TPCHGEN_H
+
+#include "Record.h"
+#include "DBFile.h"
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+#define TPCH_MAX_LINES 7        // line items per order are 1..7
+#define TPCH_MAX_ROW 4096       // bytes of the largest generated record
+#define TPCH_CURRENT_DATE 1263  // days after 1992-01-01 of 1995-06-17, the "current date" that
+                                // decides l_returnflag and l_linestatus
+
+// Deterministic generator of TPC-H like data for the eight relations of the
+// catalog. Added so that the demo, benchmarks and tests can run without the .tbl
+// files of dbgen.
+//
+// The cardinalities, keys and foreign keys follow the TPC-H specification
+// (partsupp pairs every part with 4 suppliers, l_partkey/l_suppkey pairs are
+// in partsupp, o_custkey is never a multiple of 3, ...), as do the value ranges,
+// the domains of the flag and category columns and the way the dates, the flags
+// and o_totalprice depend on each other. Names and comments are random words.
+//
+// Every row is generated from a random number generator seeded with the seed, the
+// relation and the row number only, so the data is the same on every machine and
+// for every way of generating it. A relation is written either as a .tbl file in
+// the format SuckNextRecord reads, or straight into a heap file, building the
+// binary records without going through the text.
+class TPCHGen {
+  private:
+    double scale;
+    unsigned long long seed;
+    unsigned long long state; // of the random number generator, seeded per row
+
+    // where the rows go, and the row being built as text and in the layout of
+    // Record.bits
+    FILE* outText;
+    DBFile* outHeap;
+    long numRows;
+    string text;
+    char* recBits;
+    int curAtt;
+    int curPos;
+
+    // number of rows of each relation at this scale
+    long numParts;
+    long numSuppliers;
+    long numCustomers;
+    long numOrders;
+
+    // seed the generator for row of relation rel
+    void seedRow(int rel, long row);
+
+    // next random number (splitmix64)
+    unsigned long long next();
+
+    // uniform in [lo, hi]
+    long uniform(long lo, long hi);
+
+    // random words, lo..hi characters of them
+    string words(int lo, int hi);
+
+    // random alphanumeric string of lo..hi characters
+    string alphanumeric(int lo, int hi);
+
+    // day (after 1992-01-01) as yyyy-mm-dd
+    string date(int day);
+
+    // phone number of someone in nation
+    string phone(int nation);
+
+    // retail price of a part in cents, which l_extendedprice depends on
+    long retailPrice(long partKey);
+
+    // the i-th (0..3) supplier of a part
+    long partSupplier(long partKey, int i);
+
+    // build a row and write it out
+    void startRow(int numAtts);
+    void addInt(int val);
+    void addDouble(long cents); // doubles are all multiples of 0.01, given in cents
+    void addString(const string &val);
+    void emitRow();
+
+    // generate and write out row of relation rel. Row numbers start at 0
+    void regionRow(long row);
+    void nationRow(long row);
+    void partRow(long row);
+    void supplierRow(long row);
+    void partsuppRow(long row);
+    void customerRow(long row);
+    void ordersRow(long row);
+
+    // day the order of row was placed, which its line items' dates depend on
+    int orderDate(long row);
+
+    // generate the line items of the order of row, writing them out if emit. The
+    // order's status and total price are worked out from them
+    void lineitems(long row, bool emit, char &status, long &totalCents);
+
+    // write out every row of relation relName. Returns the number of rows, or -1 if
+    // relName isn't a TPC-H relation
+    long generate(const char *relName);
+
+  public:
+    // scale factor as in dbgen (1 is about 1GB of text); seed picks the data
+    TPCHGen (double scale, unsigned long long seed);
+    ~TPCHGen ();
+
+    // true if relName is one of the eight TPC-H relations
+    static bool Knows (const char *relName);
+
+    // write relName to the text file tblPath. Returns the number of rows, or -1 if
+    // relName isn't a TPC-H relation
+    long WriteText (const char *relName, char *tblPath);
+
+    // write relName to the heap file binPath (replacing anything there). Returns
+    // the number of rows, or -1 if relName isn't a TPC-H relation
+    long WriteHeap (const char *relName, char *binPath);
+};
+
+#endif
@@ -0,0 +1,670 @@
+/*******************************************************************************
+ * Author: Neeraj Rao
+ * Email:  neeraj AT cise.ufl.edu
+ ******************************************************************************/
+#include "Defs.h"
+#include "Tree.h"
+#include "Comparison.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+typedef struct{
+  Pipe* inputPipe;
+  Pipe* outputPipe;
+  OrderMaker* sortOrder;
+  int runlen;
+} treeWorkerUtil; // struct used by the BigQ thread in Tree.Load
+
+
+void* treeWorkerRoutine(void* ptr){
+  treeWorkerUtil* myT = (treeWorkerUtil*) ptr;
+  new BigQ(*(myT->inputPipe),*(myT->outputPipe),*(myT->sortOrder),myT->runlen); // the BigQ constructor blocks till the
+                                                           // input pipe is shut down and the output pipe emptied, so
+                                                           // it gets its own thread (same as Sorted.myWorkerRoutine)
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Constructor
+ *----------------------------------------------------------------------------*/
+Tree :: Tree () {
+  dataFile = new File();
+  indexFile = new File();
+  currPage = new Page();
+  if(dataFile == NULL || indexFile == NULL || currPage == NULL){
+    cout << "ERROR : Not enough memory to create File. EXIT !!!\n";
+    exit(1);
+  }
+
+  // schema of the one-Int record holding a child page number
+  Attribute childAtt = {"child", Int};
+  childSchema = new Schema("tree_child", 1, &childAtt);
+
+  rootPage = -1;
+  height = 0;
+  LEAFORDERVALID = false;
+  currLeaf = 0;
+  CALLEDBEFORE = false;
+  highOrder = new OrderMaker();
+  keyOrder = leadOrder = leadEntryOrder = NULL; // built by Create or Open
+  indexFileName = NULL;
+  sortOrder = NULL;
+  OWNSORTORDER = false;
+}
+
+/*------------------------------------------------------------------------------
+ * Destructor
+ *----------------------------------------------------------------------------*/
+Tree :: ~Tree () {
+  // housekeeping
+  delete dataFile;
+  delete indexFile;
+  delete currPage;
+  delete childSchema;
+  delete highOrder;
+  delete keyOrder;
+  delete leadOrder;
+  delete leadEntryOrder;
+  delete [] indexFileName;
+  if(OWNSORTORDER) delete sortOrder;
+}
+
+/*------------------------------------------------------------------------------
+ * Creates file using File class.
+ *   - fpath is path to file,
+ *   - file_type is tree
+ *   - startup holds the key ordermaker and runlen (same struct as sorted)
+ * Return 1 on success and 0 on failure
+ *----------------------------------------------------------------------------*/
+int Tree :: Create (char *f_path, fType f_type, void *startup) {
+  typedef struct {OrderMaker *o; int l;} temp;
+  temp* tempvar = (temp*) startup;
+  sortOrder = tempvar->o;
+  myRunlen = tempvar->l;
+  initKeyOrders();
+
+  dataFileName = f_path;
+  delete [] indexFileName;
+  indexFileName = new char[strlen(f_path)+5];
+  sprintf(indexFileName, "%s.idx", f_path);
+
+  dataFile->Open(0, dataFileName);
+  indexFile->Open(0, indexFileName);
+  rootPage = -1;
+  height = 0;
+  LEAFORDERVALID = false;
+  CALLEDBEFORE = false;
+
+  return dataFile->CheckFileDesOkay() && indexFile->CheckFileDesOkay();
+}
+
+/*------------------------------------------------------------------------------
+ * fpath is path to file. this fn assumes the file has already been created and
+ * closed. returns 1 on success and 0 on failure
+ *----------------------------------------------------------------------------*/
+int Tree :: Open (char *f_path) {
+  dataFileName = f_path;
+  delete [] indexFileName;
+  indexFileName = new char[strlen(f_path)+5];
+  sprintf(indexFileName, "%s.idx", f_path);
+
+  // build sortOrder and find the root from metadata
+  char metafilepath[100];
+  sprintf(metafilepath, "%s.meta", f_path);
+  ifstream myfile (metafilepath);
+
+  if (myfile.is_open())
+  {
+    char* line = new char[1000];
+
+    // ignore first line coz it says "tree", which we already know
+    myfile.getline(line,1000);
+
+    // next line is runlen
+    myfile.getline(line,1000);
+    string mystringrunlen (line);
+    istringstream bufferrunlen(mystringrunlen);
+    bufferrunlen >> myRunlen;
+
+    // next line is number of key attributes
+    int numAtts;
+    myfile.getline(line,1000);
+    string mystring (line);
+    istringstream buffer(mystring);
+    buffer >> numAtts;
+
+    // next lines are att numbers and types e.g.
+    // 1 String
+    myAtt* myAtts = new myAtt[numAtts];
+    for(int i=0;i<numAtts;i++){
+      myfile.getline(line,1000);
+      string mystring (line);
+      unsigned found1 = mystring.find_last_of(" ");
+
+      // save att number in array
+      string attNo = mystring.substr(0,found1+1);
+      istringstream buffer(attNo);
+      buffer >> myAtts[i].attNo;
+
+      // save att type in array
+      string attType = mystring.substr(found1+1);
+      if(attType.compare("Int")==0){
+        myAtts[i].attType = Int;
+      }
+      else if(attType.compare("Double")==0){
+        myAtts[i].attType = Double;
+      }
+      else if(attType.compare("String")==0){
+        myAtts[i].attType = String;
+      }
+    }
+    sortOrder = new OrderMaker();
+    sortOrder->initOrderMaker(numAtts,myAtts);
+    OWNSORTORDER = true;
+    delete [] myAtts;
+
+    // last two values are the root page and the height. PrinttoString leaves a
+    // blank line behind it so read them with >> rather than getline
+    myfile >> rootPage >> height;
+    delete [] line;
+  }
+  else cerr << "Unable to open file " << metafilepath << " for reading." << endl;
+  initKeyOrders();
+  LEAFORDERVALID = false;
+  CALLEDBEFORE = false;
+
+  dataFile->Open(1, dataFileName);
+  indexFile->Open(1, indexFileName);
+  return dataFile->CheckFileDesOkay() && indexFile->CheckFileDesOkay();
+}
+
+/*------------------------------------------------------------------------------
+ * Bulk load data from file at loadpath
+ * If the tree is empty, the input is sorted with a BigQ and the tree is built
+ * bottom-up: full leaves are packed first, then each level of the index is
+ * packed from the first key of every page of the level below it. Otherwise the
+ * records are simply added one at a time.
+ * This operation canNOT be interrupted!!!
+ *----------------------------------------------------------------------------*/
+void Tree :: Load (Schema &f_schema, char *loadpath) {
+  FILE* tempFile = fopen(loadpath, "r");
+  if(tempFile==NULL){
+    cerr << "ERROR: File " << loadpath << " not found. EXIT !!!\n" << endl;
+    exit(1);
+  }
+
+  Record tempRecord;
+  if(rootPage != -1){ // tree already has data. No bottom-up build possible
+    while(tempRecord.SuckNextRecord (&f_schema, tempFile) == 1){
+      Add(tempRecord);
+    }
+    fclose(tempFile);
+    return;
+  }
+
+  // sort the input
+  int buffsz = 100; // pipe cache size
+  Pipe input(buffsz);
+  Pipe output(buffsz);
+  treeWorkerUtil* t = new treeWorkerUtil();
+  t->inputPipe = &input;
+  t->outputPipe = &output;
+  t->sortOrder = sortOrder;
+  t->runlen = myRunlen;
+  pthread_t worker;
+  pthread_create(&worker, NULL, treeWorkerRoutine, (void*)t);
+
+  while(tempRecord.SuckNextRecord (&f_schema, tempFile) == 1){
+    input.Insert(&tempRecord);
+  }
+  fclose(tempFile);
+  input.ShutDown();
+
+  // pack the leaves. level holds one entry per page of the level being built
+  vector<Record*> level;
+  Page p;
+  int pageNo = numPages(dataFile);
+  Record* firstEntry = NULL;
+  while(output.Remove(&tempRecord)){
+    if(firstEntry == NULL){
+      firstEntry = makeEntry(&tempRecord, sortOrder, pageNo);
+    }
+    if(!p.Append(&tempRecord)){ // page full. record was not consumed
+      dataFile->AddPage(&p, pageNo);
+      level.push_back(firstEntry);
+      p.EmptyItOut();
+      pageNo++;
+      firstEntry = makeEntry(&tempRecord, sortOrder, pageNo);
+      p.Append(&tempRecord);
+    }
+  }
+  if(firstEntry != NULL){
+    dataFile->AddPage(&p, pageNo);
+    level.push_back(firstEntry);
+  }
+  pthread_join(worker, NULL);
+  delete t;
+
+  if(level.empty()){ // nothing to load
+    return;
+  }
+
+  // pack the index, one level at a time, till a level fits on one page
+  height = 0;
+  while(level.size() > 1){
+    height++;
+    vector<Record*> nextLevel;
+    Page ip;
+    int ipNo = numPages(indexFile);
+    firstEntry = NULL;
+    for(size_t i=0;i<level.size();i++){
+      if(firstEntry == NULL){
+        firstEntry = makeEntry(level[i], keyOrder, ipNo);
+      }
+      if(!ip.Append(level[i])){
+        indexFile->AddPage(&ip, ipNo);
+        nextLevel.push_back(firstEntry);
+        ip.EmptyItOut();
+        ipNo++;
+        firstEntry = makeEntry(level[i], keyOrder, ipNo);
+        ip.Append(level[i]);
+      }
+      delete level[i];
+    }
+    indexFile->AddPage(&ip, ipNo);
+    nextLevel.push_back(firstEntry);
+    level = nextLevel;
+  }
+  rootPage = getChild(level[0]);
+  delete level[0];
+  LEAFORDERVALID = false;
+  CALLEDBEFORE = false;
+}
+
+/*------------------------------------------------------------------------------
+ * Move to first record in file
+ *----------------------------------------------------------------------------*/
+void Tree :: MoveFirst () {
+  if(!LEAFORDERVALID){
+    leafOrder.clear();
+    if(rootPage != -1){
+      buildLeafOrder(rootPage, height);
+    }
+    LEAFORDERVALID = true;
+  }
+  CALLEDBEFORE = false;
+  positionAt(0);
+}
+
+/*------------------------------------------------------------------------------
+ * Add new record in key order. Descend to the right leaf, insert the record
+ * there and split the leaf (and its ancestors) if it overflows.
+ *----------------------------------------------------------------------------*/
+void Tree :: Add (Record &addme) {
+  LEAFORDERVALID = false;
+  CALLEDBEFORE = false;
+
+  Record* rec = new Record();
+  rec->Consume(&addme);
+
+  if(rootPage == -1){ // empty tree. the root is a single leaf
+    vector<Record*> recs;
+    recs.push_back(rec);
+    rootPage = numPages(dataFile);
+    height = 0;
+    writePage(dataFile, rootPage, recs);
+    return;
+  }
+
+  // descend, remembering the path so splits can be pushed up
+  ComparisonEngine ceng;
+  vector<int> pathNodes;
+  vector<int> pathSlots;
+  int node = rootPage;
+  for(int level = height; level > 0; level--){
+    vector<Record*> entries;
+    readPage(indexFile, node, entries);
+    int slot = 0; // entry 0 is minus infinity
+    for(size_t i=1;i<entries.size();i++){
+      if(ceng.Compare(rec, sortOrder, entries[i], keyOrder) >= 0) slot = i;
+      else break;
+    }
+    pathNodes.push_back(node);
+    pathSlots.push_back(slot);
+    node = getChild(entries[slot]);
+    for(size_t i=0;i<entries.size();i++) delete entries[i];
+  }
+
+  // insert after any records with the same key so that equal keys keep their
+  // insertion order
+  vector<Record*> recs;
+  readPage(dataFile, node, recs);
+  int pos = recs.size();
+  for(size_t i=0;i<recs.size();i++){
+    if(ceng.Compare(recs[i], rec, sortOrder) > 0){
+      pos = i;
+      break;
+    }
+  }
+  recs.insert(recs.begin()+pos, rec);
+  if(writePage(dataFile, node, recs)){
+    return;
+  }
+
+  // leaf overflowed. split it in half; the right half goes to a new page at
+  // the end of the file
+  int mid = recs.size()/2;
+  vector<Record*> left(recs.begin(), recs.begin()+mid);
+  vector<Record*> right(recs.begin()+mid, recs.end());
+  int newPage = numPages(dataFile);
+  Record* separator = makeEntry(right[0], sortOrder, newPage);
+  if(!writePage(dataFile, node, left) || !writePage(dataFile, newPage, right)){
+    cerr << "ERROR: Record too large for a B+-tree leaf. EXIT !!!" << endl;
+    exit(1);
+  }
+  insertIntoParent(pathNodes, pathSlots, separator, node);
+}
+
+/*------------------------------------------------------------------------------
+ * Insert entry just after leftChild's slot in the index node at the top of the
+ * path. If the node overflows, split it and push the first key of the right
+ * half up. If there is no node left on the path, grow a new root.
+ *----------------------------------------------------------------------------*/
+void Tree :: insertIntoParent(vector<int> &pathNodes, vector<int> &pathSlots, Record* entry, int leftChild){
+  if(pathNodes.empty()){ // split the root
+    vector<Record*> entries;
+    entries.push_back(makeEntry(entry, keyOrder, leftChild)); // key is ignored (minus infinity)
+    entries.push_back(entry);
+    rootPage = numPages(indexFile);
+    height++;
+    writePage(indexFile, rootPage, entries);
+    return;
+  }
+
+  int node = pathNodes.back();
+  int slot = pathSlots.back();
+  pathNodes.pop_back();
+  pathSlots.pop_back();
+
+  vector<Record*> entries;
+  readPage(indexFile, node, entries);
+  entries.insert(entries.begin()+slot+1, entry);
+  if(writePage(indexFile, node, entries)){
+    return;
+  }
+
+  int mid = entries.size()/2;
+  vector<Record*> left(entries.begin(), entries.begin()+mid);
+  vector<Record*> right(entries.begin()+mid, entries.end());
+  int newNode = numPages(indexFile);
+  Record* separator = makeEntry(right[0], keyOrder, newNode);
+  if(!writePage(indexFile, node, left) || !writePage(indexFile, newNode, right)){
+    cerr << "ERROR: Key too large for a B+-tree node. EXIT !!!" << endl;
+    exit(1);
+  }
+  insertIntoParent(pathNodes, pathSlots, separator, node);
+}
+
+/*------------------------------------------------------------------------------
+ * READ data from file. Get next record relative to pointer.
+ * Records come back in key order. If the tree was changed since the last
+ * MoveFirst, the scan restarts from the first record.
+ *----------------------------------------------------------------------------*/
+int Tree :: GetNext (Record &fetchme) {
+  if(!LEAFORDERVALID){
+    MoveFirst();
+  }
+  while(1){
+    if(currPage->GetFirst(&fetchme)){
+      return 1;
+    }
+    if(currLeaf+1 >= (int)leafOrder.size()){ // no more leaves
+      return 0;
+    }
+    positionAt(currLeaf+1);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * READ data from file. Get next record that matches CNF.
+ * If the CNF bounds the leading key attribute from below, the first call
+ * descends the tree straight to the first leaf that can qualify. If it bounds
+ * it from above, the scan stops as soon as the bound is passed. Every record
+ * returned is still checked against the whole CNF.
+ *----------------------------------------------------------------------------*/
+int Tree :: GetNext (Record &fetchme, CNF &cnf, Record &literal) {
+  if(!LEAFORDERVALID){
+    MoveFirst();
+  }
+
+  if(!CALLEDBEFORE){
+    CALLEDBEFORE = true;
+    cnf.GetLeadingAttBounds(*sortOrder, lowLit, highLit, highInclusive);
+    if(highLit != -1){
+      myAtt highAtt = {highLit, sortOrder->getWhichTypes()[0]};
+      highOrder->initOrderMaker(1, &highAtt);
+    }
+    if(lowLit != -1 && rootPage != -1){
+      int leaf = findLeaf(literal, lowLit);
+      for(size_t i=0;i<leafOrder.size();i++){
+        if(leafOrder[i] == leaf){
+          positionAt(i);
+          break;
+        }
+      }
+    }
+  }
+
+  ComparisonEngine ceng;
+  while(GetNext(fetchme)){
+    if(highLit != -1){
+      int c = ceng.Compare(&fetchme, leadOrder, &literal, highOrder);
+      if(c > 0 || (c == 0 && !highInclusive)){ // past the upper bound. nothing further can qualify
+        return 0;
+      }
+    }
+    if(ceng.Compare(&fetchme, &literal, &cnf)){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Find the leftmost leaf that can hold records whose leading key att is >=
+ * attribute litAtt of literal. Equal keys may straddle a split, so we follow
+ * the last entry that is strictly smaller.
+ *----------------------------------------------------------------------------*/
+int Tree :: findLeaf(Record &literal, int litAtt){
+  ComparisonEngine ceng;
+  OrderMaker litOrder;
+  myAtt att = {litAtt, sortOrder->getWhichTypes()[0]};
+  litOrder.initOrderMaker(1, &att);
+
+  int node = rootPage;
+  for(int level = height; level > 0; level--){
+    vector<Record*> entries;
+    readPage(indexFile, node, entries);
+    int slot = 0;
+    for(size_t i=1;i<entries.size();i++){
+      if(ceng.Compare(entries[i], leadEntryOrder, &literal, &litOrder) < 0) slot = i;
+      else break;
+    }
+    node = getChild(entries[slot]);
+    for(size_t i=0;i<entries.size();i++) delete entries[i];
+  }
+  return node;
+}
+
+/*------------------------------------------------------------------------------
+ * Walk the index in order and append every leaf to leafOrder
+ *----------------------------------------------------------------------------*/
+void Tree :: buildLeafOrder(int node, int level){
+  if(level == 0){
+    leafOrder.push_back(node);
+    return;
+  }
+  vector<Record*> entries;
+  readPage(indexFile, node, entries);
+  vector<int> children;
+  for(size_t i=0;i<entries.size();i++){
+    children.push_back(getChild(entries[i]));
+    delete entries[i];
+  }
+  for(size_t i=0;i<children.size();i++){
+    buildLeafOrder(children[i], level-1);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Move the scan to leafOrder[idx]
+ *----------------------------------------------------------------------------*/
+void Tree :: positionAt(int idx){
+  currLeaf = idx;
+  currPage->EmptyItOut();
+  if(idx < (int)leafOrder.size()){
+    dataFile->GetPage(currPage, leafOrder[idx]);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Read all records of page pageNo of f into recs
+ *----------------------------------------------------------------------------*/
+void Tree :: readPage(File* f, int pageNo, vector<Record*> &recs){
+  Page p;
+  f->GetPage(&p, pageNo);
+  Record temp;
+  while(p.GetFirst(&temp)){
+    Record* r = new Record();
+    r->Consume(&temp);
+    recs.push_back(r);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Write recs to page pageNo of f. Returns 0 without touching recs if they
+ * don't fit on one page. Otherwise the records are consumed and recs emptied.
+ *----------------------------------------------------------------------------*/
+int Tree :: writePage(File* f, int pageNo, vector<Record*> &recs){
+  int size = sizeof(int); // record count at the start of the page
+  for(size_t i=0;i<recs.size();i++){
+    size += ((int*)recs[i]->bits)[0];
+  }
+  if(size > PAGE_SIZE){
+    return 0;
+  }
+
+  Page p;
+  for(size_t i=0;i<recs.size();i++){
+    p.Append(recs[i]);
+    delete recs[i];
+  }
+  recs.clear();
+  f->AddPage(&p, pageNo);
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Number of pages in f, correcting for the header page
+ *----------------------------------------------------------------------------*/
+int Tree :: numPages(File* f){
+  int correctLength = f->GetLength();
+  if(correctLength!=0) return correctLength - 1;
+  else return correctLength;
+}
+
+/*------------------------------------------------------------------------------
+ * Build an index entry: the key atts of rec, followed by child
+ *----------------------------------------------------------------------------*/
+Record* Tree :: makeEntry(Record* rec, OrderMaker* recOrder, int child){
+  char childStr[20];
+  sprintf(childStr, "%d|", child);
+  Record childRec;
+  childRec.ComposeRecord(childSchema, childStr);
+
+  int numKeys = recOrder->getNumAtts();
+  int* attsToKeep = new int[numKeys+1];
+  for(int i=0;i<numKeys;i++){
+    attsToKeep[i] = recOrder->getWhichAtts()[i];
+  }
+  attsToKeep[numKeys] = 0;
+
+  Record* entry = new Record();
+  entry->MergeRecords(rec, &childRec, rec->GetNumAtts(), 1, attsToKeep, numKeys+1, numKeys);
+  delete [] attsToKeep;
+  return entry;
+}
+
+/*------------------------------------------------------------------------------
+ * The child page number is the last att of an index entry
+ *----------------------------------------------------------------------------*/
+int Tree :: getChild(Record* entry){
+  int numKeys = sortOrder->getNumAtts();
+  return *((int*)(entry->bits + ((int*)entry->bits)[numKeys+1]));
+}
+
+/*------------------------------------------------------------------------------
+ * Build keyOrder, leadOrder and leadEntryOrder from sortOrder
+ *----------------------------------------------------------------------------*/
+void Tree :: initKeyOrders(){
+  int numKeys = sortOrder->getNumAtts();
+  myAtt* myAtts = new myAtt[numKeys];
+  for(int i=0;i<numKeys;i++){
+    myAtts[i].attNo = i;
+    myAtts[i].attType = sortOrder->getWhichTypes()[i];
+  }
+  keyOrder = new OrderMaker();
+  keyOrder->initOrderMaker(numKeys, myAtts);
+
+  leadEntryOrder = new OrderMaker();
+  leadEntryOrder->initOrderMaker(1, myAtts);
+
+  myAtts[0].attNo = sortOrder->getWhichAtts()[0];
+  leadOrder = new OrderMaker();
+  leadOrder->initOrderMaker(1, myAtts);
+  delete [] myAtts;
+}
+
+/*------------------------------------------------------------------------------
+ * Write the meta file. Same format as sorted, plus the root page and height
+ *----------------------------------------------------------------------------*/
+void Tree :: writeMeta(){
+  char metafilepath[100];
+  sprintf(metafilepath, "%s.meta", dataFileName);
+  ofstream myfile (metafilepath);
+  char printedOrder[1000];
+  sortOrder->PrinttoString(printedOrder);
+  if (myfile.is_open())
+  {
+    myfile << "tree" << endl;
+    myfile << myRunlen << endl;
+    myfile << printedOrder << endl;
+    myfile << rootPage << endl;
+    myfile << height << endl;
+    myfile.close();
+  }
+  else cerr << "Unable to open file " << metafilepath << " for writing." << endl;
+}
+
+/*------------------------------------------------------------------------------
+ * Correct the length returned by File->GetLength which adds 1 to the actual
+ * number of pages of records for the one page of metadata at the beginning.
+ *----------------------------------------------------------------------------*/
+int Tree :: GetNumofRecordPages(){
+  return numPages(dataFile);
+}
+
+/*------------------------------------------------------------------------------
+ * Close the file. Return 1 on success and 0 on failure
+ *----------------------------------------------------------------------------*/
+int Tree :: Close () {
+  writeMeta();
+  indexFile->Close();
+  dataFile->Close();
+  return 1;
+}
+
+/*******************************************************************************
+ * END OF FILE
+ ******************************************************************************/
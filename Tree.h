@@ -0,0 +1,126 @@
+#ifndef TREEFILE_H
+#define TREEFILE_H
+
+#include "TwoWayList.h"
+#include "Record.h"
+#include "Schema.h"
+#include "File.h"
+#include "Comparison.h"
+#include "ComparisonEngine.h"
+#include "GenericDBFile.h"
+#include "BigQ.h"
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// B+-tree file keyed on an OrderMaker. Added after the final demo.
+// The leaves are ordinary data pages stored in the file at fpath. The internal
+// nodes are stored in a second file at fpath.idx. Each internal node is one page
+// of "entries", and each entry is a record made up of the key attributes of the
+// first data record under a child, followed by one Int attribute holding the
+// child's page number. The key of the first entry on a node is never looked at;
+// it stands for minus infinity.
+//
+// height 0 means the root is a leaf (a data page), height 1 means the root is an
+// internal node whose children are data pages, and so on. rootPage of -1 means
+// the tree is empty.
+class Tree: virtual public GenericDBFile {
+  private:
+    File* dataFile;       // leaves
+    File* indexFile;      // internal nodes
+    char* dataFileName;
+    char* indexFileName;
+    OrderMaker* sortOrder; // key of the tree. Initialized either from DBFile.Create or, in Tree.Open,
+                           // from the information stored in the meta file
+    bool OWNSORTORDER;     // TRUE: Tree.Open built sortOrder and frees it. FALSE: it is the caller's
+    OrderMaker* keyOrder;  // same key, but numbered 0..n-1 so it can be used on index entries
+    int myRunlen;          // runlen for the BigQ used by bulk loads
+    int rootPage;
+    int height;
+
+    Schema* childSchema;   // schema of the one-Int record used to tack a page number onto an entry
+
+    // scan state
+    vector<int> leafOrder; // data page numbers in key order; rebuilt lazily after an Add
+    bool LEAFORDERVALID;
+    int currLeaf;          // index into leafOrder of the page in currPage
+    Page* currPage;
+    bool CALLEDBEFORE;     // relevant for GetNext WITH CNF.
+                           // TRUE: bounds were worked out and the scan was positioned
+                           // FALSE: MoveFirst or Add reset it
+    int lowLit;            // literal attribute holding the lower bound on the leading key att; -1 if none
+    int highLit;           // literal attribute holding the upper bound on the leading key att; -1 if none
+    int highInclusive;     // 1 if the upper bound is inclusive (equality)
+    OrderMaker* leadOrder; // the leading key att of a data record
+    OrderMaker* leadEntryOrder; // the leading key att of an index entry
+    OrderMaker* highOrder; // the upper bound att of the literal
+
+    // read all records of a page into recs (in order)
+    void readPage(File* f, int pageNo, vector<Record*> &recs);
+
+    // write recs to page pageNo of f. recs are consumed. Returns 0 (and consumes
+    // nothing) if the records don't fit on one page
+    int writePage(File* f, int pageNo, vector<Record*> &recs);
+
+    // number of pages in f (corrects for the header page)
+    int numPages(File* f);
+
+    // build an index entry out of the key atts of rec (as numbered by recOrder) and child
+    Record* makeEntry(Record* rec, OrderMaker* recOrder, int child);
+
+    // extract the child page number out of an index entry
+    int getChild(Record* entry);
+
+    // insert entry just after the slot pointing to leftChild in the index node on top of
+    // the path, splitting upwards as needed
+    void insertIntoParent(vector<int> &pathNodes, vector<int> &pathSlots, Record* entry, int leftChild);
+
+    // walk the index and fill leafOrder
+    void buildLeafOrder(int node, int level);
+
+    // find the leftmost leaf that can hold records whose leading key att is >= the
+    // literal's attribute litAtt
+    int findLeaf(Record &literal, int litAtt);
+
+    // move the scan to leafOrder[idx]
+    void positionAt(int idx);
+
+    // build keyOrder, leadOrder and leadEntryOrder from sortOrder
+    void initKeyOrders();
+
+    // write the meta file
+    void writeMeta();
+
+  public:
+    Tree ();
+    virtual ~Tree ();
+    // fpath is path to file. this fn assumes the file has already been created. return 1 on success and 0 on failure
+    virtual int Open (char *fpath);
+
+    // move to first record in file
+    virtual void MoveFirst ();
+
+    // add new record in key order; must consume addme after it is added so it can't be reused
+    virtual void Add (Record &addme);
+
+    // return next record; return 0 if no record present
+    virtual int GetNext (Record &fetchme);
+
+    // return next record that satisfies CNF. literal is used to check cnf; return 0 if no record present.
+    virtual int GetNext (Record &fetchme, CNF &cnf, Record &literal);
+
+    // creates file using File class. fpath is path to file, file_type is tree, startup holds the key ordermaker and runlen; return 1 on success and 0 on failure
+    virtual int Create (char *fpath, fType file_type, void *startup);
+
+    // close the file. return 1 on success and 0 on failure
+    virtual int Close ();
+
+    // bulk loads from loadpath, which is a TEXT FILE. An empty tree is built bottom-up from sorted input.
+    virtual void Load (Schema &myschema, char *loadpath);
+
+    virtual int GetNumofRecordPages();
+  };
+
+#endif
@@ -8,16 +8,27 @@
 #include "RelOp.h"
 #include <pthread.h>
 #include <unordered_map>
+#include <unordered_set>
 #include "Function.h"
 #include "Pipe.h"
 #include "DBFile.h"
 #include "Record.h"
+#include "Catalog.h"
+#include "TPCHGen.h"
 #include <fstream>
 
 using namespace std;
 
 int pipesz = 100; // buffer sz allowed for each pipe
-int buffsz = 100; // pages of memory allowed for operations
+int buffsz = 100; // pages of memory allowed for operations (outside of query plans)
+int memBudget = 1000; // pages of memory shared by all the operations of a query plan
+int maxDPRelations = 10; // joins over more relations than this are ordered greedily; the DP join
+                         // enumerator in a4-2utils.h takes time and memory exponential in the count
+int statsMaxPages = 50000; // UPDATE STATISTICS reads a random sample of this many pages of larger relations
+                           // instead of all of them. 0 means always read everything
+int planCacheSize = 256; // query plans remembered by the plan cache in a4-2utils.h. 0 turns it off
+double tpchScale = 0.01; // setupDemo generates relations it finds no .tbl file for at this TPC-H scale
+unsigned long long tpchSeed = 1; // ... and with this seed (see TPCHGen.h)
 
 // variables used for setOutput
 streambuf * buf= std::cout.rdbuf();
@@ -25,6 +36,10 @@ ofstream of;
 ostream out(buf);
 
 Statistics stats; // used in a4-2utils.h
+unordered_set<string> queryAtts;          // attributes the query being planned outputs: selects, groups on or
+                                          // aggregates over (see FindQueryAtts in a4-2utils.h). Empty: keep everything
+unordered_map<string, int> pendingAttUses; // uses of each attribute by the conjuncts of its WHERE clause that are
+                                          // not nodes yet. The scans and joins drop what neither needs
 
 // Extern variables from yacc
 extern struct FuncOperator *finalfunc;
@@ -39,6 +54,9 @@ extern "C"  struct NameList *groupingAtts; // grouping atts (NULL if no grouping
 extern "C"  struct NameList *attsToSelect; // the set of attributes in the SELECT (NULL if no such atts)
 extern "C"  int distinctAtts; // 1 if there is a DISTINCT in a non-aggregate query
 extern "C"  int distinctFunc;  // 1 if there is a DISTINCT in an aggregate query
+extern "C"  struct NameList *orderingAtts; // the attributes in the ORDER BY (NULL if no ORDER BY)
+extern "C"  int orderDescending; // 1 if the ORDER BY is DESC
+extern "C"  int limitRows; // the number in the LIMIT (-1 if no LIMIT)
 extern "C"  struct SchemaList *schemas; // the list of tables and aliases in the query
 extern "C"  char* bulkFileName; // bulk loading file name string
 extern "C"  char* outputFileName; // output file name or STDOUT string
@@ -140,6 +158,10 @@ void printEverything(){
 
   cout << "distinctFunc: " << distinctFunc << endl;
   cout << "distinctAtts: " << distinctAtts << endl;
+  cout << "orderby list: ";
+  PrintNameList(orderingAtts);
+  cout << "orderDescending: " << orderDescending << endl;
+  cout << "limitRows: " << limitRows << endl;
 
   cout << "func " << finalFunction->code << " " << endl;
 }
@@ -224,27 +246,40 @@ char *catalog_path, *dbfile_dir, *tpch_dir = NULL;
 const char *settings = "test.cat";
 
 // saved state file contains the names of the relations that
-// have been previously created
+// have been previously created. Only read to build the binary catalog
+// the first time the database is fired up after it was introduced
 const char *savedStateFile = "savedState.txt";
 
+// binary catalog of the relations and their statistics (see Catalog.h),
+// in the same directory as the bin and meta files
+const char *catalogFile = "catalog.bin";
+Catalog dbCatalog;
+
+// Serialized (text) form of the Statistics object. Imported into the
+// catalog once and rewritten by UPDATE STATISTICS
+char *statsFileName = "Statistics.txt";
+
 // Lets the database know which relations we've
-// already created tables for. This is stored in the file
-// savedState.txt in the same directory as the bin and meta files
+// already created tables for. They are loaded from the binary
+// catalog once, at startup; CREATE and DROP keep DBinfo and the
+// catalog up to date themselves
 void RestoreDBState(){
   DBinfo.clear();
-  char db_path[100]; // construct path of the saved state file
-  sprintf (db_path, "%s%s", dbfile_dir, savedStateFile);
-  ifstream infile;
-  infile.open(db_path);
-  string buffer;
+  char db_path[100]; // construct path of the catalog
+  sprintf (db_path, "%s%s", dbfile_dir, catalogFile);
+  char state_path[100]; // and of the saved state file
+  sprintf (state_path, "%s%s", dbfile_dir, savedStateFile);
+  dbCatalog.Open(db_path, catalog_path, state_path, statsFileName);
+
+  vector<string> &relNames = dbCatalog.GetRelations();
   cout << endl << "--------------------------------------------" << endl;
   cout << "INFO: The following relation schemas have been loaded:" << endl;
-  while (getline(infile, buffer)){ // while the file has more lines.
-    DBinfo[buffer]=new relation ((char*)buffer.c_str(), new Schema (catalog_path, (char*)buffer.c_str()), dbfile_dir);
-    cout << buffer << endl;
+  for (int i = 0; i < relNames.size(); i++){
+    char *relName = (char*)relNames[i].c_str();
+    DBinfo[relName]=new relation (strdup(relName), dbCatalog.GetSchema(relName), dbfile_dir);
+    cout << relName << endl;
   }
   cout << "--------------------------------------------" << endl << endl;
-  infile.close();
 }
 
 void setup () {
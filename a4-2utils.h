@@ -19,13 +19,16 @@
 #include <cstring>
 #include <algorithm>
 #include "operation_node.h"
+#include "HyperLogLog.h"
 #include "a3utils.h"
+#include <boost/timer.hpp>
+#include <iomanip>
 
 using namespace std;
 
 GenericQTreeNode* QueryRoot; // after executing queryPlanning, the root should be saved here!!
-// Serialized form of the Statistics object
-char *statsFileName = "Statistics.txt";
+
+#define MAX_REL_NAME 64 // longest relation name (or alias) we expect in a query
 
 // Use a hash to store the relation name alias.
 unordered_map<string, string> relAlias;
@@ -84,7 +87,7 @@ void ConvertOrList(struct OrList *pOr) {
 void AndListNode2QTreeNode(struct AndList &dummy, char* RelName[], int numToJoin, int& pipeIDcounter){
   // cout << RelName[0] << " " << RelName[1] << " " << numToJoin << endl; // debug
   string leftRelName(RelName[0]), rightRelName; // debug
-  GenericQTreeNode* NewQNode;
+  GenericQTreeNode* NewQNode = NULL;
   // update the string in dummy to attribute name alone without "." because the constructors
   // for the tree nodes in operation_node.h call cnf_pred.GrowFromParseTree (&dummy, re->schema(), literal) i.e.,
   // GrowFromParseTree will use dummy along with the Schema to create the CNF that can be printed out. However, the
@@ -113,17 +116,119 @@ void AndListNode2QTreeNode(struct AndList &dummy, char* RelName[], int numToJoin
   }
   else
     cerr << "ERROR: Join must have two input relations!!!" << endl;
+  UseConjunctAtts(&dummy);
 
   // update the relNameToTreeMap, store back new treeNode/subtree pointer.
   relNameToTreeMap[leftRelName]=NewQNode;
 }
 ///!!!
 
+/*------------------------------------------------------------------------------
+ * Name of the relation an operand such as "n.n_nationkey" belongs to ("n")
+ *----------------------------------------------------------------------------*/
+string OperandRelName(struct Operand *pOperand){
+  string value(pOperand->value);
+  return value.substr(0, value.find("."));
+}
+
+/*------------------------------------------------------------------------------
+ * Work out which relations a conjunct (a single AndList node) refers to and copy
+ * their names into names[0] (and names[1]), going through alias so that we get the
+ * names the relations currently have in the Statistics object.
+ * Returns the number of relations: 2 for an equi-join of two relations that have
+ * not been joined yet; 1 for a selection. An equi-join of two relations that have
+ * already been joined (the second conjunct of a two-attribute join) is a selection.
+ * For a selection, we don't know whether LHS or RHS is the attribute, so we must check
+ *----------------------------------------------------------------------------*/
+int ConjunctRelNames(struct AndList *conjunct, unordered_map<string, string> &alias, char *names[]){
+  struct ComparisonOp *pCom = conjunct->left->left;
+  if(pCom->left->code == NAME && pCom->right->code == NAME && pCom->code == EQUALS){
+    string leftRelName = OperandRelName(pCom->left);
+    string rightRelName = OperandRelName(pCom->right);
+    if(alias.count(leftRelName)) leftRelName = alias[leftRelName];
+    if(alias.count(rightRelName)) rightRelName = alias[rightRelName];
+    strcpy(names[0], leftRelName.c_str());
+    strcpy(names[1], rightRelName.c_str());
+    if(leftRelName != rightRelName)
+      return 2;
+    return 1;
+  }
+  string relName = OperandRelName((pCom->left->code == NAME) ? pCom->left : pCom->right);
+  if(alias.count(relName)) relName = alias[relName];
+  strcpy(names[0], relName.c_str());
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Record in alias that the relation names[1] has been joined into names[0]:
+ * everything that was part of the right relation is now part of the left one
+ *----------------------------------------------------------------------------*/
+void MergeAlias(unordered_map<string, string> &alias, char *names[]){
+  string leftRelName(names[0]), rightRelName(names[1]);
+  for(auto it = alias.begin();it!=alias.end();it++){
+    if((it->second).compare(rightRelName)==0) it->second = leftRelName;
+  }
+  alias[rightRelName] = leftRelName;
+}
+
+/*------------------------------------------------------------------------------
+ * Apply a conjunct to the Statistics s and, if it is a join, record in alias that
+ * the right relation is now part of the left one (the Statistics object keeps the
+ * joined relation under the left relation's name). names must point at two buffers
+ * of MAX_REL_NAME chars; they are filled in by ConjunctRelNames.
+ * Returns the estimated number of tuples after the conjunct if estimate is true (the
+ * Statistics object has to be copied for that) and 0 otherwise.
+ *----------------------------------------------------------------------------*/
+double SimulateConjunct(struct AndList *conjunct, Statistics &s, unordered_map<string, string> &alias, char *names[], int &numToJoin, bool estimate){
+  struct AndList dummy; // make a dummy andlist that only has this one operation inside.
+  dummy.left = conjunct->left;
+  dummy.rightAnd = NULL;
+  numToJoin = ConjunctRelNames(conjunct, alias, names);
+
+  double result = 0;
+  if(estimate)
+    result = s.Estimate(&dummy, names, numToJoin);
+  s.Apply(&dummy, names, numToJoin);
+
+  if(numToJoin == 2)
+    MergeAlias(alias, names);
+  return result;
+}
+
+/*------------------------------------------------------------------------------
+ * Apply a conjunct for real: update the Statistics and relAlias and turn the
+ * conjunct into a query tree node. Appends the conjunct to the sofar list.
+ *----------------------------------------------------------------------------*/
+void ApplyConjunct(struct AndList *target, struct AndList *&sofar, struct AndList *&Sofartail, Statistics &s, int &pipeIDcounter){
+  char strRelName0[MAX_REL_NAME], strRelName1[MAX_REL_NAME];
+  char *names[2] = {strRelName0, strRelName1};
+  int numToJoin;
+  double estimate = SimulateConjunct(target, s, relAlias, names, numToJoin, true);
+
+  // hit two bird with one stone convert the dummy AndList node to the query tree node.
+  struct AndList dummy;
+  dummy.left = target->left;
+  dummy.rightAnd = NULL;
+  AndListNode2QTreeNode(dummy, names, numToJoin, pipeIDcounter);
+  relNameToTreeMap[names[0]]->estTuples = estimate; // used by PhysicalPlanning
+  pipeIDcounter++;
+
+  target->rightAnd = NULL;
+  if(!Sofartail){  // Node is the first.
+    sofar = target;
+    Sofartail = target;
+  }
+  else{ // sofar has node in it.
+    Sofartail->rightAnd = target;
+    Sofartail = target;
+  }
+}
+
 /*------------------------------------------------------------------------------
  * Recursive routine that reorders the AndList greedily.
  * Each time loop though the current AndList and do estimation one by one.
- * Each time pluck out one operation off the candidate AndList, insert into
- * the sofar list.
+ * Each time pluck out the operation with the smallest estimate off the candidate
+ * AndList and insert it into the sofar list.
  * Apply the change to the statistics.
  * Sofartail is a fast reference to the last element in the sofar list.
  *
@@ -131,7 +236,8 @@ void AndListNode2QTreeNode(struct AndList &dummy, char* RelName[], int numToJoin
  * A name Qtree subtree hash relNameToTreeMap is used to record the intermediate Qtree.
  * Connecting the node to the tree is done inside each the Qnode's constructor.
  *
- * made some change to statistics to handle self join esitimates
+ * Used for joins over more than maxDPRelations relations, and for whatever
+ * DPAndListEval could not place.
  *----------------------------------------------------------------------------*/
 void RecursiveAndListEval(struct AndList *&sofar, struct AndList *Sofartail, struct AndList *&candidates, Statistics &s, int &pipeIDcounter){
   // terminating base case. candidates exhausted.
@@ -139,48 +245,25 @@ void RecursiveAndListEval(struct AndList *&sofar, struct AndList *Sofartail, str
     return;
 
   struct AndList *temp = candidates;
-  int MinInd;
-  vector<int> MidResult;
+  vector<double> MidResult;
   // relation name buffer
-  char strRelrightRelName[40];
-  char strRelName2[40];
+  char strRelName0[MAX_REL_NAME], strRelName1[MAX_REL_NAME];
+  char *names[2] = {strRelName0, strRelName1};
   struct AndList dummy;// make a dummy andlist that only has one operation inside.
 
-  char * names[2]; // the length is two is because an Orlist at most contain ONLY one single join operation.
   // a while loop that estimates the increase of cost caused every AndList node on the existing Statistics.
   while(temp){
     dummy.left = temp->left;
     dummy.rightAnd = NULL;
-
-    struct ComparisonOp * pCom = dummy.left->left;
-    int numToJoin = 1;
-    strcpy (strRelrightRelName, pCom->left->value);
-    strcpy (strRelName2, pCom->right->value);
-    // if equal join
-    if(pCom->left->code == NAME && pCom->right->code == NAME && pCom->code == EQUALS){
-      // !!!!!may become a source of bug if attributes passed format not __._____
-      names[0]=strtok(strRelrightRelName, ".");
-      names[1]=strtok(strRelName2, ".");
-      numToJoin = 2;
-      // replace the att with the established alias if any
-      if(relAlias.count(names[1]))
-        strcpy(names[1], relAlias[names[1]].c_str());
-      if(relAlias.count(names[0]))
-        strcpy(names[0], relAlias[names[0]].c_str());
-    }
-    else{
-      names[0]=(pCom->left->code == NAME)?strtok(strRelrightRelName, "."):strtok(strRelName2, ".");
-    }
+    int numToJoin = ConjunctRelNames(temp, relAlias, names);
     // record the number of estimated tuple number in a vector.
     MidResult.push_back(s.Estimate(&dummy, names, numToJoin));
     temp = temp->rightAnd;
   }
   // find the index of the minimum cost.
-  int min = MidResult[0];
   int minInd = 0;
-  for(int i = 0;i<MidResult.size();i++){
-    if(MidResult[i]<min)minInd = i;
-    min = MidResult[i];
+  for(int i = 1;i<MidResult.size();i++){
+    if(MidResult[i]<MidResult[minInd]) minInd = i;
   }
 
   // get the Andlist element based on the minInd, pluck it out and insert it into the sofar list.
@@ -194,120 +277,253 @@ void RecursiveAndListEval(struct AndList *&sofar, struct AndList *Sofartail, str
     target = target->rightAnd;
   }
 
-  if(target == candidates){ // the node to be removed is the first node.
+  if(target == candidates) // the node to be removed is the first node.
     candidates = target->rightAnd;
-    target->rightAnd = NULL;
-  }
-  else{ // the node to be removed is in the middle or tail.
+  else // the node to be removed is in the middle or tail.
     pre->rightAnd = target->rightAnd;
-    target->rightAnd = NULL;
-  }
 
   // PrintAndList(candidates); // debug
 
-  /*
-   * Append the new node to the sofar list. Apply the
-   * Change in Statistics and perform next round of recursive evaluation.
-   * */
+  // Append the new node to the sofar list. Apply the change in Statistics
+  // and perform next round of recursive evaluation.
+  ApplyConjunct(target, sofar, Sofartail, s, pipeIDcounter);
+  RecursiveAndListEval(sofar, Sofartail, candidates, s, pipeIDcounter);
+}
 
-  // dummy singleton att node for estimate purposes only
-  dummy.left = target->left;
-  struct ComparisonOp * pCom = dummy.left->left;
+/*------------------------------------------------------------------------------
+ * The best way found so far of joining one subset of the relations. Used by
+ * DPAndListEval
+ *----------------------------------------------------------------------------*/
+typedef struct{
+  bool valid;                          // false: no way of joining the subset without a cross product
+  double cost;                         // sum of the estimated sizes of all the intermediate results
+  vector<struct AndList*> order;       // join conjuncts, in the order they are to be applied
+  Statistics* stats;                   // Statistics after the conjuncts in order have been applied
+  unordered_map<string, string> alias; // relAlias after the conjuncts in order have been applied
+} dpPlan;
 
-  int numToJoin = 1;
-  // if equal join
-  strcpy (strRelrightRelName, pCom->left->value);
-  strcpy (strRelName2, pCom->right->value);
+/*------------------------------------------------------------------------------
+ * Selinger style join ordering. Selections are applied first. Then, for every
+ * subset of the relations (a bitmask over rels), in order of size, we find the
+ * cheapest way of building it as the join of two smaller subsets that are
+ * connected by at least one join conjunct; the first such conjunct does the join
+ * and any others become selections on the result. The cost of a plan is the sum of
+ * the estimated sizes of all its intermediate results. Plans need not be left-deep.
+ *
+ * The conjuncts of the best plan are applied (in order) with ApplyConjunct.
+ * Anything we can't place (the query needs a cross product or names a relation that
+ * isn't in rels) is left in candidates for RecursiveAndListEval.
+ *----------------------------------------------------------------------------*/
+void DPAndListEval(struct AndList *&sofar, struct AndList *&Sofartail, struct AndList *&candidates, vector<string> &rels, Statistics &s, int &pipeIDcounter){
+  char strRelName0[MAX_REL_NAME], strRelName1[MAX_REL_NAME];
+  char *names[2] = {strRelName0, strRelName1};
+  int numRels = rels.size();
 
-  // two attribute equal join
-  if(pCom->left->code == NAME && pCom->right->code == NAME && pCom->code == EQUALS){
-    // !!!!!may become a source of bug if attributes passed format not __._____
-    names[0]=strtok(strRelrightRelName, ".");
-    names[1]=strtok(strRelName2, ".");
-    numToJoin = 2;
-    string leftRelName(names[0]);
-    string rightRelName(names[1]);
-    // update the names passed to Apply if the name has appeared.
-    if(relAlias.count(rightRelName))
-      strcpy(names[1], relAlias[rightRelName].c_str());
-    if(relAlias.count(leftRelName))
-      strcpy(names[0], relAlias[leftRelName].c_str());
-
-    // update the change to the relation name in the hash data structructure
-    // if att1 and att2 both appears for the first time, add n1's alias to n0
-    if(relAlias.count(rightRelName)==0&&relAlias.count(leftRelName)==0)
-      relAlias[rightRelName]=leftRelName;
-    // if att1 has already has a alias and att2 appears for the first time, set att2's alias to att1.
-    else if(relAlias.count(leftRelName)!=0&&relAlias.count(rightRelName)==0)
-      relAlias[rightRelName]=relAlias[leftRelName];
-    // if att2 has appeared while att1 not, modify all the alias of att2 to att1's value.
-    else if(relAlias.count(leftRelName)==0&&relAlias.count(rightRelName)!=0){
-      string temp = relAlias[rightRelName];
-      for(auto it = relAlias.begin();it!=relAlias.end();it++){
-        if((it->second).compare(temp)==0)it->second = leftRelName;
-      }
+  // work out which relations each conjunct refers to BEFORE anything is applied
+  // (applying a conjunct strips the relation names off its operands)
+  vector<struct AndList*> conjuncts;
+  vector<int> relMasks;
+  unordered_map<string, string> noAlias;
+  for(struct AndList *temp = candidates;temp;temp = temp->rightAnd){
+    int numToJoin = ConjunctRelNames(temp, noAlias, names);
+    int mask = 0;
+    for(int i=0;i<numToJoin;i++){
+      int relIndex = find(rels.begin(), rels.end(), string(names[i])) - rels.begin();
+      if(relIndex == numRels)
+        return; // leave everything to the greedy routine
+      mask |= 1 << relIndex;
     }
-    // if both have appeared, modify all the alias of att2 to att1's alias' value.
-    else {
-      string temp = relAlias[rightRelName];
+    conjuncts.push_back(temp);
+    relMasks.push_back(mask);
+  }
 
-      if(relAlias[leftRelName]!=relAlias[rightRelName])
-      for(auto it = relAlias.begin();it!=relAlias.end();it++){
-        if((it->second).compare(temp)==0)it->second = relAlias[leftRelName];
-      }
+  // push every selection down to its relation
+  vector<struct AndList*> joins;
+  vector<int> joinMasks;
+  for(int i=0;i<conjuncts.size();i++){
+    if(relMasks[i] & (relMasks[i]-1)){ // more than one bit set
+      joins.push_back(conjuncts[i]);
+      joinMasks.push_back(relMasks[i]);
     }
-    // debug message
-    // if(relAlias.count(leftRelName)>0)
-    //   cout << "M1 " << relAlias[leftRelName] << " 2 " << relAlias[rightRelName] << endl;
-    // else
-    //   cout << "M1 " << " " << " 2 " << relAlias[rightRelName] << endl;
+    else
+      ApplyConjunct(conjuncts[i], sofar, Sofartail, s, pipeIDcounter);
   }
+  candidates = NULL;
 
-  // naming scheme for select
-  // we don't know whether LHS or RHS is the attribute, so we must check
-  else
-    names[0] = (pCom->left->code == NAME) ? strtok(strRelrightRelName, ".") : strtok(strRelName2, ".");
+  int full = (1 << numRels) - 1;
+  vector<dpPlan> best(full + 1);
+  for(int mask=1;mask<=full;mask++){
+    best[mask].valid = false;
+    best[mask].stats = NULL;
+  }
+  for(int i=0;i<numRels;i++){
+    best[1 << i].valid = true;
+    best[1 << i].cost = 0;
+    best[1 << i].stats = new Statistics(s);
+    best[1 << i].alias = relAlias;
+  }
 
-   // apply the function to the statistics to reflect changes.
-  s.Apply(&dummy, names, numToJoin);
+  int plansConsidered = 0;
+  for(int mask=1;mask<=full;mask++){
+    if(!(mask & (mask-1))) continue; // singletons are done
+    int lowest = mask & -mask;
+    // left side always holds the lowest relation so each split is seen once
+    for(int left=(mask-1)&mask;left>0;left=(left-1)&mask){
+      int right = mask ^ left;
+      if(!(left & lowest) || !best[left].valid || !best[right].valid) continue;
 
-  // hit two bird with one stone convert the dummy AndList node to the query tree node.
-  AndListNode2QTreeNode(dummy, names, numToJoin, pipeIDcounter);
+      vector<struct AndList*> crossing; // conjuncts joining left and right
+      for(int i=0;i<joins.size();i++){
+        if((joinMasks[i] & ~mask) == 0 && (joinMasks[i] & left) && (joinMasks[i] & right))
+          crossing.push_back(joins[i]);
+      }
+      if(crossing.empty()) continue; // no cross products
+      plansConsidered++;
 
-  if(!Sofartail){  // Node is the first.
-    sofar = target;
-    Sofartail = target;
+      Statistics* stats = new Statistics(*best[left].stats);
+      unordered_map<string, string> alias = best[left].alias;
+      int numToJoin;
+      for(int i=0;i<best[right].order.size();i++)
+        SimulateConjunct(best[right].order[i], *stats, alias, names, numToJoin, false);
+      double size = 0;
+      for(int i=0;i<crossing.size();i++)
+        size = SimulateConjunct(crossing[i], *stats, alias, names, numToJoin, true);
+      double cost = best[left].cost + best[right].cost + size;
+
+      if(best[mask].valid && best[mask].cost <= cost){
+        delete stats;
+        continue;
+      }
+      delete best[mask].stats;
+      best[mask].valid = true;
+      best[mask].cost = cost;
+      best[mask].stats = stats;
+      best[mask].alias = alias;
+      best[mask].order = best[left].order;
+      best[mask].order.insert(best[mask].order.end(), best[right].order.begin(), best[right].order.end());
+      best[mask].order.insert(best[mask].order.end(), crossing.begin(), crossing.end());
+    }
   }
-  else{ // sofar has node in it.
-    Sofartail->rightAnd = target;
-    Sofartail = target;
+
+  if(best[full].valid){
+    cout << "Join order: dynamic programming over " << numRels << " relations, " << plansConsidered
+         << " plans considered, estimated cost " << (long long) best[full].cost << " tuples" << endl;
+    for(int i=0;i<best[full].order.size();i++)
+      ApplyConjunct(best[full].order[i], sofar, Sofartail, s, pipeIDcounter);
+  }
+  else{
+    cout << "Join order: no plan without a cross product; ordering joins greedily" << endl;
+    for(int i=joins.size()-1;i>=0;i--){ // hand the joins back to the greedy routine
+      joins[i]->rightAnd = candidates;
+      candidates = joins[i];
+    }
   }
+  for(int mask=1;mask<=full;mask++)
+    delete best[mask].stats;
+}
 
-  // perform another round of reordering
-  pipeIDcounter++;
-  RecursiveAndListEval(sofar, Sofartail, candidates, s, pipeIDcounter);
+/*------------------------------------------------------------------------------
+ * Name of an attribute without the relation in front of it
+ *----------------------------------------------------------------------------*/
+string BareAttName(char *name){
+  char *dot = strchr(name, '.');
+  return string(dot ? dot + 1 : name);
+}
+
+void AddQueryAtt(char *name){
+  queryAtts.insert(BareAttName(name));
+}
+
+void AddQueryFuncAtts(struct FuncOperator *pFunc){
+  if(!pFunc)
+    return;
+  if(pFunc->leftOperand && pFunc->leftOperand->code == NAME)
+    AddQueryAtt(pFunc->leftOperand->value);
+  AddQueryFuncAtts(pFunc->leftOperator);
+  AddQueryFuncAtts(pFunc->right);
 }
 
 /*------------------------------------------------------------------------------
- * Wrapper function that calculate the lowest cost (query with least intermediate
- * tuples) query AndList out of all possible permutations of the list greedily.
- * Calls RecursiveAndListEval to do do the actual cost calculation
+ * Work out queryAtts, the attributes the current query selects, groups on or
+ * aggregates over, and pendingAttUses, how often its WHERE clause compares
+ * each attribute. As the conjuncts are made into nodes (see UseConjunctAtts),
+ * every scan and join works out which of its attributes are still needed above
+ * it and leaves the rest out of its output: the projection at the root is
+ * pushed down the tree. Must be called before planning, which takes the WHERE
+ * clause apart
  *----------------------------------------------------------------------------*/
-void PermutationTreeGen(struct AndList *&candidates, TableList *t, Statistics &s){
-  // walk the table list linearly. Build table alias structure. Record the table number.
-  int numToBeJoin = 0;
-  while(t){
-    numToBeJoin++;
-    if(t->aliasAs)
-      s.CopyRel(t->tableName, t->aliasAs);
-    t = t->next;
+void FindQueryAtts(){
+  queryAtts.clear();
+  pendingAttUses.clear();
+  if(!attsToSelect && !groupingAtts && !finalFunction)
+    return; // the query doesn't say what it wants; keep everything
+  for(struct NameList *n = attsToSelect;n;n = n->next)
+    AddQueryAtt(n->name);
+  for(struct NameList *n = groupingAtts;n;n = n->next)
+    AddQueryAtt(n->name);
+  AddQueryFuncAtts(finalFunction);
+  for(struct AndList *a = whereClausePredicate;a;a = a->rightAnd){
+    for(struct OrList *o = a->left;o;o = o->rightOr){
+      if(o->left->left->code == NAME) pendingAttUses[BareAttName(o->left->left->value)]++;
+      if(o->left->right->code == NAME) pendingAttUses[BareAttName(o->left->right->value)]++;
+    }
   }
+}
 
-  struct AndList *sofar;
-  int pipeIDcounter = 0;
-  RecursiveAndListEval(sofar, NULL, candidates, s, pipeIDcounter);
-  candidates = sofar;
+/*------------------------------------------------------------------------------
+ * Collect the nodes of the query tree in post-order (children first)
+ *----------------------------------------------------------------------------*/
+void PostOrderNodes(GenericQTreeNode* currentNode, vector<GenericQTreeNode*> &nodes){
+  if(!currentNode)
+    return;
+  PostOrderNodes(currentNode->left, nodes);
+  PostOrderNodes(currentNode->right, nodes);
+  nodes.push_back(currentNode);
+}
+
+/*------------------------------------------------------------------------------
+ * Physical planning, done once the shape of the query tree is fixed.
+ * 1. estimate the size of every node's output, bottom-up
+ * 2. let every node that needs memory choose its algorithm, assuming memBudget is
+ *    split evenly between all such nodes (they all run at the same time)
+ * 3. split memBudget between those nodes in proportion to the memory their
+ *    algorithms could use, giving nobody more than it can use or less than
+ *    MIN_OP_PAGES
+ *----------------------------------------------------------------------------*/
+void PhysicalPlanning(GenericQTreeNode* root){
+  vector<GenericQTreeNode*> nodes;
+  PostOrderNodes(root, nodes);
 
+  for(int i=0;i<nodes.size();i++)
+    nodes[i]->EstimateSize();
+
+  int numMemoryNodes = 0;
+  for(int i=0;i<nodes.size();i++){
+    if(nodes[i]->MemoryWanted() > 0) numMemoryNodes++;
+  }
+  int evenShare = (numMemoryNodes > 0) ? memBudget / numMemoryNodes : memBudget;
+  if(evenShare < MIN_OP_PAGES) evenShare = MIN_OP_PAGES;
+  for(int i=0;i<nodes.size();i++)
+    nodes[i]->ChooseAlgorithm(evenShare);
+
+  double totalWanted = 0;
+  for(int i=0;i<nodes.size();i++)
+    totalWanted += nodes[i]->MemoryWanted();
+  for(int i=0;i<nodes.size();i++){
+    double wanted = nodes[i]->MemoryWanted();
+    if(wanted <= 0) continue;
+    double pages = (totalWanted <= memBudget) ? wanted : memBudget * wanted / totalWanted;
+    nodes[i]->memPages = (pages < MIN_OP_PAGES) ? MIN_OP_PAGES : (int) ceil(pages);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Once every conjunct is a node, put the aggregation, duplicate removal,
+ * projection or group by on top, then the ORDER BY or LIMIT, and do the
+ * physical planning. estimates, if
+ * not NULL, are the output sizes of the nodes in post-order (from the plan cache)
+ *----------------------------------------------------------------------------*/
+void FinishQTree(int pipeIDcounter, vector<double> *estimates){
   // At this point, only QTree node should remain in the hash.
   // add aggregation, duplicate removal, projection or group by operation at the root.
   GenericQTreeNode* root = relNameToTreeMap.begin()->second;
@@ -318,14 +534,209 @@ void PermutationTreeGen(struct AndList *&candidates, TableList *t, Statistics &s
   else
     new ProjectNode(attsToSelect, root, pipeIDcounter);
   new DupRemNode(distinctAtts, distinctFunc, root, pipeIDcounter);
+  if(orderingAtts)
+    new OrderByNode(orderingAtts, orderDescending, limitRows, root, pipeIDcounter);
+  else if(limitRows != NO_LIMIT)
+    new LimitNode(limitRows, root, pipeIDcounter);
 
   // cout << "Size of the hash: " << relNameToTreeMap.size() << endl; // debug
 
   // Now this QTree node is the root of the entire tree.
   QueryRoot = root;
+  if(estimates){
+    vector<GenericQTreeNode*> nodes;
+    PostOrderNodes(QueryRoot, nodes);
+    for(int i=0;i<nodes.size() && i<estimates->size();i++)
+      nodes[i]->estTuples = (*estimates)[i];
+  }
+  PhysicalPlanning(QueryRoot);
   // cout << root->schema()->GetNumAtts() << endl; exit(1); // debug
 }
 
+/*------------------------------------------------------------------------------
+ * Wrapper function that calculate the lowest cost (query with least intermediate
+ * tuples) ordering of the AndList. Joins over up to maxDPRelations relations
+ * are ordered by DPAndListEval; larger ones (and anything it can't handle) greedily
+ * by RecursiveAndListEval
+ *----------------------------------------------------------------------------*/
+void PermutationTreeGen(struct AndList *&candidates, TableList *t, Statistics &s){
+  boost::timer planTimer;
+  // walk the table list linearly. Build table alias structure. Record the table number.
+  vector<string> rels;
+  while(t){
+    rels.push_back(t->aliasAs ? t->aliasAs : t->tableName);
+    if(t->aliasAs)
+      s.CopyRel(t->tableName, t->aliasAs);
+    t = t->next;
+  }
+
+  struct AndList *sofar = NULL;
+  struct AndList *Sofartail = NULL;
+  int pipeIDcounter = 0;
+  if(rels.size() <= maxDPRelations)
+    DPAndListEval(sofar, Sofartail, candidates, rels, s, pipeIDcounter);
+  else
+    cout << "Join order: " << rels.size() << " relations is more than " << maxDPRelations << "; ordering joins greedily" << endl;
+  RecursiveAndListEval(sofar, Sofartail, candidates, s, pipeIDcounter);
+  candidates = sofar;
+  cout << "Planning time: " << planTimer.elapsed() << "s" << endl;
+  FinishQTree(pipeIDcounter, NULL);
+}
+
+/*------------------------------------------------------------------------------
+ * A query plan remembered by the plan cache. Queries that differ only in the
+ * literals of their WHERE clause share a plan: the join order and the physical
+ * choices made for the first of them are reused for the others, whose nodes are
+ * built from their own parse trees (and so with their own literals)
+ *----------------------------------------------------------------------------*/
+typedef struct{
+  vector<int> order;        // WHERE clause conjuncts (numbered as in the query) in the order they were applied
+  vector<double> estimates; // estTuples of every node of the query tree, in post-order
+  int catalogVersion;       // dbCatalog.GetVersion() when the plan was made
+  int hits;                 // times the plan was reused
+} cachedPlan;
+
+// normalized query text (see NormalizeQuery) -> plan
+unordered_map<string, cachedPlan> planCache;
+
+/*------------------------------------------------------------------------------
+ * Append an operand to a normalized query: names as they are, literals as ?
+ * followed by their type so that queries only differing in literals match
+ *----------------------------------------------------------------------------*/
+void NormalizeOperand(struct Operand *pOperand, string &key){
+  if(pOperand->code == NAME)
+    key += pOperand->value;
+  else
+    key += (pOperand->code == INT) ? "?i" : ((pOperand->code == DOUBLE) ? "?d" : "?s");
+}
+
+/*------------------------------------------------------------------------------
+ * Append an aggregate function to a normalized query
+ *----------------------------------------------------------------------------*/
+void NormalizeFunc(struct FuncOperator *pFunc, string &key){
+  if(!pFunc)
+    return;
+  char code[16];
+  sprintf(code, "(%d ", pFunc->code);
+  key += code;
+  if(pFunc->leftOperand){
+    key += pFunc->leftOperand->value;
+    key += " ";
+  }
+  NormalizeFunc(pFunc->leftOperator, key);
+  NormalizeFunc(pFunc->right, key);
+  key += ")";
+}
+
+/*------------------------------------------------------------------------------
+ * Text of the current query with the literals of the WHERE clause taken out.
+ * Key of the plan cache. Must be called before planning, which rewrites the
+ * WHERE clause
+ *----------------------------------------------------------------------------*/
+string NormalizeQuery(){
+  string key = distinctAtts ? "SELECT DISTINCT" : "SELECT";
+  for(struct NameList *n = attsToSelect;n;n = n->next){
+    key += " ";
+    key += n->name;
+  }
+  if(finalFunction){
+    key += distinctFunc ? " SUM DISTINCT " : " SUM ";
+    NormalizeFunc(finalFunction, key);
+  }
+  key += " FROM";
+  for(struct TableList *t = tables;t;t = t->next){
+    key += " ";
+    key += t->tableName;
+    key += " AS ";
+    key += t->aliasAs ? t->aliasAs : t->tableName;
+  }
+  key += " WHERE";
+  for(struct AndList *a = whereClausePredicate;a;a = a->rightAnd){
+    key += " (";
+    for(struct OrList *o = a->left;o;o = o->rightOr){
+      if(o != a->left)
+        key += " OR ";
+      NormalizeOperand(o->left->left, key);
+      key += (o->left->code == LESS_THAN) ? " < " : ((o->left->code == GREATER_THAN) ? " > " : " = ");
+      NormalizeOperand(o->left->right, key);
+    }
+    key += ")";
+  }
+  key += " GROUP BY";
+  for(struct NameList *n = groupingAtts;n;n = n->next){
+    key += " ";
+    key += n->name;
+  }
+  key += " ORDER BY";
+  for(struct NameList *n = orderingAtts;n;n = n->next){
+    key += " ";
+    key += n->name;
+  }
+  if(orderingAtts && orderDescending)
+    key += " DESC";
+  char limit[16];
+  sprintf(limit, " LIMIT %d", limitRows); // a different limit can make for a different plan
+  key += limit;
+  return key;
+}
+
+/*------------------------------------------------------------------------------
+ * Remember the plan just made for the query with the given key. conjuncts are
+ * the WHERE clause conjuncts in the order they were written
+ *----------------------------------------------------------------------------*/
+void RememberPlan(string &key, vector<struct AndList*> &conjuncts){
+  if(planCacheSize <= 0)
+    return;
+  cachedPlan plan;
+  for(struct AndList *a = whereClausePredicate;a;a = a->rightAnd) // in the order they were applied
+    plan.order.push_back(find(conjuncts.begin(), conjuncts.end(), a) - conjuncts.begin());
+  vector<GenericQTreeNode*> nodes;
+  PostOrderNodes(QueryRoot, nodes);
+  for(int i=0;i<nodes.size();i++)
+    plan.estimates.push_back(nodes[i]->estTuples);
+  plan.catalogVersion = dbCatalog.GetVersion();
+  plan.hits = 0;
+  if(planCache.size() >= planCacheSize)
+    planCache.clear(); // crude, but a plan only costs one planning to make again
+  planCache[key] = plan;
+}
+
+/*------------------------------------------------------------------------------
+ * Build the query tree of the current query the way plan says: turn its
+ * conjuncts into nodes in the cached order, then restore the cached size
+ * estimates for the physical planning. No Statistics are looked at
+ *----------------------------------------------------------------------------*/
+void ReplayPlan(cachedPlan &plan, vector<struct AndList*> &conjuncts){
+  boost::timer planTimer;
+  char strRelName0[MAX_REL_NAME], strRelName1[MAX_REL_NAME];
+  char *names[2] = {strRelName0, strRelName1};
+  struct AndList *sofar = NULL;
+  struct AndList *Sofartail = NULL;
+  int pipeIDcounter = 0;
+  for(int i=0;i<plan.order.size();i++){
+    struct AndList *target = conjuncts[plan.order[i]];
+    int numToJoin = ConjunctRelNames(target, relAlias, names);
+    struct AndList dummy;
+    dummy.left = target->left;
+    dummy.rightAnd = NULL;
+    AndListNode2QTreeNode(dummy, names, numToJoin, pipeIDcounter);
+    pipeIDcounter++;
+    if(numToJoin == 2)
+      MergeAlias(relAlias, names);
+
+    target->rightAnd = NULL;
+    if(!Sofartail)
+      sofar = target;
+    else
+      Sofartail->rightAnd = target;
+    Sofartail = target;
+  }
+  whereClausePredicate = sofar;
+  cout << "Join order: from the plan cache (reused " << plan.hits << " times)" << endl;
+  cout << "Planning time: " << planTimer.elapsed() << "s" << endl;
+  FinishQTree(pipeIDcounter, &plan.estimates);
+}
+
 /*------------------------------------------------------------------------------
  * Run() EVERY node whilst traversing the tree post-order
  *----------------------------------------------------------------------------*/
@@ -363,10 +774,10 @@ void InOrderPrintQTree(GenericQTreeNode* currentNode){
 }
 
 /*------------------------------------------------------------------------------
- * Create Query Plan
+ * Create Query Plan. Returns false if the query is rejected and must not be run
  * Called in main.cc
  *----------------------------------------------------------------------------*/
-void queryPlanning(){
+bool queryPlanning(){
   relNameToTreeMap.clear(); // clear any mappings from past SQL commands
                             // needed because we accept SQL commands in a while loop
                             // in main.cc
@@ -375,14 +786,36 @@ void queryPlanning(){
   cout << endl << "--------------------------------------------" << endl;
   cout <<         "         Starting query optimization";
   cout << endl << "--------------------------------------------" << endl;
-  stats.Read(statsFileName); // init Statistics object from serialized text file
-  PermutationTreeGen(whereClausePredicate, tables, stats);
+  stats = dbCatalog.GetStatistics(); // init Statistics object from the catalog. A copy, since planning Applies predicates to it
+
+  // reuse the plan of an earlier query that only differed in its literals if
+  // nothing in the catalog has changed since
+  string key = NormalizeQuery();
+  FindQueryAtts();
+  vector<struct AndList*> conjuncts;
+  for(struct AndList *a = whereClausePredicate;a;a = a->rightAnd)
+    conjuncts.push_back(a);
+  auto cached = planCache.find(key);
+  if(cached != planCache.end() && cached->second.catalogVersion == dbCatalog.GetVersion()){
+    cached->second.hits++;
+    ReplayPlan(cached->second, conjuncts);
+  }
+  else{
+    PermutationTreeGen(whereClausePredicate, tables, stats);
+    if(QueryRoot->Valid())
+      RememberPlan(key, conjuncts);
+  }
+  if(!QueryRoot->Valid()){
+    cout << "ERROR: Query rejected." << endl;
+    return false;
+  }
 
   cout << endl << "Generated Query Plan: " << endl; // InOrder print out the tree.
   InOrderPrintQTree(QueryRoot);
   cout << endl << "--------------------------------------------" << endl;
   cout <<         "           Query optimization done";
   cout << endl << "--------------------------------------------" << endl;
+  return true;
 }
 
 /*------------------------------------------------------------------------------
@@ -410,94 +843,249 @@ void queryExecution(){
   cout << endl << "--------------------------------------------" << endl;
 }
 
+/*------------------------------------------------------------------------------
+ * EXPLAIN ANALYZE: execute the query plan, throwing the records away, and print
+ * what every operation actually did next to what the planner expected.
+ * Rows in are the records the operation took from its input pipes and rows out the
+ * ones it put into its output pipe. Input wait is the time the operation spent
+ * waiting for its children to produce, output wait the time it spent waiting for its
+ * parent to consume. Pages written are temporary files (sort runs, the disk side of a
+ * block nested loop join): what the operation spilled
+ * Called in main.cc
+ *----------------------------------------------------------------------------*/
+void explainAnalyze(){
+  cout << endl << "--------------------------------------------" << endl;
+  cout <<         "          Starting query execution";
+  cout << endl << "--------------------------------------------" << endl;
+  vector<GenericQTreeNode*> nodes;
+  PostOrderNodes(QueryRoot, nodes);
+  for(int i=0;i<nodes.size();i++)
+    nodes[i]->outpipe->Instrument(nodes[i]->pipeID);
+
+  long startWall = WallNanos();
+  PostOrderRun(QueryRoot);
+  int cnt = clear_pipe (*(QueryRoot->outpipe), QueryRoot->schema(), false);
+  PostOrderWait(QueryRoot);
+  double total = (WallNanos() - startWall) / 1e9;
+
+  cout << endl << left << setw(6) << "pipe" << setw(19) << "operation"
+       << right << setw(12) << "est. rows" << setw(12) << "rows in" << setw(12) << "rows out"
+       << setw(10) << "in wait" << setw(10) << "out wait" << setw(9) << "cpu" << setw(9) << "wall"
+       << setw(10) << "pages rd" << setw(10) << "pages wr" << setw(12) << "peak mem" << endl;
+  cout << fixed << setprecision(3);
+  for(int i=0;i<nodes.size();i++){
+    GenericQTreeNode* node = nodes[i];
+    ExecCounters &c = node->Operation()->GetCounters();
+    long rowsIn = 0;
+    double inWait = 0;
+    GenericQTreeNode* children[2] = {node->left, node->right};
+    for(int j=0;j<2;j++){
+      if(!children[j]) continue;
+      rowsIn += children[j]->outpipe->NumInserted();
+      inWait += children[j]->outpipe->ConsumerWait();
+    }
+    cout << left << setw(6) << node->pipeID << setw(19) << node->Name() << right
+         << setw(12) << (long long) node->estTuples;
+    if(node->left)
+      cout << setw(12) << rowsIn;
+    else
+      cout << setw(12) << "-"; // reads the disk
+    cout << setw(12) << node->outpipe->NumInserted()
+         << setw(9) << inWait << "s" << setw(9) << node->outpipe->ProducerWait() << "s"
+         << setw(8) << c.cpuNanos / 1e9 << "s" << setw(8) << c.wallNanos / 1e9 << "s"
+         << setw(10) << c.pagesRead << setw(10) << c.pagesWritten
+         << setw(9) << c.peakMemory / 1024 << " KB" << endl;
+  }
+  cout.unsetf(ios::fixed);
+  cout << setprecision(6);
+
+  // the output pipe of every operation. A pipe that is often full holds back its
+  // producer (a slow consumer, or too small a pipesz); one that is mostly empty
+  // starves its consumer
+  cout << endl;
+  for(int i=0;i<nodes.size();i++)
+    Pipe::Find(nodes[i]->pipeID)->PrintStats();
+
+  cout << "\nQuery returned " << cnt << " records in " << total << "s \n";
+  cout << endl << "--------------------------------------------" << endl;
+  cout <<         "           Query execution done";
+  cout << endl << "--------------------------------------------" << endl;
+}
+
+/*------------------------------------------------------------------------------
+ * Value of attribute att of rec as text, the way it would be written in a query
+ *----------------------------------------------------------------------------*/
+string AttValueText(Record &rec, int att, Type type){
+  char *val = rec.bits + ((int *) rec.bits)[att + 1];
+  char buffer[32];
+  switch (type) {
+    case Int:
+      sprintf(buffer, "%d", *((int *) val));
+      return string(buffer);
+    case Double:
+      sprintf(buffer, "%.17g", *((double *) val));
+      return string(buffer);
+    default:
+      return string(val);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * What UPDATE STATISTICS gathers about one attribute in its scan
+ *----------------------------------------------------------------------------*/
+typedef struct {
+  HyperLogLog distinct;   // distinct values
+  double minNum, maxNum;  // smallest and largest value of an Int or Double attribute
+  string minStr, maxStr;  // smallest and largest value of a String attribute
+} attStats;
+
+/*------------------------------------------------------------------------------
+ * Add one record to the statistics being gathered: cnt counts it, every
+ * attribute adds its value to its HyperLogLog and its min/max and the record
+ * takes part in the reservoir sample (the cnt-th record replaces a random one of
+ * the STATS_SAMPLE_SIZE in the sample with probability STATS_SAMPLE_SIZE/cnt,
+ * which keeps the sample uniform). rec is consumed if it goes into the sample.
+ *----------------------------------------------------------------------------*/
+void CollectRecord(Record &rec, Attribute *relAtts, int totalAtts, attStats *atts, int &cnt, vector<Record*> &sample){
+  for (int i = 0; i < totalAtts; i++) {
+    atts[i].distinct.Add(&rec, i, relAtts[i].myType);
+    char *val = rec.bits + ((int *) rec.bits)[i + 1];
+    if (relAtts[i].myType == String) {
+      if (cnt == 0 || strcmp(val, atts[i].minStr.c_str()) < 0) atts[i].minStr = val;
+      if (cnt == 0 || strcmp(val, atts[i].maxStr.c_str()) > 0) atts[i].maxStr = val;
+    }
+    else {
+      double num = (relAtts[i].myType == Int) ? *((int *) val) : *((double *) val);
+      if (cnt == 0 || num < atts[i].minNum) atts[i].minNum = num;
+      if (cnt == 0 || num > atts[i].maxNum) atts[i].maxNum = num;
+    }
+  }
+  cnt++;
+  if (sample.size() < STATS_SAMPLE_SIZE) {
+    sample.push_back(new Record);
+    sample.back()->Consume(&rec);
+  }
+  else {
+    long slot = random() % cnt;
+    if (slot < STATS_SAMPLE_SIZE)
+      sample[slot]->Consume(&rec);
+  }
+}
+
 /*------------------------------------------------------------------------------
  * Update Statistics
  * Called in main.cc
+ * Everything is gathered in ONE scan of the relation: the number of tuples and,
+ * per attribute, a HyperLogLog estimate of the distinct values, the min/max and
+ * a reservoir sample that the histograms and most common values are built from.
+ * Relations of more than statsMaxPages pages are not read in full; a random
+ * sample of statsMaxPages of their pages is read instead and the counts are
+ * scaled up.
  *----------------------------------------------------------------------------*/
 void updateStatistics(){
   char* relName = tables->tableName;
   if(DBinfo.count(relName)){
     // The user has specified which table he wants to update but we must not
-    // lose all the other extant Statistics information. Hence, start by reading
-    // the current Statistics.txt file and then update only the relation the
+    // lose all the other extant Statistics information. Hence, start from the
+    // statistics in the catalog and then update only the relation the
     // user specified using Statistics.AddRel and Statistics.AddAtt
-    stats.Read(statsFileName);
+    stats = dbCatalog.GetStatistics();
 
     cout << "INFO: Updating Statistics object" << endl;
     cout << "      " << "Relation: " << relName << endl;
     rel = DBinfo[relName];
+    Attribute* relAtts = rel->schema()->GetAtts();
+    int totalAtts = rel->schema()->GetNumAtts();
+    attStats* atts = new attStats[totalAtts];
+    vector<Record*> sample;
+    Record rec;
+    int cnt = 0;     // records read
+    double scale = 1; // records in the relation per record read
 
-    // update the total number of tuples in the relation
-    // create a SelectFile with a blank CNF (equivalent to
-    // SELECT ALL) and then simply read out all the records,
-    // keeping count of how many you read
     DBFile dbfile;
     dbfile.Open(rel->path());
-    SelectFile sf;
-    sf.Use_n_Pages (buffsz);
-    Pipe outPipe(pipesz);
-
-    // create an empty CNF to give to the SelectFile so it acts
-    // as a SELECT ALL
-    Record literal;
-    CNF emptyCNF;
-    AndList emptyAndList;
-    emptyAndList.left = NULL;
-    emptyAndList.rightAnd = NULL;
-    emptyCNF.GrowFromParseTree (&emptyAndList, rel->schema(), literal);
-
-    // start counting the records from the table
-    sf.Run(dbfile,outPipe,emptyCNF,literal);
-    int cnt = clear_pipe (outPipe, rel->schema (), false);
-    sf.WaitUntilDone();
-    cout << "      " << "Total recs: " << cnt << endl;
-    stats.AddRel(relName,cnt);
-    dbfile.Close();
-
-    // for each attribute in the relation, update the number of
-    // unique values for the attribute. Do this by
-    // SF's (with a blank CNF) -> Project (on the attribute) -> DuplicateRemoval
+    int numPages = dbfile.GetNumofRecordPages();
+    if (statsMaxPages <= 0 || numPages <= statsMaxPages) {
+      // read everything
+      if (numPages > 0) {
+        dbfile.MoveFirst();
+        while (dbfile.GetNext(rec))
+          CollectRecord(rec, relAtts, totalAtts, atts, cnt, sample);
+      }
+      dbfile.Close();
+    }
+    else {
+      // read statsMaxPages random data pages, in file order (selection sampling:
+      // page p is taken with probability pages still wanted/pages left). The
+      // data pages of every file type are in the File at the relation's path;
+      // a sorted file's delta runs are left out, the scaling accounts for them
+      dbfile.Close();
+      File file;
+      file.Open(1, rel->path());
+      int dataPages = (file.GetLength() > 0) ? file.GetLength() - 1 : 0;
+      int wanted = (statsMaxPages < dataPages) ? statsMaxPages : dataPages;
+      int taken = 0;
+      Page page;
+      for (int p = 0; p < dataPages && taken < wanted; p++) {
+        if (random() % (dataPages - p) < wanted - taken) {
+          file.GetPage(&page, p);
+          while (page.GetFirst(&rec))
+            CollectRecord(rec, relAtts, totalAtts, atts, cnt, sample);
+          taken++;
+        }
+      }
+      file.Close();
+      scale = (taken > 0) ? numPages/(double)taken : 1;
+      cout << "      " << "Sampled " << taken << " of " << numPages << " pages" << endl;
+    }
+
+    int numTuples = (int)(cnt*scale);
+    cout << "      " << "Total recs: " << numTuples << endl;
+    stats.AddRel(relName,numTuples);
+
     cout << "      " << "Attributes:" << endl;
-    Attribute* relAtts = rel->schema()->GetAtts();
-    int totalAtts = rel->schema()->GetNumAtts();
     for(int i=0;i<totalAtts;i++){
-      // SelectFile
-      DBFile dbfiletemp;
-      Record literaltemp;
-      dbfiletemp.Open(rel->path());
-      SelectFile SF;
-      SF.Use_n_Pages (buffsz);
-      Pipe sfOutputPipe(pipesz);
-
-      // Project
-      Project P;
-      P.Use_n_Pages(buffsz);
-      Pipe pOutputPipe(pipesz);
-      int keepMe[] = {i};
-
-      // DuplicateRemoval
-      DuplicateRemoval D;
-      Schema dSchema ("duprem", 1, &relAtts[i]);
-      D.Use_n_Pages(buffsz); //this was missing in the original test.cc. Use_n_Pages MUST be called for Join, DuplicateRemoval and GroupBy
-      Pipe dOutputPipe(pipesz);
-
-      // Start counting unique records
-      SF.Run(dbfiletemp,sfOutputPipe,emptyCNF,literaltemp);
-      P.Run(sfOutputPipe, pOutputPipe, keepMe, totalAtts, 1);
-      D.Run(pOutputPipe, dOutputPipe, dSchema);
-
-      int cnt = clear_pipe (dOutputPipe, &dSchema, false);
-
-      SF.WaitUntilDone();
-      P.WaitUntilDone();
-      D.WaitUntilDone();
-
-      cout << "        " << relAtts[i].name << ": " << cnt << endl;
-      dbfiletemp.Close();
-      stats.AddAtt(relName, relAtts[i].name, cnt);
+      // HyperLogLog can't count past what it was shown. If we only read a
+      // sample, an attribute that looks like a key (nearly every value
+      // distinct) is assumed to stay one; any other is assumed to have shown
+      // us all its values
+      double distinct = atts[i].distinct.Estimate();
+      if (distinct > cnt)
+        distinct = cnt;
+      if (scale > 1 && distinct >= 0.9*cnt)
+        distinct *= scale;
+      int numDistinct = (distinct < 1) ? 1 : (int)(distinct + 0.5);
+      cout << "        " << relAtts[i].name << ": " << numDistinct << endl;
+      stats.AddAtt(relName, relAtts[i].name, numDistinct);
+
+      // most common values and histogram, stretched to the real min/max
+      vector<string> values;
+      for (int j = 0; j < sample.size(); j++)
+        values.push_back(AttValueText(*sample[j], i, relAtts[i].myType));
+      stats.AddDistribution(relAtts[i].name, values, relAtts[i].myType != String);
+      if (cnt > 0) {
+        char buffer[32];
+        string minValue, maxValue;
+        if (relAtts[i].myType == String) {
+          minValue = atts[i].minStr;
+          maxValue = atts[i].maxStr;
+        }
+        else {
+          sprintf(buffer, "%.17g", atts[i].minNum);
+          minValue = buffer;
+          sprintf(buffer, "%.17g", atts[i].maxNum);
+          maxValue = buffer;
+        }
+        stats.AddRange(relAtts[i].name, minValue, maxValue);
+      }
     }
-    stats.Write(statsFileName); // make changes persistent by writing it to Statistics.txt
-    cout << "INFO: Statistics changes made persistent in " << statsFileName << endl << endl;
+    for (int j = 0; j < sample.size(); j++)
+      delete sample[j];
+    delete [] atts;
+
+    dbCatalog.UpdateStatistics(relName, stats); // make changes persistent in the catalog
+    stats.Write(statsFileName); // and in Statistics.txt, which is still the text form people read
+    cout << "INFO: Statistics changes made persistent in the catalog and in " << statsFileName << endl << endl;
   }
   else{
     cout << "ERROR: Table " << relName << " does not exist." << endl;
@@ -0,0 +1,905 @@
+/*******************************************************************************
+ * File: bench.cc
+ * Microbenchmarks for the hot paths of the storage layer, the sort and the
+ * relational operations. Built and run by "make bench".
+ *
+ * Everything runs on synthetic data generated from a fixed seed, so two builds
+ * run on the same input. The hash table benchmarks run on TPC-H keys, generated
+ * by TPCHGen with lineitem about as big as the synthetic relation (the TPC-H
+ * schemas come from the catalog file). Each benchmark is run BENCH_REPEATS times and the best
+ * time is kept. The results are written to stdout as JSON:
+ *   {"records": N, "page_size": P, "repeats": R, "string_kernels": K, "benchmarks": [
+ *     {"name": "...", "items": n, "seconds": s, "items_per_sec": r}, ...]}
+ * Usage: bench.out [records]
+ ******************************************************************************/
+#include "Record.h"
+#include "Schema.h"
+#include "File.h"
+#include "DBFile.h"
+#include "Pipe.h"
+#include "BigQ.h"
+#include "RelOp.h"
+#include "Function.h"
+#include "Comparison.h"
+#include "ComparisonEngine.h"
+#include "StringCompare.h"
+#include "HashTable.h"
+#include "TPCHGen.h"
+#include "ParseTree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+#define BENCH_RECORDS 200000  // default number of records in the synthetic relation
+#define BENCH_REPEATS 3       // runs of each benchmark; the best one is reported
+#define BENCH_SEED 12345      // seed of the data generator
+#define BENCH_GROUPS 100      // distinct values of the grouping attribute d
+#define BENCH_BNL_FRACTION 10 // the block nested loop join runs on records/10 left records
+#define BENCH_SPILL_PAGES 4   // memory of the joins whose sorts are made to spill
+#define BENCH_TOP_N 100       // limit of the ORDER BY ... LIMIT benchmarks
+
+int pipesz = 100; // same defaults as a3utils.h
+int buffsz = 100;
+
+char benchText[] = "bench.tbl";   // synthetic relation as text
+char benchHeap[] = "bench.bin";   // and as a heap file
+char benchMeta[] = "bench.bin.meta";
+char tpchHeap[] = "bench_tpch.bin"; // a TPC-H relation, while it is read in
+char tpchMeta[] = "bench_tpch.bin.meta";
+
+int numRecords = BENCH_RECORDS;
+Schema* benchSchema;              // (a Int, b Double, c String, d Int). a is unique, d = a % BENCH_GROUPS
+Schema* smallSchema;              // (rd Int, rs String), one record per value of d
+vector<Record*> records;          // the synthetic relation, in memory
+vector<Record*> smallRecords;
+bool firstResult = true;
+
+/*------------------------------------------------------------------------------
+ * Deterministic generator (a plain LCG, so the data doesn't depend on the libc)
+ *----------------------------------------------------------------------------*/
+unsigned long long benchState = BENCH_SEED;
+unsigned int benchRandom(){
+  benchState = benchState * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned int) (benchState >> 33);
+}
+
+/*------------------------------------------------------------------------------
+ * Report one result
+ *----------------------------------------------------------------------------*/
+void report(const char* name, long items, double seconds){
+  printf("%s\n    {\"name\": \"%s\", \"items\": %ld, \"seconds\": %.6f, \"items_per_sec\": %.1f}",
+         firstResult ? "" : ",", name, items, seconds, seconds > 0 ? items / seconds : 0.0);
+  firstResult = false;
+  fflush(stdout);
+}
+
+/*------------------------------------------------------------------------------
+ * Run fn BENCH_REPEATS times and report the best time. fn returns the number
+ * of items it processed
+ *----------------------------------------------------------------------------*/
+template <class F>
+void measure(const char* name, F fn){
+  double best = -1;
+  long items = 0;
+  for(int i=0;i<BENCH_REPEATS;i++){
+    long start = WallNanos();
+    items = fn();
+    double secs = (WallNanos() - start) / 1e9;
+    if(best < 0 || secs < best) best = secs;
+  }
+  report(name, items, best);
+}
+
+/*------------------------------------------------------------------------------
+ * Parse tree helpers, so that CNFs and Functions can be grown without the parser
+ *----------------------------------------------------------------------------*/
+struct AndList* comparison(const char* left, int leftCode, int op, const char* right, int rightCode){
+  struct Operand* l = new Operand;
+  l->code = leftCode;
+  l->value = strdup(left);
+  struct Operand* r = new Operand;
+  r->code = rightCode;
+  r->value = strdup(right);
+  struct ComparisonOp* cmp = new ComparisonOp;
+  cmp->code = op;
+  cmp->left = l;
+  cmp->right = r;
+  struct OrList* orList = new OrList;
+  orList->left = cmp;
+  orList->rightOr = NULL;
+  struct AndList* andList = new AndList;
+  andList->left = orList;
+  andList->rightAnd = NULL;
+  return andList;
+}
+
+// first AND rest, for CNFs of several comparisons
+struct AndList* conjunction(struct AndList* first, struct AndList* rest){
+  first->rightAnd = rest;
+  return first;
+}
+
+struct FuncOperator* attribute(const char* name){
+  struct FuncOperand* operand = new FuncOperand;
+  operand->code = NAME;
+  operand->value = strdup(name);
+  struct FuncOperator* func = new FuncOperator;
+  func->code = 0;
+  func->leftOperator = NULL;
+  func->leftOperand = operand;
+  func->right = NULL;
+  return func;
+}
+
+/*------------------------------------------------------------------------------
+ * Feed copies of recs into a pipe from a thread of its own, then shut it down
+ *----------------------------------------------------------------------------*/
+typedef struct{
+  vector<Record*>* recs;
+  Pipe* pipe;
+} FeedUtil; // struct used by feedThread
+
+void* feedRoutine(void* ptr){
+  FeedUtil* myT = (FeedUtil*) ptr;
+  Record rec;
+  for(int i=0;i<myT->recs->size();i++){
+    rec.Copy(myT->recs->at(i));
+    myT->pipe->Insert(&rec);
+  }
+  myT->pipe->ShutDown();
+  return 0;
+}
+
+void startFeed(pthread_t* thread, FeedUtil* t, vector<Record*>* recs, Pipe* pipe){
+  t->recs = recs;
+  t->pipe = pipe;
+  pthread_create(thread, NULL, feedRoutine, (void*)t);
+}
+
+long drain(Pipe* pipe){
+  Record rec;
+  long cnt = 0;
+  while(pipe->Remove(&rec)) cnt++;
+  return cnt;
+}
+
+/*------------------------------------------------------------------------------
+ * Generate the synthetic relations. The text file is written in the format
+ * Load and SuckNextRecord read
+ *----------------------------------------------------------------------------*/
+void generate(){
+  Attribute benchAtts[] = {{(char*)"a", Int}, {(char*)"b", Double}, {(char*)"c", String}, {(char*)"d", Int}};
+  benchSchema = new Schema((char*)"bench", 4, benchAtts);
+  Attribute smallAtts[] = {{(char*)"rd", Int}, {(char*)"rs", String}};
+  smallSchema = new Schema((char*)"small", 2, smallAtts);
+
+  FILE* text = fopen(benchText, "w");
+  if(text == NULL){
+    cerr << "ERROR: Could not create " << benchText << endl;
+    exit(1);
+  }
+  for(int i=0;i<numRecords;i++){
+    int a = (int) (((long long) i * 2654435761LL) % numRecords); // a permutation of 0..n-1 for most n
+    char c[32];
+    int len = 4 + benchRandom() % 20;
+    for(int j=0;j<len;j++) c[j] = 'a' + benchRandom() % 26;
+    c[len] = 0;
+    fprintf(text, "%d|%.2f|%s|%d|\n", a, (benchRandom() % 1000000) / 100.0, c, a % BENCH_GROUPS);
+  }
+  fclose(text);
+
+  for(int i=0;i<BENCH_GROUPS;i++){
+    char src[64];
+    sprintf(src, "%d|group%d|", i, i);
+    Record* rec = new Record;
+    rec->ComposeRecord(smallSchema, src);
+    smallRecords.push_back(rec);
+  }
+}
+
+/*******************************************************************************
+ * Storage
+ ******************************************************************************/
+void benchStorage(){
+  measure("record_suck_next_record", [](){
+    for(int i=0;i<records.size();i++) delete records[i];
+    records.clear();
+    FILE* text = fopen(benchText, "r");
+    Record rec;
+    while(rec.SuckNextRecord(benchSchema, text)){
+      Record* copy = new Record;
+      copy->Consume(&rec);
+      records.push_back(copy);
+    }
+    fclose(text);
+    return (long) records.size();
+  });
+
+  // pack the records into pages once; encode and decode them repeatedly
+  vector<Page*> pages;
+  pages.push_back(new Page);
+  Record rec;
+  for(int i=0;i<records.size();i++){
+    rec.Copy(records[i]);
+    if(!pages.back()->Append(&rec)){
+      pages.push_back(new Page);
+      pages.back()->Append(&rec);
+    }
+  }
+  vector<char*> bits;
+  for(int i=0;i<pages.size();i++){
+    bits.push_back(new char[PAGE_SIZE]);
+    pages[i]->ToBinary(bits[i]);
+  }
+
+  measure("page_encode", [&](){
+    for(int i=0;i<pages.size();i++) pages[i]->ToBinary(bits[i]);
+    return (long) records.size();
+  });
+
+  measure("page_decode", [&](){
+    Page page;
+    for(int i=0;i<bits.size();i++) page.FromBinary(bits[i]);
+    return (long) records.size();
+  });
+
+  for(int i=0;i<pages.size();i++){
+    delete pages[i];
+    delete [] bits[i];
+  }
+
+  measure("heap_append", [](){
+    DBFile dbfile;
+    dbfile.Create(benchHeap, heap, NULL);
+    Record rec;
+    for(int i=0;i<records.size();i++){
+      rec.Copy(records[i]);
+      dbfile.Add(rec);
+    }
+    dbfile.Close();
+    return (long) records.size();
+  });
+
+  measure("heap_scan", [](){
+    DBFile dbfile;
+    dbfile.Open(benchHeap);
+    dbfile.MoveFirst();
+    Record rec;
+    long cnt = 0;
+    while(dbfile.GetNext(rec)) cnt++;
+    dbfile.Close();
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * ComparisonEngine: neighbouring records compared on one attribute of each type,
+ * finding it through the offsets in the records or where the schema puts it
+ ******************************************************************************/
+void benchCompare(const char* name, int att, Type type, bool bySchema){
+  myAtt key = {att, type};
+  OrderMaker order;
+  if(bySchema)
+    order.initOrderMaker(1, &key, benchSchema); // where a, b and c are known from the schema
+  else
+    order.initOrderMaker(1, &key);
+  measure(name, [&](){
+    ComparisonEngine ceng;
+    long cnt = 0;
+    int sink = 0;
+    for(int round=0;round<10;round++){
+      for(int i=1;i<records.size();i++){
+        sink += ceng.Compare(records[i-1], records[i], &order);
+        cnt++;
+      }
+    }
+    if(sink == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * KeyComparator: the same comparisons through the comparator specialized for
+ * the key, as BigQ, the sort-merge join and GroupBy make them
+ ******************************************************************************/
+void benchKeyCompare(const char* name, int att, Type type){
+  myAtt key = {att, type};
+  OrderMaker order;
+  order.initOrderMaker(1, &key, benchSchema);
+  KeyComparator comparator = order.GetComparator();
+  measure(name, [&](){
+    long cnt = 0;
+    int sink = 0;
+    for(int round=0;round<10;round++){
+      for(int i=1;i<records.size();i++){
+        sink += comparator.Compare(records[i-1]->bits, records[i]->bits);
+        cnt++;
+      }
+    }
+    if(sink == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * ComparisonEngine: a String attribute checked against a literal, as selections
+ * do, with the kernels named in the output (see StringCompare)
+ ******************************************************************************/
+void benchStringCNF(const char* name, int op, const char* value){
+  Record literal;
+  CNF cnf;
+  cnf.GrowFromParseTree(comparison("c", NAME, op, value, STRING), benchSchema, literal);
+  measure(name, [&](){
+    ComparisonEngine ceng;
+    long cnt = 0;
+    int sink = 0;
+    for(int round=0;round<10;round++){
+      for(int i=0;i<records.size();i++){
+        sink += ceng.Compare(records[i], &literal, &cnf);
+        cnt++;
+      }
+    }
+    if(sink == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * ComparisonEngine: a selection of three comparisons shaped like a scan of
+ * lineitem for TPC-H Q6 (a range on a Double and a bound on an Int, about 12%
+ * of the records pass), one record at a time and in batches
+ ******************************************************************************/
+struct AndList* scanPredicate(){
+  return conjunction(comparison("b", NAME, GREATER_THAN, "2500.0", DOUBLE),
+         conjunction(comparison("b", NAME, LESS_THAN, "7500.0", DOUBLE),
+                     comparison("d", NAME, LESS_THAN, "24", INT)));
+}
+
+void benchBatchCNF(){
+  Record literal;
+  CNF cnf;
+  cnf.GrowFromParseTree(scanPredicate(), benchSchema, literal);
+  vector<char*> recs(records.size());
+  vector<int> selected(records.size());
+  for(int i=0;i<records.size();i++) recs[i] = records[i]->bits;
+
+  measure("cnf_scan_row", [&](){
+    ComparisonEngine ceng;
+    long cnt = 0;
+    int sink = 0;
+    for(int round=0;round<10;round++){
+      for(int i=0;i<records.size();i++){
+        sink += ceng.Compare(records[i], &literal, &cnf);
+        cnt++;
+      }
+    }
+    if(sink == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return cnt;
+  });
+
+  measure("cnf_scan_batch", [&](){
+    ComparisonEngine ceng;
+    long cnt = 0;
+    int sink = 0;
+    for(int round=0;round<10;round++){
+      sink += ceng.Compare(&recs[0], recs.size(), &literal, &cnf, &selected[0]);
+      cnt += recs.size();
+    }
+    if(sink == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * Pipes: records flow through stages pass-through threads between a producer
+ * and the consumer
+ ******************************************************************************/
+typedef struct{
+  Pipe* in;
+  Pipe* out;
+} StageUtil; // struct used by stageThread
+
+void* stageRoutine(void* ptr){
+  StageUtil* myT = (StageUtil*) ptr;
+  Record rec;
+  while(myT->in->Remove(&rec)) myT->out->Insert(&rec);
+  myT->out->ShutDown();
+  return 0;
+}
+
+void benchPipe(const char* name, int stages){
+  measure(name, [&](){
+    vector<Pipe*> pipes;
+    for(int i=0;i<=stages;i++) pipes.push_back(new Pipe(pipesz));
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, pipes[0]);
+    vector<pthread_t> threads(stages);
+    vector<StageUtil> utils(stages);
+    for(int i=0;i<stages;i++){
+      utils[i].in = pipes[i];
+      utils[i].out = pipes[i+1];
+      pthread_create(&threads[i], NULL, stageRoutine, (void*)&utils[i]);
+    }
+    long cnt = drain(pipes[stages]);
+    pthread_join(feedThread, NULL);
+    for(int i=0;i<stages;i++) pthread_join(threads[i], NULL);
+    for(int i=0;i<=stages;i++) delete pipes[i];
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * BigQ: sort on a (unique) with different run lengths
+ ******************************************************************************/
+typedef struct{
+  Pipe* in;
+  Pipe* out;
+  OrderMaker* order;
+  int runlen;
+} SortUtil; // struct used by sortThread
+
+void* sortRoutine(void* ptr){
+  SortUtil* myT = (SortUtil*) ptr;
+  BigQ sorter(*(myT->in), *(myT->out), *(myT->order), myT->runlen);
+  return 0;
+}
+
+void benchBigQ(const char* name, int runlen){
+  myAtt key = {0, Int};
+  OrderMaker order;
+  order.initOrderMaker(1, &key);
+  measure(name, [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread, sortThread;
+    FeedUtil feed;
+    SortUtil sort = {&in, &out, &order, runlen};
+    pthread_create(&sortThread, NULL, sortRoutine, (void*)&sort);
+    startFeed(&feedThread, &feed, &records, &in);
+    long cnt = drain(&out);
+    pthread_join(feedThread, NULL);
+    pthread_join(sortThread, NULL);
+    return cnt;
+  });
+}
+
+/*******************************************************************************
+ * Relational operations. Operations that read a pipe are fed copies of the
+ * synthetic relation; items are input records
+ ******************************************************************************/
+void benchRelOps(){
+  Record literal;
+  CNF halfA;
+  char half[16];
+  sprintf(half, "%d", numRecords / 2);
+  halfA.GrowFromParseTree(comparison("a", NAME, LESS_THAN, half, INT), benchSchema, literal);
+
+  measure("relop_select_file", [&](){
+    DBFile dbfile;
+    dbfile.Open(benchHeap);
+    dbfile.MoveFirst();
+    Pipe out(pipesz);
+    SelectFile op;
+    op.Use_n_Pages(buffsz);
+    op.Run(dbfile, out, halfA, literal);
+    drain(&out);
+    op.WaitUntilDone();
+    dbfile.Close();
+    return (long) records.size();
+  });
+
+  // the same, keeping only a and d of the records accepted
+  int keepAD[] = {0, 3};
+  measure("relop_select_file_keep_atts", [&](){
+    DBFile dbfile;
+    dbfile.Open(benchHeap);
+    dbfile.MoveFirst();
+    Pipe out(pipesz);
+    SelectFile op;
+    op.Use_n_Pages(buffsz);
+    op.KeepAtts(keepAD, 2, benchSchema);
+    op.Run(dbfile, out, halfA, literal);
+    drain(&out);
+    op.WaitUntilDone();
+    dbfile.Close();
+    return (long) records.size();
+  });
+
+  measure("relop_select_pipe", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    SelectPipe op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, halfA, literal);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    return (long) records.size();
+  });
+
+  Record scanLiteral;
+  CNF scan;
+  scan.GrowFromParseTree(scanPredicate(), benchSchema, scanLiteral);
+
+  measure("relop_select_file_scan", [&](){
+    DBFile dbfile;
+    dbfile.Open(benchHeap);
+    dbfile.MoveFirst();
+    Pipe out(pipesz);
+    SelectFile op;
+    op.Use_n_Pages(buffsz);
+    op.Run(dbfile, out, scan, scanLiteral);
+    drain(&out);
+    op.WaitUntilDone();
+    dbfile.Close();
+    return (long) records.size();
+  });
+
+  measure("relop_select_pipe_scan", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    SelectPipe op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, scan, scanLiteral);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    return (long) records.size();
+  });
+
+  measure("relop_project", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    int keepMe[] = {3, 0};
+    Project op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, keepMe, 4, 2);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    return (long) records.size();
+  });
+
+  Function sumB;
+  sumB.GrowFromParseTree(attribute("b"), *benchSchema);
+
+  measure("relop_sum", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    Sum op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, sumB);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    return (long) records.size();
+  });
+
+  myAtt groupKey = {3, Int};
+  OrderMaker groupOrder;
+  groupOrder.initOrderMaker(1, &groupKey);
+
+  measure("relop_group_by", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    GroupBy op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, groupOrder, sumB);
+    op.WaitUntilDone(); // GroupBy hands its output over from another thread once it is done
+    drain(&out);
+    pthread_join(feedThread, NULL);
+    return (long) records.size();
+  });
+
+  // duplicate removal on the d column alone: BENCH_GROUPS distinct values
+  vector<Record*> dOnly;
+  int keepD[] = {3};
+  for(int i=0;i<records.size();i++){
+    Record* rec = new Record;
+    rec->Copy(records[i]);
+    rec->Project(keepD, 1, 4);
+    dOnly.push_back(rec);
+  }
+  Attribute dAtts[] = {{(char*)"d", Int}};
+  Schema dSchema((char*)"d", 1, dAtts);
+
+  measure("relop_duplicate_removal", [&](){
+    Pipe in(pipesz), out(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &dOnly, &in);
+    DuplicateRemoval op;
+    op.Use_n_Pages(buffsz);
+    op.Run(in, out, dSchema);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    return (long) dOnly.size();
+  });
+  for(int i=0;i<dOnly.size();i++) delete dOnly[i];
+
+  // every record joins with exactly one of the BENCH_GROUPS small records
+  CNF joinD;
+  Record joinLiteral;
+  joinD.GrowFromParseTree(comparison("d", NAME, EQUALS, "rd", NAME), benchSchema, smallSchema, joinLiteral);
+
+  measure("relop_join_sort_merge", [&](){
+    Pipe left(pipesz), right(pipesz), out(pipesz);
+    pthread_t feedL, feedR;
+    FeedUtil fL, fR;
+    startFeed(&feedL, &fL, &records, &left);
+    startFeed(&feedR, &fR, &smallRecords, &right);
+    Join op;
+    op.Use_n_Pages(buffsz);
+    op.Run(left, right, out, joinD, joinLiteral);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedL, NULL);
+    pthread_join(feedR, NULL);
+    return (long) (records.size() + smallRecords.size());
+  });
+
+  // a join only one in BENCH_GROUPS left records finds a match in, with too little
+  // memory to sort the left input: sorting it whole or only its keys. Then the first
+  // join again, keeping only a and rd of the joined records
+  vector<Record*> oneSmall(smallRecords.begin(), smallRecords.begin() + 1);
+  int keepARd[] = {0, 0};
+  for(int late=0;late<=2;late++){
+    const char* name = (late == 0) ? "relop_join_selective_spill" :
+                       ((late == 1) ? "relop_join_selective_spill_late" : "relop_join_keep_atts");
+    measure(name, [&](){
+      Pipe left(pipesz), right(pipesz), out(pipesz);
+      pthread_t feedL, feedR;
+      FeedUtil fL, fR;
+      startFeed(&feedL, &fL, &records, &left);
+      startFeed(&feedR, &fR, (late == 2) ? &smallRecords : &oneSmall, &right);
+      Join op;
+      if(late == 2){
+        op.Use_n_Pages(buffsz);
+        op.KeepAtts(keepARd, 2, 1);
+      }
+      else{
+        op.Use_n_Pages(BENCH_SPILL_PAGES);
+        op.UseLateMaterialization(late == 1, false);
+      }
+      op.Run(left, right, out, joinD, joinLiteral);
+      drain(&out);
+      op.WaitUntilDone();
+      pthread_join(feedL, NULL);
+      pthread_join(feedR, NULL);
+      return (long) records.size();
+    });
+  }
+
+  vector<Record*> bnlRecords(records.begin(), records.begin() + records.size() / BENCH_BNL_FRACTION);
+
+  measure("relop_join_block_nested_loop", [&](){
+    Pipe left(pipesz), right(pipesz), out(pipesz);
+    pthread_t feedL, feedR;
+    FeedUtil fL, fR;
+    startFeed(&feedL, &fL, &bnlRecords, &left);
+    startFeed(&feedR, &fR, &smallRecords, &right);
+    Join op;
+    op.Use_n_Pages(buffsz);
+    op.UseBlockNestedLoop(false); // the small relation is held in memory
+    op.Run(left, right, out, joinD, joinLiteral);
+    drain(&out);
+    op.WaitUntilDone();
+    pthread_join(feedL, NULL);
+    pthread_join(feedR, NULL);
+    return (long) (bnlRecords.size() + smallRecords.size());
+  });
+
+  // the records with the largest b: all of them sorted, and the first BENCH_TOP_N out of
+  // a sort or out of OrderBy's heap
+  myAtt orderKey = {1, Double};
+  OrderMaker byB;
+  byB.initOrderMaker(1, &orderKey, benchSchema);
+  int orderLimits[] = {NO_LIMIT, BENCH_TOP_N};
+  const char* orderNames[] = {"relop_order_by", "relop_order_by_limit"};
+  for(int l=0;l<2;l++){
+    measure(orderNames[l], [&](){
+      Pipe in(pipesz), out(pipesz);
+      pthread_t feedThread;
+      FeedUtil feed;
+      startFeed(&feedThread, &feed, &records, &in);
+      OrderBy op;
+      op.Use_n_Pages(buffsz);
+      op.SortDescending(true);
+      op.Run(in, out, byB, orderLimits[l]);
+      drain(&out);
+      op.WaitUntilDone();
+      pthread_join(feedThread, NULL);
+      return (long) records.size();
+    });
+  }
+
+  // the first BENCH_TOP_N records a scan accepts: Limit cancels the scan once it has them.
+  // Items are the records in the file, as for relop_select_file
+  measure("relop_limit_select_file", [&](){
+    DBFile dbfile;
+    dbfile.Open(benchHeap);
+    dbfile.MoveFirst();
+    Pipe scanned(pipesz), out(pipesz);
+    SelectFile scan;
+    scan.Use_n_Pages(buffsz);
+    scan.Run(dbfile, scanned, halfA, literal);
+    Limit op;
+    op.Run(scanned, out, BENCH_TOP_N);
+    drain(&out);
+    scan.WaitUntilDone();
+    op.WaitUntilDone();
+    dbfile.Close();
+    return (long) records.size();
+  });
+
+  measure("relop_write_out", [&](){
+    Pipe in(pipesz);
+    pthread_t feedThread;
+    FeedUtil feed;
+    startFeed(&feedThread, &feed, &records, &in);
+    FILE* devNull = fopen("/dev/null", "w");
+    WriteOut op;
+    op.Run(in, devNull, *benchSchema);
+    op.WaitUntilDone();
+    pthread_join(feedThread, NULL);
+    fclose(devNull);
+    return (long) records.size();
+  });
+}
+
+/*******************************************************************************
+ * HashTable on the keys of TPC-H: l_orderkey (1 to 7 line items per order, keys
+ * spread out), (l_partkey, l_suppkey) pairs, the 4 (l_returnflag, l_linestatus)
+ * groups and distinct c_name strings
+ ******************************************************************************/
+void loadTPCH(TPCHGen &gen, const char* relName, vector<Record*> &recs){
+  gen.WriteHeap(relName, tpchHeap);
+  DBFile dbfile;
+  dbfile.Open(tpchHeap);
+  dbfile.MoveFirst();
+  Record rec;
+  while(dbfile.GetNext(rec)){
+    Record* copy = new Record;
+    copy->Consume(&rec);
+    recs.push_back(copy);
+  }
+  dbfile.Close();
+  remove(tpchHeap);
+  remove(tpchMeta);
+}
+
+// key on the attributes names of schema
+void keyOn(OrderMaker &order, Schema &schema, const char* first, const char* second){
+  myAtt atts[2];
+  int numAtts = (second == NULL) ? 1 : 2;
+  const char* names[] = {first, second};
+  for(int i=0;i<numAtts;i++){
+    atts[i].attNo = schema.Find((char*)names[i]);
+    atts[i].attType = schema.FindType((char*)names[i]);
+  }
+  order.initOrderMaker(numAtts, atts, &schema);
+}
+
+// FindOrInsert every record of recs on order, as a group by or a distinct count does
+void benchHashDistinct(const char* name, vector<Record*> &recs, OrderMaker &order){
+  measure(name, [&](){
+    HashTable table(order);
+    Record rec;
+    bool inserted;
+    for(int i=0;i<recs.size();i++){
+      rec.Copy(recs[i]);
+      table.FindOrInsert(&rec, inserted);
+    }
+    return (long) recs.size();
+  });
+}
+
+void benchHashTable(){
+  TPCHGen gen(numRecords / 6000000.0, BENCH_SEED);
+  Schema lineitemSchema((char*)"catalog", (char*)"lineitem");
+  Schema ordersSchema((char*)"catalog", (char*)"orders");
+  Schema customerSchema((char*)"catalog", (char*)"customer");
+  vector<Record*> lineitems, orders, customers;
+  loadTPCH(gen, "lineitem", lineitems);
+  loadTPCH(gen, "orders", orders);
+  loadTPCH(gen, "customer", customers);
+
+  OrderMaker lOrderKey, oOrderKey, partSupp, flagStatus, cName;
+  keyOn(lOrderKey, lineitemSchema, "l_orderkey", NULL);
+  keyOn(oOrderKey, ordersSchema, "o_orderkey", NULL);
+  keyOn(partSupp, lineitemSchema, "l_partkey", "l_suppkey");
+  keyOn(flagStatus, lineitemSchema, "l_returnflag", "l_linestatus");
+  keyOn(cName, customerSchema, "c_name", NULL);
+
+  // the build side of a hash join of orders and lineitem, and its probe side
+  measure("hash_build_l_orderkey", [&](){
+    HashTable table(lOrderKey);
+    Record rec;
+    for(int i=0;i<lineitems.size();i++){
+      rec.Copy(lineitems[i]);
+      table.Insert(&rec);
+    }
+    return (long) lineitems.size();
+  });
+
+  HashTable joinTable(lOrderKey, oOrderKey);
+  Record rec;
+  for(int i=0;i<lineitems.size();i++){
+    rec.Copy(lineitems[i]);
+    joinTable.Insert(&rec);
+  }
+  measure("hash_probe_o_orderkey", [&](){
+    long matches = 0;
+    for(int i=0;i<orders.size();i++){
+      for(int e = joinTable.Find(orders[i]);e != -1;e = joinTable.Next(e))
+        matches++;
+    }
+    if(matches == 0x7fffffff) printf(" "); // keep the compiler from dropping the loop
+    return (long) orders.size();
+  });
+
+  benchHashDistinct("hash_distinct_l_partkey_l_suppkey", lineitems, partSupp);
+  benchHashDistinct("hash_group_l_returnflag_l_linestatus", lineitems, flagStatus);
+  benchHashDistinct("hash_distinct_c_name", customers, cName);
+
+  for(int i=0;i<lineitems.size();i++) delete lineitems[i];
+  for(int i=0;i<orders.size();i++) delete orders[i];
+  for(int i=0;i<customers.size();i++) delete customers[i];
+}
+
+int main(int argc, char* argv[]){
+  if(argc > 1) numRecords = atoi(argv[1]);
+  if(numRecords < BENCH_BNL_FRACTION){
+    cerr << "ERROR: Need at least " << BENCH_BNL_FRACTION << " records" << endl;
+    exit(1);
+  }
+  generate();
+
+  printf("{\"records\": %d, \"page_size\": %d, \"repeats\": %d, \"string_kernels\": \"%s\", \"benchmarks\": [",
+         numRecords, PAGE_SIZE, BENCH_REPEATS, StringCompare::Kernels());
+  benchStorage();
+  benchCompare("compare_int", 0, Int, false);
+  benchCompare("compare_double", 1, Double, false);
+  benchCompare("compare_string", 2, String, false);
+  benchCompare("compare_int_fixed_offset", 0, Int, true);
+  benchCompare("compare_double_fixed_offset", 1, Double, true);
+  benchKeyCompare("key_compare_int", 0, Int);
+  benchKeyCompare("key_compare_double", 1, Double);
+  benchKeyCompare("key_compare_string", 2, String);
+  benchStringCNF("cnf_string_equal", EQUALS, "qwertyuiopasdf");
+  benchStringCNF("cnf_string_less", LESS_THAN, "mmmmmmmm");
+  benchBatchCNF();
+  benchPipe("pipe_1_stage", 0);
+  benchPipe("pipe_2_stages", 1);
+  benchPipe("pipe_4_stages", 3);
+  benchBigQ("bigq_runlen_2", 2);
+  benchBigQ("bigq_runlen_8", 8);
+  benchBigQ("bigq_runlen_64", 64);
+  benchRelOps();
+  benchHashTable();
+  printf("\n]}\n");
+
+  remove(benchText);
+  remove(benchHeap);
+  remove(benchMeta);
+  return 0;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/
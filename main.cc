@@ -43,10 +43,6 @@ void createDB(){
 
   DBFile dbfile;
   rel = new relation (relName, sch, dbfile_dir);
-  char db_path[100]; // construct path of the saved state file
-  sprintf (db_path, "%s%s", dbfile_dir, savedStateFile);
-  ofstream myfile;
-  myfile.open (db_path, ofstream::out | ofstream::app);
 
   if(strcmp(createTableType->heapOrSorted,"HEAP")==0){
     cout << "HEAP DBFile will be placed at " << rel->path () << "..." << endl;
@@ -54,8 +50,7 @@ void createDB(){
     DBinfo[relName]=rel;
     dbfile.Close();
     // for init'ing DBinfo in a3utils.cc/RestoreDBState() the next time the DB is fired up
-    if (myfile.is_open())
-      myfile << relName << endl;
+    dbCatalog.AddRelation(relName, sch);
   }
   else if(strcmp(createTableType->heapOrSorted,"SORTED")==0){
     if(createTableType->sortingAtts==NULL){
@@ -77,12 +72,32 @@ void createDB(){
       DBinfo[relName]=rel;
       dbfile.Close();
       // for init'ing DBinfo in a3utils.cc/RestoreDBState() the next time the DB is fired up
-      if (myfile.is_open())
-        myfile << relName << endl;
+      dbCatalog.AddRelation(relName, sch);
+    }
+  }
+  else if(strcmp(createTableType->heapOrSorted,"TREE")==0){ // B+-tree keyed on the sorting attributes
+    if(createTableType->sortingAtts==NULL){
+      cout << "ERROR: Please enter key attributes." << endl << endl;
+      return;
+    }
+    else{
+      cout << "TREE DBFile will be placed at " << rel->path () << "..." << endl;
+
+      Record literal;
+      CNF sort_pred;
+      sort_pred.GrowFromParseTree (createTableType->sortingAtts, rel->schema (), literal); // constructs CNF predicate based on key attributes
+      OrderMaker sortorder;
+      OrderMaker dummy;
+      sort_pred.GetSortOrders (sortorder, dummy);
+      int runlen = 100; // only used to sort the input of a bulk load
+      struct {OrderMaker *o; int l;} startup = {&sortorder, runlen};
+      dbfile.Create (rel->path(), tree, &startup);
+      DBinfo[relName]=rel;
+      dbfile.Close();
+      // for init'ing DBinfo in a3utils.cc/RestoreDBState() the next time the DB is fired up
+      dbCatalog.AddRelation(relName, sch);
     }
   }
-  myfile.close();
-  RestoreDBState();
 }
 
 /*------------------------------------------------------------------------------
@@ -102,50 +117,53 @@ bool fexists(const char *filename)
 void setupDemo(){
   cout << "--------------------------------------------" << endl;
   cout << "Creating all relation schemas" << endl;
-  char db_path[100]; // construct path of the saved state file
-  // save the state in savedState.txt for the next time we open up the database
-  sprintf (db_path, "%s%s", dbfile_dir, savedStateFile);
-  ofstream myfile;
-  myfile.open (db_path, ofstream::out);
-  if (myfile.is_open()){
-    myfile << supplier << endl;
-    myfile << part << endl;
-    myfile << partsupp << endl;
-    myfile << nation << endl;
-    myfile << lineitem << endl;
-    myfile << region << endl;
-    myfile << orders << endl;
-    myfile << customer << endl;
-  }
-  myfile.close();
+  char *demoRels[] = {supplier, part, partsupp, nation, lineitem, region, orders, customer};
+  int numDemoRels = sizeof(demoRels)/sizeof(char*);
 
-  // create all the relations and assign it to DBinfo
-  RestoreDBState();
+  // add the schemas we don't have yet to the catalog. It remembers them
+  // for the next time we open up the database
+  unordered_map<string, Schema*> textSchemas;
+  Catalog::ReadTextSchemas(catalog_path, textSchemas);
+  for (int i = 0; i < numDemoRels; i++){
+    if (!DBinfo.count(demoRels[i]) && textSchemas.count(demoRels[i])){
+      dbCatalog.AddRelation(demoRels[i], textSchemas[demoRels[i]]);
+      textSchemas.erase(demoRels[i]);
+      DBinfo[demoRels[i]] = new relation (demoRels[i], dbCatalog.GetSchema(demoRels[i]), dbfile_dir);
+    }
+  }
+  for (auto it = textSchemas.begin(); it != textSchemas.end(); ++it)
+    delete it->second;
 
   cout << "--------------------------------------------" << endl;
   cout << "Creating bin files..." << endl << endl;
-  ifstream infile;
-  infile.open(db_path);
-  string buffer;
   char tbl_path[100]; // construct path of the tpch bulk data file
-  while (getline(infile, buffer)){ // while the file has more lines.
-    if(fexists(DBinfo[buffer]->path())){
-      cout << DBinfo[buffer]->path() << " already exists. No need to create." << endl;
+  for (int i = 0; i < numDemoRels; i++){
+    if(!DBinfo.count(demoRels[i])){
+      cout << "No schema for " << demoRels[i] << " in " << catalog_path << ". Skipping it." << endl;
+    }
+    else if(fexists(DBinfo[demoRels[i]]->path())){
+      cout << DBinfo[demoRels[i]]->path() << " already exists. No need to create." << endl;
     }
     else{
       DBFile dbfile;
-      cout << DBinfo[buffer]->path() << " does not exist. Creating it." << endl;
-      sprintf (tbl_path, "%s%s.tbl", tpch_dir, (char*)buffer.c_str());
+      cout << DBinfo[demoRels[i]]->path() << " does not exist. Creating it." << endl;
+      sprintf (tbl_path, "%s%s.tbl", tpch_dir, demoRels[i]);
+      if(!fexists(tbl_path) && TPCHGen::Knows(demoRels[i])){
+        // no dbgen output: generate the data straight into the heap file
+        cout << "No " << tbl_path << ". Generating " << demoRels[i] << " at scale " << tpchScale << "..." << endl;
+        TPCHGen gen (tpchScale, tpchSeed);
+        cout << gen.WriteHeap (demoRels[i], DBinfo[demoRels[i]]->path()) << " records generated" << endl;
+        continue;
+      }
       cout << "Inserting data from " << tbl_path << "..." << endl;
-      dbfile.Create (DBinfo[buffer]->path(), heap, NULL);
+      dbfile.Create (DBinfo[demoRels[i]]->path(), heap, NULL);
       dbfile.Close();
-      dbfile.Open (DBinfo[buffer]->path());
-      dbfile.Load (*(DBinfo[buffer]->schema ()), tbl_path);
+      dbfile.Open (DBinfo[demoRels[i]]->path());
+      dbfile.Load (*(DBinfo[demoRels[i]]->schema ()), tbl_path);
       dbfile.Close();
     }
   }
   cout << "--------------------------------------------" << endl << endl;
-  infile.close();
 }
 
 /*------------------------------------------------------------------------------
@@ -202,30 +220,25 @@ void dropTable(){
     perror( "ERROR: Cannot delete .bin" );
   if( remove( db_path ) != 0 )
     perror( "ERROR: Cannot delete .bin.meta" );
-  DBinfo.erase(relName);
-  delete rel;
-  cout << "INFO: Table Dropped" << endl;
-
-  // update the saved database state file so we can init DBinfo in
-  // a3utils.cc/RestoreDBState() the next time the DB is fired up
-  sprintf (db_path, "%s%s", dbfile_dir, savedStateFile);
-  ifstream infile;
-  infile.open(db_path);
-  string buffer;
-
-  ofstream tempFile ("temp");
-
-  while (getline(infile, buffer)){ // while the file has more lines.
-    if(buffer.compare(relName)!=0)
-      tempFile << buffer << endl;
+  sprintf (db_path, "%s%s.bin.idx", dbfile_dir, relName);
+  remove( db_path ); // index of a tree dbfile. not there for heap or sorted
+  for(int i=0;;i++){ // delta runs of a sorted dbfile. numbered from 0 with no gaps
+    sprintf (db_path, "%s%s.bin.delta%d", dbfile_dir, relName, i);
+    if( remove( db_path ) != 0 ) break;
+  }
+  // forget the relation and every alias of it that an earlier query set up
+  for (auto it = DBinfo.begin(); it != DBinfo.end(); ){
+    if (it->second == rel)
+      it = DBinfo.erase(it);
+    else
+      ++it;
   }
-  infile.close();
-  tempFile.close();
-
-  remove(db_path);
-  rename("temp",db_path);
 
-  RestoreDBState();
+  // update the catalog so we can init DBinfo in
+  // a3utils.cc/RestoreDBState() the next time the DB is fired up
+  dbCatalog.DropRelation(relName); // also deletes the schema
+  delete rel;
+  cout << "INFO: Table Dropped" << endl;
 }
 
 /*------------------------------------------------------------------------------
@@ -268,6 +281,7 @@ int main () {
      * 6 if the command is 'quit'
      * 7 if the command is 'setupDemo'
      * 8 if the command is 'UPDATE STATISTICS'
+     * 9 if the command is 'EXPLAIN ANALYZE' followed by a SQL command
      *******************************************/
    switch (commandFlag){
      case 1:
@@ -294,8 +308,7 @@ int main () {
        break;
      case 5:
        Qrenaming();
-       queryPlanning();
-       if(performExecution)
+       if(queryPlanning() && performExecution)
          queryExecution();
        break;
      case 6:
@@ -308,11 +321,17 @@ int main () {
      case 8:
        updateStatistics();
        break;
+     case 9:
+       Qrenaming();
+       if(queryPlanning())
+         explainAnalyze(); // runs the query even with SET OUTPUT NONE; that's the point
+       break;
      case -1:
        cout << "ERROR: Please check your command syntax." << endl;
        break;
     }
 
+    RecordPool::Trim(); // the command's records are all gone; give their memory back in bulk
     cout << "time elapsed: " << t.elapsed() << "s. " << endl << endl;
     commandFlag=-1;
   }
@@ -13,10 +13,17 @@
 #include "Comparison.h"
 #include "a3utils.h"
 #include "Defs.h"
+#include "BloomFilter.h"
 
 using namespace std;
 extern unordered_map<string, relation*> DBinfo;
 
+// Physical cost model. Costs are in page I/Os; CPU work is converted at the rate below
+#define COST_PER_COMPARISON 0.00002 // a record comparison, as a fraction of a page I/O
+#define MIN_OP_PAGES 4              // least memory the planner gives an operation
+#define DEFAULT_RECORD_WIDTH 64     // bytes per record when a relation has no pages or statistics
+#define STRING_KEY_WIDTH 16         // bytes a String join attribute is guessed to take in a key record
+
 /*******************************************************************************
  * Helper function to print output schema of each node
  ******************************************************************************/
@@ -40,6 +47,63 @@ void PrintOutputSchema(Schema* s){
   }
 }
 
+/*******************************************************************************
+ * Helper functions to work out which attributes a node has to output. What the
+ * query outputs is in queryAtts, and the uses of attributes by the conjuncts that
+ * are not nodes yet in pendingAttUses (see FindQueryAtts in a4-2utils.h)
+ ******************************************************************************/
+// the times conjunct (NULL for none) compares the attribute name
+int ConjunctAttUses(char *name, struct AndList *conjunct){
+  int uses = 0;
+  if(conjunct == NULL)
+    return 0;
+  for(struct OrList *o = conjunct->left;o;o = o->rightOr){
+    if(o->left->left->code == NAME && strcmp(o->left->left->value, name) == 0) uses++;
+    if(o->left->right->code == NAME && strcmp(o->left->right->value, name) == 0) uses++;
+  }
+  return uses;
+}
+
+// conjunct has been made into a node; its attributes are one use less pending
+void UseConjunctAtts(struct AndList *conjunct){
+  for(struct OrList *o = conjunct->left;o;o = o->rightOr){
+    if(o->left->left->code == NAME && pendingAttUses.count(o->left->left->value)) pendingAttUses[o->left->left->value]--;
+    if(o->left->right->code == NAME && pendingAttUses.count(o->left->right->value)) pendingAttUses[o->left->right->value]--;
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * The attributes of s still needed above the node being made for conjunct: the
+ * query outputs them, or a conjunct other than this one compares them. Their
+ * numbers go in keep (which must hold all of s's), and numKeep is set. Returns
+ * their schema, or NULL if all of them are needed (or none, or the query doesn't
+ * say which)
+ *----------------------------------------------------------------------------*/
+Schema* KeptSchema(Schema *s, struct AndList *conjunct, int *keep, int &numKeep){
+  int numAtts = s->GetNumAtts();
+  numKeep = numAtts;
+  if(queryAtts.empty())
+    return NULL;
+  Attribute* atts = s->GetAtts();
+  Attribute* keptAtts = new Attribute[numAtts];
+  int numKept = 0;
+  for(int i=0;i<numAtts;i++){
+    auto pending = pendingAttUses.find(atts[i].name);
+    int usesLeft = (pending == pendingAttUses.end()) ? 0 : pending->second - ConjunctAttUses(atts[i].name, conjunct);
+    if(!queryAtts.count(atts[i].name) && usesLeft <= 0)
+      continue;
+    keep[numKept] = i;
+    keptAtts[numKept++] = atts[i];
+  }
+  Schema* kept = NULL;
+  if(numKept > 0 && numKept < numAtts){ // nothing to gain, or nothing would be left
+    kept = new Schema("keptSchema", numKept, keptAtts);
+    numKeep = numKept;
+  }
+  delete [] keptAtts;
+  return kept;
+}
+
 /*******************************************************************************
  * Generic base class for the different query tree nodes
  ******************************************************************************/
@@ -54,9 +118,17 @@ class GenericQTreeNode {
     Pipe* outpipe;
     int pipeID;
 
+    // filled in by the planner (a4-2utils.h)
+    double estTuples; // estimated number of output records. -1 until the planner knows
+    double estWidth;  // estimated bytes per output record
+    int memPages;     // pages of memory given to the operation (Use_n_Pages)
+
     GenericQTreeNode(){
       left = NULL;
       right = NULL;
+      estTuples = -1;
+      estWidth = DEFAULT_RECORD_WIDTH;
+      memPages = buffsz;
 
       // create the output pipe so that we can call Run on the nodes
       // without worrying about the order of traversal of the tree
@@ -70,8 +142,65 @@ class GenericQTreeNode {
     virtual void Print(){};
     virtual void Run(){};
     virtual void WaitUntilDone(){};
+
+    // the relational operation doing the node's work and its name. used by EXPLAIN ANALYZE
+    virtual RelationalOp* Operation(){ return NULL; };
+    virtual string Name(){ return ""; };
+
+    // try to apply a join's Bloom filter somewhere in this subtree, as close to the disk as
+    // possible. attNames are the attributes the filter is probed with. Returns false if no
+    // operation in the subtree can apply it
+    virtual bool PushBloomFilter(BloomFilter* bf, vector<string> &attNames){ return false; };
+
+    // false if the node can't do what the query asked of it, which is then not run
+    virtual bool Valid(){ return true; };
+
+    // work out estTuples (unless the planner already has) and estWidth from the children's.
+    // Called bottom-up. By default the output looks like the left input
+    virtual void EstimateSize(){
+      if(estTuples < 0) estTuples = left->estTuples;
+      estWidth = left->estWidth;
+    };
+
+    // choose how to do the operation when it has about pages pages of memory
+    virtual void ChooseAlgorithm(int pages){};
+
+    // pages of memory the operation could make use of; 0 if it just streams its input
+    virtual double MemoryWanted(){ return 0; };
+
+    // estimated size of the output in pages
+    double EstPages(){
+      double pages = estTuples * estWidth / PAGE_SIZE;
+      return (pages < 1) ? 1 : pages;
+    };
+
+    // print the planner's estimates
+    void PrintEstimates(){
+      cout << "Estimated output: " << (long long) estTuples << " records, " << (long long) EstPages() << " pages" << endl;
+      if(MemoryWanted() > 0)
+        cout << "Memory: " << memPages << " pages" << endl;
+    };
 };
 
+/*******************************************************************************
+ * Helper function to build the OrderMaker a Bloom filter is probed with on
+ * records of schema s. Returns false if s doesn't have all of attNames
+ ******************************************************************************/
+bool BloomProbeOrder(Schema* s, vector<string> &attNames, OrderMaker &probeAtts){
+  myAtt* atts = new myAtt[attNames.size()];
+  for(int i=0;i<attNames.size();i++){
+    atts[i].attNo = s->Find((char*)attNames[i].c_str());
+    atts[i].attType = s->FindType((char*)attNames[i].c_str());
+    if(atts[i].attNo == -1){
+      delete [] atts;
+      return false;
+    }
+  }
+  probeAtts.initOrderMaker(attNames.size(),atts);
+  delete [] atts;
+  return true;
+}
+
 /*******************************************************************************
  * Tree Node for Select Pipe operation
  * There may be more than one of these in the query tree.
@@ -126,12 +255,13 @@ class Selection_PNode : virtual public GenericQTreeNode {
       PrintOutputSchema(left->schema());
       cout << "Select CNF: " << endl << "    ";
       cnf_pred.Print();
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
     void Run(){
       // cout << "selectpipe started" << endl; // debug
-      SP.Use_n_Pages (buffsz);
+      SP.Use_n_Pages (memPages);
       SP.Run (*(left->outpipe), *outpipe, cnf_pred, literal); // Select Pipe takes its input from its left child's
                                                               // outPipe. Its right child is NULL.
     };
@@ -140,6 +270,18 @@ class Selection_PNode : virtual public GenericQTreeNode {
       // cout << "selectpipe ended" << endl; // debug
       SP.WaitUntilDone ();
     }
+
+    RelationalOp* Operation(){ return &SP; }
+
+    string Name(){ return "SELECT PIPE"; }
+
+    bool PushBloomFilter(BloomFilter* bf, vector<string> &attNames){
+      if(left->PushBloomFilter(bf,attNames)) return true; // the closer to the disk the better
+      OrderMaker probeAtts;
+      if(!BloomProbeOrder(rschema,attNames,probeAtts)) return false;
+      SP.AddBloomFilter(bf,probeAtts);
+      return true;
+    }
 };
 
 /*******************************************************************************
@@ -154,6 +296,8 @@ class Selection_FNode : virtual public GenericQTreeNode {
     CNF cnf_pred;
     SelectFile SF;
     DBFile dbfile;
+    int* keepAtts;      // attributes of the relation in the output (see SelectFile.KeepAtts); NULL: all
+    int numKeepAtts;
   public:
     Selection_FNode(struct AndList &dummy, string &RelName, unordered_map<string, GenericQTreeNode*> &relNameToTreeMap, int pipeIDcounter){
       GenericQTreeNode();
@@ -162,8 +306,18 @@ class Selection_FNode : virtual public GenericQTreeNode {
       // use a stringstream to store output from the recursive call of PrintOrList
       rel = DBinfo[RelName];
 
-      // init the schema
+      // init the schema: the attributes of the relation still needed above the scan
       rschema = rel->schema();
+      keepAtts = new int[rschema->GetNumAtts()];
+      Schema* kept = KeptSchema(rschema, &dummy, keepAtts, numKeepAtts);
+      if(kept != NULL){
+        rschema = kept;
+        SF.KeepAtts(keepAtts, numKeepAtts, rel->schema());
+      }
+      else{
+        delete [] keepAtts;
+        keepAtts = NULL;
+      }
 
       pipeID = pipeIDcounter;
 
@@ -187,9 +341,12 @@ class Selection_FNode : virtual public GenericQTreeNode {
       cout << "   SELECT FILE OPERATION" << endl;
       cout << "   ---------------------" << endl;
       cout << "Output pipe ID: " << pipeID << endl;
-      PrintOutputSchema(rel->schema());
+      PrintOutputSchema(rschema);
       cout << "CNF: " << endl << "    ";
       cnf_pred.Print();
+      if(keepAtts != NULL)
+        cout << "Keeps " << numKeepAtts << " of the " << rel->schema()->GetNumAtts() << " attributes of the relation" << endl;
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
@@ -197,7 +354,7 @@ class Selection_FNode : virtual public GenericQTreeNode {
       // cout << "selectfile started" << endl; // debug
       dbfile.Open (rel->path());
       //dbfile.MoveFirst();
-      SF.Use_n_Pages (buffsz);
+      SF.Use_n_Pages (memPages);
       SF.Run (dbfile, *outpipe, cnf_pred, literal); // Select File takes its input from the disk.
     };
 
@@ -206,6 +363,34 @@ class Selection_FNode : virtual public GenericQTreeNode {
       SF.WaitUntilDone ();
       dbfile.Close();
     }
+
+    RelationalOp* Operation(){ return &SF; }
+
+    string Name(){ return "SELECT FILE"; }
+
+    bool PushBloomFilter(BloomFilter* bf, vector<string> &attNames){
+      OrderMaker probeAtts;
+      if(!BloomProbeOrder(rschema,attNames,probeAtts)) return false;
+      SF.AddBloomFilter(bf,probeAtts);
+      return true;
+    }
+
+    // the record width comes from the size of the file on disk, and the share of the
+    // attributes kept. Without a selection the planner hasn't estimated the output,
+    // which is then the whole relation. The data pages of every file type are in the
+    // File at the relation's path; the DBFile isn't opened, as opening a sorted file
+    // can rewrite it
+    void EstimateSize(){
+      int relTuples = stats.GetRelSize(rel->name());
+      File file;
+      file.Open (1, rel->path());
+      int relPages = (file.GetLength() > 0) ? file.GetLength() - 1 : 0;
+      file.Close();
+      if(relTuples > 0 && relPages > 0)
+        estWidth = (double) relPages * PAGE_SIZE / relTuples * numKeepAtts / rel->schema()->GetNumAtts();
+      if(estTuples < 0)
+        estTuples = (relTuples < 0) ? 0 : relTuples;
+    };
 };
 
 /*******************************************************************************
@@ -295,12 +480,20 @@ class ProjectNode : virtual public GenericQTreeNode {
       PrintOutputSchema(rschema);
       cout << "Project Attributes:" << endl;
       PrintNameList(&PAtts);
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
+    // the width shrinks with the number of attributes kept
+    void EstimateSize(){
+      estTuples = left->estTuples;
+      estWidth = left->estWidth * numAttsOut / numAttsIn;
+    };
+
     void Run(){
       // cout << "project started" << endl; // debug
-      P.Use_n_Pages (buffsz);
+      P.Use_n_Pages (memPages);
+      P.UseSchema (left->schema()); // lay the output out by rschema
       P.Run (*(left->outpipe), *outpipe, keepMe, numAttsIn, numAttsOut); // Project takes its input from its left child's
                                                                          // outPipe. Its right child is NULL.
     };
@@ -309,6 +502,10 @@ class ProjectNode : virtual public GenericQTreeNode {
       // cout << "project ended" << endl; // debug
       P.WaitUntilDone ();
     }
+
+    RelationalOp* Operation(){ return &P; }
+
+    string Name(){ return "PROJECT"; }
 };
 
 /*******************************************************************************
@@ -351,12 +548,18 @@ class DupRemNode : virtual public GenericQTreeNode {
       cout << "Input pipe ID: " << left->pipeID << endl;
       cout << "Output pipe ID: " << pipeID << endl;
       PrintOutputSchema(rschema);
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
+    // sorts its input
+    double MemoryWanted(){
+      return left->EstPages();
+    };
+
     void Run(){
       // cout << "dupremoval started" << endl; // debug
-      D.Use_n_Pages (buffsz);
+      D.Use_n_Pages (memPages);
       D.Run (*(left->outpipe), *outpipe, *rschema); // DuplicateRemoval takes its input from its left child's
                                                     // outPipe. Its right child is NULL.
     };
@@ -366,6 +569,207 @@ class DupRemNode : virtual public GenericQTreeNode {
       D.WaitUntilDone ();
     }
 
+    RelationalOp* Operation(){ return &D; }
+
+    string Name(){ return "DUPLICATE REMOVAL"; }
+
+};
+
+/*******************************************************************************
+ * Tree Node for Order By operation (ORDER BY, with or without a LIMIT)
+ * Only ONE instance of this node will be in the Query Tree at any given time,
+ * at its root: it orders the output of the query.
+ ******************************************************************************/
+class OrderByNode : virtual public GenericQTreeNode {
+  private:
+    OrderBy O;
+    OrderMaker sortOrder;
+    vector<string> orderNames; // used for printing in Print()
+    int descending;
+    int limit; // NO_LIMIT if none
+    bool allFound; // false if an ORDER BY attribute is not in the output
+
+  public:
+    OrderByNode(NameList *oAtts, int descending, int limit, GenericQTreeNode* &root, int& pipeIDcounter){
+      GenericQTreeNode();
+      left = root;
+      root = this;
+
+      // inherit the schema from its left child
+      rschema = left->schema();
+
+      this->descending = descending;
+      this->limit = limit;
+      allFound = true;
+
+      // the parser lists the attributes last first
+      vector<char*> names;
+      for(NameList* n = oAtts;n;n = n->next)
+        names.insert(names.begin(),n->name);
+
+      // the attributes must be in the output of the query; the projection will have
+      // dropped the relation name in front of them
+      myAtt* orderMakerAtts = new myAtt[names.size()];
+      int numOrderAtts = 0;
+      for(int i=0;i<names.size();i++){
+        char* name = names[i];
+        if(rschema->Find(name) == -1 && strchr(name,'.') != NULL)
+          name = strchr(name,'.')+1;
+        if(rschema->Find(name) == -1){
+          cerr << "ERROR: ORDER BY attribute " << names[i] << " is not in the output of the query" << endl;
+          allFound = false;
+          continue;
+        }
+        orderMakerAtts[numOrderAtts].attNo = rschema->Find(name);
+        orderMakerAtts[numOrderAtts].attType = rschema->FindType(name);
+        numOrderAtts++;
+        orderNames.push_back(name);
+      }
+      sortOrder.initOrderMaker(numOrderAtts,orderMakerAtts,rschema);
+      delete [] orderMakerAtts;
+
+      pipeID = pipeIDcounter;
+      pipeIDcounter++; // increment for next guy
+    };
+
+    Schema* schema () {
+      return rschema;
+    }
+
+    ~OrderByNode(){
+    };
+
+    // the query is not run without the ordering it asked for
+    bool Valid(){
+      return allFound;
+    };
+
+    // true if the first limit records are expected to fit in the node's memory
+    bool TopNFits(){
+      return limit != NO_LIMIT && limit * estWidth <= (double) memPages * PAGE_SIZE;
+    };
+
+    void Print(){
+      cout << endl;
+      cout << "***************************" << endl;
+      cout << "     ORDER BY OPERATION" << endl;
+      cout << "     ------------------" << endl;
+      cout << "Input pipe ID: " << left->pipeID << endl;
+      cout << "Output pipe ID: " << pipeID << endl;
+      PrintOutputSchema(rschema);
+      cout << "Order Attributes:" << endl;
+      for(int i=0;i<orderNames.size();i++)
+        cout << "    " << orderNames[i] << endl;
+      cout << (descending ? "Descending" : "Ascending") << endl;
+      if(limit != NO_LIMIT){
+        cout << "Limit: " << limit << endl;
+        if(TopNFits())
+          cout << "Keeps the first " << limit << " records in a heap in memory" << endl;
+        else
+          cout << "Sorts its input; the first " << limit << " records would not fit in memory" << endl;
+      }
+      PrintEstimates();
+      cout << "***************************" << endl;
+    };
+
+    void EstimateSize(){
+      estTuples = (limit != NO_LIMIT && limit < left->estTuples) ? limit : left->estTuples;
+      estWidth = left->estWidth;
+    };
+
+    // a heap of limit records, or its input to sort
+    double MemoryWanted(){
+      if(limit == NO_LIMIT)
+        return left->EstPages();
+      double pages = limit * estWidth / PAGE_SIZE;
+      if(pages < 1) pages = 1;
+      return (pages < left->EstPages()) ? pages : left->EstPages();
+    };
+
+    void Run(){
+      // cout << "orderby started" << endl; // debug
+      O.Use_n_Pages (memPages);
+      O.SortDescending (descending);
+      O.Run (*(left->outpipe), *outpipe, sortOrder, limit); // OrderBy takes its input from its left child's
+                                                            // outPipe. Its right child is NULL.
+    };
+
+    void WaitUntilDone(){
+      // cout << "orderby ended" << endl; // debug
+      O.WaitUntilDone ();
+    }
+
+    RelationalOp* Operation(){ return &O; }
+
+    string Name(){ return "ORDER BY"; }
+
+};
+
+/*******************************************************************************
+ * Tree Node for Limit operation (LIMIT without ORDER BY)
+ * Only ONE instance of this node will be in the Query Tree at any given time,
+ * at its root.
+ ******************************************************************************/
+class LimitNode : virtual public GenericQTreeNode {
+  private:
+    Limit L;
+    int limit;
+
+  public:
+    LimitNode(int limit, GenericQTreeNode* &root, int& pipeIDcounter){
+      GenericQTreeNode();
+      left = root;
+      root = this;
+
+      // inherit the schema from its left child
+      rschema = left->schema();
+
+      this->limit = limit;
+
+      pipeID = pipeIDcounter;
+      pipeIDcounter++; // increment for next guy
+    };
+
+    Schema* schema () {
+      return rschema;
+    }
+
+    ~LimitNode(){
+    };
+
+    void Print(){
+      cout << endl;
+      cout << "***************************" << endl;
+      cout << "      LIMIT OPERATION" << endl;
+      cout << "      ---------------" << endl;
+      cout << "Input pipe ID: " << left->pipeID << endl;
+      cout << "Output pipe ID: " << pipeID << endl;
+      PrintOutputSchema(rschema);
+      cout << "Limit: " << limit << endl;
+      PrintEstimates();
+      cout << "***************************" << endl;
+    };
+
+    void EstimateSize(){
+      estTuples = (limit < left->estTuples) ? limit : left->estTuples;
+      estWidth = left->estWidth;
+    };
+
+    void Run(){
+      // cout << "limit started" << endl; // debug
+      L.Run (*(left->outpipe), *outpipe, limit); // Limit takes its input from its left child's
+                                                 // outPipe. Its right child is NULL.
+    };
+
+    void WaitUntilDone(){
+      // cout << "limit ended" << endl; // debug
+      L.WaitUntilDone ();
+    }
+
+    RelationalOp* Operation(){ return &L; }
+
+    string Name(){ return "LIMIT"; }
+
 };
 
 /*******************************************************************************
@@ -420,12 +824,19 @@ class SumNode : virtual public GenericQTreeNode {
       PrintOutputSchema(rschema);
       cout << "Corresponding Function: " << endl;
       Func.Print(funcOperator,*rschema);
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
+    // one Double
+    void EstimateSize(){
+      estTuples = 1;
+      estWidth = 2 * sizeof (int) + sizeof (double);
+    };
+
     void Run(){
       // cout << "sum started" << endl; // debug
-      S.Use_n_Pages (buffsz);
+      S.Use_n_Pages (memPages);
       S.Run (*(left->outpipe), *outpipe, Func); // Sum takes its input from its left child's
                                                     // outPipe. Its right child is NULL.
     };
@@ -435,6 +846,10 @@ class SumNode : virtual public GenericQTreeNode {
       S.WaitUntilDone ();
     }
 
+    RelationalOp* Operation(){ return &S; }
+
+    string Name(){ return "SUM"; }
+
 };
 
 /*******************************************************************************
@@ -500,7 +915,7 @@ class Group_byNode : virtual public GenericQTreeNode {
 
       this->funcOperator=funcOperator;
 
-      grp_order.initOrderMaker(numGroupingAtts-1,orderMakerAtts);
+      grp_order.initOrderMaker(numGroupingAtts-1,orderMakerAtts,left->schema());
 
       pipeID = pipeIDcounter;
       pipeIDcounter++; // increment for next guy
@@ -525,12 +940,24 @@ class Group_byNode : virtual public GenericQTreeNode {
       PrintNameList(&GAtts);
       cout << "Aggregate Function:" << endl;
       Func.Print(funcOperator,*rschema);
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
+    // at most one group per input record; sorts its input
+    void EstimateSize(){
+      estTuples = left->estTuples;
+      estWidth = left->estWidth;
+    };
+
+    double MemoryWanted(){
+      return left->EstPages();
+    };
+
     void Run(){
       // cout << "groupby started" << endl; // debug
-      G.Use_n_Pages (buffsz);
+      G.Use_n_Pages (memPages);
+      G.UseSchema (left->schema()); // lay the output out by rschema
       G.Run (*(left->outpipe), *outpipe, grp_order, Func); // GroupBy takes its input from its left child's
                                                            // outPipe. Its right child is NULL.
     };
@@ -540,6 +967,10 @@ class Group_byNode : virtual public GenericQTreeNode {
       G.WaitUntilDone ();
     }
 
+    RelationalOp* Operation(){ return &G; }
+
+    string Name(){ return "GROUP BY"; }
+
 };
 
 /*******************************************************************************
@@ -552,6 +983,16 @@ class JoinNode : virtual public GenericQTreeNode {
     Record literal;
     CNF cnf_pred;
     Join J;
+    BloomFilter* bloom; // NULL for block nested loop joins
+    bool bloomPushed;   // true: the filter is applied below the right input
+    int algorithm;      // JOIN_SORT_MERGE or JOIN_BLOCK_NESTED_LOOP, picked by ChooseAlgorithm
+    bool blockLeft;     // block nested loop: hold the left input in memory instead of the right
+    double cost;        // estimated cost of the chosen algorithm, in page I/Os
+    int* keepAtts;      // attributes of the inputs in the output (see Join.KeepAtts); NULL: all
+    int numKeepAtts;
+    int numAttsIn;      // attributes of the two inputs together
+    bool lateLeft;      // sort-merge: materialize the left/right input late (see Join)
+    bool lateRight;
 
   public:
     JoinNode(struct AndList &dummy, string &RelName0, string &RelName1, unordered_map<string,GenericQTreeNode*> &relNameToTreeMap, int& pipeIDcounter,unordered_map<string, string> &nodeAlias){
@@ -621,14 +1062,127 @@ class JoinNode : virtual public GenericQTreeNode {
         if((it->second).compare(RelName1)==0)it->second = RelName0;
       }
 
-      // create the schema that will be used for parents of this node
+      // create the schema that will be used for parents of this node: the attributes of both
+      // inputs, less those the query makes no use of (see FindQueryAtts)
       rschema=left->schema();
       rschema=rschema->mergeSchema(right->schema());
+      KeepQueryAtts(&dummy);
 
       pipeID=pipeIDcounter;
 
       // create the CNF from schema.
       cnf_pred.GrowFromParseTree (&dummy, left->schema(), right->schema(), literal);
+
+      bloom = NULL;
+      bloomPushed = false;
+      OrderMaker leftOrder, rightOrder;
+      algorithm = cnf_pred.GetSortOrders(leftOrder, rightOrder) ? JOIN_SORT_MERGE : JOIN_BLOCK_NESTED_LOOP;
+      blockLeft = false;
+      cost = 0;
+      lateLeft = false;
+      lateRight = false;
+    };
+
+    // Narrow rschema down to the attributes still needed above the join (see KeptSchema)
+    // and have the join output only those, so records carry no attribute that no
+    // operation above will look at
+    void KeepQueryAtts(struct AndList *conjunct){
+      numAttsIn = rschema->GetNumAtts();
+      keepAtts = new int[numAttsIn];
+      Schema* kept = KeptSchema(rschema, conjunct, keepAtts, numKeepAtts);
+      if(kept == NULL){
+        delete [] keepAtts;
+        keepAtts = NULL;
+        return;
+      }
+      rschema = kept;
+      int numAttsLeft = left->schema()->GetNumAtts();
+      int fromLeft = 0;
+      for(int i=0;i<numKeepAtts;i++){ // numbers in the right record for the right attributes
+        if(keepAtts[i] < numAttsLeft) fromLeft++;
+        else keepAtts[i] -= numAttsLeft;
+      }
+      J.KeepAtts(keepAtts, numKeepAtts, fromLeft);
+    };
+
+    void EstimateSize(){
+      if(estTuples < 0) estTuples = left->estTuples * right->estTuples;
+      estWidth = (left->estWidth + right->estWidth) * numKeepAtts / numAttsIn; // the attributes kept of both inputs
+    };
+
+    // Pages of I/O that materializing an input late saves over sorting it whole, or a
+    // negative number if it doesn't pay. It only pays if the input would spill: its
+    // records are then written to the stash once and read back once per page missed
+    // (the records that join come in key order, not in stash order), and only its
+    // keys, order's attributes and a page and a slot, are sorted
+    double LateSavings(GenericQTreeNode* input, OrderMaker &order, int pages){
+      double inputPages = input->EstPages();
+      if(inputPages <= pages)
+        return -1;
+      double keyWidth = sizeof(int) * (order.getNumAtts() + 5);
+      for(int i=0;i<order.getNumAtts();i++){
+        Type type = order.getWhichTypes()[i];
+        keyWidth += (type == Int) ? sizeof(int) : ((type == Double) ? sizeof(double) : STRING_KEY_WIDTH);
+      }
+      double keyPages = input->estTuples * keyWidth / PAGE_SIZE;
+      double fetched = (estTuples < input->estTuples) ? estTuples : input->estTuples;
+      double lateCost = inputPages + (keyPages > pages ? 2 * keyPages : 0) + fetched * (1 - pages / inputPages);
+      return 2 * inputPages - lateCost;
+    };
+
+    // Cost of each way of doing the join with pages pages of memory; pick the cheapest.
+    // Sort-merge: the BigQs write both inputs out as sorted runs and read them back once.
+    // Block nested loop: the block side is read once, the other side is written to disk
+    // once and read back once per block; every pair of records is compared.
+    void ChooseAlgorithm(int pages){
+      double leftPages = left->EstPages(), rightPages = right->EstPages();
+      double comparePairs = left->estTuples * right->estTuples * COST_PER_COMPARISON;
+      double bnlRightCost = leftPages + leftPages * ceil(rightPages / pages) + comparePairs;
+      double bnlLeftCost = rightPages + rightPages * ceil(leftPages / pages) + comparePairs;
+      blockLeft = bnlLeftCost < bnlRightCost;
+      cost = blockLeft ? bnlLeftCost : bnlRightCost;
+
+      if(algorithm == JOIN_SORT_MERGE){ // only possible with an equality
+        double sortCost = 2 * (leftPages + rightPages) + COST_PER_COMPARISON *
+                          (left->estTuples * log2(left->estTuples + 1) + right->estTuples * log2(right->estTuples + 1) +
+                           left->estTuples + right->estTuples);
+        if(sortCost <= cost) cost = sortCost;
+        else algorithm = JOIN_BLOCK_NESTED_LOOP;
+      }
+
+      // a sort-merge join builds a Bloom filter on the left join keys. Hand it to the operation
+      // reading the right relation off the disk if there is one, so records that can't join
+      // never get into a pipe
+      if(algorithm == JOIN_SORT_MERGE){
+        OrderMaker leftOrder, rightOrder;
+        cnf_pred.GetSortOrders(leftOrder, rightOrder);
+        bloom = new BloomFilter();
+        vector<string> attNames;
+        Attribute* rightAtts = right->schema()->GetAtts();
+        for(int i=0;i<rightOrder.getNumAtts();i++){
+          attNames.push_back(rightAtts[rightOrder.getWhichAtts()[i]].name);
+        }
+        bloomPushed = right->PushBloomFilter(bloom,attNames);
+        J.SetBloomFilter(bloom,bloomPushed);
+
+        // sort only the keys of an input whose records are too wide to sort cheaply
+        double savedLeft = LateSavings(left, leftOrder, pages);
+        double savedRight = LateSavings(right, rightOrder, pages);
+        lateLeft = savedLeft > 0;
+        lateRight = savedRight > 0;
+        if(lateLeft) cost -= savedLeft;
+        if(lateRight) cost -= savedRight;
+        J.UseLateMaterialization(lateLeft,lateRight);
+      }
+      else
+        J.UseBlockNestedLoop(blockLeft);
+    };
+
+    // sort-merge: as much of both inputs as possible; block nested loop: all of the block side
+    double MemoryWanted(){
+      if(algorithm == JOIN_SORT_MERGE)
+        return left->EstPages() + right->EstPages();
+      return (blockLeft ? left->EstPages() : right->EstPages()) + 1;
     };
 
     Schema* schema () {
@@ -636,6 +1190,7 @@ class JoinNode : virtual public GenericQTreeNode {
     }
 
     ~JoinNode(){
+      delete bloom; // the operations it was handed to only borrow it
     };
 
     void Print(){
@@ -649,12 +1204,25 @@ class JoinNode : virtual public GenericQTreeNode {
       PrintOutputSchema(rschema);
       cout << "Join CNF: " << endl << "    ";
       cnf_pred.Print();
+      if(algorithm == JOIN_SORT_MERGE)
+        cout << "Algorithm: sort-merge";
+      else
+        cout << "Algorithm: block nested loop, " << (blockLeft ? "left" : "right") << " input in memory";
+      cout << " (estimated cost " << (long long) cost << " page I/Os)" << endl;
+      if(bloom != NULL)
+        cout << "Bloom filter on left join keys, " << (bloomPushed ? "pushed down the right input" : "applied in the join") << endl;
+      if(lateLeft || lateRight)
+        cout << "Late materialization of the " << (lateLeft ? (lateRight ? "left and right inputs" : "left input") : "right input") << endl;
+      if(keepAtts != NULL)
+        cout << "Keeps " << numKeepAtts << " of the " << numAttsIn << " attributes of its inputs" << endl;
+      PrintEstimates();
       cout << "***************************" << endl;
     };
 
     void Run(){
       // cout << "join started" << endl; // debug
-      J.Use_n_Pages (buffsz);
+      J.Use_n_Pages (memPages);
+      J.UseSchemas (left->schema(), right->schema()); // lay the output out by rschema
       J.Run(*(left->outpipe),*(right->outpipe),*outpipe,cnf_pred,literal); // Join takes its input from its left and
                                                                            // right children's outpipes
     };
@@ -664,6 +1232,14 @@ class JoinNode : virtual public GenericQTreeNode {
       J.WaitUntilDone ();
     }
 
+    RelationalOp* Operation(){ return &J; }
+
+    string Name(){ return "JOIN"; }
+
+    bool PushBloomFilter(BloomFilter* bf, vector<string> &attNames){
+      return left->PushBloomFilter(bf,attNames) || right->PushBloomFilter(bf,attNames);
+    }
+
 };
 
 #endif
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * File: tpchgen.cc
+ * Writes the eight TPC-H relations of the catalog at any scale factor, in place
+ * of dbgen. Built by "make tpchgen.out".
+ *
+ * The data only depends on the scale and the seed (see TPCHGen.h). In text mode
+ * it writes <dir><relation>.tbl files that DBFile::Load and setupDemo read; in
+ * heap mode it writes <dir><relation>.bin heap files directly.
+ * Usage: tpchgen.out <scale> <dir> [seed] [text|heap]
+ ******************************************************************************/
+#include "TPCHGen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+int pipesz = 100; // same defaults as a3utils.h
+int buffsz = 100;
+
+int main (int argc, char *argv[]) {
+  if (argc < 3 || (argc > 4 && strcmp (argv[4], "text") && strcmp (argv[4], "heap"))) {
+    cerr << "Usage: " << argv[0] << " <scale> <dir> [seed] [text|heap]" << endl;
+    exit(1);
+  }
+  double scale = atof (argv[1]);
+  char *dir = argv[2];
+  unsigned long long seed = (argc > 3) ? strtoull (argv[3], NULL, 10) : 1;
+  bool text = (argc <= 4 || !strcmp (argv[4], "text"));
+  if (scale <= 0) {
+    cerr << "ERROR: The scale factor must be positive. EXIT !!!" << endl;
+    exit(1);
+  }
+
+  const char *rels[] = {"region", "nation", "part", "supplier", "partsupp", "customer", "orders", "lineitem"};
+  TPCHGen gen (scale, seed);
+  char path[1024];
+  for (int i = 0; i < sizeof (rels) / sizeof (rels[0]); i++) {
+    sprintf (path, "%s%s.%s", dir, rels[i], text ? "tbl" : "bin");
+    long rows = text ? gen.WriteText (rels[i], path) : gen.WriteHeap (rels[i], path);
+    cout << path << ": " << rows << " records" << endl;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+ * EOF
+ ******************************************************************************/